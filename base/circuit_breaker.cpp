@@ -0,0 +1,94 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "circuit_breaker.h"
+
+#include <algorithm>
+#include <glog/logging.h>
+
+#include "base/metrics.h"
+
+namespace wastlernet {
+    namespace {
+        const char* StateName(CircuitBreaker::State state) {
+            switch (state) {
+                case CircuitBreaker::State::kClosed: return "closed";
+                case CircuitBreaker::State::kOpen: return "open";
+                case CircuitBreaker::State::kHalfOpen: return "half-open";
+            }
+            return "unknown";
+        }
+    }
+
+    CircuitBreaker::CircuitBreaker(std::string connection, Options options)
+        : connection_(std::move(connection)), options_(options), backoff_(options.initial_backoff) {
+        metrics::WastlernetMetrics::GetInstance().SetCircuitBreakerState(connection_, static_cast<int>(state_));
+    }
+
+    bool CircuitBreaker::Allow(Clock::time_point now) {
+        absl::MutexLock lock(&mutex_);
+        switch (state_) {
+            case State::kClosed:
+                return true;
+            case State::kOpen:
+                if (now < open_until_) {
+                    return false;
+                }
+                // Let a single probe through.
+                Transition(State::kHalfOpen);
+                return true;
+            case State::kHalfOpen:
+                // A probe is already in flight.
+                return false;
+        }
+        return false;
+    }
+
+    void CircuitBreaker::RecordSuccess() {
+        absl::MutexLock lock(&mutex_);
+        failures_ = 0;
+        backoff_ = options_.initial_backoff;
+        if (state_ != State::kClosed) {
+            Transition(State::kClosed);
+        }
+    }
+
+    void CircuitBreaker::RecordFailure(Clock::time_point now) {
+        absl::MutexLock lock(&mutex_);
+        failures_++;
+        if (state_ == State::kHalfOpen || (state_ == State::kClosed && failures_ >= options_.failure_threshold)) {
+            open_until_ = now + backoff_;
+            Transition(State::kOpen);
+            LOG(WARNING) << "[" << connection_ << "] circuit opened after " << failures_
+                         << " consecutive failures; next probe in "
+                         << std::chrono::duration_cast<std::chrono::seconds>(backoff_).count() << "s";
+            backoff_ = std::min(backoff_ * 2, options_.max_backoff);
+        }
+    }
+
+    void CircuitBreaker::Release(Clock::time_point now) {
+        absl::MutexLock lock(&mutex_);
+        if (state_ == State::kHalfOpen) {
+            open_until_ = now;
+            Transition(State::kOpen);
+        }
+    }
+
+    CircuitBreaker::State CircuitBreaker::state() {
+        absl::MutexLock lock(&mutex_);
+        return state_;
+    }
+
+    CircuitBreaker::Clock::duration CircuitBreaker::backoff() {
+        absl::MutexLock lock(&mutex_);
+        return backoff_;
+    }
+
+    void CircuitBreaker::Transition(State state) {
+        if (state != state_) {
+            LOG(INFO) << "[" << connection_ << "] circuit " << StateName(state_) << " -> " << StateName(state);
+        }
+        state_ = state;
+        metrics::WastlernetMetrics::GetInstance().SetCircuitBreakerState(connection_, static_cast<int>(state_));
+    }
+}
@@ -0,0 +1,89 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Circuit breaker for device connections.
+//
+// A wastlernet::CircuitBreaker tracks consecutive failures of a connection and stops
+// callers from hitting a device that is known to be down:
+//
+// - closed:    requests pass; after `failure_threshold` consecutive failures the breaker opens.
+// - open:      requests fail fast without touching the network until the probe backoff elapses.
+// - half-open: exactly one probe request is let through. Success closes the breaker again;
+//              failure re-opens it and doubles the probe backoff (up to `max_backoff`).
+//
+// The current state of every breaker is exported as the Prometheus gauge
+// wastlernet_circuit_breaker_state{connection="..."} (0 = closed, 1 = open, 2 = half-open).
+//
+// Thread-safety
+// All public methods are internally synchronized.
+//
+#pragma once
+#include <chrono>
+#include <string>
+#include <absl/synchronization/mutex.h>
+
+#ifndef WASTLERNET_CIRCUIT_BREAKER_H
+#define WASTLERNET_CIRCUIT_BREAKER_H
+namespace wastlernet {
+    class CircuitBreaker {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        enum class State { kClosed = 0, kOpen = 1, kHalfOpen = 2 };
+
+        struct Options {
+            /** Consecutive failures after which the breaker opens. */
+            int failure_threshold = 3;
+            /** Time the breaker stays open before the first probe. */
+            Clock::duration initial_backoff = std::chrono::seconds(5);
+            /** Upper bound for the exponentially growing probe backoff. */
+            Clock::duration max_backoff = std::chrono::minutes(10);
+        };
+
+        /**
+         * @param connection Label identifying the guarded connection in metrics and logs.
+         * @param options    Thresholds and backoff settings.
+         */
+        explicit CircuitBreaker(std::string connection, Options options);
+
+        explicit CircuitBreaker(std::string connection) : CircuitBreaker(std::move(connection), Options()) { }
+
+        /**
+         * Check whether a request may be attempted now. Every call returning true must be followed
+         * by exactly one call to RecordSuccess(), RecordFailure() or Release().
+         */
+        bool Allow(Clock::time_point now = Clock::now());
+
+        /** Record a successful request; closes the breaker. */
+        void RecordSuccess();
+
+        /** Record a failed request; may open the breaker. */
+        void RecordFailure(Clock::time_point now = Clock::now());
+
+        /**
+         * Record a request whose outcome says nothing about the device, e.g. because the caller's
+         * deadline expired first. Leaves the failure count unchanged; a half-open probe is handed
+         * back so that the next request may probe again.
+         */
+        void Release(Clock::time_point now = Clock::now());
+
+        State state();
+
+        /** Backoff applied the next time the breaker opens. */
+        Clock::duration backoff();
+
+    private:
+        absl::Mutex mutex_;
+
+        std::string connection_;
+        Options options_;
+
+        State state_ ABSL_GUARDED_BY(mutex_) = State::kClosed;
+        int failures_ ABSL_GUARDED_BY(mutex_) = 0;
+        Clock::duration backoff_ ABSL_GUARDED_BY(mutex_);
+        Clock::time_point open_until_ ABSL_GUARDED_BY(mutex_);
+
+        void Transition(State state) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+    };
+}
+#endif //WASTLERNET_CIRCUIT_BREAKER_H
@@ -0,0 +1,112 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include <gtest/gtest.h>
+
+#include "circuit_breaker.h"
+
+using wastlernet::CircuitBreaker;
+using namespace std::chrono_literals;
+
+namespace {
+    CircuitBreaker::Options TestOptions() {
+        CircuitBreaker::Options options;
+        options.failure_threshold = 3;
+        options.initial_backoff = 10s;
+        options.max_backoff = 30s;
+        return options;
+    }
+}
+
+// Failures below the threshold keep the breaker closed; a success resets the count.
+TEST(CircuitBreakerTest, StaysClosedBelowThreshold) {
+    CircuitBreaker breaker("test", TestOptions());
+    auto now = CircuitBreaker::Clock::now();
+
+    breaker.RecordFailure(now);
+    breaker.RecordFailure(now);
+    breaker.RecordSuccess();
+    breaker.RecordFailure(now);
+    breaker.RecordFailure(now);
+
+    EXPECT_EQ(CircuitBreaker::State::kClosed, breaker.state());
+    EXPECT_TRUE(breaker.Allow(now));
+}
+
+// Consecutive failures open the breaker; requests fail fast until the backoff has elapsed.
+TEST(CircuitBreakerTest, OpensAfterThreshold) {
+    CircuitBreaker breaker("test", TestOptions());
+    auto now = CircuitBreaker::Clock::now();
+
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(breaker.Allow(now));
+        breaker.RecordFailure(now);
+    }
+
+    EXPECT_EQ(CircuitBreaker::State::kOpen, breaker.state());
+    EXPECT_FALSE(breaker.Allow(now));
+    EXPECT_FALSE(breaker.Allow(now + 9s));
+}
+
+// After the backoff exactly one probe is admitted; success closes the breaker.
+TEST(CircuitBreakerTest, HalfOpenProbeSuccessCloses) {
+    CircuitBreaker breaker("test", TestOptions());
+    auto now = CircuitBreaker::Clock::now();
+    for (int i = 0; i < 3; i++) {
+        breaker.RecordFailure(now);
+    }
+
+    EXPECT_TRUE(breaker.Allow(now + 10s));
+    EXPECT_EQ(CircuitBreaker::State::kHalfOpen, breaker.state());
+    EXPECT_FALSE(breaker.Allow(now + 10s));
+
+    breaker.RecordSuccess();
+    EXPECT_EQ(CircuitBreaker::State::kClosed, breaker.state());
+    EXPECT_TRUE(breaker.Allow(now + 10s));
+    EXPECT_EQ(10s, breaker.backoff());
+}
+
+// A failed probe re-opens the breaker with exponentially growing, capped backoff.
+TEST(CircuitBreakerTest, HalfOpenProbeFailureBacksOff) {
+    CircuitBreaker breaker("test", TestOptions());
+    auto now = CircuitBreaker::Clock::now();
+    for (int i = 0; i < 3; i++) {
+        breaker.RecordFailure(now);
+    }
+
+    // first probe after 10s fails -> next probe after 20s
+    now += 10s;
+    ASSERT_TRUE(breaker.Allow(now));
+    breaker.RecordFailure(now);
+    EXPECT_EQ(CircuitBreaker::State::kOpen, breaker.state());
+    EXPECT_FALSE(breaker.Allow(now + 19s));
+
+    // second probe after 20s fails -> next probe after 30s (capped)
+    now += 20s;
+    ASSERT_TRUE(breaker.Allow(now));
+    breaker.RecordFailure(now);
+    EXPECT_FALSE(breaker.Allow(now + 29s));
+
+    // third probe after 30s fails -> still 30s
+    now += 30s;
+    ASSERT_TRUE(breaker.Allow(now));
+    breaker.RecordFailure(now);
+    EXPECT_FALSE(breaker.Allow(now + 29s));
+    EXPECT_TRUE(breaker.Allow(now + 30s));
+}
+
+// A released probe neither closes nor backs off the breaker; the next request may probe again.
+TEST(CircuitBreakerTest, ReleasedProbeKeepsBackoff) {
+    CircuitBreaker breaker("test", TestOptions());
+    auto now = CircuitBreaker::Clock::now();
+    for (int i = 0; i < 3; i++) {
+        breaker.RecordFailure(now);
+    }
+
+    now += 10s;
+    ASSERT_TRUE(breaker.Allow(now));
+    breaker.Release(now);
+    EXPECT_EQ(CircuitBreaker::State::kOpen, breaker.state());
+    EXPECT_EQ(20s, breaker.backoff());
+    EXPECT_TRUE(breaker.Allow(now));
+}
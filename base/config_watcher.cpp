@@ -0,0 +1,187 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "config_watcher.h"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <memory>
+#include <absl/strings/str_cat.h>
+#include <glog/logging.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/text_format.h>
+
+namespace wastlernet {
+    namespace {
+        // Quiet period after a file event before the reload is triggered.
+        constexpr int kSettleMillis = 250;
+
+        constexpr char kReload = 'r';
+        constexpr char kStop = 's';
+
+        // Write end of the self-pipe of the active watcher, used by the signal handler.
+        std::atomic<int> sighup_fd{-1};
+
+        void HandleSighup(int) {
+            int fd = sighup_fd.load();
+            if (fd >= 0) {
+                int saved_errno = errno;
+                (void)!write(fd, &kReload, 1);
+                errno = saved_errno;
+            }
+        }
+
+        // Returns true if the inotify buffer contains an event for `file`.
+        bool DrainInotify(int fd, const std::string& file) {
+            alignas(struct inotify_event) char buf[4096];
+            bool matched = false;
+            ssize_t len;
+            while ((len = read(fd, buf, sizeof(buf))) > 0) {
+                for (char* p = buf; p < buf + len;) {
+                    auto* event = reinterpret_cast<struct inotify_event*>(p);
+                    if (event->len > 0 && file == event->name) {
+                        matched = true;
+                    }
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            return matched;
+        }
+    }
+
+    ConfigWatcher::ConfigWatcher(std::string path) : path_(std::move(path)) {
+        auto slash = path_.rfind('/');
+        if (slash == std::string::npos) {
+            dir_ = ".";
+            file_ = path_;
+        } else {
+            dir_ = slash == 0 ? "/" : path_.substr(0, slash);
+            file_ = path_.substr(slash + 1);
+        }
+    }
+
+    ConfigWatcher::~ConfigWatcher() {
+        if (sighup_fd.load() == wake_fds_[1]) {
+            std::signal(SIGHUP, SIG_DFL);
+            sighup_fd = -1;
+        }
+        for (int fd : {inotify_fd_, wake_fds_[0], wake_fds_[1]}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    absl::Status ConfigWatcher::Init() {
+        if (pipe2(wake_fds_, O_NONBLOCK | O_CLOEXEC) != 0) {
+            return absl::InternalError(absl::StrCat("Could not create pipe: ", strerror(errno)));
+        }
+
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd_ < 0) {
+            return absl::InternalError(absl::StrCat("Could not initialize inotify: ", strerror(errno)));
+        }
+        if (inotify_add_watch(inotify_fd_, dir_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+            return absl::InternalError(absl::StrCat("Could not watch ", dir_, ": ", strerror(errno)));
+        }
+
+        sighup_fd = wake_fds_[1];
+        struct sigaction action {};
+        action.sa_handler = HandleSighup;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        if (sigaction(SIGHUP, &action, nullptr) != 0) {
+            return absl::InternalError(absl::StrCat("Could not install SIGHUP handler: ", strerror(errno)));
+        }
+
+        initialized_ = true;
+        LOG(INFO) << "Watching " << path_ << " for changes (reload also on SIGHUP)";
+        return absl::OkStatus();
+    }
+
+    void ConfigWatcher::Run(const std::function<void()>& on_reload) {
+        if (!initialized_) {
+            // Polling descriptors that were never opened would block forever.
+            LOG(ERROR) << "Configuration watcher not initialized; not watching " << path_;
+            return;
+        }
+
+        struct pollfd fds[2] = {
+                {wake_fds_[0], POLLIN, 0},
+                {inotify_fd_, POLLIN, 0},
+        };
+
+        bool file_changed = false;
+        while (true) {
+            // While a file change is pending, wait for the burst of events to settle.
+            int rc = poll(fds, 2, file_changed ? kSettleMillis : -1);
+            if (rc < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                LOG(ERROR) << "Error waiting for configuration changes: " << strerror(errno);
+                return;
+            }
+
+            if (rc == 0) {
+                file_changed = false;
+                LOG(INFO) << "Configuration file " << path_ << " changed";
+                on_reload();
+                continue;
+            }
+
+            if (fds[1].revents & POLLIN) {
+                file_changed |= DrainInotify(inotify_fd_, file_);
+            }
+
+            if (fds[0].revents & POLLIN) {
+                char c;
+                bool reload = false;
+                while (read(wake_fds_[0], &c, 1) == 1) {
+                    if (c == kStop) {
+                        return;
+                    }
+                    reload = true;
+                }
+                if (reload) {
+                    LOG(INFO) << "Received SIGHUP";
+                    file_changed = false;
+                    on_reload();
+                }
+            }
+        }
+    }
+
+    void ConfigWatcher::Stop() {
+        if (wake_fds_[1] >= 0) {
+            (void)!write(wake_fds_[1], &kStop, 1);
+        }
+    }
+
+    absl::StatusOr<Config> LoadConfig(const std::string& path) {
+        Config config;
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            return absl::NotFoundError(absl::StrCat("Could not open configuration file ", path));
+        }
+
+        bool parsed;
+        {
+            auto cfg_file = std::make_unique<google::protobuf::io::FileInputStream>(fd);
+            parsed = google::protobuf::TextFormat::Parse(cfg_file.get(), &config);
+        }
+        close(fd);
+
+        if (!parsed) {
+            return absl::InvalidArgumentError(absl::StrCat("Unable to parse configuration file ", path));
+        }
+        return config;
+    }
+}
@@ -0,0 +1,71 @@
+/// \file config_watcher.h
+/// \brief Detects requests to reload the configuration file.
+///
+/// `ConfigWatcher` triggers a reload callback when
+/// - the process receives `SIGHUP`, or
+/// - the configuration file is written or replaced (via inotify on its
+///   directory, so that editors saving through rename are picked up as well).
+///
+/// Bursts of file events (an editor usually produces several) are collapsed
+/// into a single callback. The callback runs on the thread calling `Run()`.
+///
+/// Only one `ConfigWatcher` may exist per process, since it owns the `SIGHUP`
+/// handler.
+///
+/// `LoadConfig()` and `SectionChanged()` are used by the reload callback to
+/// parse the new file and find the sections that differ from the running
+/// configuration.
+#pragma once
+#include <functional>
+#include <string>
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <google/protobuf/util/message_differencer.h>
+
+#include "config/config.pb.h"
+
+#ifndef WASTLERNET_CONFIG_WATCHER_H
+#define WASTLERNET_CONFIG_WATCHER_H
+namespace wastlernet {
+    class ConfigWatcher {
+    public:
+        explicit ConfigWatcher(std::string path);
+
+        /// Restores the default `SIGHUP` disposition and closes all descriptors.
+        ~ConfigWatcher();
+
+        ConfigWatcher(const ConfigWatcher&) = delete;
+        ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+        /// Set up the inotify watch and install the `SIGHUP` handler.
+        absl::Status Init();
+
+        /// Block and invoke `on_reload` for every reload request until `Stop()`
+        /// is called. Returns immediately if `Init()` did not succeed.
+        void Run(const std::function<void()>& on_reload);
+
+        /// Make `Run()` return. Safe to call from any thread.
+        void Stop();
+
+    private:
+        std::string path_;
+        std::string dir_;
+        std::string file_;
+
+        int inotify_fd_ = -1;
+        // Self-pipe woken by SIGHUP and Stop().
+        int wake_fds_[2] = {-1, -1};
+        // Set once `Init()` succeeded.
+        bool initialized_ = false;
+    };
+
+    /// Parse the text-format configuration file at `path`.
+    absl::StatusOr<Config> LoadConfig(const std::string& path);
+
+    /// Returns true if a config section was added, removed or modified.
+    template <class T>
+    bool SectionChanged(bool had_old, const T& old_section, bool has_new, const T& new_section) {
+        return had_old != has_new || !google::protobuf::util::MessageDifferencer::Equals(old_section, new_section);
+    }
+}
+#endif //WASTLERNET_CONFIG_WATCHER_H
@@ -0,0 +1,146 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <gtest/gtest.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
+
+#include "config_watcher.h"
+
+using wastlernet::Config;
+using wastlernet::ConfigWatcher;
+
+namespace {
+    constexpr char kConfig[] = R"(
+timescaledb { host: "db" port: 5432 }
+solvis { host: "solvis" port: 502 }
+weather { listen: "http://0.0.0.0:8080" }
+)";
+
+    constexpr char kChangedWeather[] = R"(
+timescaledb { host: "db" port: 5432 }
+solvis { host: "solvis" port: 502 }
+weather { listen: "http://0.0.0.0:8081" }
+)";
+
+    class ConfigWatcherTest : public testing::Test {
+    protected:
+        void SetUp() override {
+            char dir[] = "/tmp/config_watcher_testXXXXXX";
+            ASSERT_NE(mkdtemp(dir), nullptr);
+            dir_ = dir;
+            path_ = dir_ + "/wastlernet.cfg";
+            Write(path_, kConfig);
+        }
+
+        void TearDown() override {
+            std::remove(path_.c_str());
+            std::remove((path_ + ".tmp").c_str());
+            std::remove(dir_.c_str());
+        }
+
+        static void Write(const std::string& path, const std::string& content) {
+            std::ofstream out(path, std::ios::trunc);
+            out << content;
+        }
+
+        // Save the way most editors do: write a temporary file and rename it over the original.
+        void Save(const std::string& content) {
+            Write(path_ + ".tmp", content);
+            ASSERT_EQ(std::rename((path_ + ".tmp").c_str(), path_.c_str()), 0);
+        }
+
+        std::string dir_;
+        std::string path_;
+    };
+}
+
+// The reload callback sees the new file; only the modified section differs from the running one.
+TEST_F(ConfigWatcherTest, ReloadsChangedFile) {
+    auto running = wastlernet::LoadConfig(path_);
+    ASSERT_TRUE(running.ok()) << running.status();
+
+    ConfigWatcher watcher(path_);
+    ASSERT_TRUE(watcher.Init().ok());
+
+    absl::Mutex mutex;
+    int reloads = 0;
+    std::optional<Config> reloaded;
+    std::thread thread([&]() {
+        watcher.Run([&]() {
+            auto config = wastlernet::LoadConfig(path_);
+            absl::MutexLock lock(&mutex);
+            reloads++;
+            if (config.ok()) {
+                reloaded = *config;
+            }
+        });
+    });
+
+    Save(kChangedWeather);
+    {
+        absl::MutexLock lock(&mutex);
+        EXPECT_TRUE(mutex.AwaitWithTimeout(absl::Condition(
+                +[](int* n) { return *n > 0; }, &reloads), absl::Seconds(5)));
+    }
+    // Let a possible second callback for the same burst of events arrive.
+    absl::SleepFor(absl::Milliseconds(500));
+    watcher.Stop();
+    thread.join();
+
+    absl::MutexLock lock(&mutex);
+    EXPECT_EQ(reloads, 1);
+    ASSERT_TRUE(reloaded.has_value());
+    EXPECT_TRUE(wastlernet::SectionChanged(running->has_weather(), running->weather(),
+                                           reloaded->has_weather(), reloaded->weather()));
+    EXPECT_FALSE(wastlernet::SectionChanged(running->has_solvis(), running->solvis(),
+                                            reloaded->has_solvis(), reloaded->solvis()));
+    EXPECT_FALSE(wastlernet::SectionChanged(running->has_timescaledb(), running->timescaledb(),
+                                            reloaded->has_timescaledb(), reloaded->timescaledb()));
+}
+
+TEST_F(ConfigWatcherTest, ReloadsOnSighup) {
+    ConfigWatcher watcher(path_);
+    ASSERT_TRUE(watcher.Init().ok());
+
+    absl::Mutex mutex;
+    int reloads = 0;
+    std::thread thread([&]() {
+        watcher.Run([&]() {
+            absl::MutexLock lock(&mutex);
+            reloads++;
+        });
+    });
+
+    std::raise(SIGHUP);
+    {
+        absl::MutexLock lock(&mutex);
+        EXPECT_TRUE(mutex.AwaitWithTimeout(absl::Condition(
+                +[](int* n) { return *n > 0; }, &reloads), absl::Seconds(5)));
+    }
+    watcher.Stop();
+    thread.join();
+}
+
+// Run() must not block on descriptors that were never opened.
+TEST_F(ConfigWatcherTest, RunReturnsWhenInitFailed) {
+    ConfigWatcher watcher(dir_ + "/missing/wastlernet.cfg");
+    EXPECT_FALSE(watcher.Init().ok());
+
+    bool reloaded = false;
+    watcher.Run([&reloaded]() { reloaded = true; });
+    EXPECT_FALSE(reloaded);
+}
+
+TEST_F(ConfigWatcherTest, LoadConfigRejectsInvalidFile) {
+    Write(path_, "weather { listen: ");
+    EXPECT_TRUE(absl::IsInvalidArgument(wastlernet::LoadConfig(path_).status()));
+    EXPECT_TRUE(absl::IsNotFound(wastlernet::LoadConfig(dir_ + "/missing.cfg").status()));
+}
@@ -0,0 +1,68 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Deadline helper.
+//
+// A wastlernet::Deadline is the point in time by which an operation (e.g. one poll of a
+// device) must have completed. The polling scheduler creates one deadline per poll and
+// passes it down into Query(), ModbusConnection::Execute() and HttpConnection::Execute(),
+// which shrink their socket timeouts to the remaining budget. This keeps polls on cadence
+// even when a device hangs.
+//
+// Deadlines are based on std::chrono::steady_clock and are cheap to copy.
+//
+#pragma once
+#include <algorithm>
+#include <chrono>
+
+#ifndef WASTLERNET_DEADLINE_H
+#define WASTLERNET_DEADLINE_H
+namespace wastlernet {
+    class Deadline {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /** A deadline that never expires. */
+        static Deadline Infinite() {
+            return Deadline(Clock::time_point::max());
+        }
+
+        /** A deadline expiring `timeout` from now. */
+        static Deadline After(Clock::duration timeout) {
+            return Deadline(Clock::now() + timeout);
+        }
+
+        /** A deadline expiring at the given point in time. */
+        static Deadline At(Clock::time_point when) {
+            return Deadline(when);
+        }
+
+        bool IsInfinite() const { return when_ == Clock::time_point::max(); }
+
+        bool Expired() const { return !IsInfinite() && Clock::now() >= when_; }
+
+        /** Time left until the deadline; zero if expired, Clock::duration::max() if infinite. */
+        Clock::duration Remaining() const {
+            if (IsInfinite()) {
+                return Clock::duration::max();
+            }
+            return std::max(when_ - Clock::now(), Clock::duration::zero());
+        }
+
+        /** Time left until the deadline in milliseconds, capped at `cap` (e.g. a configured socket timeout). */
+        std::chrono::milliseconds RemainingMillis(std::chrono::milliseconds cap) const {
+            if (IsInfinite()) {
+                return cap;
+            }
+            return std::min(std::chrono::duration_cast<std::chrono::milliseconds>(Remaining()), cap);
+        }
+
+        Clock::time_point When() const { return when_; }
+
+    private:
+        explicit Deadline(Clock::time_point when) : when_(when) { }
+
+        Clock::time_point when_;
+    };
+}
+#endif //WASTLERNET_DEADLINE_H
@@ -0,0 +1,49 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "host_reachability.h"
+
+#include <cctype>
+#include <absl/strings/str_cat.h>
+
+namespace wastlernet {
+    std::string HostReachability::Host(std::string_view base_url) {
+        size_t start = base_url.find("://");
+        start = start == std::string_view::npos ? 0 : start + 3;
+        size_t end = base_url.find_first_of("/?#", start);
+        std::string_view authority = base_url.substr(start, end == std::string_view::npos ? end : end - start);
+        // Credentials do not identify the host.
+        if (size_t at = authority.rfind('@'); at != std::string_view::npos) {
+            authority.remove_prefix(at + 1);
+        }
+
+        std::string host(base_url.substr(0, start));
+        host.append(authority.data(), authority.size());
+        for (char& c : host) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return host;
+    }
+
+    absl::Status HostReachability::Check(const std::string& base_url, Clock::time_point now) {
+        std::string host = Host(base_url);
+        absl::MutexLock lock(&mutex_);
+        auto it = failures_.find(host);
+        if (it == failures_.end() || now - it->second.when >= retry_after_) {
+            return absl::OkStatus();
+        }
+        return absl::UnavailableError(absl::StrCat("HTTP host ", host, " unreachable: ", it->second.error));
+    }
+
+    void HostReachability::RecordSuccess(const std::string& base_url) {
+        std::string host = Host(base_url);
+        absl::MutexLock lock(&mutex_);
+        failures_.erase(host);
+    }
+
+    void HostReachability::RecordFailure(const std::string& base_url, std::string_view error, Clock::time_point now) {
+        std::string host = Host(base_url);
+        absl::MutexLock lock(&mutex_);
+        failures_[host] = Failure{now, std::string(error)};
+    }
+}
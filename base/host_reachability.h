@@ -0,0 +1,72 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Shared per-host reachability of HTTP devices.
+//
+// HttpConnection initializes lazily: Init() does not probe the device, and the first real request
+// establishes the connection. The outcome of every request is recorded here per host (scheme, host
+// and port of the base URL), so that all connections to the same device share it: once a request
+// to a host failed at the transport level (connection refused or reset, name not resolved), Init()
+// and every request of any connection to that host fail fast with the recorded error for
+// `retry_after`, instead of each connection probing the device on its own. Requests cancelled at
+// their deadline do not mark a host unreachable.
+// A successful request to the host clears the failure.
+//
+// Thread-safety
+// All public methods are internally synchronized.
+//
+#pragma once
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <absl/container/flat_hash_map.h>
+#include <absl/status/status.h>
+#include <absl/synchronization/mutex.h>
+
+#ifndef WASTLERNET_HOST_REACHABILITY_H
+#define WASTLERNET_HOST_REACHABILITY_H
+namespace wastlernet {
+    class HostReachability {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /** The process-wide cache used by HttpConnection. */
+        static HostReachability& GetInstance() {
+            static HostReachability instance;
+            return instance;
+        }
+
+        /** @param retry_after Time for which a failed request marks its host as unreachable. */
+        explicit HostReachability(Clock::duration retry_after = std::chrono::seconds(10))
+            : retry_after_(retry_after) { }
+
+        HostReachability(const HostReachability&) = delete;
+        HostReachability& operator=(const HostReachability&) = delete;
+
+        /**
+         * OK unless a request to the host of `base_url` failed within `retry_after` (and none has
+         * succeeded since); Unavailable with the recorded error otherwise. Unknown hosts are OK.
+         */
+        absl::Status Check(const std::string& base_url, Clock::time_point now = Clock::now());
+
+        /** Record a response from the host of `base_url`. */
+        void RecordSuccess(const std::string& base_url);
+
+        /** Record a transport-level failure of a request to the host of `base_url`. */
+        void RecordFailure(const std::string& base_url, std::string_view error, Clock::time_point now = Clock::now());
+
+        /** Cache key of `base_url`: its scheme, host and port, without path and user info. */
+        static std::string Host(std::string_view base_url);
+
+    private:
+        struct Failure {
+            Clock::time_point when;
+            std::string error;
+        };
+
+        absl::Mutex mutex_;
+        Clock::duration retry_after_;
+        absl::flat_hash_map<std::string, Failure> failures_ ABSL_GUARDED_BY(mutex_);
+    };
+}
+#endif //WASTLERNET_HOST_REACHABILITY_H
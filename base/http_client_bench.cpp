@@ -0,0 +1,176 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Throughput benchmark for the HTTP device clients against recorded responses.
+//
+// Serves the responses stored in the testdata/ directories of the modules from a local
+// HttpReplayServer and runs a fixed number of Query() calls through each client, reporting queries
+// per second, the p50/p99 latency and the CPU time per query. Without injected latency the run is
+// CPU bound, so the CPU time tracks the client-side cost of a poll (request, parse, dispatch) and
+// can be compared before and after a change. The clients skip responses equal to the last one
+// they handled (HttpConnection::ExecuteIfChanged()); as the replayed bodies never change, the
+// benchmark forgets the last response before every query, so that each one is parsed and
+// dispatched like a changed response from the device:
+//
+//   http_client_bench --iterations=5000 --benchmark=fronius,senec,hafnertec
+//
+// The CPU time includes the in-process listener; compare runs of the same build options only.
+//
+// With --record_url, the selected clients query the device at that URL once instead and store
+// its responses in testdata/ (e.g. --benchmark=senec --record_url=https://senec.local).
+//
+// Benchmarks:
+// - fronius:   power flow, battery and meter clients, one query each per iteration. The Fronius
+//              responses are synthetic until recorded from a device (see fronius/testdata/README.md).
+// - senec:     SenecClient (POST lala.cgi).
+// - hafnertec: HafnertecClient (schematic page).
+//
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <absl/strings/str_cat.h>
+
+#include "base/http_replay.h"
+#include "fronius/fronius_client.h"
+#include "hafnertec/hafnertec_client.h"
+#include "senec/senec_client.h"
+
+DEFINE_int32(port, 15040, "TCP port of the replay server");
+DEFINE_int32(iterations, 1000, "Number of queries per benchmark");
+DEFINE_int32(latency_us, 0, "Injected response latency in microseconds");
+DEFINE_int32(jitter_us, 0, "Injected additional random latency in microseconds");
+DEFINE_double(error_rate, 0, "Fraction of requests answered with 500");
+DEFINE_string(benchmark, "fronius,senec,hafnertec", "Comma-separated list of benchmarks to run");
+DEFINE_string(testdata, WASTLERNET_SOURCE_DIR, "Source directory containing <module>/testdata");
+DEFINE_string(record_url, "", "Record the responses of this device into testdata instead of benchmarking");
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Result {
+        std::vector<double> latencies;
+        int errors = 0;
+        double seconds = 0;
+        double cpu_seconds = 0;
+    };
+
+    struct Endpoint {
+        std::string path;
+        std::string file;  // relative to --testdata
+        std::string content_type;
+    };
+
+    void CheckOk(const absl::Status& st) {
+        CHECK(st.ok()) << st;
+    }
+
+    double Percentile(std::vector<double>& sorted, double q) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(q * sorted.size()))];
+    }
+
+    void Report(const char* name, Result result) {
+        std::sort(result.latencies.begin(), result.latencies.end());
+        double queries = result.latencies.size();
+        printf("%-10s %8.0f queries %10.1f queries/s   p50 %8.3f ms   p99 %8.3f ms   cpu %8.1f us/query   %d errors\n",
+               name, queries, queries / result.seconds, Percentile(result.latencies, 0.5) * 1e3,
+               Percentile(result.latencies, 0.99) * 1e3, result.cpu_seconds * 1e6 / queries, result.errors);
+    }
+
+    // Records the responses of `clients`, which query `endpoints` in this order, or serves the
+    // recorded ones and runs `query` FLAGS_iterations times against them.
+    void Bench(const char* name, const std::vector<Endpoint>& endpoints,
+               const std::vector<wastlernet::HttpConnection*>& clients, const std::function<absl::Status()>& query) {
+        if (!FLAGS_record_url.empty()) {
+            for (size_t i = 0; i < clients.size(); i++) {
+                CheckOk(wastlernet::RecordResponse(*clients[i], absl::StrCat(FLAGS_testdata, "/", endpoints[i].file)));
+            }
+            return;
+        }
+
+        wastlernet::HttpReplayOptions options;
+        options.latency = std::chrono::microseconds(FLAGS_latency_us);
+        options.jitter = std::chrono::microseconds(FLAGS_jitter_us);
+        options.error_rate = FLAGS_error_rate;
+
+        wastlernet::HttpReplayServer server(absl::StrCat("http://127.0.0.1:", FLAGS_port), options);
+        for (const auto& endpoint : endpoints) {
+            CheckOk(server.AddFile(endpoint.path, absl::StrCat(FLAGS_testdata, "/", endpoint.file),
+                                   endpoint.content_type));
+        }
+        CheckOk(server.Start());
+        for (auto* client : clients) {
+            CheckOk(client->Init());
+        }
+
+        Result result;
+        result.latencies.reserve(FLAGS_iterations);
+        auto start = Clock::now();
+        std::clock_t cpu_start = std::clock();
+        for (int i = 0; i < FLAGS_iterations; i++) {
+            for (auto* client : clients) {
+                client->ForgetLastResponse();
+            }
+            auto t0 = Clock::now();
+            if (!query().ok()) {
+                result.errors++;
+            }
+            result.latencies.push_back(std::chrono::duration<double>(Clock::now() - t0).count());
+        }
+        result.cpu_seconds = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        Report(name, result);
+    }
+}
+
+int main(int argc, char** argv) {
+    gflags::SetUsageMessage("Usage: http_client_bench [--iterations=N] [--latency_us=N] [--benchmark=fronius,senec,hafnertec]");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+
+    // The replay server, or the device to record.
+    std::string url = FLAGS_record_url.empty() ? absl::StrCat("http://127.0.0.1:", FLAGS_port) : FLAGS_record_url;
+
+    printf("latency %d us, jitter %d us, error rate %.3f, %d iterations\n", FLAGS_latency_us, FLAGS_jitter_us,
+           FLAGS_error_rate, FLAGS_iterations);
+    auto enabled = [](const char* name) {
+        return ("," + FLAGS_benchmark + ",").find(std::string(",") + name + ",") != std::string::npos;
+    };
+    if (enabled("fronius")) {
+        fronius::FroniusPowerFlowClient power_flow(url);
+        fronius::FroniusBatteryClient battery(url);
+        fronius::FroniusEnergyMeterClient meter(url);
+        Bench("fronius", {
+                      {"/solar_api/v1/GetPowerFlowRealtimeData.fcgi", "fronius/testdata/GetPowerFlowRealtimeData.json", "application/json"},
+                      {"/solar_api/v1/GetStorageRealtimeData.cgi", "fronius/testdata/GetStorageRealtimeData.json", "application/json"},
+                      {"/solar_api/v1/GetMeterRealtimeData.cgi", "fronius/testdata/GetMeterRealtimeData.json", "application/json"},
+              }, {&power_flow, &battery, &meter}, [&] {
+                  absl::Status st = power_flow.Query([](const fronius::Leistung&, const fronius::Quellen&) { });
+                  st.Update(battery.Query([](const fronius::Batterie&) { }));
+                  st.Update(meter.Query([](double) { }));
+                  return st;
+              });
+    }
+    if (enabled("senec")) {
+        senec::SenecClient senec(url);
+        Bench("senec", {{"/lala.cgi", "senec/testdata/lala.cgi.json", "application/json"}}, {&senec}, [&] {
+            return senec.Query([](const senec::SenecData&) { return absl::OkStatus(); });
+        });
+    }
+    if (enabled("hafnertec")) {
+        hafnertec::HafnertecClient hafnertec(url, "user", "password");
+        Bench("hafnertec", {{"/schematic_files/9.cgi", "hafnertec/testdata/schematic_9.html", "text/html"}},
+              {&hafnertec}, [&] {
+                  return hafnertec.Query([](const hafnertec::HafnertecData&) { return absl::OkStatus(); });
+              });
+    }
+    return 0;
+}
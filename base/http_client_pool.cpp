@@ -0,0 +1,89 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "http_client_pool.h"
+
+#include <absl/hash/hash.h>
+#include <absl/strings/str_cat.h>
+
+#include "base/metrics.h"
+
+using web::http::client::http_client;
+using web::http::client::http_client_config;
+
+namespace wastlernet {
+    namespace {
+        // User and password hash, so that changed credentials get a fresh client without keeping
+        // the password itself in the key.
+        std::string CredentialsKey(const web::credentials& credentials) {
+            if (!credentials.is_set()) {
+                return "";
+            }
+            auto password = credentials._internal_decrypt();
+            return absl::StrCat(credentials.username(), ":",
+                                absl::Hash<std::string>{}(password != nullptr ? *password : std::string()));
+        }
+
+        std::string ProxyKey(const web::web_proxy& proxy) {
+            if (proxy.is_disabled()) {
+                return "none";
+            }
+            if (proxy.is_auto_discovery()) {
+                return "auto";
+            }
+            if (proxy.is_specified()) {
+                return absl::StrCat(proxy.address().to_string(), "@", CredentialsKey(proxy.credentials()));
+            }
+            return "default";
+        }
+    }
+
+    std::string HttpClientPool::Key(const std::string& base_url, const http_client_config& config) {
+        return absl::StrCat(base_url, "|", CredentialsKey(config.credentials()), "|",
+                            ProxyKey(config.proxy()), "|",
+                            config.validate_certificates() ? 1 : 0, "|",
+                            std::chrono::duration_cast<std::chrono::milliseconds>(config.timeout()).count());
+    }
+
+    std::shared_ptr<http_client> HttpClientPool::Acquire(const std::string& base_url,
+                                                         const http_client_config& config) {
+        auto now = std::chrono::steady_clock::now();
+        std::shared_ptr<http_client> client;
+        bool reused;
+        {
+            absl::MutexLock lock(&mutex_);
+            auto& entry = clients_[Key(base_url, config)];
+            if (entry.client == nullptr || now - entry.last_used > idle_timeout_) {
+                // Connections held by the previous client close once its last user drops it.
+                entry.client = std::make_shared<http_client>(base_url, config);
+                entry.used = false;
+            }
+            reused = entry.used;
+            entry.used = true;
+            entry.last_used = now;
+            client = entry.client;
+        }
+        metrics::WastlernetMetrics::GetInstance().RecordHttpPoolRequest(base_url, reused);
+        return client;
+    }
+
+    void HttpClientPool::Invalidate(const std::shared_ptr<http_client>& client) {
+        absl::MutexLock lock(&mutex_);
+        for (auto it = clients_.begin(); it != clients_.end(); ++it) {
+            if (it->second.client == client) {
+                clients_.erase(it);
+                return;
+            }
+        }
+    }
+
+    void HttpClientPool::SetIdleTimeout(std::chrono::steady_clock::duration idle_timeout) {
+        absl::MutexLock lock(&mutex_);
+        idle_timeout_ = idle_timeout;
+    }
+
+    size_t HttpClientPool::size() {
+        absl::MutexLock lock(&mutex_);
+        return clients_.size();
+    }
+}
@@ -0,0 +1,91 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Shared pool of cpprest HTTP clients.
+//
+// A cpprest http_client keeps its TCP (and TLS) connections open between requests (HTTP/1.1
+// keep-alive) and reuses them for subsequent requests, but only for requests issued through the
+// same client instance. The wastlernet::HttpClientPool therefore hands out one shared client per
+// endpoint, so that all HttpConnection instances talking to the same device (e.g. the Fronius
+// power flow and battery clients on the master inverter) share its open connections instead of
+// performing a handshake on every poll.
+//
+// Clients are keyed by base URL and the connection-relevant parts of their configuration
+// (credentials, proxy, certificate validation, timeout). Passwords enter the key as a hash only. A client that has not been used for the
+// idle timeout is replaced by a fresh one on its next use: embedded web servers silently drop idle
+// keep-alive connections, and a request on such a connection would fail. Clients whose request
+// failed at the transport level are replaced as well (see Invalidate()).
+//
+// Every request is counted as
+//   wastlernet_http_pool_requests_total{endpoint="...", connection="reused|new"},
+// where "new" marks the first request of a client, i.e. the one paying for the handshake.
+//
+// Thread-safety
+// All methods are internally synchronized. The returned clients are thread-safe themselves.
+//
+#pragma once
+#include <chrono>
+#include <memory>
+#include <string>
+#include <absl/container/flat_hash_map.h>
+#include <absl/synchronization/mutex.h>
+#include <cpprest/http_client.h>
+
+#ifndef WASTLERNET_HTTP_CLIENT_POOL_H
+#define WASTLERNET_HTTP_CLIENT_POOL_H
+namespace wastlernet {
+    class HttpClientPool {
+    public:
+        /** The process-wide pool used by HttpConnection. */
+        static HttpClientPool& GetInstance() {
+            static HttpClientPool instance;
+            return instance;
+        }
+
+        /** Idle timeout used unless configured otherwise (Config.http_idle_timeout). */
+        static constexpr std::chrono::seconds kDefaultIdleTimeout{30};
+
+        explicit HttpClientPool(std::chrono::steady_clock::duration idle_timeout = kDefaultIdleTimeout)
+            : idle_timeout_(idle_timeout) { }
+
+        HttpClientPool(const HttpClientPool&) = delete;
+        HttpClientPool& operator=(const HttpClientPool&) = delete;
+
+        /**
+         * The shared client for `base_url` and `config`, creating (or replacing an idle) one if
+         * necessary. Call once per request: the call marks the client as used and counts the request.
+         */
+        std::shared_ptr<web::http::client::http_client> Acquire(const std::string& base_url,
+                                                                const web::http::client::http_client_config& config);
+
+        /**
+         * Drop `client` from the pool after a transport error, so that the next Acquire() starts
+         * with fresh connections. No-op if the client was already replaced.
+         */
+        void Invalidate(const std::shared_ptr<web::http::client::http_client>& client);
+
+        /**
+         * Time after which an unused client is replaced. Should be shorter than the keep-alive
+         * timeout of the servers and longer than their poll interval, so that polls reuse connections.
+         */
+        void SetIdleTimeout(std::chrono::steady_clock::duration idle_timeout);
+
+        /** Number of pooled clients. */
+        size_t size();
+
+    private:
+        struct Entry {
+            std::shared_ptr<web::http::client::http_client> client;
+            std::chrono::steady_clock::time_point last_used;
+            bool used = false;
+        };
+
+        absl::Mutex mutex_;
+        std::chrono::steady_clock::duration idle_timeout_ ABSL_GUARDED_BY(mutex_);
+        absl::flat_hash_map<std::string, Entry> clients_ ABSL_GUARDED_BY(mutex_);
+
+        /** Pool key of a client: base URL and the configuration affecting its connections. */
+        static std::string Key(const std::string& base_url, const web::http::client::http_client_config& config);
+    };
+}
+#endif //WASTLERNET_HTTP_CLIENT_POOL_H
@@ -5,73 +5,317 @@
 #include "http_connection.h"
 
 #include <glog/logging.h>
+#include <absl/hash/hash.h>
 #include <absl/strings/str_cat.h>
+#include <absl/strings/string_view.h>
+#include <absl/time/time.h>
+#include <cpprest/rawptrstream.h>
+#include <map>
+#include <memory>
 #include <optional>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "base/host_reachability.h"
+#include "base/metrics.h"
 
 #define LOGS(level) LOG(level) << "[" << Name() << "] "
 
 using namespace web::http::client;
 using web::http::methods;
 using web::http::status_codes;
+using web::http::http_request;
 using web::http::http_response;
 
 namespace wastlernet {
     absl::Status HttpConnection::Init() {
+        // No probe request: the first real request establishes the connection. Fail fast only
+        // while another connection has found the host unreachable.
+        if (auto st = HostReachability::GetInstance().Check(base_url_); !st.ok()) {
+            LOGS(WARNING) << st.message();
+            return st;
+        }
+
         absl::MutexLock lock(&mutex_);
+        if (!initialized_) {
+            LOGS(INFO) << "Initializing HTTP connection";
+            config_ = ClientConfig();
+            initialized_ = true;
+        }
+        return absl::OkStatus();
+    }
 
-        LOGS(INFO) << "Initializing and testing HTTP connection";
-        client_.reset(new http_client(base_url_, ClientConfig()));
+    namespace {
+        // Cancels asynchronous requests whose deadline has passed. One thread serves all requests,
+        // so a request in flight does not tie up a thread of its own.
+        class CancellationTimer {
+        public:
+            static CancellationTimer& GetInstance() {
+                // Never destroyed: requests may still be registered during static destruction.
+                static auto* instance = new CancellationTimer();
+                return *instance;
+            }
 
-        try {
-            return client_->request(methods::GET).then(
-                [=](const http_response &response) {
-                    if (response.status_code() == status_codes::OK) {
-                        initialized_ = true;
-                        return absl::OkStatus();
-                    } else {
-                        LOGS(ERROR) << "HTTP test request failed: " << response.reason_phrase();
-                        return absl::FailedPreconditionError(
-                            absl::StrCat("HTTP test request failed: ", response.reason_phrase()));
+            void CancelAt(Deadline::Clock::time_point when, pplx::cancellation_token_source cts) {
+                absl::MutexLock lock(&mutex_);
+                pending_.emplace(when, std::move(cts));
+            }
+
+        private:
+            CancellationTimer() {
+                std::thread(&CancellationTimer::Run, this).detach();
+            }
+
+            void Run() {
+                while (true) {
+                    std::vector<pplx::cancellation_token_source> expired;
+                    {
+                        absl::MutexLock lock(&mutex_);
+                        auto has_pending = [this]() ABSL_NO_THREAD_SAFETY_ANALYSIS { return !pending_.empty(); };
+                        mutex_.Await(absl::Condition(&has_pending));
+
+                        // Sleep until the earliest deadline, or until an earlier one is registered.
+                        auto next = pending_.begin()->first;
+                        auto earlier = [this, next]() ABSL_NO_THREAD_SAFETY_ANALYSIS {
+                            return pending_.begin()->first < next;
+                        };
+                        mutex_.AwaitWithTimeout(absl::Condition(&earlier),
+                                                absl::FromChrono(next - Deadline::Clock::now()));
+
+                        auto now = Deadline::Clock::now();
+                        while (!pending_.empty() && pending_.begin()->first <= now) {
+                            expired.push_back(std::move(pending_.begin()->second));
+                            pending_.erase(pending_.begin());
+                        }
                     }
-                }).get();
-        } catch (const std::exception &e) {
-            LOGS(ERROR) << "Error while testing HTTP connection: " << e.what();
-            return absl::InternalError(absl::StrCat("Error while testing HTTP connection: ", e.what()));
+                    // Cancelling completed requests is a no-op.
+                    for (const auto& cts : expired) {
+                        cts.cancel();
+                    }
+                }
+            }
+
+            absl::Mutex mutex_;
+            std::multimap<Deadline::Clock::time_point, pplx::cancellation_token_source> pending_
+                ABSL_GUARDED_BY(mutex_);
+        };
+
+        // Whether `e` reports a request cancelled through its cancellation token.
+        bool IsCancellation(const std::exception& e) {
+            if (dynamic_cast<const pplx::task_canceled*>(&e) != nullptr) {
+                return true;
+            }
+            auto* http_error = dynamic_cast<const web::http::http_exception*>(&e);
+            return http_error != nullptr && http_error->error_code() == std::errc::operation_canceled;
         }
     }
 
-    absl::Status HttpConnection::Execute(std::function<absl::Status(const http_response &)> handler) {
+    absl::Status HttpConnection::Execute(std::function<absl::Status(const http_response &)> handler,
+                                         const Deadline &deadline) {
+        return ExecuteAsync(std::move(handler), deadline).get();
+    }
+
+    pplx::task<absl::Status> HttpConnection::ExecuteAsync(std::function<absl::Status(const http_response &)> handler,
+                                                          const Deadline &deadline) {
+        return Start([handler = std::move(handler)](const http_response &response) {
+            return pplx::task_from_result(handler(response));
+        }, deadline, false);
+    }
+
+    absl::Status HttpConnection::ExecuteIfChanged(std::function<absl::Status(const std::string &)> handler,
+                                                  const Deadline &deadline) {
+        return ExecuteIfChangedAsync(std::move(handler), deadline).get();
+    }
+
+    pplx::task<absl::Status> HttpConnection::ExecuteIfChangedAsync(
+            std::function<absl::Status(const std::string &)> handler, const Deadline &deadline) {
+        return Start([this, handler = std::move(handler)](const http_response &response) -> pplx::task<absl::Status> {
+            if (response.status_code() == status_codes::NotModified) {
+                metrics::WastlernetMetrics::GetInstance().RecordHttpResponse(base_url_ + path_, false);
+                return pplx::task_from_result(absl::OkStatus());
+            }
+            if (response.status_code() != status_codes::OK) {
+                LOGS(ERROR) << "HTTP request failed: " << response.reason_phrase();
+                return pplx::task_from_result(
+                        absl::InternalError(absl::StrCat("HTTP request failed: ", response.reason_phrase())));
+            }
+
+            // Continue once the body has arrived instead of blocking a pool thread on it.
+            return response.extract_utf8string(true).then([this, handler, response](const std::string &body) {
+                return HandleIfChanged(handler, response, body);
+            });
+        }, deadline, true);
+    }
+
+    absl::Status HttpConnection::HandleIfChanged(const std::function<absl::Status(const std::string &)> &handler,
+                                                 const http_response &response, const std::string &body) {
+        auto& mx = metrics::WastlernetMetrics::GetInstance();
+        size_t hash = absl::Hash<absl::string_view>{}(absl::string_view(body));
+        bool changed;
+        {
+            absl::MutexLock lock(&mutex_);
+            changed = last_response_.hash != hash;
+        }
+        if (changed) {
+            if (auto st = handler(body); !st.ok()) {
+                // Not remembered, so that the same body is handled again on the next request.
+                return st;
+            }
+        } else {
+            LOGS(INFO) << "Response unchanged, skipping";
+        }
+
+        {
+            const auto& headers = response.headers();
+            absl::MutexLock lock(&mutex_);
+            last_response_.hash = hash;
+            last_response_.etag.clear();
+            last_response_.last_modified.clear();
+            headers.match(web::http::header_names::etag, last_response_.etag);
+            headers.match(web::http::header_names::last_modified, last_response_.last_modified);
+        }
+        mx.RecordHttpResponse(base_url_ + path_, changed);
+        return absl::OkStatus();
+    }
+
+    void HttpConnection::ForgetLastResponse() {
+        absl::MutexLock lock(&mutex_);
+        last_response_ = LastResponse();
+    }
+
+    pplx::task<absl::Status> HttpConnection::Start(AsyncHandler handler, const Deadline &deadline, bool conditional) {
         LOGS(INFO) << "Executing HTTP request";
 
         if (!initialized_) {
-            return absl::FailedPreconditionError("HTTP connection not initialized");
+            if (auto st = Init(); !st.ok()) {
+                return pplx::task_from_result(st);
+            }
+        } else if (auto st = HostReachability::GetInstance().Check(base_url_); !st.ok()) {
+            // Another connection found the host unreachable after this one was initialized.
+            LOGS(WARNING) << st.message();
+            return pplx::task_from_result(st);
+        }
+        if (deadline.Expired()) {
+            return pplx::task_from_result(absl::DeadlineExceededError("Deadline expired before HTTP request"));
+        }
+
+        // Fail fast while the endpoint is known to be down instead of blocking on connect/response timeouts.
+        if (!breaker_.Allow()) {
+            return pplx::task_from_result(absl::UnavailableError(
+                absl::StrCat("HTTP endpoint ", base_url_, path_, " unavailable (circuit open)")));
         }
 
         // Build request URI and start the request.
         web::uri_builder builder(U(path_));
 
-        absl::MutexLock lock(&mutex_);
+        http_client_config config;
+        {
+            absl::MutexLock lock(&mutex_);
+            config = config_;
+        }
+        auto client = HttpClientPool::GetInstance().Acquire(base_url_, config);
+        pplx::cancellation_token_source cts;
+        pplx::task<http_response> request;
         try {
-            if (request_type_ == GET) {
-                return client_->request(methods::GET, builder.to_string()).then(handler).get();
+            LastResponse last;
+            if (conditional && request_type_ == GET) {
+                absl::MutexLock lock(&mutex_);
+                last = last_response_;
             }
-            if (request_type_ == POST) {
+            if (request_type_ == GET && (!last.etag.empty() || !last.last_modified.empty())) {
+                http_request message(methods::GET);
+                message.set_request_uri(builder.to_string());
+                if (!last.etag.empty()) {
+                    message.headers().add(web::http::header_names::if_none_match, last.etag);
+                }
+                if (!last.last_modified.empty()) {
+                    message.headers().add(web::http::header_names::if_modified_since, last.last_modified);
+                }
+                request = client->request(message, cts.get_token());
+            } else if (request_type_ == GET) {
+                request = client->request(methods::GET, builder.to_string(), cts.get_token());
+            } else if (request_type_ == POST && static_body_.has_value()) {
+                // Read in place from the immutable body; the connection outlives the request.
+                http_request message(methods::POST);
+                message.set_request_uri(builder.to_string());
+                concurrency::streams::rawptr_buffer<uint8_t> buffer(
+                        reinterpret_cast<const uint8_t*>(static_body_->data()), static_body_->size());
+                message.set_body(buffer.create_istream(), static_body_->size(), U(static_content_type_));
+                request = client->request(message, cts.get_token());
+            } else if (request_type_ == POST) {
                 std::optional<web::json::value> body = RequestBody();
                 if (body.has_value()) {
-                    return client_->request(methods::POST, builder.to_string(), *body).then(handler).get();
+                    request = client->request(methods::POST, builder.to_string(), *body, cts.get_token());
                 } else {
-                    return client_->request(methods::POST, builder.to_string()).then(handler).get();
+                    request = client->request(methods::POST, builder.to_string(), cts.get_token());
                 }
+            } else {
+                breaker_.RecordFailure();
+                LOGS(ERROR) << "Unknown HTTP request type";
+                return pplx::task_from_result(absl::InternalError("Unknown HTTP request type"));
             }
-            LOGS(ERROR) << "Unknown HTTP request type";
-            return absl::InternalError("Unknown HTTP request type");
         } catch (const std::exception &e) {
-            LOGS(ERROR) << "Error while executing HTTP request: " << e.what();
-            return absl::InternalError(absl::StrCat("Error while executing HTTP request: ", e.what()));
+            breaker_.RecordFailure();
+            HostReachability::GetInstance().RecordFailure(base_url_, e.what());
+            HttpClientPool::GetInstance().Invalidate(client);
+            LOGS(ERROR) << "Error while starting HTTP request: " << e.what();
+            return pplx::task_from_result(
+                absl::InternalError(absl::StrCat("Error while executing HTTP request: ", e.what())));
+        }
+
+        if (!deadline.IsInfinite()) {
+            CancellationTimer::GetInstance().CancelAt(deadline.When(), cts);
         }
-    }
 
-    absl::Status HttpConnection::Reinit() {
-        return Init();
+        return request.then([this, client, deadline, handler = std::move(handler)](
+                pplx::task<http_response> response) -> pplx::task<absl::Status> {
+            http_response r;
+            try {
+                r = response.get();
+            } catch (const std::exception &e) {
+                if (deadline.Expired() && IsCancellation(e)) {
+                    // Cancelled at our deadline: a slow response says nothing about the host, so
+                    // neither the breaker nor the connections sharing the host hold it against it.
+                    breaker_.Release();
+                    LOGS(WARNING) << "HTTP request exceeded deadline";
+                    return pplx::task_from_result(absl::DeadlineExceededError("HTTP request exceeded deadline"));
+                }
+                // A transport error (refused, reset, unresolvable) counts against the host even if
+                // the deadline has passed meanwhile.
+                breaker_.RecordFailure();
+                HostReachability::GetInstance().RecordFailure(base_url_, e.what());
+                // The client's connections may be broken; start over with fresh ones.
+                HttpClientPool::GetInstance().Invalidate(client);
+                if (deadline.Expired()) {
+                    LOGS(WARNING) << "HTTP request exceeded deadline: " << e.what();
+                    return pplx::task_from_result(
+                            absl::DeadlineExceededError(absl::StrCat("HTTP request exceeded deadline: ", e.what())));
+                }
+                LOGS(ERROR) << "Error while executing HTTP request: " << e.what();
+                return pplx::task_from_result(
+                        absl::InternalError(absl::StrCat("Error while executing HTTP request: ", e.what())));
+            }
+
+            // The device answered; application-level errors in the handler do not count against it,
+            // and leave the pooled client in place.
+            breaker_.RecordSuccess();
+            HostReachability::GetInstance().RecordSuccess(base_url_);
+            auto handler_error = [this](const std::exception &e) {
+                LOGS(ERROR) << "Error while handling HTTP response: " << e.what();
+                return absl::InternalError(absl::StrCat("Error while handling HTTP response: ", e.what()));
+            };
+            try {
+                return handler(r).then([handler_error](pplx::task<absl::Status> handled) {
+                    try {
+                        return handled.get();
+                    } catch (const std::exception &e) {
+                        return handler_error(e);
+                    }
+                });
+            } catch (const std::exception &e) {
+                return pplx::task_from_result(handler_error(e));
+            }
+        });
     }
 } // namespace
@@ -7,24 +7,41 @@
 // boilerplate for performing simple HTTP requests (GET/POST) against a fixed endpoint.
 //
 // Responsibilities
-// - Lazily initialize and maintain a cpprestsdk http_client instance.
-// - Serialize access and automatically re-initialize the client on failures.
+// - Obtain the cpprestsdk http_client from the shared HttpClientPool, so that keep-alive
+//   connections are reused across polls and across connections to the same endpoint.
+// - Run requests concurrently: several requests of one or more connections may be in flight at
+//   once. After a transport error, the pooled client is dropped, so that the next request starts
+//   over with fresh connections.
+// - Fail fast through a CircuitBreaker while the endpoint is unreachable.
+// - Initialize lazily: the first request establishes the connection. The outcome of every request
+//   is shared with all connections to the same host through the HostReachability cache, and every
+//   request fails fast while the host is marked unreachable there.
 // - Provide hook points to customize client configuration and request body.
-// - Execute a user-provided callback with the received HTTP response.
+// - Execute a user-provided callback with the received HTTP response, bounded by a Deadline,
+//   either blocking (Execute()) or asynchronously (ExecuteAsync()).
 //
 // Thread-safety
-// All public methods are internally synchronized via an absl::Mutex. Multiple threads may
-// call Init() and Execute() concurrently on the same instance. The callback passed to Execute()
-// is invoked while the connection is held; keep it short and non-blocking.
+// All public methods are thread-safe. Multiple threads may call Init() and Execute() concurrently
+// on the same instance, and several requests may be in flight at once; they are not serialized.
+// The callback runs on a cpprest thread pool thread; keep it short and non-blocking.
 //
 // Usage
 // - Construct with base_url, path and request type.
-// - Call Init() once before the first Execute(); subsequent calls are cheap no-ops.
+// - Optionally call Init() before the first Execute(); it does not contact the device, but fails
+//   fast while the host is known to be unreachable. Execute() initializes on demand.
 // - Optionally override ClientConfig() to inject credentials, TLS verification, timeouts, etc.
-// - For POST requests, optionally override RequestBody() to provide a JSON payload.
+// - For POST requests with a fixed payload, call SetStaticBody() in the constructor: the body is
+//   serialized once and sent from the same buffer on every request. For payloads that change
+//   between requests, override RequestBody() instead.
+// - For endpoints polled for their current state, use ExecuteIfChanged(): it only hands on bodies
+//   that differ from the last one handled, and sends conditional GET requests (ETag /
+//   Last-Modified) where the device supports them.
+//   If the handled data is stored later, call ForgetLastResponse() when storing fails.
 // - Provide a Name() in derived classes for logging/diagnostics.
 //
 #pragma once
+#include <atomic>
+#include <cstddef>
 #include <optional>
 #include <string>
 #include <absl/status/status.h>
@@ -33,6 +50,12 @@
 #include <cpprest/http_msg.h>
 #include <cpprest/http_client.h>
 #include <cpprest/json.h>
+#include <pplx/pplxtasks.h>
+
+#include "base/circuit_breaker.h"
+#include "base/deadline.h"
+#include "base/host_reachability.h"
+#include "base/http_client_pool.h"
 
 #ifndef HTTP_CONNECTION_H
 #define HTTP_CONNECTION_H
@@ -42,8 +65,8 @@ namespace wastlernet {
      * Base class managing a simple HTTP endpoint interaction.
      *
      * A derived class specifies a human-readable Name(), and can customize the client
-     * configuration and/or the request body for POST requests. After calling Init(),
-     * use Execute() to perform the request and handle the response in the provided callback.
+     * configuration and/or the request body for POST requests. Use Execute() to perform the
+     * request and handle the response in the provided callback.
      */
     class HttpConnection {
       public:
@@ -59,14 +82,15 @@ namespace wastlernet {
          * @param request_type Type of request to perform (GET or POST).
          */
         HttpConnection(const std::string& base_url, const std::string& path, RequestType request_type)
-          : base_url_(base_url), path_(path), request_type_(request_type) {}
+          : base_url_(base_url), path_(path), request_type_(request_type), breaker_(base_url + path) {}
 
         virtual ~HttpConnection() { }
 
         /**
-         * Initialize the internal HTTP client.
-         * Must be called before calling Execute(). Safe to call multiple times.
-         * @return absl::OkStatus on success; a non-OK status describing the error otherwise.
+         * Initialize the internal HTTP client, without sending a request. Called by Execute() on
+         * demand. Safe to call multiple times.
+         * @return absl::OkStatus on success; Unavailable while a request of any connection to the
+         *         same host recently failed (see HostReachability).
          */
         absl::Status Init();
 
@@ -75,10 +99,63 @@ namespace wastlernet {
          * The request method (GET/POST) is determined by the constructor argument, and for POST the
          * optional JSON body returned by RequestBody() is used if provided.
          *
-         * @param method Callback receiving the HTTP response; return non-OK to signal an application error.
+         * If no response has arrived by `deadline`, the request is cancelled and DeadlineExceeded is
+         * returned; the callback is then not invoked. While the circuit breaker is open, or while
+         * the host is marked unreachable (see HostReachability), Execute() fails fast with
+         * Unavailable. Transport errors and client timeouts count towards opening the breaker;
+         * requests cancelled at `deadline` and exceptions thrown by the callback do not, and neither
+         * marks the host unreachable. Exceptions of the callback are returned as Internal.
+         *
+         * @param method   Callback receiving the HTTP response; return non-OK to signal an application error.
+         * @param deadline Time by which the response must have been received.
          * @return absl::OkStatus if the request succeeded and the callback returned OK; otherwise a non-OK status.
          */
-        absl::Status Execute(std::function<absl::Status(const web::http::http_response&)> method);
+        absl::Status Execute(std::function<absl::Status(const web::http::http_response&)> method,
+                             const Deadline& deadline = Deadline::Infinite());
+
+        /**
+         * Asynchronous variant of Execute(): start the request and return without waiting for it.
+         *
+         * The task completes with the status Execute() would have returned: the callback's status
+         * once the response has arrived, or DeadlineExceeded if the request is cancelled at
+         * `deadline`. Requests of several connections (or several requests of one) can be in flight
+         * at the same time and composed with pplx::when_all() without blocking a thread per request:
+         *
+         *   std::vector<pplx::task<absl::Status>> requests = {a.ExecuteAsync(...), b.ExecuteAsync(...)};
+         *   auto statuses = pplx::when_all(requests.begin(), requests.end()).get();
+         *
+         * The connection must outlive the returned task.
+         */
+        pplx::task<absl::Status> ExecuteAsync(std::function<absl::Status(const web::http::http_response&)> method,
+                                              const Deadline& deadline = Deadline::Infinite());
+
+        /**
+         * Execute the request for an endpoint that is polled for its current state, and invoke
+         * `handler` with the body of a 200 response only if it differs from the last body the handler
+         * accepted (returned OK for). Unchanged bodies are detected by their hash and return OK without
+         * invoking the handler, so that the caller skips parsing and storing a sample it already has.
+         *
+         * Once the endpoint has returned an ETag or Last-Modified header, GET requests carry
+         * If-None-Match / If-Modified-Since, and 304 (Not Modified) counts as unchanged. Other
+         * statuses than 200 and 304 are returned as errors.
+         *
+         * Every current response, changed or not, refreshes the freshness timestamp of the connection
+         * (wastlernet_http_last_response_timestamp_seconds).
+         */
+        absl::Status ExecuteIfChanged(std::function<absl::Status(const std::string& body)> handler,
+                                      const Deadline& deadline = Deadline::Infinite());
+
+        /** Asynchronous variant of ExecuteIfChanged(), see ExecuteAsync(). */
+        pplx::task<absl::Status> ExecuteIfChangedAsync(std::function<absl::Status(const std::string& body)> handler,
+                                                       const Deadline& deadline = Deadline::Infinite());
+
+        /**
+         * Forget the last body accepted by an ExecuteIfChanged() handler, so that the next request
+         * hands on the current body even if it is unchanged. Call when the data derived from an
+         * accepted body could not be stored after all, e.g. because the database write or a request
+         * to another endpoint of the same sample failed.
+         */
+        void ForgetLastResponse();
 
       private:
         absl::Mutex mutex_;
@@ -86,12 +163,37 @@ namespace wastlernet {
         std::string base_url_, path_;
         RequestType request_type_;
 
-        bool initialized_ = false;
+        std::atomic<bool> initialized_{false};
+
+        /** ClientConfig() as of Init(); identifies the pooled client together with base_url_. */
+        web::http::client::http_client_config config_;
+
+        CircuitBreaker breaker_;
+
+        /** Pre-serialized POST body and its content type; immutable after construction. */
+        std::optional<std::string> static_body_;
+        std::string static_content_type_;
+
+        /** Validators of the last body accepted by an ExecuteIfChanged() handler. */
+        struct LastResponse {
+            std::optional<size_t> hash;
+            std::string etag;
+            std::string last_modified;
+        };
+        LastResponse last_response_ ABSL_GUARDED_BY(mutex_);
 
-        std::unique_ptr<web::http::client::http_client> client_;
+        /** Continuation of a request with its response; may wait for the body without blocking. */
+        using AsyncHandler = std::function<pplx::task<absl::Status>(const web::http::http_response&)>;
 
-        /** (Re-)initialize the client when necessary. */
-        absl::Status Reinit();
+        /** Start the request; `conditional` adds the validators of last_response_ to GET requests. */
+        pplx::task<absl::Status> Start(AsyncHandler handler, const Deadline& deadline, bool conditional);
+
+        /**
+         * Hand `body` of a 200 `response` to `handler` unless it equals the last accepted body, and
+         * remember its validators once accepted.
+         */
+        absl::Status HandleIfChanged(const std::function<absl::Status(const std::string&)>& handler,
+                                     const web::http::http_response& response, const std::string& body);
 
       protected:
         /** Name of the connection (for logging/diagnostics). Must be provided by derived classes. */
@@ -108,6 +210,16 @@ namespace wastlernet {
          * Return std::nullopt for no body / GET requests.
          */
         virtual std::optional<web::json::value> RequestBody() { return std::nullopt; }
+
+        /**
+         * Send `body` with `content_type` on every POST request, in place of RequestBody(). The body
+         * is streamed from this buffer without being copied or re-serialized per request. Must be
+         * called from the constructor of the derived class, before any request is started.
+         */
+        void SetStaticBody(std::string body, std::string content_type = "application/json") {
+            static_body_ = std::move(body);
+            static_content_type_ = std::move(content_type);
+        }
     };
 }
 #endif //HTTP_CONNECTION_H
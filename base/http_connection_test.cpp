@@ -1,80 +1,77 @@
 //
 // Created by wastl on 06.07.25.
 //
+#include <algorithm>
+#include <memory>
 #include <thread>
+#include <vector>
 #include <gtest/gtest.h>
 
+#include "http_client_pool.h"
 #include "http_connection.h"
+#include "http_replay.h"
 
-#include <absl/strings/strip.h>
-#include <cpprest/http_listener.h>
-#include <glog/logging.h>
+#include <absl/synchronization/mutex.h>
 
 using web::http::http_request;
-using web::http::experimental::listener::http_listener;
 
 constexpr char kAddress[] = "http://127.0.0.1:15003";
+// Answers after 500ms, for deadline tests.
+constexpr char kSlowAddress[] = "http://127.0.0.1:15004";
+// Nothing listens here.
+constexpr char kUnreachableAddress[] = "http://127.0.0.1:15009";
+constexpr char kETag[] = "\"v1\"";
 
 class HTTPTest : public testing::Test {
 protected:
-    HTTPTest() {
-    }
+    // A request as received by the replay server.
+    struct Received {
+        std::string method;
+        std::string path;
+        std::string body;
+        std::string if_none_match;
+    };
 
     void SetUp() override {
-        server_thread_ = startListener(kAddress);
+        wastlernet::HttpReplayOptions options;
+        options.on_request = [this](const http_request &request) {
+            Received received{request.method(), request.relative_uri().path(),
+                              request.extract_utf8string(true).get(), ""};
+            request.headers().match(web::http::header_names::if_none_match, received.if_none_match);
+            absl::MutexLock lock(&mutex_);
+            received_.push_back(std::move(received));
+        };
+        server_ = std::make_unique<wastlernet::HttpReplayServer>(kAddress, options);
+        server_->AddResponse("/test", R"({"result":"ok"})");
+        // /etag supports conditional requests with a fixed ETag
+        server_->AddResponse("/etag", "versioned", "text/plain", kETag);
+        ASSERT_TRUE(server_->Start().ok());
+
+        wastlernet::HttpReplayOptions slow;
+        slow.latency = std::chrono::milliseconds(500);
+        slow_server_ = std::make_unique<wastlernet::HttpReplayServer>(kSlowAddress, slow);
+        slow_server_->AddResponse("/slow", "");
+        ASSERT_TRUE(slow_server_->Start().ok());
     }
 
     void TearDown() override {
-        if (server_thread_ != nullptr) {
-            server_thread_->close();
-        }
+        // Reachability is process-wide; do not let one test's failures fail the next one fast.
+        wastlernet::HostReachability::GetInstance().RecordSuccess(kAddress);
+        wastlernet::HostReachability::GetInstance().RecordSuccess(kSlowAddress);
     }
 
-private:
-    std::unique_ptr<http_listener> server_thread_;
-
-
-    // Start a listener for test purposes that echos back the request as JSON
-    std::unique_ptr<http_listener> startListener(const std::string &listen) {
-        auto listener = std::make_unique<http_listener>(listen);
-
-        LOG(INFO) << "starting REST listener on address " << listen;
-
-        listener->support([=](const http_request &request) {
-            auto uri = request.relative_uri();
-
-            LOG(INFO) << "Received REST request to " << uri.path();
-
-            std::string path = std::string(absl::StripPrefix(uri.path(), "/"));
-
-            try {
-                if (path == "") {
-                    // empty path is connection init
-                    request.reply(web::http::status_codes::OK).get();
-                } else if (path == "test") {
-                    // /test path is used for testing GET and POST
-                    web::json::value output = web::json::value::object({
-                        {"method", web::json::value::string(request.method())},
-                        {"path", web::json::value::string(uri.path())},
-                        {"body", request.extract_json().get()}
-                    });
-
-                    request.reply(web::http::status_codes::OK, output).get();
-                } else {
-                    // everything else should return NOT FOUND
-                    request.reply(web::http::status_codes::NotFound,
-                                  std::string("data for module \"") + path + "\" not found", "text/plain").get();
-                }
-            } catch (const std::exception &e) {
-                LOG(ERROR) << "Error while resolving REST request: " << e.what();
-                request.reply(web::http::status_codes::InternalError);
-            }
-        });
+    // Requests to the recorded paths of kAddress so far, in order of arrival.
+    std::vector<Received> received() {
+        absl::MutexLock lock(&mutex_);
+        return received_;
+    }
 
-        listener->open().get();
+private:
+    absl::Mutex mutex_;
+    std::vector<Received> received_ ABSL_GUARDED_BY(mutex_);
 
-        return std::move(listener);
-    }
+    // Destroyed first, so that no request is recorded into destroyed members.
+    std::unique_ptr<wastlernet::HttpReplayServer> server_, slow_server_;
 };
 
 // Test implementations of wastlernet::HttpConnection for different methods and paths
@@ -105,6 +102,47 @@ namespace {
         }
     };
 
+    class TestHTTPStaticPostConnection : public wastlernet::HttpConnection {
+    public:
+        TestHTTPStaticPostConnection()
+            : HttpConnection(kAddress, "test", POST) {
+            SetStaticBody(R"({"foo":"static"})");
+        }
+
+    protected:
+        std::string Name() override { return "TestHTTPStaticPostConnection"; }
+    };
+
+    class TestHTTPETagConnection : public wastlernet::HttpConnection {
+    public:
+        TestHTTPETagConnection()
+            : HttpConnection(kAddress, "etag", GET) {
+        }
+
+    protected:
+        std::string Name() override { return "TestHTTPETagConnection"; }
+    };
+
+    class TestHTTPUnreachableConnection : public wastlernet::HttpConnection {
+    public:
+        TestHTTPUnreachableConnection()
+            : HttpConnection(kUnreachableAddress, "test", GET) {
+        }
+
+    protected:
+        std::string Name() override { return "TestHTTPUnreachableConnection"; }
+    };
+
+    class TestHTTPSlowConnection : public wastlernet::HttpConnection {
+    public:
+        TestHTTPSlowConnection()
+            : HttpConnection(kSlowAddress, "slow", GET) {
+        }
+
+    protected:
+        std::string Name() override { return "TestHTTPSlowConnection"; }
+    };
+
     class TestHTTPNotFoundConnection : public wastlernet::HttpConnection {
     public:
         TestHTTPNotFoundConnection()
@@ -124,14 +162,17 @@ TEST_F(HTTPTest, Get) {
     ASSERT_TRUE(st.ok()) << st.message();
 
     st = conn.Execute([](const web::http::http_response &response) {
-        auto json = response.extract_json().get();
-
-        EXPECT_EQ("GET", json.at("method").as_string());
-        EXPECT_EQ("/test", json.at("path").as_string());
+        EXPECT_EQ(web::http::status_codes::OK, response.status_code());
+        EXPECT_EQ("ok", response.extract_json().get().at("result").as_string());
 
         return absl::OkStatus();
     });
     ASSERT_TRUE(st.ok()) << st.message();
+
+    auto requests = received();
+    ASSERT_EQ(requests.size(), 1);
+    EXPECT_EQ("GET", requests[0].method);
+    EXPECT_EQ("/test", requests[0].path);
 }
 
 // Test initialization and POST request
@@ -142,17 +183,130 @@ TEST_F(HTTPTest, Post) {
     ASSERT_TRUE(st.ok()) << st.message();
 
     st = conn.Execute([](const web::http::http_response &response) {
-        auto json = response.extract_json().get();
+        EXPECT_EQ(web::http::status_codes::OK, response.status_code());
+        return absl::OkStatus();
+    });
+    ASSERT_TRUE(st.ok()) << st.message();
+
+    auto requests = received();
+    ASSERT_EQ(requests.size(), 1);
+    EXPECT_EQ("POST", requests[0].method);
+    EXPECT_EQ("/test", requests[0].path);
+    EXPECT_EQ("bar", web::json::value::parse(requests[0].body).at("foo").as_string());
+}
+
+// Test that a static body is sent unchanged with every request
+TEST_F(HTTPTest, PostStaticBody) {
+    TestHTTPStaticPostConnection conn;
+
+    auto st = conn.Init();
+    ASSERT_TRUE(st.ok()) << st.message();
+
+    for (int i = 0; i < 3; i++) {
+        st = conn.Execute([](const web::http::http_response &response) { return absl::OkStatus(); });
+        ASSERT_TRUE(st.ok()) << st.message();
+    }
+
+    auto requests = received();
+    ASSERT_EQ(requests.size(), 3);
+    for (const auto& request : requests) {
+        EXPECT_EQ("POST", request.method);
+        EXPECT_EQ("static", web::json::value::parse(request.body).at("foo").as_string());
+    }
+}
 
-        EXPECT_EQ("POST", json.at("method").as_string());
-        EXPECT_EQ("/test", json.at("path").as_string());
-        EXPECT_EQ("bar", json.at("body").at("foo").as_string());
+// Test that the first request initializes the connection
+TEST_F(HTTPTest, InitializesLazily) {
+    TestHTTPGetConnection conn;
 
+    auto st = conn.Execute([](const web::http::http_response &response) {
+        EXPECT_EQ(web::http::status_codes::OK, response.status_code());
         return absl::OkStatus();
     });
     ASSERT_TRUE(st.ok()) << st.message();
 }
 
+// Test that a failed request makes other connections to the same host fail fast on Init()
+TEST_F(HTTPTest, SharesHostReachability) {
+    TestHTTPUnreachableConnection first, second;
+    ASSERT_TRUE(first.Init().ok());
+
+    auto handler = [](const web::http::http_response &) { return absl::OkStatus(); };
+    EXPECT_FALSE(first.Execute(handler).ok());
+    EXPECT_EQ(second.Init().code(), absl::StatusCode::kUnavailable);
+}
+
+// Test that an initialized connection fails fast, without a request, once another connection found
+// its host unreachable
+TEST_F(HTTPTest, InitializedConnectionChecksHostReachability) {
+    TestHTTPGetConnection conn;
+    auto handler = [](const web::http::http_response &) { return absl::OkStatus(); };
+    ASSERT_TRUE(conn.Execute(handler).ok());
+
+    wastlernet::HostReachability::GetInstance().RecordFailure(kAddress, "connection refused");
+    EXPECT_EQ(conn.Execute(handler).code(), absl::StatusCode::kUnavailable);
+    EXPECT_EQ(received().size(), 1);
+
+    wastlernet::HostReachability::GetInstance().RecordSuccess(kAddress);
+    EXPECT_TRUE(conn.Execute(handler).ok());
+    EXPECT_EQ(received().size(), 2);
+}
+
+// Test that a request cancelled at its deadline leaves the host reachable for other connections
+TEST_F(HTTPTest, DeadlineCancelKeepsHostReachable) {
+    TestHTTPSlowConnection slow;
+    auto st = slow.Execute([](const web::http::http_response &) { return absl::OkStatus(); },
+                           wastlernet::Deadline::After(std::chrono::milliseconds(100)));
+    EXPECT_EQ(st.code(), absl::StatusCode::kDeadlineExceeded) << st;
+    EXPECT_TRUE(wastlernet::HostReachability::GetInstance().Check(kSlowAddress).ok());
+
+    TestHTTPSlowConnection sibling;
+    EXPECT_TRUE(sibling.Init().ok());
+}
+
+// Test that an unchanged body is only handed to the first handler that accepts it
+TEST_F(HTTPTest, ExecuteIfChangedSkipsUnchangedBody) {
+    TestHTTPGetConnection conn;
+    ASSERT_TRUE(conn.Init().ok());
+
+    int calls = 0;
+    auto handler = [&calls](const std::string &body) {
+        calls++;
+        return calls == 1 ? absl::InternalError("rejected") : absl::OkStatus();
+    };
+
+    // A rejected body is handled again on the next request.
+    EXPECT_FALSE(conn.ExecuteIfChanged(handler).ok());
+    ASSERT_TRUE(conn.ExecuteIfChanged(handler).ok());
+    ASSERT_TRUE(conn.ExecuteIfChanged(handler).ok());
+    ASSERT_TRUE(conn.ExecuteIfChanged(handler).ok());
+    EXPECT_EQ(calls, 2);
+}
+
+// Test that requests are conditional once the endpoint returned an ETag
+TEST_F(HTTPTest, ExecuteIfChangedSendsConditionalRequests) {
+    TestHTTPETagConnection conn;
+    ASSERT_TRUE(conn.Init().ok());
+
+    int calls = 0;
+    auto handler = [&calls](const std::string &body) {
+        EXPECT_EQ("versioned", body);
+        calls++;
+        return absl::OkStatus();
+    };
+
+    ASSERT_TRUE(conn.ExecuteIfChanged(handler).ok());
+    ASSERT_TRUE(conn.ExecuteIfChanged(handler).ok());
+    ASSERT_TRUE(conn.ExecuteIfChanged(handler).ok());
+    EXPECT_EQ(calls, 1);
+
+    auto requests = received();
+    ASSERT_EQ(requests.size(), 3);
+    EXPECT_EQ("", requests[0].if_none_match);
+    EXPECT_EQ(kETag, requests[1].if_none_match);
+    EXPECT_EQ(kETag, requests[2].if_none_match);
+}
+
 // Test initialization and request to non-existant URL
 TEST_F(HTTPTest, NotFound) {
     TestHTTPNotFoundConnection conn;
@@ -167,3 +321,103 @@ TEST_F(HTTPTest, NotFound) {
     });
     ASSERT_FALSE(st.ok()) << st.message();
 }
+
+// Requests of several connections are in flight at the same time and composed with when_all().
+TEST_F(HTTPTest, ExecuteAsync) {
+    TestHTTPGetConnection get;
+    TestHTTPPostConnection post;
+    TestHTTPSlowConnection slow;
+    ASSERT_TRUE(get.Init().ok());
+    ASSERT_TRUE(post.Init().ok());
+    ASSERT_TRUE(slow.Init().ok());
+
+    auto handler = [](const web::http::http_response &) { return absl::OkStatus(); };
+    auto deadline = wastlernet::Deadline::After(std::chrono::milliseconds(200));
+    std::vector<pplx::task<absl::Status>> requests = {
+        get.ExecuteAsync(handler, deadline),
+        post.ExecuteAsync(handler, deadline),
+        slow.ExecuteAsync(handler, deadline),
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto statuses = pplx::when_all(requests.begin(), requests.end()).get();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(450));
+    ASSERT_EQ(statuses.size(), 3);
+    EXPECT_TRUE(statuses[0].ok()) << statuses[0];
+    EXPECT_TRUE(statuses[1].ok()) << statuses[1];
+    EXPECT_EQ(statuses[2].code(), absl::StatusCode::kDeadlineExceeded) << statuses[2];
+
+    std::vector<std::string> methods;
+    for (const auto& request : received()) {
+        methods.push_back(request.method);
+    }
+    std::sort(methods.begin(), methods.end());
+    EXPECT_EQ(methods, std::vector<std::string>({"GET", "POST"}));
+}
+
+// A callback throwing on a valid response is an application error: it neither opens the circuit nor
+// discards the pooled client.
+TEST_F(HTTPTest, ThrowingHandlerKeepsCircuitClosed) {
+    TestHTTPGetConnection conn;
+    ASSERT_TRUE(conn.Init().ok());
+    ASSERT_TRUE(conn.Execute([](const web::http::http_response &response) { return absl::OkStatus(); }).ok());
+
+    auto& pool = wastlernet::HttpClientPool::GetInstance();
+    size_t clients = pool.size();
+    for (int i = 0; i < 10; i++) {
+        auto st = conn.Execute([](const web::http::http_response &response) -> absl::Status {
+            throw std::runtime_error("malformed response");
+        });
+        EXPECT_EQ(st.code(), absl::StatusCode::kInternal) << st;
+    }
+    EXPECT_EQ(pool.size(), clients);
+
+    auto st = conn.Execute([](const web::http::http_response &response) { return absl::OkStatus(); });
+    EXPECT_TRUE(st.ok()) << st;
+}
+
+// Connections to the same endpoint share one pooled client, and with it its keep-alive connections.
+TEST_F(HTTPTest, SharesPooledClient) {
+    TestHTTPGetConnection get;
+    TestHTTPPostConnection post;
+    ASSERT_TRUE(get.Init().ok());
+    ASSERT_TRUE(post.Init().ok());
+
+    auto& pool = wastlernet::HttpClientPool::GetInstance();
+    size_t clients = pool.size();
+    auto handler = [](const web::http::http_response &response) { return absl::OkStatus(); };
+    ASSERT_TRUE(get.Execute(handler).ok());
+    ASSERT_TRUE(post.Execute(handler).ok());
+    EXPECT_EQ(pool.size(), clients);
+}
+
+TEST(HttpClientPoolTest, ReplacesIdleAndInvalidatedClients) {
+    wastlernet::HttpClientPool pool(std::chrono::milliseconds(50));
+    web::http::client::http_client_config insecure;
+    insecure.set_validate_certificates(false);
+
+    auto client = pool.Acquire(kAddress, {});
+    EXPECT_EQ(pool.Acquire(kAddress, {}), client);
+    EXPECT_NE(pool.Acquire(kAddress, insecure), client);
+    EXPECT_EQ(pool.size(), 2);
+
+    pool.Invalidate(client);
+    auto fresh = pool.Acquire(kAddress, {});
+    EXPECT_NE(fresh, client);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_NE(pool.Acquire(kAddress, {}), fresh);
+}
+
+// Changed credentials must not reuse a client (and its connections) authenticated with the old ones.
+TEST(HttpClientPoolTest, SeparatesClientsByCredentials) {
+    wastlernet::HttpClientPool pool;
+    web::http::client::http_client_config old_password, new_password;
+    old_password.set_credentials(web::credentials("admin", "old"));
+    new_password.set_credentials(web::credentials("admin", "new"));
+
+    auto client = pool.Acquire(kAddress, old_password);
+    EXPECT_EQ(pool.Acquire(kAddress, old_password), client);
+    EXPECT_NE(pool.Acquire(kAddress, new_password), client);
+    EXPECT_EQ(pool.size(), 2);
+}
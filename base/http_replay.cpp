@@ -0,0 +1,149 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "http_replay.h"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <absl/strings/str_cat.h>
+#include <glog/logging.h>
+
+using web::http::http_request;
+using web::http::http_response;
+using web::http::status_codes;
+using web::http::experimental::listener::http_listener;
+
+namespace wastlernet {
+    HttpReplayServer::HttpReplayServer(std::string address, HttpReplayOptions options)
+        : address_(std::move(address)), options_(std::move(options)), random_(options_.seed) { }
+
+    HttpReplayServer::~HttpReplayServer() {
+        Stop();
+    }
+
+    void HttpReplayServer::AddResponse(const std::string& path, std::string body, std::string content_type,
+                                       std::string etag) {
+        auto response = std::make_shared<const Response>(
+                Response{std::move(body), std::move(content_type), std::move(etag)});
+        absl::MutexLock lock(&mutex_);
+        responses_[path] = std::move(response);
+    }
+
+    absl::Status HttpReplayServer::AddFile(const std::string& path, const std::string& file,
+                                           std::string content_type) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) {
+            return absl::NotFoundError(absl::StrCat("Could not read recorded response ", file));
+        }
+        std::stringstream body;
+        body << in.rdbuf();
+        AddResponse(path, body.str(), std::move(content_type));
+        return absl::OkStatus();
+    }
+
+    absl::Status HttpReplayServer::Start() {
+        try {
+            listener_ = std::make_unique<http_listener>(address_);
+            listener_->support([this](const http_request& request) { Handle(request); });
+            listener_->open().get();
+        } catch (const std::exception& e) {
+            listener_ = nullptr;
+            return absl::UnavailableError(absl::StrCat("Could not listen on ", address_, ": ", e.what()));
+        }
+        return absl::OkStatus();
+    }
+
+    void HttpReplayServer::Stop() {
+        if (listener_ != nullptr) {
+            try {
+                listener_->close().get();
+            } catch (const std::exception& e) {
+                LOG(WARNING) << "Error while closing replay listener: " << e.what();
+            }
+            listener_ = nullptr;
+        }
+    }
+
+    void HttpReplayServer::SetFaults(std::chrono::microseconds latency, std::chrono::microseconds jitter,
+                                     double error_rate) {
+        absl::MutexLock lock(&mutex_);
+        options_.latency = latency;
+        options_.jitter = jitter;
+        options_.error_rate = error_rate;
+    }
+
+    int64_t HttpReplayServer::requests() {
+        absl::MutexLock lock(&mutex_);
+        return requests_;
+    }
+
+    void HttpReplayServer::Handle(const http_request& request) {
+        std::string path = request.relative_uri().path();
+        std::shared_ptr<const Response> response;
+        std::chrono::microseconds delay;
+        bool error;
+        std::function<void(const http_request&)> on_request;
+        {
+            absl::MutexLock lock(&mutex_);
+            auto it = responses_.find(path);
+            if (it == responses_.end()) {
+                request.reply(status_codes::NotFound, absl::StrCat("no recorded response for ", path), "text/plain");
+                return;
+            }
+            response = it->second;
+            requests_++;
+
+            delay = options_.latency;
+            if (options_.jitter.count() > 0) {
+                std::uniform_int_distribution<int64_t> jitter(0, options_.jitter.count());
+                delay += std::chrono::microseconds(jitter(random_));
+            }
+            error = std::uniform_real_distribution<double>(0, 1)(random_) < options_.error_rate;
+            on_request = options_.on_request;
+        }
+
+        if (on_request) {
+            on_request(request);
+        }
+        if (delay.count() > 0) {
+            std::this_thread::sleep_for(delay);
+        }
+        if (error) {
+            request.reply(status_codes::InternalError);
+        } else if (response->etag.empty()) {
+            request.reply(status_codes::OK, response->body, response->content_type);
+        } else {
+            http_response reply(status_codes::OK);
+            std::string if_none_match;
+            if (request.headers().match(web::http::header_names::if_none_match, if_none_match) &&
+                if_none_match == response->etag) {
+                reply.set_status_code(status_codes::NotModified);
+            } else {
+                reply.set_body(response->body, response->content_type);
+            }
+            reply.headers().add(web::http::header_names::etag, response->etag);
+            request.reply(reply);
+        }
+    }
+
+    absl::Status RecordResponse(HttpConnection& connection, const std::string& file) {
+        if (auto st = connection.Init(); !st.ok()) {
+            return st;
+        }
+        return connection.Execute([&file](const http_response& response) {
+            if (response.status_code() != status_codes::OK) {
+                return absl::UnavailableError(absl::StrCat("Device answered ", response.status_code(), " ",
+                                                           response.reason_phrase()));
+            }
+            std::string body = response.extract_utf8string(true).get();
+            std::ofstream out(file, std::ios::binary | std::ios::trunc);
+            out << body;
+            if (!out) {
+                return absl::InternalError(absl::StrCat("Could not write ", file));
+            }
+            LOG(INFO) << "Recorded " << body.size() << " bytes to " << file;
+            return absl::OkStatus();
+        });
+    }
+}
@@ -0,0 +1,140 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Recorded HTTP device responses for tests and benchmarks.
+//
+// A wastlernet::HttpReplayServer serves fixed responses per path from a local cpprest listener, so
+// that HTTP clients can be tested and benchmarked without the device, the HTTP counterpart of the
+// ModbusSimulator:
+//
+//   HttpReplayOptions options;
+//   options.latency = std::chrono::milliseconds(20);  // typical embedded web server
+//   options.error_rate = 0.01;                        // 1% of requests answered with 500
+//
+//   HttpReplayServer server("http://127.0.0.1:15040", options);
+//   RETURN_IF_ERROR(server.AddFile("/lala.cgi", "senec/testdata/lala.cgi.json", "application/json"));
+//   RETURN_IF_ERROR(server.Start());
+//
+// Responses are stored in the testdata/ directory of their module; a README there marks responses
+// that were not recorded from a real device. New ones are captured with RecordResponse(), which
+// issues the request of an initialized HttpConnection (with its credentials and request body) and
+// writes the response body to a file.
+//
+// Paths without a recorded response are answered with 404. Responses added with an ETag answer
+// conditional requests carrying it in If-None-Match with 304 (Not Modified), like devices
+// supporting them. With `error_rate`, requests are answered with 500 (Internal Server Error) at
+// random; timeouts are simulated with a `latency` beyond the client timeout.
+//
+// Thread-safety
+// All public methods are internally synchronized. Requests are answered concurrently on the
+// cpprest thread pool, so injected latency does not add up across clients.
+//
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <absl/container/flat_hash_map.h>
+#include <absl/status/status.h>
+#include <absl/synchronization/mutex.h>
+#include <cpprest/http_listener.h>
+#include <cpprest/http_msg.h>
+
+#include "base/http_connection.h"
+
+#ifndef WASTLERNET_HTTP_REPLAY_H
+#define WASTLERNET_HTTP_REPLAY_H
+namespace wastlernet {
+    struct HttpReplayOptions {
+        /** Server-side processing time added before each response, e.g. the CGI time of a device. */
+        std::chrono::microseconds latency{0};
+        /**
+         * Upper bound of a random extra delay per response, so that concurrent clients do not get
+         * their responses in lockstep.
+         */
+        std::chrono::microseconds jitter{0};
+        /** Fraction of requests answered with 500 (Internal Server Error) instead of the recorded body. */
+        double error_rate = 0;
+        /**
+         * Seed of the generator picking the delays and the 500 responses; the same seed and request
+         * order give the same sequence of answers.
+         */
+        uint32_t seed = 1;
+        /** Called for each request to a recorded path before it is answered, e.g. to check the body. */
+        std::function<void(const web::http::http_request&)> on_request;
+    };
+
+    class HttpReplayServer {
+    public:
+        /**
+         * @param address   URL to listen on, e.g. "http://127.0.0.1:15040".
+         * @param options   Latency and fault injection.
+         */
+        explicit HttpReplayServer(std::string address, HttpReplayOptions options = HttpReplayOptions());
+
+        /** Stops the listener if still running. */
+        ~HttpReplayServer();
+
+        HttpReplayServer(const HttpReplayServer&) = delete;
+        HttpReplayServer& operator=(const HttpReplayServer&) = delete;
+
+        /**
+         * Answer requests to `path` (e.g. "/lala.cgi", regardless of the query string) with `body`.
+         * With a non-empty `etag`, the response carries it, and requests sending it back in
+         * If-None-Match are answered with 304.
+         */
+        void AddResponse(const std::string& path, std::string body, std::string content_type = "application/json",
+                         std::string etag = "");
+
+        /** Like AddResponse(), with the body read from a recorded response file. */
+        absl::Status AddFile(const std::string& path, const std::string& file,
+                             std::string content_type = "application/json");
+
+        /** Open the listener. */
+        absl::Status Start();
+
+        /** Close the listener. */
+        void Stop();
+
+        /**
+         * Change latency, jitter and 500 rate for subsequent requests, e.g. to degrade the device in
+         * the middle of a run. Recorded responses and the on_request callback stay in place.
+         */
+        void SetFaults(std::chrono::microseconds latency, std::chrono::microseconds jitter, double error_rate);
+
+        /** Number of requests to recorded paths received so far. */
+        int64_t requests();
+
+        const std::string& address() const {
+            return address_;
+        }
+
+    private:
+        struct Response {
+            std::string body;
+            std::string content_type;
+            std::string etag;
+        };
+
+        std::string address_;
+        std::unique_ptr<web::http::experimental::listener::http_listener> listener_;
+
+        absl::Mutex mutex_;
+        HttpReplayOptions options_ ABSL_GUARDED_BY(mutex_);
+        std::mt19937 random_ ABSL_GUARDED_BY(mutex_);
+        // Responses are immutable once added and shared with requests being answered.
+        absl::flat_hash_map<std::string, std::shared_ptr<const Response>> responses_ ABSL_GUARDED_BY(mutex_);
+        int64_t requests_ ABSL_GUARDED_BY(mutex_) = 0;
+
+        void Handle(const web::http::http_request& request);
+    };
+
+    /**
+     * Issue the request of `connection` (initialized on demand) once and store the body of a 200
+     * response in `file`, for replay with HttpReplayServer::AddFile().
+     */
+    absl::Status RecordResponse(HttpConnection& connection, const std::string& file);
+}
+#endif //WASTLERNET_HTTP_REPLAY_H
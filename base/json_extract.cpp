@@ -0,0 +1,363 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "json_extract.h"
+
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <absl/strings/str_cat.h>
+
+namespace wastlernet {
+    namespace {
+        // Deeper documents are rejected instead of risking the stack; device responses nest < 10.
+        constexpr int kMaxDepth = 64;
+
+        bool ParseDouble(std::string_view raw, double* out) {
+            char buffer[64];
+            if (raw.empty() || raw.size() >= sizeof(buffer)) {
+                return false;
+            }
+            memcpy(buffer, raw.data(), raw.size());
+            buffer[raw.size()] = '\0';
+            char* end;
+            *out = strtod(buffer, &end);
+            return end != buffer;
+        }
+
+        void AppendUtf8(uint32_t cp, std::string* out) {
+            if (cp < 0x80) {
+                out->push_back(static_cast<char>(cp));
+            } else if (cp < 0x800) {
+                out->push_back(static_cast<char>(0xC0 | (cp >> 6)));
+                out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            } else if (cp < 0x10000) {
+                out->push_back(static_cast<char>(0xE0 | (cp >> 12)));
+                out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            } else {
+                out->push_back(static_cast<char>(0xF0 | (cp >> 18)));
+                out->push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+                out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+        }
+
+        bool ParseHex4(std::string_view s, size_t pos, uint32_t* out) {
+            if (pos + 4 > s.size()) {
+                return false;
+            }
+            auto [ptr, ec] = std::from_chars(s.data() + pos, s.data() + pos + 4, *out, 16);
+            return ec == std::errc() && ptr == s.data() + pos + 4;
+        }
+    }
+
+    double JsonSlot::AsDouble(double def) const {
+        double value;
+        if ((type == Type::kNumber || type == Type::kString) && ParseDouble(raw, &value)) {
+            return value;
+        }
+        return def;
+    }
+
+    int64_t JsonSlot::AsInt(int64_t def) const {
+        double value;
+        if ((type == Type::kNumber || type == Type::kString) && ParseDouble(raw, &value)) {
+            return static_cast<int64_t>(value);
+        }
+        return def;
+    }
+
+    bool JsonSlot::AsBool(bool def) const {
+        if (type == Type::kBool) {
+            return raw == "true";
+        }
+        if (type == Type::kNumber) {
+            return AsDouble() != 0;
+        }
+        return def;
+    }
+
+    std::string JsonSlot::AsString(std::string_view def) const {
+        if (type != Type::kString) {
+            return std::string(def);
+        }
+        if (raw.find('\\') == std::string_view::npos) {
+            return std::string(raw);
+        }
+
+        std::string result;
+        result.reserve(raw.size());
+        for (size_t i = 0; i < raw.size(); i++) {
+            if (raw[i] != '\\' || i + 1 == raw.size()) {
+                result.push_back(raw[i]);
+                continue;
+            }
+            char c = raw[++i];
+            switch (c) {
+                case 'b': result.push_back('\b'); break;
+                case 'f': result.push_back('\f'); break;
+                case 'n': result.push_back('\n'); break;
+                case 'r': result.push_back('\r'); break;
+                case 't': result.push_back('\t'); break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!ParseHex4(raw, i + 1, &cp)) {
+                        result.push_back(c);
+                        break;
+                    }
+                    i += 4;
+                    uint32_t low;
+                    if (cp >= 0xD800 && cp < 0xDC00 && i + 2 < raw.size() && raw[i + 1] == '\\' &&
+                        raw[i + 2] == 'u' && ParseHex4(raw, i + 3, &low) && low >= 0xDC00 && low < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    }
+                    AppendUtf8(cp, &result);
+                    break;
+                }
+                default: result.push_back(c); break; // \" \\ \/
+            }
+        }
+        return result;
+    }
+
+    JsonExtractor::JsonExtractor() : nodes_(1) { }
+
+    int JsonExtractor::Add(std::initializer_list<std::string_view> path) {
+        int node = 0;
+        for (std::string_view key : path) {
+            auto it = nodes_[node].children.find(absl::string_view(key.data(), key.size()));
+            if (it == nodes_[node].children.end()) {
+                int child = static_cast<int>(nodes_.size());
+                nodes_[node].children.emplace(std::string(key), child);
+                nodes_.emplace_back();
+                node = child;
+            } else {
+                node = it->second;
+            }
+        }
+        if (nodes_[node].slot < 0) {
+            nodes_[node].slot = static_cast<int>(slots_++);
+        }
+        return nodes_[node].slot;
+    }
+
+    // Recursive descent over the body, following the path trie of a JsonExtractor. Values below trie
+    // nodes are parsed; everything else is skipped by matching brackets and strings only.
+    class JsonScanner {
+    public:
+        JsonScanner(const JsonExtractor& extractor, std::string_view body, JsonSlot* slots)
+            : nodes_(extractor.nodes_), body_(body), slots_(slots) { }
+
+        absl::Status Run() {
+            if (!Value(0, 0)) {
+                return error_;
+            }
+            SkipWhitespace();
+            if (pos_ != body_.size()) {
+                Fail("trailing characters");
+                return error_;
+            }
+            return absl::OkStatus();
+        }
+
+    private:
+        const std::vector<JsonExtractor::Node>& nodes_;
+        std::string_view body_;
+        JsonSlot* slots_;
+        size_t pos_ = 0;
+        absl::Status error_;
+
+        bool Fail(const char* what) {
+            error_ = absl::InvalidArgumentError(absl::StrCat("invalid JSON at offset ", pos_, ": ", what));
+            return false;
+        }
+
+        void SkipWhitespace() {
+            while (pos_ < body_.size() &&
+                   (body_[pos_] == ' ' || body_[pos_] == '\n' || body_[pos_] == '\r' || body_[pos_] == '\t')) {
+                pos_++;
+            }
+        }
+
+        bool Expect(char c) {
+            SkipWhitespace();
+            if (pos_ == body_.size() || body_[pos_] != c) {
+                return Fail(pos_ == body_.size() ? "unexpected end" : "unexpected character");
+            }
+            pos_++;
+            return true;
+        }
+
+        // Positioned on the opening quote; `contents` excludes the quotes.
+        bool String(std::string_view* contents) {
+            size_t start = ++pos_;
+            while (pos_ < body_.size()) {
+                char c = body_[pos_];
+                if (c == '"') {
+                    *contents = body_.substr(start, pos_ - start);
+                    pos_++;
+                    return true;
+                }
+                pos_ += c == '\\' ? 2 : 1;
+            }
+            return Fail("unterminated string");
+        }
+
+        bool Scalar() {
+            size_t start = pos_;
+            while (pos_ < body_.size()) {
+                char c = body_[pos_];
+                if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+                    break;
+                }
+                pos_++;
+            }
+            return pos_ > start || Fail("unexpected character");
+        }
+
+        bool Skip() {
+            std::string_view ignored;
+            if (body_[pos_] == '"') {
+                return String(&ignored);
+            }
+            if (body_[pos_] != '{' && body_[pos_] != '[') {
+                return Scalar();
+            }
+            int depth = 0;
+            while (pos_ < body_.size()) {
+                char c = body_[pos_];
+                if (c == '"') {
+                    if (!String(&ignored)) {
+                        return false;
+                    }
+                    continue;
+                }
+                if (c == '{' || c == '[') {
+                    depth++;
+                } else if ((c == '}' || c == ']') && --depth == 0) {
+                    pos_++;
+                    return true;
+                }
+                pos_++;
+            }
+            return Fail("unexpected end");
+        }
+
+        int Child(int node, std::string_view key) const {
+            const auto& children = nodes_[node].children;
+            auto it = children.find(absl::string_view(key.data(), key.size()));
+            return it == children.end() ? -1 : it->second;
+        }
+
+        bool Object(int node, int depth) {
+            pos_++;
+            SkipWhitespace();
+            if (pos_ < body_.size() && body_[pos_] == '}') {
+                pos_++;
+                return true;
+            }
+            while (true) {
+                SkipWhitespace();
+                if (pos_ == body_.size() || body_[pos_] != '"') {
+                    return Fail("expected key");
+                }
+                std::string_view key;
+                if (!String(&key) || !Expect(':') || !Value(Child(node, key), depth + 1)) {
+                    return false;
+                }
+                SkipWhitespace();
+                if (pos_ < body_.size() && body_[pos_] == ',') {
+                    pos_++;
+                    continue;
+                }
+                return Expect('}');
+            }
+        }
+
+        bool Array(int node, int depth) {
+            pos_++;
+            SkipWhitespace();
+            if (pos_ < body_.size() && body_[pos_] == ']') {
+                pos_++;
+                return true;
+            }
+            for (int index = 0;; index++) {
+                int child = -1;
+                if (!nodes_[node].children.empty()) {
+                    char key[16];
+                    auto [end, ec] = std::to_chars(key, key + sizeof(key), index);
+                    child = Child(node, std::string_view(key, end - key));
+                }
+                if (!Value(child, depth + 1)) {
+                    return false;
+                }
+                SkipWhitespace();
+                if (pos_ < body_.size() && body_[pos_] == ',') {
+                    pos_++;
+                    continue;
+                }
+                return Expect(']');
+            }
+        }
+
+        bool Value(int node, int depth) {
+            SkipWhitespace();
+            if (pos_ == body_.size()) {
+                return Fail("unexpected end");
+            }
+            if (node < 0) {
+                return Skip();
+            }
+            if (depth > kMaxDepth) {
+                return Fail("nesting too deep");
+            }
+
+            size_t start = pos_;
+            JsonSlot value;
+            switch (body_[pos_]) {
+                case '{':
+                    value.type = JsonSlot::Type::kObject;
+                    if (!Object(node, depth)) return false;
+                    break;
+                case '[':
+                    value.type = JsonSlot::Type::kArray;
+                    if (!Array(node, depth)) return false;
+                    break;
+                case '"':
+                    value.type = JsonSlot::Type::kString;
+                    if (!String(&value.raw)) return false;
+                    break;
+                default:
+                    if (!Scalar()) return false;
+                    value.raw = body_.substr(start, pos_ - start);
+                    if (value.raw == "true" || value.raw == "false") {
+                        value.type = JsonSlot::Type::kBool;
+                    } else if (value.raw == "null") {
+                        value.type = JsonSlot::Type::kNull;
+                    } else if (value.raw[0] == '-' || (value.raw[0] >= '0' && value.raw[0] <= '9')) {
+                        value.type = JsonSlot::Type::kNumber;
+                    } else {
+                        pos_ = start;
+                        return Fail("unexpected character");
+                    }
+                    break;
+            }
+
+            int slot = nodes_[node].slot;
+            if (slot >= 0) {
+                if (value.raw.empty() && value.type != JsonSlot::Type::kString) {
+                    value.raw = body_.substr(start, pos_ - start);
+                }
+                slots_[slot] = value;
+            }
+            return true;
+        }
+    };
+
+    absl::Status JsonExtractor::Extract(std::string_view body, JsonSlots* slots) const {
+        slots->assign(slots_, JsonSlot());
+        return JsonScanner(*this, body, slots->data()).Run();
+    }
+}
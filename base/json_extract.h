@@ -0,0 +1,106 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Path-based streaming JSON extraction.
+//
+// The device clients only need a handful of fields out of each response, e.g. P_PV from the Fronius
+// Body.Data.Site object or the PM1OBJ1.U_AC array of a Senec response. Parsing the full body into a
+// web::json::value allocates a node (and a string) for every element of the document, only to look
+// up those few fields afterwards.
+//
+// A wastlernet::JsonExtractor instead is set up once with the paths a client needs. Extract() then
+// makes a single pass over the body and fills one JsonSlot per path, without building a DOM:
+// subtrees outside of the declared paths are skipped without looking at their keys, and the slots
+// only point into the body buffer. Typical use:
+//
+//   struct SiteFields {
+//       wastlernet::JsonExtractor json;
+//       int p_pv = json.Add({"Body", "Data", "Site", "P_PV"});
+//   };
+//
+//   static const SiteFields fields;
+//   wastlernet::JsonSlots slots;
+//   RETURN_IF_ERROR(fields.json.Extract(body, &slots));
+//   double p_pv = slots[fields.p_pv].AsDouble();
+//
+// Array elements are addressed by their decimal index ("0", "1", ...). A path may also end at an
+// object or array, whose slot then covers its raw JSON text (e.g. to check that it is present).
+// Keys are compared with their raw (still escaped) text, which is what all device APIs use.
+//
+// Thread-safety
+// Add() must not be called concurrently with anything else. Extract() is const and may be called
+// concurrently once all paths are added.
+//
+#pragma once
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/inlined_vector.h>
+#include <absl/status/status.h>
+
+#ifndef WASTLERNET_JSON_EXTRACT_H
+#define WASTLERNET_JSON_EXTRACT_H
+namespace wastlernet {
+    /** Value found at one path of a JsonExtractor. Points into the extracted body. */
+    struct JsonSlot {
+        enum class Type { kMissing, kNull, kBool, kNumber, kString, kObject, kArray };
+
+        Type type = Type::kMissing;
+
+        // Number or literal text, string contents without the quotes (escapes not decoded), or the
+        // complete text of an object or array.
+        std::string_view raw;
+
+        bool present() const { return type != Type::kMissing; }
+
+        /** The number, or a string holding a number (as sent by some firmwares); `def` otherwise. */
+        double AsDouble(double def = 0.0) const;
+
+        /** Like AsDouble, truncated to an integer. */
+        int64_t AsInt(int64_t def = 0) const;
+
+        /** Boolean literals; numbers are true when non-zero. */
+        bool AsBool(bool def = false) const;
+
+        /** The decoded string (escapes resolved), or `def` if the value is not a string. */
+        std::string AsString(std::string_view def = "") const;
+    };
+
+    // Enough for all device clients without touching the heap.
+    using JsonSlots = absl::InlinedVector<JsonSlot, 48>;
+
+    class JsonExtractor {
+    public:
+        JsonExtractor();
+
+        /**
+         * Declare a path (object keys and array indexes from the document root) and return its slot
+         * index. Adding the same path twice returns the same slot.
+         */
+        int Add(std::initializer_list<std::string_view> path);
+
+        /** Number of slots, i.e. distinct paths added. */
+        size_t size() const { return slots_; }
+
+        /**
+         * Parse `body` in one pass and fill `slots` (resized to size()) with the values of all added
+         * paths. Paths not present in the document are left kMissing. Returns InvalidArgument if the
+         * body is not well-formed JSON.
+         */
+        absl::Status Extract(std::string_view body, JsonSlots* slots) const;
+
+    private:
+        struct Node {
+            absl::flat_hash_map<std::string, int> children;
+            int slot = -1;
+        };
+
+        std::vector<Node> nodes_;
+        size_t slots_ = 0;
+
+        friend class JsonScanner;
+    };
+}
+#endif //WASTLERNET_JSON_EXTRACT_H
@@ -0,0 +1,105 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include <cmath>
+#include <gtest/gtest.h>
+
+#include "json_extract.h"
+
+using wastlernet::JsonExtractor;
+using wastlernet::JsonSlot;
+using wastlernet::JsonSlots;
+
+constexpr char kFronius[] = R"({
+  "Body" : {
+    "Data" : {
+      "Inverters" : { "1" : { "DT" : 1, "P" : 2351.5, "Battery_Mode" : "normal" } },
+      "Site" : {
+        "Mode" : "bidirectional",
+        "P_Akku" : -1200.25,
+        "P_Grid" : 12.5,
+        "P_Load" : "-1164.2",
+        "P_PV" : 2351.5e0,
+        "rel_Autonomy" : null
+      }
+    }
+  },
+  "Head" : { "RequestArguments" : {}, "Status" : { "Code" : 0, "Reason" : "", "UserMessage" : "" } }
+})";
+
+TEST(JsonExtractTest, ExtractsDeclaredPaths) {
+    JsonExtractor json;
+    int p_pv = json.Add({"Body", "Data", "Site", "P_PV"});
+    int p_load = json.Add({"Body", "Data", "Site", "P_Load"});
+    int p_akku = json.Add({"Body", "Data", "Site", "P_Akku"});
+    int mode = json.Add({"Body", "Data", "Site", "Mode"});
+    int autonomy = json.Add({"Body", "Data", "Site", "rel_Autonomy"});
+    int missing = json.Add({"Body", "Data", "Site", "E_Total"});
+    int site = json.Add({"Body", "Data", "Site"});
+    int code = json.Add({"Head", "Status", "Code"});
+    EXPECT_EQ(json.Add({"Body", "Data", "Site", "P_PV"}), p_pv);
+    EXPECT_EQ(json.size(), 8);
+
+    JsonSlots slots;
+    ASSERT_TRUE(json.Extract(kFronius, &slots).ok());
+    ASSERT_EQ(slots.size(), 8);
+
+    EXPECT_EQ(slots[p_pv].type, JsonSlot::Type::kNumber);
+    EXPECT_DOUBLE_EQ(slots[p_pv].AsDouble(), 2351.5);
+    EXPECT_DOUBLE_EQ(slots[p_load].AsDouble(), -1164.2);  // numeric string
+    EXPECT_DOUBLE_EQ(slots[p_akku].AsDouble(), -1200.25);
+    EXPECT_EQ(slots[mode].AsString(), "bidirectional");
+    EXPECT_EQ(slots[autonomy].type, JsonSlot::Type::kNull);
+    EXPECT_TRUE(std::isnan(slots[autonomy].AsDouble(NAN)));
+    EXPECT_FALSE(slots[missing].present());
+    EXPECT_DOUBLE_EQ(slots[missing].AsDouble(-1), -1);
+    EXPECT_EQ(slots[site].type, JsonSlot::Type::kObject);
+    EXPECT_EQ(slots[site].raw.front(), '{');
+    EXPECT_EQ(slots[site].raw.back(), '}');
+    EXPECT_EQ(slots[code].AsInt(-1), 0);
+}
+
+TEST(JsonExtractTest, IndexesArrays) {
+    JsonExtractor json;
+    int first = json.Add({"PM1OBJ1", "U_AC", "0"});
+    int third = json.Add({"PM1OBJ1", "U_AC", "2"});
+    int fourth = json.Add({"PM1OBJ1", "U_AC", "3"});
+    int nested = json.Add({"Body", "Data", "0", "Controller", "Voltage_DC"});
+
+    JsonSlots slots;
+    ASSERT_TRUE(json.Extract(R"({"Body":{"Data":[{"Controller":{"Voltage_DC":52.1}},{}]},
+                                 "skip":[[1,2],{"a":"]}"}],
+                                 "PM1OBJ1":{"U_AC":["fl_436C0000","fl_436CE667","fl_436D199A"]}})",
+                             &slots).ok());
+    EXPECT_EQ(slots[first].AsString(), "fl_436C0000");
+    EXPECT_EQ(slots[third].AsString(), "fl_436D199A");
+    EXPECT_FALSE(slots[fourth].present());
+    EXPECT_DOUBLE_EQ(slots[nested].AsDouble(), 52.1);
+}
+
+TEST(JsonExtractTest, DecodesStringsAndLiterals) {
+    JsonExtractor json;
+    int text = json.Add({"text"});
+    int on = json.Add({"params", "switch:0", "output"});
+    int lux = json.Add({"params", "illuminance:0", "lux"});
+
+    JsonSlots slots;
+    ASSERT_TRUE(json.Extract(R"({"text":"a\"b\\c\u00e4\ud83d\ude00","params":{"switch:0":{"output":true},
+                                 "illuminance:0":{"lux":312}}})",
+                             &slots).ok());
+    EXPECT_EQ(slots[text].AsString(), "a\"b\\c\xC3\xA4\xF0\x9F\x98\x80");
+    EXPECT_TRUE(slots[on].AsBool());
+    EXPECT_EQ(slots[lux].AsInt(), 312);
+    EXPECT_EQ(slots[lux].AsString("none"), "none");
+}
+
+TEST(JsonExtractTest, RejectsMalformedBodies) {
+    JsonExtractor json;
+    json.Add({"a", "b"});
+
+    JsonSlots slots;
+    for (const char* body : {"", "{", R"({"a":})", R"({"a":{"b":1})", R"({"a":"x)", R"({"a":1} x)",
+                             R"({"a":{"b":1,}})", R"({"x":[1,2})", R"({"a":{"b":nope}})"}) {
+        EXPECT_EQ(json.Extract(body, &slots).code(), absl::StatusCode::kInvalidArgument) << body;
+    }
+}
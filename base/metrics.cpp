@@ -11,7 +11,7 @@ WastlernetMetrics::WastlernetMetrics()
   // Initialize families
   queries_total_family_ = &prometheus::BuildCounter()
       .Name("wastlernet_queries_total")
-      .Help("Number of queries to different services, labeled by result (ok/error).")
+      .Help("Number of queries to different services, labeled by result (ok/error/deadline_exceeded).")
       .Register(*registry_);
 
   query_latency_seconds_family_ = &prometheus::BuildHistogram()
@@ -24,6 +24,41 @@ WastlernetMetrics::WastlernetMetrics()
       .Help("Number of updates received from devices, labeled by service and device.")
       .Register(*registry_);
 
+  circuit_breaker_state_family_ = &prometheus::BuildGauge()
+      .Name("wastlernet_circuit_breaker_state")
+      .Help("State of the circuit breaker guarding a device connection (0 = closed, 1 = open, 2 = half-open).")
+      .Register(*registry_);
+
+  modbus_bus_busy_seconds_family_ = &prometheus::BuildCounter()
+      .Name("wastlernet_modbus_bus_busy_seconds_total")
+      .Help("Time a shared Modbus bus spent executing requests in seconds; its rate is the bus utilisation.")
+      .Register(*registry_);
+
+  modbus_bus_queue_depth_family_ = &prometheus::BuildGauge()
+      .Name("wastlernet_modbus_bus_queue_depth")
+      .Help("Number of requests waiting for a shared Modbus bus.")
+      .Register(*registry_);
+
+  modbus_register_cache_family_ = &prometheus::BuildCounter()
+      .Name("wastlernet_modbus_register_cache_total")
+      .Help("Cacheable Modbus registers served from the register cache (hit) or read from the device (miss).")
+      .Register(*registry_);
+
+  http_pool_requests_family_ = &prometheus::BuildCounter()
+      .Name("wastlernet_http_pool_requests_total")
+      .Help("HTTP requests issued through the shared client pool, on a reused client or a new one (new connection).")
+      .Register(*registry_);
+
+  http_responses_family_ = &prometheus::BuildCounter()
+      .Name("wastlernet_http_responses_total")
+      .Help("Current responses of polled HTTP endpoints, with a changed body or an unchanged one (incl. 304 Not Modified).")
+      .Register(*registry_);
+
+  http_last_response_family_ = &prometheus::BuildGauge()
+      .Name("wastlernet_http_last_response_timestamp_seconds")
+      .Help("Unix time of the last current response of a polled HTTP endpoint, changed or not.")
+      .Register(*registry_);
+
   // Increment app starts gauge/counter
   prometheus::BuildCounter()
       .Name("wastlernet_app_starts_total")
@@ -66,6 +101,7 @@ WastlernetMetrics::QueryChildren& WastlernetMetrics::GetOrCreateChildren(const s
   QueryChildren children;
   children.ok_counter = &queries_total_family_->Add({{"service", service}, {"result", "ok"}});
   children.error_counter = &queries_total_family_->Add({{"service", service}, {"result", "error"}});
+  children.deadline_exceeded_counter = &queries_total_family_->Add({{"service", service}, {"result", "deadline_exceeded"}});
   children.latency = &query_latency_seconds_family_->Add({{"service", service}}, buckets_.latency_seconds);
 
   auto [insert_it, _] = by_service_.emplace(service, children);
@@ -77,6 +113,17 @@ void WastlernetMetrics::RecordQueryResult(const std::string& service, bool ok) {
   if (ok) c.ok_counter->Increment(); else c.error_counter->Increment();
 }
 
+void WastlernetMetrics::RecordQueryStatus(const std::string& service, const absl::Status& st) {
+  auto& c = GetOrCreateChildren(service);
+  if (st.ok()) {
+    c.ok_counter->Increment();
+  } else if (absl::IsDeadlineExceeded(st)) {
+    c.deadline_exceeded_counter->Increment();
+  } else {
+    c.error_counter->Increment();
+  }
+}
+
 void WastlernetMetrics::ObserveQueryLatency(const std::string& service, double seconds) {
   auto& c = GetOrCreateChildren(service);
   c.latency->Observe(seconds);
@@ -99,6 +146,86 @@ void WastlernetMetrics::RecordDeviceUpdate(const std::string& service, const std
   ctr->Increment();
 }
 
+void WastlernetMetrics::SetCircuitBreakerState(const std::string& connection, int state) {
+  absl::MutexLock lock(&mu_);
+  auto it = circuit_breaker_gauges_.find(connection);
+  prometheus::Gauge* gauge = nullptr;
+  if (it != circuit_breaker_gauges_.end()) {
+    gauge = it->second;
+  } else {
+    gauge = &circuit_breaker_state_family_->Add({{"connection", connection}});
+    circuit_breaker_gauges_.emplace(connection, gauge);
+  }
+  gauge->Set(state);
+}
+
+void WastlernetMetrics::RecordModbusBusBusy(const std::string& gateway, double seconds) {
+  absl::MutexLock lock(&mu_);
+  auto it = modbus_bus_busy_counters_.find(gateway);
+  prometheus::Counter* ctr = nullptr;
+  if (it != modbus_bus_busy_counters_.end()) {
+    ctr = it->second;
+  } else {
+    ctr = &modbus_bus_busy_seconds_family_->Add({{"gateway", gateway}});
+    modbus_bus_busy_counters_.emplace(gateway, ctr);
+  }
+  ctr->Increment(seconds);
+}
+
+void WastlernetMetrics::SetModbusBusQueueDepth(const std::string& gateway, int depth) {
+  absl::MutexLock lock(&mu_);
+  auto it = modbus_bus_queue_gauges_.find(gateway);
+  prometheus::Gauge* gauge = nullptr;
+  if (it != modbus_bus_queue_gauges_.end()) {
+    gauge = it->second;
+  } else {
+    gauge = &modbus_bus_queue_depth_family_->Add({{"gateway", gateway}});
+    modbus_bus_queue_gauges_.emplace(gateway, gauge);
+  }
+  gauge->Set(depth);
+}
+
+void WastlernetMetrics::RecordModbusRegisterCache(const std::string& connection, int hits, int misses) {
+  absl::MutexLock lock(&mu_);
+  auto it = modbus_register_cache_counters_.find(connection);
+  if (it == modbus_register_cache_counters_.end()) {
+    it = modbus_register_cache_counters_.emplace(connection, std::make_pair(
+        &modbus_register_cache_family_->Add({{"connection", connection}, {"result", "hit"}}),
+        &modbus_register_cache_family_->Add({{"connection", connection}, {"result", "miss"}}))).first;
+  }
+  it->second.first->Increment(hits);
+  it->second.second->Increment(misses);
+}
+
+void WastlernetMetrics::RecordHttpPoolRequest(const std::string& endpoint, bool reused) {
+  const char* connection = reused ? "reused" : "new";
+  std::string key = endpoint + "|" + connection;
+  absl::MutexLock lock(&mu_);
+  auto it = http_pool_request_counters_.find(key);
+  prometheus::Counter* ctr = nullptr;
+  if (it != http_pool_request_counters_.end()) {
+    ctr = it->second;
+  } else {
+    ctr = &http_pool_requests_family_->Add({{"endpoint", endpoint}, {"connection", connection}});
+    http_pool_request_counters_.emplace(key, ctr);
+  }
+  ctr->Increment();
+}
+
+void WastlernetMetrics::RecordHttpResponse(const std::string& connection, bool changed) {
+  absl::MutexLock lock(&mu_);
+  auto it = http_response_children_.find(connection);
+  if (it == http_response_children_.end()) {
+    HttpResponseChildren children;
+    children.changed = &http_responses_family_->Add({{"connection", connection}, {"body", "changed"}});
+    children.unchanged = &http_responses_family_->Add({{"connection", connection}, {"body", "unchanged"}});
+    children.last_response = &http_last_response_family_->Add({{"connection", connection}});
+    it = http_response_children_.emplace(connection, children).first;
+  }
+  (changed ? it->second.changed : it->second.unchanged)->Increment();
+  it->second.last_response->SetToCurrentTime();
+}
+
 WastlernetMetrics::ScopedQueryTimer::~ScopedQueryTimer() {
   const auto end = Clock::now();
   const double seconds = std::chrono::duration<double>(end - start_).count();
@@ -7,12 +7,14 @@
 #include <prometheus/counter.h>
 #include <prometheus/histogram.h>
 #include <prometheus/gauge.h>
+#include <absl/status/status.h>
 #include <absl/synchronization/mutex.h>
 #include <chrono>
 #include <memory>
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #ifndef METRICS_H
@@ -43,6 +45,10 @@ public:
     // Record a query outcome (increments counter with result label)
     void RecordQueryResult(const std::string& service, bool ok);
 
+    // Record a query outcome from its status; deadline-exceeded queries are counted separately
+    // under result="deadline_exceeded" so that slow devices can be told apart from failing ones.
+    void RecordQueryStatus(const std::string& service, const absl::Status& st);
+
     // Observe a query latency in seconds (histogram)
     void ObserveQueryLatency(const std::string& service, double seconds);
 
@@ -50,6 +56,32 @@ public:
     // Exposes Prometheus counter: wastlernet_device_updates_total{service="...", device="..."}
     void RecordDeviceUpdate(const std::string& service, const std::string& device);
 
+    // Set the state of a connection's circuit breaker (0 = closed, 1 = open, 2 = half-open)
+    // Exposes Prometheus gauge: wastlernet_circuit_breaker_state{connection="..."}
+    void SetCircuitBreakerState(const std::string& connection, int state);
+
+    // Account time a shared Modbus bus spent executing requests; rate() of the counter is the bus utilisation.
+    // Exposes Prometheus counter: wastlernet_modbus_bus_busy_seconds_total{gateway="..."}
+    void RecordModbusBusBusy(const std::string& gateway, double seconds);
+
+    // Set the number of requests waiting for a shared Modbus bus.
+    // Exposes Prometheus gauge: wastlernet_modbus_bus_queue_depth{gateway="..."}
+    void SetModbusBusQueueDepth(const std::string& gateway, int depth);
+
+    // Count Modbus registers served from the register cache (hits) or read from the device although cacheable (misses).
+    // Exposes Prometheus counter: wastlernet_modbus_register_cache_total{connection="...", result="hit|miss"}
+    void RecordModbusRegisterCache(const std::string& connection, int hits, int misses);
+
+    // Count an HTTP request issued through the shared client pool, on a reused or a new client.
+    // Exposes Prometheus counter: wastlernet_http_pool_requests_total{endpoint="...", connection="reused|new"}
+    void RecordHttpPoolRequest(const std::string& endpoint, bool reused);
+
+    // Record a current response of a polled HTTP endpoint, with a changed body or an unchanged one (or 304), and
+    // refresh its freshness timestamp.
+    // Exposes Prometheus counter: wastlernet_http_responses_total{connection="...", body="changed|unchanged"}
+    // and gauge: wastlernet_http_last_response_timestamp_seconds{connection="..."}
+    void RecordHttpResponse(const std::string& connection, bool changed);
+
     // RAII helper to time a scope and optionally record result on destruction
     class ScopedQueryTimer {
     public:
@@ -85,6 +117,7 @@ private:
     struct QueryChildren {
         prometheus::Counter* ok_counter = nullptr;    // queries_total{result="ok"}
         prometheus::Counter* error_counter = nullptr; // queries_total{result="error"}
+        prometheus::Counter* deadline_exceeded_counter = nullptr; // queries_total{result="deadline_exceeded"}
         prometheus::Histogram* latency = nullptr;     // query_latency_seconds
     };
 
@@ -97,12 +130,40 @@ private:
     std::unique_ptr<prometheus::Exposer> exposer_;
     BucketsConfig buckets_;
 
-    prometheus::Family<prometheus::Counter>* queries_total_family_; // labels: service, result
+    prometheus::Family<prometheus::Counter>* queries_total_family_; // labels: service, result (ok/error/deadline_exceeded)
     prometheus::Family<prometheus::Histogram>* query_latency_seconds_family_; // label: service
     prometheus::Family<prometheus::Counter>* device_updates_total_family_; // labels: service, device
+    prometheus::Family<prometheus::Gauge>* circuit_breaker_state_family_; // label: connection
+    prometheus::Family<prometheus::Counter>* modbus_bus_busy_seconds_family_; // label: gateway
+    prometheus::Family<prometheus::Gauge>* modbus_bus_queue_depth_family_; // label: gateway
+    prometheus::Family<prometheus::Counter>* modbus_register_cache_family_; // labels: connection, result (hit/miss)
+    prometheus::Family<prometheus::Counter>* http_pool_requests_family_; // labels: endpoint, connection (reused/new)
+    prometheus::Family<prometheus::Counter>* http_responses_family_; // labels: connection, body (changed/unchanged)
+    prometheus::Family<prometheus::Gauge>* http_last_response_family_; // label: connection
 
     // Cache for device counters to avoid duplicate Add() calls with same labels
     std::unordered_map<std::string, prometheus::Counter*> device_updates_counters_ ABSL_GUARDED_BY(mu_);
+
+    // Cache for circuit breaker gauges, keyed by connection
+    std::unordered_map<std::string, prometheus::Gauge*> circuit_breaker_gauges_ ABSL_GUARDED_BY(mu_);
+
+    // Caches for Modbus bus metrics, keyed by gateway
+    std::unordered_map<std::string, prometheus::Counter*> modbus_bus_busy_counters_ ABSL_GUARDED_BY(mu_);
+    std::unordered_map<std::string, prometheus::Gauge*> modbus_bus_queue_gauges_ ABSL_GUARDED_BY(mu_);
+
+    // Cache for Modbus register cache counters, keyed by connection; first = hits, second = misses
+    std::unordered_map<std::string, std::pair<prometheus::Counter*, prometheus::Counter*>> modbus_register_cache_counters_ ABSL_GUARDED_BY(mu_);
+
+    // Cache for HTTP pool counters, keyed by "endpoint|reused" / "endpoint|new"
+    std::unordered_map<std::string, prometheus::Counter*> http_pool_request_counters_ ABSL_GUARDED_BY(mu_);
+
+    // Cache for HTTP response metrics, keyed by connection
+    struct HttpResponseChildren {
+        prometheus::Counter* changed = nullptr;
+        prometheus::Counter* unchanged = nullptr;
+        prometheus::Gauge* last_response = nullptr;
+    };
+    std::unordered_map<std::string, HttpResponseChildren> http_response_children_ ABSL_GUARDED_BY(mu_);
 };
 }
 
@@ -0,0 +1,491 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "modbus_async.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <absl/strings/str_cat.h>
+#include <glog/logging.h>
+
+namespace wastlernet {
+    namespace {
+        constexpr uint8_t kReadHoldingRegisters = 0x03;
+        constexpr uint8_t kWriteMultipleRegisters = 0x10;
+        constexpr uint8_t kExceptionFlag = 0x80;
+
+        // Request limits of the Modbus specification.
+        constexpr int kMaxReadRegisters = 125;
+        constexpr int kMaxWriteRegisters = 123;
+
+        // MBAP header: transaction id, protocol id, length (2 bytes each) and unit id.
+        constexpr size_t kHeaderSize = 7;
+        constexpr size_t kMaxPduSize = 253;
+
+        void AppendUInt16(std::string* s, uint16_t v) {
+            s->push_back(static_cast<char>(v >> 8));
+            s->push_back(static_cast<char>(v & 0xFF));
+        }
+
+        uint16_t ReadUInt16(const uint8_t* p) {
+            return static_cast<uint16_t>((p[0] << 8) | p[1]);
+        }
+
+        absl::StatusOr<ModbusRegisters> DecodeResponse(uint8_t function, int count, const uint8_t* pdu,
+                                                       size_t size, const std::string& name) {
+            if (size >= 2 && pdu[0] == (function | kExceptionFlag)) {
+                return absl::InternalError(absl::StrCat("Modbus exception ", pdu[1], " from ", name));
+            }
+            if (size < 1 || pdu[0] != function) {
+                return absl::InternalError(absl::StrCat("Unexpected Modbus response from ", name));
+            }
+            if (function != kReadHoldingRegisters) {
+                return ModbusRegisters();
+            }
+            if (size < 2 || pdu[1] != 2 * count || size < 2 + 2 * static_cast<size_t>(count)) {
+                return absl::InternalError(absl::StrCat("Could not retrieve all registers from ", name));
+            }
+            ModbusRegisters values(count);
+            for (int i = 0; i < count; i++) {
+                values[i] = ReadUInt16(pdu + 2 + 2 * i);
+            }
+            return values;
+        }
+    }
+
+    ModbusEventLoop::~ModbusEventLoop() {
+        stopping_ = true;
+        if (thread_.joinable()) {
+            Wake();
+            thread_.join();
+        }
+        for (int fd : {epoll_fd_, wake_fd_}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    absl::Status ModbusEventLoop::Init() {
+        if (thread_.joinable()) {
+            return absl::OkStatus();
+        }
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ < 0) {
+            return absl::InternalError(absl::StrCat("Could not create epoll instance: ", strerror(errno)));
+        }
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd_ < 0) {
+            return absl::InternalError(absl::StrCat("Could not create eventfd: ", strerror(errno)));
+        }
+        struct epoll_event ev {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) != 0) {
+            return absl::InternalError(absl::StrCat("Could not watch eventfd: ", strerror(errno)));
+        }
+
+        thread_ = std::thread(&ModbusEventLoop::Run, this);
+        return absl::OkStatus();
+    }
+
+    void ModbusEventLoop::Add(AsyncModbusConnection* conn) {
+        absl::MutexLock lock(&mutex_);
+        connections_.insert(conn);
+    }
+
+    void ModbusEventLoop::Remove(AsyncModbusConnection* conn) {
+        absl::MutexLock lock(&mutex_);
+        connections_.erase(conn);
+    }
+
+    void ModbusEventLoop::Watch(int fd, AsyncModbusConnection* conn, uint32_t events, bool add) {
+        struct epoll_event ev {};
+        ev.events = events;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epoll_fd_, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev) != 0) {
+            LOG(ERROR) << "Could not watch Modbus connection " << conn->name() << ": " << strerror(errno);
+        }
+    }
+
+    void ModbusEventLoop::Wake() {
+        uint64_t one = 1;
+        (void)!write(wake_fd_, &one, sizeof(one));
+    }
+
+    void ModbusEventLoop::Run() {
+        struct epoll_event events[16];
+        int timeout_ms = -1;
+        while (!stopping_) {
+            int n = epoll_wait(epoll_fd_, events, 16, timeout_ms);
+            if (n < 0) {
+                if (errno != EINTR) {
+                    LOG(ERROR) << "Error waiting for Modbus events: " << strerror(errno);
+                    return;
+                }
+                n = 0;
+            }
+
+            // Completed requests are collected while the connections are served and their callbacks
+            // run once the lock is released: a callback may add or remove connections.
+            AsyncModbusConnection::Completions done;
+            {
+                absl::MutexLock lock(&mutex_);
+                for (int i = 0; i < n; i++) {
+                    auto* conn = static_cast<AsyncModbusConnection*>(events[i].data.ptr);
+                    if (conn == nullptr) {
+                        uint64_t value;
+                        (void)!read(wake_fd_, &value, sizeof(value));
+                    } else if (connections_.contains(conn)) {
+                        conn->OnEvent(events[i].events, &done);
+                    }
+                }
+
+                auto now = Deadline::Clock::now();
+                auto next = Deadline::Clock::time_point::max();
+                for (auto* conn : connections_) {
+                    next = std::min(next, conn->Expire(now, &done));
+                }
+                if (next == Deadline::Clock::time_point::max()) {
+                    timeout_ms = -1;
+                } else {
+                    auto wait = std::chrono::ceil<std::chrono::milliseconds>(next - now).count();
+                    timeout_ms = static_cast<int>(std::min<int64_t>(wait, std::numeric_limits<int>::max()));
+                }
+            }
+            AsyncModbusConnection::RunCallbacks(done);
+        }
+    }
+
+    AsyncModbusConnection::AsyncModbusConnection(ModbusEventLoop* loop, const std::string& host, int16_t port,
+                                                 int max_in_flight)
+        : loop_(loop), host_(host), port_(port), max_in_flight_(std::max(max_in_flight, 1)),
+          name_(absl::StrCat(host, ":", port)) { }
+
+    AsyncModbusConnection::~AsyncModbusConnection() {
+        loop_->Remove(this);
+
+        Completions done;
+        {
+            absl::MutexLock lock(&mutex_);
+            Fail(absl::CancelledError(absl::StrCat("Modbus connection ", name_, " closed")), &done);
+        }
+        RunCallbacks(done);
+    }
+
+    absl::Status AsyncModbusConnection::Init() {
+        struct addrinfo hints {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* result = nullptr;
+        int rc = getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &result);
+        if (rc != 0) {
+            return absl::UnavailableError(absl::StrCat("Could not resolve ", host_, ": ", gai_strerror(rc)));
+        }
+        {
+            absl::MutexLock lock(&mutex_);
+            std::memcpy(&addr_, result->ai_addr, result->ai_addrlen);
+            addr_len_ = result->ai_addrlen;
+        }
+        freeaddrinfo(result);
+
+        loop_->Add(this);
+        return absl::OkStatus();
+    }
+
+    void AsyncModbusConnection::ReadRegisters(int unit_id, int address, int count, const Deadline& deadline,
+                                              Callback callback) {
+        if (count < 1 || count > kMaxReadRegisters) {
+            callback(absl::InvalidArgumentError(absl::StrCat("Cannot read ", count, " registers")));
+            return;
+        }
+        std::string pdu;
+        pdu.push_back(static_cast<char>(kReadHoldingRegisters));
+        AppendUInt16(&pdu, address);
+        AppendUInt16(&pdu, count);
+        Submit(unit_id, kReadHoldingRegisters, pdu, count, deadline, std::move(callback));
+    }
+
+    std::future<absl::StatusOr<ModbusRegisters>> AsyncModbusConnection::ReadRegisters(
+            int unit_id, int address, int count, const Deadline& deadline) {
+        auto promise = std::make_shared<std::promise<absl::StatusOr<ModbusRegisters>>>();
+        auto future = promise->get_future();
+        ReadRegisters(unit_id, address, count, deadline, [promise](absl::StatusOr<ModbusRegisters> result) {
+            promise->set_value(std::move(result));
+        });
+        return future;
+    }
+
+    void AsyncModbusConnection::WriteRegisters(int unit_id, int address, const ModbusRegisters& values,
+                                               const Deadline& deadline, Callback callback) {
+        if (values.empty() || values.size() > kMaxWriteRegisters) {
+            callback(absl::InvalidArgumentError(absl::StrCat("Cannot write ", values.size(), " registers")));
+            return;
+        }
+        std::string pdu;
+        pdu.push_back(static_cast<char>(kWriteMultipleRegisters));
+        AppendUInt16(&pdu, address);
+        AppendUInt16(&pdu, values.size());
+        pdu.push_back(static_cast<char>(2 * values.size()));
+        for (uint16_t v : values) {
+            AppendUInt16(&pdu, v);
+        }
+        Submit(unit_id, kWriteMultipleRegisters, pdu, 0, deadline, std::move(callback));
+    }
+
+    std::future<absl::StatusOr<ModbusRegisters>> AsyncModbusConnection::WriteRegisters(
+            int unit_id, int address, const ModbusRegisters& values, const Deadline& deadline) {
+        auto promise = std::make_shared<std::promise<absl::StatusOr<ModbusRegisters>>>();
+        auto future = promise->get_future();
+        WriteRegisters(unit_id, address, values, deadline, [promise](absl::StatusOr<ModbusRegisters> result) {
+            promise->set_value(std::move(result));
+        });
+        return future;
+    }
+
+    void AsyncModbusConnection::Submit(int unit_id, uint8_t function, const std::string& pdu, int count,
+                                       const Deadline& deadline, Callback callback) {
+        Completions done;
+        {
+            absl::MutexLock lock(&mutex_);
+            uint16_t id = next_id_++;
+            while (in_flight_.contains(id)) {
+                id = next_id_++;
+            }
+
+            Transaction t{id, "", function, count, deadline, std::move(callback)};
+            t.frame.reserve(kHeaderSize + pdu.size());
+            AppendUInt16(&t.frame, id);
+            AppendUInt16(&t.frame, 0);
+            AppendUInt16(&t.frame, pdu.size() + 1);
+            t.frame.push_back(static_cast<char>(unit_id));
+            t.frame += pdu;
+            queued_.push_back(std::move(t));
+
+            if (state_ == State::kDisconnected) {
+                Connect(&done);
+            } else {
+                Flush(&done);
+            }
+        }
+        RunCallbacks(done);
+
+        // Let the loop pick up the new deadline.
+        if (!deadline.IsInfinite()) {
+            loop_->Wake();
+        }
+    }
+
+    void AsyncModbusConnection::Connect(Completions* done) {
+        if (addr_len_ == 0) {
+            Fail(absl::FailedPreconditionError(absl::StrCat("Modbus connection ", name_, " not initialized")), done);
+            return;
+        }
+
+        fd_ = socket(addr_.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd_ < 0) {
+            Fail(absl::UnavailableError(absl::StrCat("Could not create socket: ", strerror(errno))), done);
+            return;
+        }
+        // Requests are small and pipelined; do not hold them back.
+        int one = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (connect(fd_, reinterpret_cast<const sockaddr*>(&addr_), addr_len_) == 0) {
+            state_ = State::kConnected;
+            loop_->Watch(fd_, this, EPOLLIN, true);
+            Flush(done);
+        } else if (errno == EINPROGRESS) {
+            state_ = State::kConnecting;
+            loop_->Watch(fd_, this, EPOLLOUT, true);
+        } else {
+            Fail(absl::UnavailableError(absl::StrCat("Could not connect to ", name_, ": ", strerror(errno))), done);
+        }
+    }
+
+    void AsyncModbusConnection::Flush(Completions* done) {
+        if (state_ != State::kConnected) {
+            return;
+        }
+        while (!queued_.empty() && in_flight_.size() < static_cast<size_t>(max_in_flight_)) {
+            Transaction t = std::move(queued_.front());
+            queued_.pop_front();
+            out_ += t.frame;
+            in_flight_.emplace(t.id, std::move(t));
+        }
+
+        size_t written = 0;
+        while (written < out_.size()) {
+            ssize_t n = send(fd_, out_.data() + written, out_.size() - written, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                Fail(absl::UnavailableError(absl::StrCat("Error sending to ", name_, ": ", strerror(errno))), done);
+                return;
+            }
+            written += n;
+        }
+        out_.erase(0, written);
+        UpdateInterest();
+    }
+
+    void AsyncModbusConnection::Parse(Completions* done) {
+        size_t pos = 0;
+        while (in_.size() - pos >= kHeaderSize) {
+            const uint8_t* frame = in_.data() + pos;
+            uint16_t id = ReadUInt16(frame);
+            uint16_t length = ReadUInt16(frame + 4);
+            if (length < 2 || length > kMaxPduSize + 1) {
+                Fail(absl::InternalError(absl::StrCat("Invalid Modbus frame from ", name_)), done);
+                return;
+            }
+            if (in_.size() - pos < 6 + length) {
+                break;
+            }
+
+            // Responses to requests that already timed out are dropped, as are frames that do not
+            // answer the request with their transaction id (other protocol or unit); that request
+            // then times out instead of completing with another device's registers.
+            auto it = in_flight_.find(id);
+            uint16_t protocol = ReadUInt16(frame + 2);
+            uint8_t unit = frame[6];
+            if (it != in_flight_.end() &&
+                (protocol != 0 || unit != static_cast<uint8_t>(it->second.frame[kHeaderSize - 1]))) {
+                LOG(WARNING) << "Dropping Modbus frame from " << name_ << " with transaction " << id
+                             << ", protocol " << protocol << " and unit " << static_cast<int>(unit)
+                             << " not matching its request";
+            } else if (it != in_flight_.end()) {
+                done->push_back({std::move(it->second.callback),
+                                 DecodeResponse(it->second.function, it->second.count, frame + kHeaderSize,
+                                                length - 1, name_)});
+                in_flight_.erase(it);
+            }
+            pos += 6 + length;
+        }
+        in_.erase(in_.begin(), in_.begin() + pos);
+
+        // Answered requests free in-flight slots.
+        Flush(done);
+    }
+
+    void AsyncModbusConnection::Fail(const absl::Status& status, Completions* done) {
+        if (fd_ >= 0) {
+            // Closing the descriptor also removes it from the epoll set.
+            close(fd_);
+            fd_ = -1;
+        }
+        state_ = State::kDisconnected;
+        out_.clear();
+        in_.clear();
+
+        for (auto& [id, t] : in_flight_) {
+            done->push_back({std::move(t.callback), status});
+        }
+        in_flight_.clear();
+        for (auto& t : queued_) {
+            done->push_back({std::move(t.callback), status});
+        }
+        queued_.clear();
+    }
+
+    void AsyncModbusConnection::UpdateInterest() {
+        if (fd_ < 0) {
+            return;
+        }
+        uint32_t events = state_ == State::kConnecting ? EPOLLOUT : EPOLLIN | (out_.empty() ? 0 : EPOLLOUT);
+        loop_->Watch(fd_, this, events, false);
+    }
+
+    void AsyncModbusConnection::OnEvent(uint32_t events, Completions* done) {
+        absl::MutexLock lock(&mutex_);
+        if (fd_ < 0) {
+            return;
+        }
+
+        if (state_ == State::kConnecting) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0) {
+                Fail(absl::UnavailableError(absl::StrCat("Could not connect to ", name_, ": ", strerror(err))),
+                     done);
+            } else if (events & EPOLLOUT) {
+                state_ = State::kConnected;
+                Flush(done);
+            }
+        } else {
+            if (events & EPOLLIN) {
+                uint8_t buf[4096];
+                while (fd_ >= 0) {
+                    ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+                    if (n > 0) {
+                        in_.insert(in_.end(), buf, buf + n);
+                    } else if (n == 0) {
+                        Fail(absl::UnavailableError(absl::StrCat("Connection closed by ", name_)), done);
+                    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        break;
+                    } else if (errno != EINTR) {
+                        Fail(absl::UnavailableError(absl::StrCat("Error receiving from ", name_, ": ",
+                                                                 strerror(errno))), done);
+                    }
+                }
+                if (fd_ >= 0) {
+                    Parse(done);
+                }
+            }
+            if (fd_ >= 0 && (events & (EPOLLERR | EPOLLHUP))) {
+                Fail(absl::UnavailableError(absl::StrCat("Connection to ", name_, " failed")), done);
+            }
+            if (fd_ >= 0 && (events & EPOLLOUT)) {
+                Flush(done);
+            }
+        }
+    }
+
+    Deadline::Clock::time_point AsyncModbusConnection::Expire(Deadline::Clock::time_point now, Completions* done) {
+        auto next = Deadline::Clock::time_point::max();
+        absl::MutexLock lock(&mutex_);
+        size_t completed = done->size();
+        auto expired = [this, now, &next, done](Transaction& t) {
+            if (t.deadline.When() > now) {
+                next = std::min(next, t.deadline.When());
+                return false;
+            }
+            done->push_back({std::move(t.callback),
+                             absl::DeadlineExceededError(absl::StrCat("No response from ", name_, " in time"))});
+            return true;
+        };
+
+        for (auto it = in_flight_.begin(); it != in_flight_.end();) {
+            if (expired(it->second)) {
+                in_flight_.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+        queued_.erase(std::remove_if(queued_.begin(), queued_.end(), expired), queued_.end());
+
+        // Expired requests free in-flight slots.
+        if (done->size() > completed) {
+            Flush(done);
+        }
+        return next;
+    }
+
+    void AsyncModbusConnection::RunCallbacks(Completions& done) {
+        for (auto& c : done) {
+            c.callback(std::move(c.result));
+        }
+    }
+}
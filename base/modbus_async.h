@@ -0,0 +1,206 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Non-blocking Modbus/TCP client.
+//
+// ModbusConnection runs libmodbus calls on the calling thread, which blocks for a full round
+// trip per request, and one request at a time. The classes in this header speak Modbus/TCP
+// directly on non-blocking sockets driven by an epoll event loop instead:
+//
+// - A single wastlernet::ModbusEventLoop thread drives any number of connections.
+// - A wastlernet::AsyncModbusConnection pipelines requests: up to `max_in_flight` transactions
+//   are outstanding at a time, and responses are matched to requests by the MBAP transaction id,
+//   so a gateway answering out of order is handled as well.
+// - Every request carries a Deadline; requests not answered in time fail with DeadlineExceeded.
+// - A failed connection fails all outstanding requests and is re-established by the next request.
+//
+//   ModbusEventLoop loop;
+//   RETURN_IF_ERROR(loop.Init());
+//   AsyncModbusConnection conn(&loop, "192.168.1.20", 502);
+//   RETURN_IF_ERROR(conn.Init());
+//
+//   // Callback style (runs on the event loop thread; keep it short):
+//   conn.ReadRegisters(1, 33024, 18, Deadline::After(2s), [](absl::StatusOr<ModbusRegisters> r) { ... });
+//
+//   // Future style:
+//   auto f = conn.ReadRegisters(1, 33280, 20, Deadline::After(2s));
+//   absl::StatusOr<ModbusRegisters> registers = f.get();
+//
+// Thread-safety
+// All public methods are internally synchronized and may be called from any thread, including
+// from callbacks. Callbacks run without any lock held, so they may also initialize and destroy
+// connections, including their own.
+//
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/synchronization/mutex.h>
+
+#include "base/deadline.h"
+
+#ifndef WASTLERNET_MODBUS_ASYNC_H
+#define WASTLERNET_MODBUS_ASYNC_H
+namespace wastlernet {
+    class AsyncModbusConnection;
+
+    /** Register values returned by a read request (empty for writes). */
+    using ModbusRegisters = std::vector<uint16_t>;
+
+    /** Event loop thread driving the I/O and deadlines of AsyncModbusConnections. */
+    class ModbusEventLoop {
+    public:
+        ModbusEventLoop() = default;
+
+        /** Stops the loop thread. All connections must have been destroyed before. */
+        ~ModbusEventLoop();
+
+        ModbusEventLoop(const ModbusEventLoop&) = delete;
+        ModbusEventLoop& operator=(const ModbusEventLoop&) = delete;
+
+        /** Create the epoll instance and start the loop thread. */
+        absl::Status Init();
+
+    private:
+        friend class AsyncModbusConnection;
+
+        int epoll_fd_ = -1;
+        // eventfd used to interrupt epoll_wait() when deadlines change or the loop stops.
+        int wake_fd_ = -1;
+        std::atomic<bool> stopping_{false};
+        std::thread thread_;
+
+        // Held while dispatching events, so that a connection cannot go away while it is served.
+        absl::Mutex mutex_;
+        absl::flat_hash_set<AsyncModbusConnection*> connections_ ABSL_GUARDED_BY(mutex_);
+
+        void Add(AsyncModbusConnection* conn);
+        void Remove(AsyncModbusConnection* conn);
+
+        /** Register `fd` (or update its interest set) for events delivered to `conn`. */
+        void Watch(int fd, AsyncModbusConnection* conn, uint32_t events, bool add);
+
+        void Wake();
+        void Run();
+    };
+
+    class AsyncModbusConnection {
+    public:
+        /** Receives the result of a request, on the event loop thread (or the calling thread on early failure). */
+        using Callback = std::function<void(absl::StatusOr<ModbusRegisters>)>;
+
+        /**
+         * @param loop          Event loop driving the connection; not owned, must outlive the connection.
+         * @param host          Target host (IPv4/IPv6/DNS name).
+         * @param port          TCP port.
+         * @param max_in_flight Maximum number of requests sent without having received their response.
+         *                      Use 1 for devices that cannot queue requests.
+         */
+        AsyncModbusConnection(ModbusEventLoop* loop, const std::string& host, int16_t port, int max_in_flight = 8);
+
+        /** Fails all outstanding requests with Cancelled. */
+        ~AsyncModbusConnection();
+
+        AsyncModbusConnection(const AsyncModbusConnection&) = delete;
+        AsyncModbusConnection& operator=(const AsyncModbusConnection&) = delete;
+
+        /** Resolve the host and attach to the event loop. The connection itself is opened by the first request. */
+        absl::Status Init();
+
+        /** Read `count` holding registers (function 0x03) from unit `unit_id`. */
+        void ReadRegisters(int unit_id, int address, int count, const Deadline& deadline, Callback callback);
+
+        std::future<absl::StatusOr<ModbusRegisters>> ReadRegisters(int unit_id, int address, int count,
+                                                                   const Deadline& deadline = Deadline::Infinite());
+
+        /** Write `values` to consecutive holding registers (function 0x10) of unit `unit_id`. */
+        void WriteRegisters(int unit_id, int address, const ModbusRegisters& values, const Deadline& deadline,
+                            Callback callback);
+
+        std::future<absl::StatusOr<ModbusRegisters>> WriteRegisters(int unit_id, int address,
+                                                                    const ModbusRegisters& values,
+                                                                    const Deadline& deadline = Deadline::Infinite());
+
+        const std::string& name() const {
+            return name_;
+        }
+
+    private:
+        friend class ModbusEventLoop;
+
+        enum class State { kDisconnected, kConnecting, kConnected };
+
+        struct Transaction {
+            uint16_t id;
+            // Complete MBAP frame.
+            std::string frame;
+            uint8_t function;
+            // Number of registers expected in the response.
+            int count;
+            Deadline deadline;
+            Callback callback;
+        };
+
+        struct Completion {
+            Callback callback;
+            absl::StatusOr<ModbusRegisters> result;
+        };
+        using Completions = std::vector<Completion>;
+
+        ModbusEventLoop* loop_;
+        std::string host_;
+        int16_t port_;
+        int max_in_flight_;
+        std::string name_;
+
+        absl::Mutex mutex_;
+        sockaddr_storage addr_ ABSL_GUARDED_BY(mutex_) = {};
+        socklen_t addr_len_ ABSL_GUARDED_BY(mutex_) = 0;
+        int fd_ ABSL_GUARDED_BY(mutex_) = -1;
+        State state_ ABSL_GUARDED_BY(mutex_) = State::kDisconnected;
+        uint16_t next_id_ ABSL_GUARDED_BY(mutex_) = 0;
+        // Requests waiting for a free in-flight slot (or the connection).
+        std::deque<Transaction> queued_ ABSL_GUARDED_BY(mutex_);
+        // Requests sent (or in out_), by transaction id.
+        absl::flat_hash_map<uint16_t, Transaction> in_flight_ ABSL_GUARDED_BY(mutex_);
+        std::string out_ ABSL_GUARDED_BY(mutex_);
+        std::vector<uint8_t> in_ ABSL_GUARDED_BY(mutex_);
+
+        void Submit(int unit_id, uint8_t function, const std::string& pdu, int count, const Deadline& deadline,
+                    Callback callback);
+
+        void Connect(Completions* done) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        /** Move queued requests into free in-flight slots and write as much as the socket accepts. */
+        void Flush(Completions* done) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        /** Match complete response frames in in_ to their transactions. */
+        void Parse(Completions* done) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        /** Close the socket and fail all requests with `status`. */
+        void Fail(const absl::Status& status, Completions* done) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        void UpdateInterest() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        // Called by the event loop, which runs the callbacks of the requests completed in `done` once
+        // it has released its lock.
+        void OnEvent(uint32_t events, Completions* done);
+
+        /** Fail requests whose deadline has passed; returns the earliest remaining deadline. */
+        Deadline::Clock::time_point Expire(Deadline::Clock::time_point now, Completions* done);
+
+        static void RunCallbacks(Completions& done);
+    };
+}
+#endif //WASTLERNET_MODBUS_ASYNC_H
@@ -0,0 +1,222 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Throughput benchmark for the Modbus client path against a simulated device.
+//
+// Runs a fixed number of requests through each client and reports reads per second and the
+// p50/p99 latency, so that changes on the Modbus path can be compared before and after:
+//
+//   modbus_bench --iterations=2000 --latency_us=2000 --jitter_us=500
+//
+// Benchmarks:
+// - connection: ModbusConnection::Execute() reading the two Solvis register blocks.
+// - solvis:     SolvisModule::Query() through a ModbusBus (read, decode, handler).
+// - async:      AsyncModbusConnection with --concurrency pipelined requests of the same blocks.
+//
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <absl/synchronization/mutex.h>
+
+#include "base/modbus_async.h"
+#include "base/modbus_bus.h"
+#include "base/modbus_connection.h"
+#include "base/modbus_sim.h"
+#include "base/state_cache.h"
+#include "solvis/solvis_module.h"
+
+DEFINE_int32(port, 15030, "TCP port of the simulated device");
+DEFINE_int32(iterations, 1000, "Number of polls per benchmark");
+DEFINE_int32(latency_us, 0, "Injected response latency in microseconds");
+DEFINE_int32(jitter_us, 0, "Injected additional random latency in microseconds");
+DEFINE_double(error_rate, 0, "Fraction of requests answered with a Modbus exception");
+DEFINE_int32(concurrency, 8, "Outstanding requests in the async benchmark");
+DEFINE_string(benchmark, "connection,solvis,async", "Comma-separated list of benchmarks to run");
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Register blocks polled by the Solvis module.
+    constexpr int kBlock1 = 33024, kBlock1Count = 18;
+    constexpr int kBlock2 = 33280, kBlock2Count = 20;
+    constexpr int kReadsPerPoll = 2;
+
+    class BenchConnection : public wastlernet::ModbusConnection {
+    public:
+        BenchConnection() : ModbusConnection("127.0.0.1", FLAGS_port) { }
+
+    protected:
+        std::string Name() override {
+            return "modbus_bench";
+        }
+    };
+
+    class BenchSolvisModule : public solvis::SolvisModule {
+    public:
+        using SolvisModule::SolvisModule;
+        using SolvisModule::Query;
+    };
+
+    struct Result {
+        std::vector<double> latencies;
+        int errors = 0;
+        double seconds = 0;
+    };
+
+    void CheckOk(const absl::Status& st) {
+        CHECK(st.ok()) << st;
+    }
+
+    double Percentile(std::vector<double>& sorted, double q) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(q * sorted.size()))];
+    }
+
+    void Report(const char* name, Result result) {
+        std::sort(result.latencies.begin(), result.latencies.end());
+        double polls = result.latencies.size();
+        printf("%-12s %8.0f polls %10.1f reads/s   p50 %8.3f ms   p99 %8.3f ms   %d errors\n", name, polls,
+               polls * kReadsPerPoll / result.seconds, Percentile(result.latencies, 0.5) * 1e3,
+               Percentile(result.latencies, 0.99) * 1e3, result.errors);
+    }
+
+    // Runs `poll` FLAGS_iterations times and records the latency of each call.
+    template<class Poll>
+    Result RunSync(Poll poll) {
+        Result result;
+        result.latencies.reserve(FLAGS_iterations);
+        auto begin = Clock::now();
+        for (int i = 0; i < FLAGS_iterations; i++) {
+            auto start = Clock::now();
+            if (!poll().ok()) {
+                result.errors++;
+            }
+            result.latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+        }
+        result.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        return result;
+    }
+
+    absl::Status ReadBlocks(modbus_t* ctx) {
+        uint16_t buffer[kBlock1Count + kBlock2Count];
+        if (modbus_read_registers(ctx, kBlock1, kBlock1Count, buffer) != kBlock1Count ||
+            modbus_read_registers(ctx, kBlock2, kBlock2Count, buffer + kBlock1Count) != kBlock2Count) {
+            return absl::InternalError(modbus_strerror(errno));
+        }
+        return absl::OkStatus();
+    }
+
+    Result BenchConnectionExecute() {
+        BenchConnection conn;
+        CheckOk(conn.Init());
+        return RunSync([&conn]() { return conn.Execute(ReadBlocks); });
+    }
+
+    Result BenchSolvisQuery() {
+        wastlernet::ModbusBus bus("127.0.0.1", FLAGS_port);
+        wastlernet::ModbusUnit unit(&bus, solvis::kDefaultUnitId);
+        wastlernet::StateCache state;
+        BenchSolvisModule module(wastlernet::TimescaleDB(), wastlernet::Solvis(), &unit, &state);
+        CheckOk(unit.Init());
+        return RunSync([&module]() {
+            return module.Query(wastlernet::Deadline::After(std::chrono::seconds(10)),
+                                [](const solvis::SolvisData&) { return absl::OkStatus(); });
+        });
+    }
+
+    // Keeps FLAGS_concurrency polls outstanding; a poll is the two block reads issued back to back.
+    Result BenchAsync() {
+        wastlernet::ModbusEventLoop loop;
+        CheckOk(loop.Init());
+        wastlernet::AsyncModbusConnection conn(&loop, "127.0.0.1", FLAGS_port, 2 * FLAGS_concurrency);
+        CheckOk(conn.Init());
+
+        absl::Mutex mu;
+        Result result;
+        int finished = 0;
+        std::atomic<int> started{0};
+        result.latencies.reserve(FLAGS_iterations);
+
+        std::function<void()> start_poll = [&]() {
+            if (started.fetch_add(1) >= FLAGS_iterations) {
+                return;
+            }
+            auto start = Clock::now();
+            auto pending = std::make_shared<int>(kReadsPerPoll);
+            auto ok = std::make_shared<bool>(true);
+            auto on_done = [&, start, pending, ok](absl::StatusOr<wastlernet::ModbusRegisters> r) {
+                {
+                    absl::MutexLock lock(&mu);
+                    *ok = *ok && r.ok();
+                    if (--*pending > 0) {
+                        return;
+                    }
+                    result.latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+                    result.errors += *ok ? 0 : 1;
+                    finished++;
+                }
+                start_poll();
+            };
+            auto deadline = wastlernet::Deadline::After(std::chrono::seconds(10));
+            conn.ReadRegisters(solvis::kDefaultUnitId, kBlock1, kBlock1Count, deadline, on_done);
+            conn.ReadRegisters(solvis::kDefaultUnitId, kBlock2, kBlock2Count, deadline, on_done);
+        };
+
+        auto begin = Clock::now();
+        for (int i = 0; i < FLAGS_concurrency; i++) {
+            start_poll();
+        }
+        {
+            absl::MutexLock lock(&mu);
+            auto all_done = [&finished]() { return finished == FLAGS_iterations; };
+            mu.Await(absl::Condition(&all_done));
+        }
+        result.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        return result;
+    }
+}
+
+int main(int argc, char** argv) {
+    gflags::SetUsageMessage("Usage: modbus_bench [--iterations=N] [--latency_us=N] [--benchmark=connection,solvis,async]");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    google::InitGoogleLogging(argv[0]);
+
+    wastlernet::ModbusSimOptions options;
+    options.host = "127.0.0.1";
+    options.latency = std::chrono::microseconds(FLAGS_latency_us);
+    options.jitter = std::chrono::microseconds(FLAGS_jitter_us);
+    options.error_rate = FLAGS_error_rate;
+
+    wastlernet::ModbusSimulator sim(FLAGS_port, kBlock1, kBlock2 + kBlock2Count - kBlock1, options);
+    for (int i = 0; i < kBlock1Count; i++) {
+        sim.SetRegister(kBlock1 + i, 400 + 10 * i);
+    }
+    for (int i = 0; i < kBlock2Count; i++) {
+        sim.SetRegister(kBlock2 + i, i % 2 == 0 ? 200 : 0);
+    }
+    CheckOk(sim.Start());
+
+    printf("latency %d us, jitter %d us, error rate %.3f, %d iterations\n", FLAGS_latency_us, FLAGS_jitter_us,
+           FLAGS_error_rate, FLAGS_iterations);
+    auto enabled = [](const char* name) {
+        return ("," + FLAGS_benchmark + ",").find(std::string(",") + name + ",") != std::string::npos;
+    };
+    if (enabled("connection")) {
+        Report("connection", BenchConnectionExecute());
+    }
+    if (enabled("solvis")) {
+        Report("solvis", BenchSolvisQuery());
+    }
+    if (enabled("async")) {
+        Report("async", BenchAsync());
+    }
+    return 0;
+}
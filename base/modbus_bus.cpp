@@ -0,0 +1,185 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "modbus_bus.h"
+
+#include <algorithm>
+#include <chrono>
+#include <absl/strings/str_cat.h>
+#include <absl/time/time.h>
+#include <glog/logging.h>
+
+#include "base/metrics.h"
+
+namespace wastlernet {
+    namespace {
+        class GatewayConnection : public ModbusConnection {
+        public:
+            GatewayConnection(const std::string& host, int16_t port, int probe_unit, int32_t probe_addr,
+                              int16_t probe_count)
+                : ModbusConnection(host, port, probe_addr, probe_count), name_(absl::StrCat("ModbusBus ", host, ":", port)) {
+                ShareBetweenUnits(probe_unit);
+            }
+
+            explicit GatewayConnection(const ModbusRtuOptions& rtu)
+                : ModbusConnection(rtu), name_(absl::StrCat("ModbusBus ", rtu.device)) {
+                ShareBetweenUnits(-1);
+            }
+
+        protected:
+            std::string Name() override {
+                return name_;
+            }
+
+        private:
+            std::string name_;
+        };
+    }
+
+    ModbusBus::ModbusBus(const std::string& host, int16_t port, int probe_unit, int32_t probe_addr,
+                         int16_t probe_count)
+        : name_(absl::StrCat(host, ":", port)),
+          gateway_(std::make_unique<GatewayConnection>(host, port, probe_unit, probe_addr, probe_count)) {
+        worker_ = std::thread(&ModbusBus::Run, this);
+    }
+
+    ModbusBus::ModbusBus(const ModbusRtuOptions& rtu)
+        : name_(rtu.device), gateway_(std::make_unique<GatewayConnection>(rtu)) {
+        worker_ = std::thread(&ModbusBus::Run, this);
+    }
+
+    ModbusBus::~ModbusBus() {
+        {
+            absl::MutexLock lock(&mutex_);
+            stopping_ = true;
+        }
+        worker_.join();
+    }
+
+    absl::Status ModbusBus::Init() {
+        return gateway_->Init();
+    }
+
+    absl::Status ModbusBus::Execute(int unit_id, Priority priority,
+                                    const std::function<absl::Status(modbus_t*)>& method, const Deadline& deadline) {
+        return Submit(unit_id, priority, [this, unit_id, &method, &deadline]() {
+            return Guarded(unit_id, [this, unit_id, &method, &deadline](ModbusConnection::Outcome* outcome) {
+                return gateway_->Execute([unit_id, &method](modbus_t* ctx) {
+                    modbus_set_slave(ctx, unit_id);
+                    return method(ctx);
+                }, deadline, outcome);
+            });
+        }, deadline);
+    }
+
+    absl::Status ModbusBus::Write(int unit_id, const std::map<int, uint16_t>& values, const Deadline& deadline) {
+        return Submit(unit_id, Priority::kControl, [this, unit_id, &values, &deadline]() {
+            return Guarded(unit_id, [this, unit_id, &values, &deadline](ModbusConnection::Outcome* outcome) {
+                return gateway_->Write(values, deadline, unit_id, outcome);
+            });
+        }, deadline);
+    }
+
+    absl::Status ModbusBus::Guarded(int unit_id,
+                                    const std::function<absl::Status(ModbusConnection::Outcome*)>& call) {
+        auto& breaker = breakers_[unit_id];
+        if (breaker == nullptr) {
+            breaker = std::make_unique<CircuitBreaker>(absl::StrCat(name_, " unit ", unit_id));
+        }
+        if (!breaker->Allow()) {
+            return absl::UnavailableError(absl::StrCat("Modbus unit ", unit_id, " on ", name_,
+                                                       " unavailable (circuit open)"));
+        }
+
+        auto outcome = ModbusConnection::Outcome::kUnknown;
+        auto st = call(&outcome);
+        switch (outcome) {
+            case ModbusConnection::Outcome::kAnswered:
+                breaker->RecordSuccess();
+                break;
+            case ModbusConnection::Outcome::kNoAnswer:
+                breaker->RecordFailure();
+                break;
+            case ModbusConnection::Outcome::kTransportError:
+            case ModbusConnection::Outcome::kUnknown:
+                // Not the unit's fault; the gateway connection has its own breaker.
+                breaker->Release();
+                break;
+        }
+        return st;
+    }
+
+    absl::Status ModbusBus::Submit(int unit_id, Priority priority, std::function<absl::Status()> call,
+                                   const Deadline& deadline) {
+        Request request{unit_id, std::move(call)};
+
+        absl::MutexLock lock(&mutex_);
+        if (stopping_) {
+            return absl::CancelledError(absl::StrCat("Modbus bus ", name_, " is shutting down"));
+        }
+        queues_[static_cast<int>(priority)][unit_id].push_back(&request);
+        queued_++;
+        metrics::WastlernetMetrics::GetInstance().SetModbusBusQueueDepth(name_, queued_);
+
+        if (!deadline.IsInfinite() &&
+            !mutex_.AwaitWithTimeout(absl::Condition(&request.started), absl::FromChrono(deadline.Remaining()))) {
+            // Still queued: withdraw the request instead of occupying the bus for a result nobody waits for.
+            auto& queue = queues_[static_cast<int>(priority)][unit_id];
+            queue.erase(std::find(queue.begin(), queue.end(), &request));
+            queued_--;
+            metrics::WastlernetMetrics::GetInstance().SetModbusBusQueueDepth(name_, queued_);
+            return absl::DeadlineExceededError(absl::StrCat("Deadline expired while waiting for Modbus bus ", name_));
+        }
+
+        mutex_.Await(absl::Condition(&request.done));
+        return request.result;
+    }
+
+    ModbusBus::Request* ModbusBus::Next() {
+        for (int priority : {static_cast<int>(Priority::kControl), static_cast<int>(Priority::kRead)}) {
+            auto& queues = queues_[priority];
+
+            // Round-robin: the first unit after the one served last, wrapping around.
+            auto it = queues.upper_bound(last_unit_[priority]);
+            for (size_t i = 0; i < queues.size(); i++, it++) {
+                if (it == queues.end()) {
+                    it = queues.begin();
+                }
+                if (!it->second.empty()) {
+                    Request* request = it->second.front();
+                    it->second.pop_front();
+                    last_unit_[priority] = it->first;
+                    queued_--;
+                    return request;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    void ModbusBus::Run() {
+        while (true) {
+            Request* request;
+            {
+                absl::MutexLock lock(&mutex_);
+                mutex_.Await(absl::Condition(this, &ModbusBus::HasWork));
+                request = Next();
+                if (request == nullptr) {
+                    // Stopping and no request left.
+                    return;
+                }
+                request->started = true;
+                metrics::WastlernetMetrics::GetInstance().SetModbusBusQueueDepth(name_, queued_);
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            auto result = request->call();
+            metrics::WastlernetMetrics::GetInstance().RecordModbusBusBusy(
+                    name_, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+            absl::MutexLock lock(&mutex_);
+            request->result = std::move(result);
+            request->done = true;
+        }
+    }
+}
@@ -0,0 +1,178 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Shared Modbus bus behind a TCP gateway.
+//
+// Several Modbus devices (units) can sit behind a single Modbus/TCP gateway, e.g. an RS485 bus
+// with the Solvis controller, the Hafnertec register interface and energy meters. A
+// wastlernet::ModbusBus carries the traffic for all of them over one ModbusConnection. The same
+// applies to an RS485 line attached directly through a serial adapter (Modbus RTU multi-drop),
+// where only one request may be on the wire at a time:
+//
+// - Requests are addressed by unit id; the bus sets the libmodbus slave id before each request.
+// - Requests are queued per unit and served round-robin across units, so a unit with a backlog
+//   (or slow responses) cannot starve the others.
+// - Control writes have priority over reads: a queued write is always served before any read.
+// - A request that is still queued when its deadline expires is dropped without touching the bus.
+// - Each unit has its own CircuitBreaker, so a unit that stopped answering fails fast without
+//   holding up the others. Only transport errors (connection reset, broken pipe, ...) affect the
+//   whole bus and reconnect it; a response timeout only counts against the addressed unit.
+//
+// The bus exports its busy time (wastlernet_modbus_bus_busy_seconds_total, whose rate is the bus
+// utilisation) and its queue depth (wastlernet_modbus_bus_queue_depth), labelled by gateway.
+//
+// Thread-safety
+// All public methods are internally synchronized. Execute() and Write() block the calling thread
+// until the request has completed; requests are executed on the bus worker thread.
+//
+#pragma once
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <absl/status/status.h>
+#include <absl/synchronization/mutex.h>
+
+#include "base/circuit_breaker.h"
+#include "base/deadline.h"
+#include "base/modbus_connection.h"
+
+#ifndef WASTLERNET_MODBUS_BUS_H
+#define WASTLERNET_MODBUS_BUS_H
+namespace wastlernet {
+    class ModbusBus {
+    public:
+        enum class Priority { kRead = 0, kControl = 1 };
+
+        /**
+         * @param host         Gateway host.
+         * @param port         Gateway TCP port.
+         * @param probe_unit   Unit probed when the connection is idle.
+         * @param probe_addr   Register probed on `probe_unit` (-1 to skip).
+         * @param probe_count  Number of registers to probe.
+         */
+        ModbusBus(const std::string& host, int16_t port, int probe_unit = MODBUS_TCP_SLAVE, int32_t probe_addr = -1,
+                  int16_t probe_count = 2);
+
+        /** A Modbus RTU line on a serial device; requests keep the RTU inter-frame delay. */
+        explicit ModbusBus(const ModbusRtuOptions& rtu);
+
+        /** Serves the requests still queued and stops the worker. */
+        ~ModbusBus();
+
+        ModbusBus(const ModbusBus&) = delete;
+        ModbusBus& operator=(const ModbusBus&) = delete;
+
+        /** Connect to the gateway. Safe to call multiple times. */
+        absl::Status Init();
+
+        /** Queue `method` for unit `unit_id` and wait for its result. */
+        absl::Status Execute(int unit_id, Priority priority, const std::function<absl::Status(modbus_t*)>& method,
+                             const Deadline& deadline = Deadline::Infinite());
+
+        /** Queue a batched register write (see ModbusConnection::Write()) with control priority. */
+        absl::Status Write(int unit_id, const std::map<int, uint16_t>& values,
+                           const Deadline& deadline = Deadline::Infinite());
+
+        /** Cache registers of unit `unit_id` read by ReadBlocks() (see ModbusConnection::SetRegisterTtl()). */
+        void SetRegisterTtl(int unit_id, int address, int count, std::chrono::steady_clock::duration ttl) {
+            gateway_->SetRegisterTtl(unit_id, address, count, ttl);
+        }
+
+        /** Read register blocks through the register cache; call from within an Execute() method. */
+        absl::Status ReadBlocks(modbus_t* ctx, const std::vector<RegisterBlock>& blocks, uint16_t* buffer) {
+            return gateway_->ReadBlocks(ctx, blocks, buffer);
+        }
+
+        /** Label of the gateway in metrics and logs ("host:port", or the serial device). */
+        const std::string& name() const {
+            return name_;
+        }
+
+    private:
+        struct Request {
+            int unit_id;
+            std::function<absl::Status()> call;
+            bool started = false;
+            bool done = false;
+            absl::Status result;
+        };
+
+        std::string name_;
+        std::unique_ptr<ModbusConnection> gateway_;
+
+        absl::Mutex mutex_;
+        // Queued requests per priority, per unit id.
+        std::map<int, std::deque<Request*>> queues_[2] ABSL_GUARDED_BY(mutex_);
+        // Unit served last per priority, for round-robin scheduling.
+        int last_unit_[2] ABSL_GUARDED_BY(mutex_) = {-1, -1};
+        int queued_ ABSL_GUARDED_BY(mutex_) = 0;
+        bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+
+        // Per unit id; only used by the worker thread.
+        std::map<int, std::unique_ptr<CircuitBreaker>> breakers_;
+
+        std::thread worker_;
+
+        /**
+         * Run `call` for `unit_id` on the worker thread, guarded by the unit's circuit breaker.
+         * `call` reports the outcome of its request on the gateway connection.
+         */
+        absl::Status Guarded(int unit_id, const std::function<absl::Status(ModbusConnection::Outcome*)>& call);
+
+        absl::Status Submit(int unit_id, Priority priority, std::function<absl::Status()> call,
+                            const Deadline& deadline);
+
+        /** Remove and return the next request to serve, or nullptr if none is queued. */
+        Request* Next() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        bool HasWork() const ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+            return queued_ > 0 || stopping_;
+        }
+
+        void Run();
+    };
+
+    /** A single device on a ModbusBus, addressed by its unit id. */
+    class ModbusUnit {
+    public:
+        /** `bus` is not owned and must outlive the unit. */
+        ModbusUnit(ModbusBus* bus, int unit_id) : bus_(bus), unit_id_(unit_id) { }
+
+        /** Connect the underlying bus. Safe to call multiple times. */
+        absl::Status Init() {
+            return bus_->Init();
+        }
+
+        absl::Status Execute(const std::function<absl::Status(modbus_t*)>& method,
+                             const Deadline& deadline = Deadline::Infinite(),
+                             ModbusBus::Priority priority = ModbusBus::Priority::kRead) {
+            return bus_->Execute(unit_id_, priority, method, deadline);
+        }
+
+        absl::Status Write(const std::map<int, uint16_t>& values, const Deadline& deadline = Deadline::Infinite()) {
+            return bus_->Write(unit_id_, values, deadline);
+        }
+
+        void SetRegisterTtl(int address, int count, std::chrono::steady_clock::duration ttl) {
+            bus_->SetRegisterTtl(unit_id_, address, count, ttl);
+        }
+
+        absl::Status ReadBlocks(modbus_t* ctx, const std::vector<RegisterBlock>& blocks, uint16_t* buffer) {
+            return bus_->ReadBlocks(ctx, blocks, buffer);
+        }
+
+        int unit_id() const {
+            return unit_id_;
+        }
+
+    private:
+        ModbusBus* bus_;
+        int unit_id_;
+    };
+}
+#endif //WASTLERNET_MODBUS_BUS_H
@@ -2,9 +2,16 @@
 // Created by wastl on 03.07.25.
 //
 #include "modbus_connection.h"
+
+#include <cstring>
+#include "base/metrics.h"
 #include "base/utility.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <vector>
 #include <absl/strings/str_cat.h>
+#include <absl/time/time.h>
 #include <glog/logging.h>
 #include <modbus/modbus.h>
 #include <modbus/modbus-tcp.h>
@@ -12,94 +19,479 @@
 #define LOGS(level) LOG(level) << "[" << Name() << "] "
 
 
+namespace {
+    // errno values after which the connection is unusable and must be re-established. On a serial
+    // line or behind a gateway shared by several units a timeout only means that the addressed unit
+    // did not answer, while I/O errors indicate that the adapter was unplugged and the device has to
+    // be reopened.
+    bool IsConnectionError(int error, bool unit_timeouts) {
+        switch (error) {
+            case ECONNRESET:
+            case ECONNABORTED:
+            case EPIPE:
+            case ENOTCONN:
+            case EBADF:
+            case EIO:
+            case ENXIO:
+            case ENODEV:
+                return true;
+            case ETIMEDOUT:
+                return !unit_timeouts;
+            default:
+                return false;
+        }
+    }
+}
+
+std::chrono::microseconds wastlernet::InterFrameDelay(const ModbusRtuOptions& options) {
+    if (options.inter_frame_delay.count() > 0) {
+        return options.inter_frame_delay;
+    }
+    if (options.baud <= 0 || options.baud > 19200) {
+        return std::chrono::microseconds(1750);
+    }
+    // A character is 11 bits on the line: start, 8 data, parity (or a second stop bit) and stop.
+    return std::chrono::microseconds((35 * 11 * 1000000LL / options.baud + 9) / 10);
+}
+
 wastlernet::ModbusConnection::~ModbusConnection() {
-    modbus_close(ctx_);
-    modbus_free(ctx_);
+    {
+        absl::MutexLock lock(&mutex_);
+        stopping_ = true;
+    }
+    if (keepalive_thread_.joinable()) {
+        keepalive_thread_.join();
+    }
+
+    if (ctx_ != nullptr) {
+        modbus_close(ctx_);
+        modbus_free(ctx_);
+    }
 }
 
 absl::Status wastlernet::ModbusConnection::Init() {
-    absl::MutexLock lock(&mutex_);
-
-    LOGS(INFO) << "Initializing Modbus connection";
+    {
+        absl::MutexLock lock(&mutex_);
+        if (initialized_) {
+            return absl::OkStatus();
+        }
+    }
 
-    ctx_ = modbus_new_tcp(host_.c_str(), port_);
-    if (ctx_ == nullptr) {
-        LOGS(ERROR) << "Unable to allocate libmodbus context";
-        return absl::InternalError("Unable to allocate libmodbus context");
+    if (!breaker_.Allow()) {
+        return absl::UnavailableError(absl::StrCat("Modbus device ", address_, " unavailable (circuit open)"));
     }
 
-    // set response timeout
-    modbus_set_response_timeout(ctx_, timeout_ms_ / 1000, (timeout_ms_ % 1000) * 1000);
+    LOGS(INFO) << "Initializing Modbus connection";
 
+    // Only hold the lock for each connection attempt, not while sleeping between attempts, so that
+    // Execute() and the keepalive thread are not blocked by the backoff.
     auto st = wastlernet::retry_with_backoff([this]() {
-        int rc = modbus_connect(ctx_);
-        if (rc == -1) {
-            return absl::InternalError(absl::StrCat("Connection failed: ", modbus_strerror(errno)));
-        }
-        return absl::OkStatus();
+        absl::MutexLock lock(&mutex_);
+        // Another thread may have connected in the meantime.
+        return initialized_ ? absl::OkStatus() : Connect();
     }, 5);
-
     if (st.ok()) {
-        initialized_ = true;
-        LOGS(INFO) << "Modbus connection to " << host_ << ":" << port_ << " established successfully";
+        breaker_.RecordSuccess();
+        absl::MutexLock lock(&mutex_);
+        if (init_addr_ >= 0 && !keepalive_thread_.joinable()) {
+            keepalive_thread_ = std::thread(&ModbusConnection::KeepAlive, this);
+        }
     } else {
+        breaker_.RecordFailure();
         LOGS(ERROR) << st;
     }
 
     return st;
 }
 
-absl::Status wastlernet::ModbusConnection::Execute(const std::function<absl::Status(modbus_t *)>& method) {
-    auto st = Reinit();
+absl::Status wastlernet::ModbusConnection::Connect() {
+    if (ctx_ == nullptr) {
+        ctx_ = rtu_ ? modbus_new_rtu(rtu_->device.c_str(), rtu_->baud, rtu_->parity, rtu_->data_bits,
+                                     rtu_->stop_bits)
+                    : modbus_new_tcp(host_.c_str(), port_);
+        if (ctx_ == nullptr) {
+            LOGS(ERROR) << "Unable to allocate libmodbus context";
+            return absl::InternalError("Unable to allocate libmodbus context");
+        }
+
+        // set response timeout
+        modbus_set_response_timeout(ctx_, timeout_ms_ / 1000, (timeout_ms_ % 1000) * 1000);
+    }
+
+    if (int rc = modbus_connect(ctx_); rc == -1) {
+        return absl::InternalError(absl::StrCat("Connection failed: ", modbus_strerror(errno)));
+    }
+
+    initialized_ = true;
+    connected_ = true;
+    shadow_.clear();
+    {
+        absl::MutexLock lock(&cache_mutex_);
+        cache_.clear();
+    }
+    last_activity_ = std::chrono::steady_clock::now();
+    LOGS(INFO) << "Modbus connection to " << address_ << " established successfully";
+    return absl::OkStatus();
+}
+
+void wastlernet::ModbusConnection::Disconnect() {
+    if (ctx_ != nullptr) {
+        modbus_close(ctx_);
+    }
+    connected_ = false;
+}
+
+absl::Status wastlernet::ModbusConnection::Execute(const std::function<absl::Status(modbus_t *)>& method,
+                                                   const Deadline& deadline, Outcome* outcome) {
+    Outcome unused;
+    if (outcome == nullptr) {
+        outcome = &unused;
+    }
+    *outcome = Outcome::kUnknown;
+
+    if (deadline.Expired()) {
+        return absl::DeadlineExceededError("Deadline expired before Modbus request");
+    }
+
+    // Fail fast while the device is known to be down instead of blocking on connect/response timeouts.
+    if (!breaker_.Allow()) {
+        return absl::UnavailableError(absl::StrCat("Modbus device ", address_, " unavailable (circuit open)"));
+    }
 
+    auto st = Attempt(method, deadline, outcome);
+    switch (*outcome) {
+        case Outcome::kAnswered:
+            // Also when the device answered with a Modbus exception or the callback rejected the reply.
+            breaker_.RecordSuccess();
+            break;
+        case Outcome::kNoAnswer:
+            if (shared_) {
+                // Only the addressed unit is silent; the caller tracks that per unit.
+                breaker_.Release();
+            } else {
+                breaker_.RecordFailure();
+            }
+            break;
+        case Outcome::kTransportError:
+            breaker_.RecordFailure();
+            break;
+        case Outcome::kUnknown:
+            // E.g. the caller's deadline expired: says nothing about the device.
+            breaker_.Release();
+            break;
+    }
+    return st;
+}
+
+absl::Status wastlernet::ModbusConnection::Attempt(const std::function<absl::Status(modbus_t *)>& method,
+                                                   const Deadline& deadline, Outcome* outcome) {
+    absl::MutexLock lock(&mutex_);
     if (!initialized_) {
         return absl::FailedPreconditionError("Modbus connection not initialized");
     }
 
-    absl::MutexLock lock(&mutex_);
-    if (!st.ok()) {
+    if (!connected_) {
+        if (auto st = Connect(); !st.ok()) {
+            *outcome = Outcome::kTransportError;
+            return st;
+        }
+    }
+
+    int error = 0;
+    auto st = RunOnce(method, deadline, &error);
+    if (st.ok() || !IsConnectionError(error, rtu_.has_value() || shared_) || deadline.Expired()) {
+        *outcome = Classify(st, error, deadline);
         return st;
     }
 
-    return method(ctx_);
+    // The connection broke (e.g. the device closed an idle socket): reconnect and retry once.
+    LOGS(INFO) << "Modbus connection lost (" << modbus_strerror(error) << "), reconnecting";
+    Disconnect();
+    if (auto cst = Connect(); !cst.ok()) {
+        *outcome = Outcome::kTransportError;
+        return cst;
+    }
+    st = RunOnce(method, deadline, &error);
+    *outcome = Classify(st, error, deadline);
+    return st;
+}
+
+wastlernet::ModbusConnection::Outcome wastlernet::ModbusConnection::Classify(const absl::Status& st, int error,
+                                                                            const Deadline& deadline) const {
+    if (st.ok()) {
+        return Outcome::kAnswered;
+    }
+    if (deadline.Expired()) {
+        return Outcome::kUnknown;
+    }
+    if (error == ETIMEDOUT) {
+        return Outcome::kNoAnswer;
+    }
+    if (IsConnectionError(error, /*unit_timeouts=*/true)) {
+        return Outcome::kTransportError;
+    }
+    return Outcome::kAnswered;
+}
+
+absl::Status wastlernet::ModbusConnection::RunOnce(const std::function<absl::Status(modbus_t *)>& method,
+                                                   const Deadline& deadline, int* error) {
+    // Shrink the response timeout to the remaining budget for this call.
+    auto timeout = deadline.RemainingMillis(std::chrono::milliseconds(timeout_ms_));
+    if (timeout.count() <= 0) {
+        return absl::DeadlineExceededError("Deadline expired before Modbus request");
+    }
+    modbus_set_response_timeout(ctx_, timeout.count() / 1000, (timeout.count() % 1000) * 1000);
+
+    // Keep the line silent for the inter-frame delay after the previous request.
+    if (auto idle = std::chrono::steady_clock::now() - last_frame_; idle < inter_frame_delay_) {
+        std::this_thread::sleep_for(inter_frame_delay_ - idle);
+    }
+
+    errno = 0;
+    auto st = method(ctx_);
+    *error = errno;
+    last_frame_ = std::chrono::steady_clock::now();
+
+    modbus_set_response_timeout(ctx_, timeout_ms_ / 1000, (timeout_ms_ % 1000) * 1000);
+
+    if (st.ok()) {
+        last_activity_ = std::chrono::steady_clock::now();
+    } else if (deadline.Expired()) {
+        LOGS(WARNING) << "Modbus request exceeded its deadline: " << st;
+        return absl::DeadlineExceededError(absl::StrCat("Modbus request exceeded deadline: ", st.message()));
+    }
+    return st;
+}
+
+std::vector<wastlernet::ModbusConnection::WriteRun> wastlernet::ModbusConnection::PlanWrites(
+        const std::map<int, uint16_t>& values, const absl::flat_hash_map<int, uint16_t>& shadow) {
+    auto unchanged = [&shadow](int address, uint16_t value) {
+        auto it = shadow.find(address);
+        return it != shadow.end() && it->second == value;
+    };
+
+    std::vector<WriteRun> runs;
+    // Index of the last changed value in the current run; values after it are trimmed.
+    size_t last_changed = 0;
+    for (const auto& [address, value] : values) {
+        bool changed = !unchanged(address, value);
+        bool extends = !runs.empty() && runs.back().address + (int) runs.back().values.size() == address &&
+                       runs.back().values.size() < MODBUS_MAX_WRITE_REGISTERS;
+
+        if (extends) {
+            runs.back().values.push_back(value);
+        } else if (changed) {
+            if (!runs.empty()) {
+                runs.back().values.resize(last_changed + 1);
+            }
+            runs.push_back({address, {value}});
+        } else {
+            // Unchanged value not adjacent to a run: nothing to write.
+            continue;
+        }
+        if (changed) {
+            last_changed = runs.back().values.size() - 1;
+        }
+    }
+    if (!runs.empty()) {
+        runs.back().values.resize(last_changed + 1);
+    }
+    return runs;
+}
+
+absl::Status wastlernet::ModbusConnection::Write(const std::map<int, uint16_t>& values, const Deadline& deadline,
+                                                 int unit_id, Outcome* outcome) {
+    // Runs with mutex_ held by Attempt().
+    return Execute([this, &values, unit_id](modbus_t* ctx) ABSL_NO_THREAD_SAFETY_ANALYSIS {
+        if (unit_id >= 0) {
+            modbus_set_slave(ctx, unit_id);
+        }
+        auto& shadow = shadow_[unit_id];
+        bool first = true;
+        for (const auto& run : PlanWrites(values, shadow)) {
+            if (!first && inter_frame_delay_.count() > 0) {
+                std::this_thread::sleep_for(inter_frame_delay_);
+            }
+            first = false;
+            int count = run.values.size();
+            int rc = count == 1 ? modbus_write_register(ctx, run.address, run.values[0])
+                                : modbus_write_registers(ctx, run.address, count, run.values.data());
+            if (rc == -1) {
+                int error = errno;
+                LOGS(ERROR) << "Error writing registers " << run.address << "-" << run.address + count - 1
+                            << ": " << modbus_strerror(error);
+                errno = error;
+                return absl::InternalError(absl::StrCat("Error writing registers: ", modbus_strerror(error)));
+            }
+            for (int i = 0; i < count; i++) {
+                shadow[run.address + i] = run.values[i];
+            }
+            // Only changed values get here, so this logs actual device writes.
+            LOGS(INFO) << "Wrote registers " << run.address << "-" << run.address + count - 1
+                       << " of unit " << unit_id;
+        }
+        return absl::OkStatus();
+    }, deadline, outcome);
+}
+
+void wastlernet::ModbusConnection::SetRegisterTtl(int unit_id, int address, int count,
+                                                  std::chrono::steady_clock::duration ttl) {
+    absl::MutexLock lock(&cache_mutex_);
+    auto& ttls = register_ttls_[unit_id];
+    auto it = std::find_if(ttls.begin(), ttls.end(), [&](const RegisterTtl& r) {
+        return r.address == address && r.count == count;
+    });
+    if (ttl <= std::chrono::steady_clock::duration::zero()) {
+        if (it != ttls.end()) {
+            ttls.erase(it);
+        }
+    } else if (it != ttls.end()) {
+        // Re-declared, e.g. when the module is re-initialized after a configuration change.
+        it->ttl = ttl;
+    } else {
+        ttls.push_back({address, count, ttl});
+    }
+    if (ttls.empty()) {
+        // Nothing left to cache on this unit: ReadBlocks() reads the blocks as planned again.
+        register_ttls_.erase(unit_id);
+    }
+    auto& cached = cache_[unit_id];
+    for (int i = 0; i < count; i++) {
+        cached.erase(address + i);
+    }
+}
+
+std::chrono::steady_clock::duration wastlernet::ModbusConnection::TtlOf(int unit_id, int address) {
+    auto it = register_ttls_.find(unit_id);
+    if (it == register_ttls_.end()) {
+        return std::chrono::steady_clock::duration::zero();
+    }
+    // Later declarations override earlier ones.
+    for (auto r = it->second.rbegin(); r != it->second.rend(); ++r) {
+        if (address >= r->address && address < r->address + r->count) {
+            return r->ttl;
+        }
+    }
+    return std::chrono::steady_clock::duration::zero();
 }
 
-absl::Status wastlernet::ModbusConnection::Reinit() {
-    // Check if a Reinit is necessary by reading e.g. the Solvis version
-    uint16_t reg[init_count_];
-    if (init_addr_ >= 0) {
-        if (int rc = modbus_read_registers(ctx_, init_addr_, init_count_, reg); rc == -1) {
-            LOGS(INFO) << "Re-initializing Modbus connection";
+absl::Status wastlernet::ModbusConnection::ReadBlocks(modbus_t* ctx, const std::vector<RegisterBlock>& blocks,
+                                                      uint16_t* buffer) {
+    int unit_id = modbus_get_slave(ctx);
+    auto now = std::chrono::steady_clock::now();
+    bool cacheable;
+    {
+        absl::MutexLock lock(&cache_mutex_);
+        cacheable = register_ttls_.contains(unit_id);
+    }
+    if (!cacheable) {
+        // Nothing cached on this unit: read the blocks as planned by the caller.
+        return ReadRegisterBlocks(ctx, blocks, buffer, inter_frame_delay_);
+    }
 
-            modbus_close(ctx_);
-            modbus_free(ctx_);
+    // Serve cached registers and collect the addresses to read, with their offset in `buffer`.
+    std::vector<std::pair<int, int>> missing;
+    int hits = 0, misses = 0;
+    {
+        absl::MutexLock lock(&cache_mutex_);
+        auto& cached = cache_[unit_id];
+        for (const auto& b : blocks) {
+            for (int i = 0; i < b.count; i++) {
+                int address = b.address + i;
+                if (TtlOf(unit_id, address) <= std::chrono::steady_clock::duration::zero()) {
+                    missing.emplace_back(address, b.offset + i);
+                    continue;
+                }
+                if (auto it = cached.find(address); it != cached.end() && it->second.expires > now) {
+                    buffer[b.offset + i] = it->second.value;
+                    hits++;
+                } else {
+                    missing.emplace_back(address, b.offset + i);
+                    misses++;
+                }
+            }
+        }
+    }
+    if (hits + misses > 0) {
+        metrics::WastlernetMetrics::GetInstance().RecordModbusRegisterCache(address_, hits, misses);
+    }
+    if (missing.empty()) {
+        return absl::OkStatus();
+    }
 
-            return Init();
+    // Re-plan the remaining registers; gaps left by cached registers may still be bridged.
+    std::sort(missing.begin(), missing.end());
+    std::vector<RegisterRange> ranges;
+    for (const auto& [address, offset] : missing) {
+        if (!ranges.empty() && ranges.back().address + ranges.back().count == address) {
+            ranges.back().count++;
+        } else if (ranges.empty() || ranges.back().address + ranges.back().count < address) {
+            ranges.push_back({address, 1});
+        }
+    }
+    auto plan = PlanRegisterBlocks(ranges);
+    int size = 0;
+    for (const auto& b : plan) {
+        size = std::max(size, b.offset + b.count);
+    }
+    std::vector<uint16_t> registers(size);
+    if (auto st = ReadRegisterBlocks(ctx, plan, registers.data(), inter_frame_delay_); !st.ok()) {
+        return st;
+    }
+
+    absl::MutexLock lock(&cache_mutex_);
+    auto& cached = cache_[unit_id];
+    for (const auto& [address, offset] : missing) {
+        // Last block starting at or before `address`; the plan covers every requested register.
+        auto b = std::upper_bound(plan.begin(), plan.end(), address,
+                                  [](int a, const RegisterBlock& block) { return a < block.address; }) - 1;
+        uint16_t value = registers[b->offset + address - b->address];
+        buffer[offset] = value;
+        if (auto ttl = TtlOf(unit_id, address); ttl > std::chrono::steady_clock::duration::zero()) {
+            cached[address] = {value, now + ttl};
         }
     }
     return absl::OkStatus();
 }
 
+void wastlernet::ModbusConnection::KeepAlive() {
+    // Name() is not used here: this thread outlives the derived class during destruction.
+    std::vector<uint16_t> reg(init_count_);
+
+    absl::MutexLock lock(&mutex_);
+    while (!mutex_.AwaitWithTimeout(absl::Condition(&stopping_), absl::FromChrono(keepalive_))) {
+        auto now = std::chrono::steady_clock::now();
+        if (!connected_ || now - last_activity_ < keepalive_) {
+            continue;
+        }
+
+        // Check the idle connection by reading e.g. the Solvis version
+        if (probe_unit_ >= 0) {
+            modbus_set_slave(ctx_, probe_unit_);
+        }
+        if (modbus_read_registers(ctx_, init_addr_, init_count_, reg.data()) == -1) {
+            int error = errno;
+            if (IsConnectionError(error, rtu_.has_value() || shared_)) {
+                LOG(INFO) << "[" << address_ << "] Keepalive probe failed (" << modbus_strerror(error)
+                          << "), closing idle Modbus connection";
+                Disconnect();
+                continue;
+            }
+            // E.g. an exception reply, or a silent probe unit on a shared bus: the connection itself is fine.
+            LOG(INFO) << "[" << address_ << "] Keepalive probe failed (" << modbus_strerror(error)
+                      << "), keeping the connection";
+        }
+        last_activity_ = now;
+    }
+}
+
 
 int16_t wastlernet::ModbusConnection::toInt16(const uint16_t *u) {
-    // Use a union for type punning to re-interpret the 16-bit unsigned integer as a 16-bit signed integer.
-    union {
-        uint16_t u16;
-        int16_t i16;
-    } converter {};
-    converter.u16 = *u;
-    return converter.i16;
+    return static_cast<int16_t>(*u);
 }
 
 int32_t wastlernet::ModbusConnection::toInt32(const uint16_t *u) {
-    // Use a union for type punning to re-interpret the 32-bit unsigned integer as a 32-bit signed integer.
-   union {
-        uint32_t u32;
-        int32_t i32;
-    } converter {};
-
-    converter.u32 = ((uint32_t)u[0] << 16) | u[1];
-    return converter.i32;
+    return static_cast<int32_t>(((uint32_t)u[0] << 16) | u[1]);
 }
 
 int64_t wastlernet::ModbusConnection::toInt64(const uint16_t *u) {
@@ -107,17 +499,12 @@ int64_t wastlernet::ModbusConnection::toInt64(const uint16_t *u) {
 }
 
 float wastlernet::ModbusConnection::toFloat(const uint16_t *u) {
-    // Use a union for type punning to re-interpret the 32-bit unsigned integer
-    // as a 32-bit floating-point number (IEEE 754 single-precision).
-    union {
-        uint32_t u32;
-        float f32;
-    } converter {};
-
-    converter.u32 = ((uint32_t)u[0] << 16) | u[1];
-
-    // Return the float representation
-    return converter.f32;
+    // Re-interpret the 32-bit unsigned integer as a 32-bit floating-point number (IEEE 754
+    // single-precision); memcpy avoids the undefined behaviour of union type punning.
+    uint32_t u32 = ((uint32_t)u[0] << 16) | u[1];
+    float f32;
+    std::memcpy(&f32, &u32, sizeof(f32));
+    return f32;
 }
 
 std::string wastlernet::ModbusConnection::toString(const uint16_t *u, int nchars) {
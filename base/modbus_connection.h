@@ -4,13 +4,24 @@
 // Modbus connection helper.
 //
 // This header defines the wastlernet::ModbusConnection base class which encapsulates
-// the boilerplate around establishing and maintaining a libmodbus TCP connection and
-// provides convenience utilities to convert raw Modbus register values to native types.
+// the boilerplate around establishing and maintaining a libmodbus connection, either Modbus/TCP
+// or Modbus RTU over a serial line (e.g. an RS485 USB adapter), and provides convenience
+// utilities to convert raw Modbus register values to native types.
 //
 // Responsibilities
-// - Lazily initialize and maintain a modbus_t context (TCP) to a given host:port.
-// - Serialize access and automatically re-initialize the context on failures.
-// - Provide Execute() to run user code against the active context.
+// - Lazily initialize and maintain a modbus_t context to a given host:port (TCP) or serial
+//   device (RTU).
+// - Serialize access and reconnect when a request fails with a connection-level error
+//   (ECONNRESET, EPIPE, ETIMEDOUT, ...), retrying the request once on the new connection.
+// - Probe idle connections from a keepalive timer instead of before every request (TCP only;
+//   a serial line has no connection that could be dropped while idle).
+// - Keep the inter-frame silence required by Modbus RTU between consecutive requests.
+// - Fail fast through a CircuitBreaker while the device is unreachable.
+// - Provide Execute() to run user code against the active context within a Deadline.
+// - Provide Write() to apply a set of register values with as few write requests as possible,
+//   skipping values the device already holds according to a shadow of the last written values.
+// - Provide ReadBlocks() to read register blocks, serving rarely changing registers from a cache
+//   with per-range TTLs.
 // - Provide conversion helpers for typical Modbus register layouts.
 //
 // Thread-safety
@@ -19,29 +30,64 @@
 // is executed while holding the connection; keep it short and avoid blocking operations.
 //
 // Usage
-// - Construct with host, port and optional initial register range (for a light-weight connectivity check).
+// - Construct with host, port and optional register range used as a light-weight connectivity probe
+//   (read once after an idle period of `keepalive_ms`).
 // - Call Init() before the first Execute(); subsequent calls are cheap no-ops.
 // - Implement Name() in derived classes to aid logging/diagnostics.
 // - Use the static conversion helpers to interpret register buffers returned by libmodbus.
 //
 #pragma once
 #include <bitset>
+#include <chrono>
+#include <map>
+#include <optional>
 #include <string>
+#include <thread>
+#include <vector>
+#include <absl/container/flat_hash_map.h>
 #include <absl/status/status.h>
+#include <absl/strings/str_cat.h>
 #include <absl/synchronization/mutex.h>
 #include <modbus/modbus.h>
+#include <modbus/modbus-rtu.h>
 #include <modbus/modbus-tcp.h>
 #include <functional>
 
+#include "base/circuit_breaker.h"
+#include "base/deadline.h"
+#include "base/register_map.h"
+
 #ifndef WASTLERNET_MODBUS_CONNECTION_H
 #define WASTLERNET_MODBUS_CONNECTION_H
 namespace wastlernet {
+    /** Serial line settings of a Modbus RTU connection. */
+    struct ModbusRtuOptions {
+        /** Serial device, e.g. /dev/ttyUSB0. */
+        std::string device;
+        int baud = 9600;
+        /** 'N', 'E' or 'O'. */
+        char parity = 'E';
+        int data_bits = 8;
+        int stop_bits = 1;
+        /**
+         * Minimum silence between two frames on the line. Zero selects the 3.5 character times
+         * required by the Modbus RTU specification (see InterFrameDelay()).
+         */
+        std::chrono::microseconds inter_frame_delay{0};
+    };
+
     /**
-     * Base class managing a Modbus/TCP connection using libmodbus.
+     * The Modbus RTU inter-frame delay for `options`: the configured delay, or 3.5 character
+     * times at the configured baud rate, fixed at 1750 µs above 19200 baud as per the specification.
+     */
+    std::chrono::microseconds InterFrameDelay(const ModbusRtuOptions& options);
+
+    /**
+     * Base class managing a Modbus/TCP or Modbus RTU connection using libmodbus.
      *
      * After Init(), use Execute() to perform Modbus operations with an active modbus_t context.
-     * The class can optionally read a small range of holding registers during initialization to
-     * validate connectivity.
+     * The class can optionally read a small range of holding registers to validate connectivity of
+     * a connection that has been idle for a while.
      */
     class ModbusConnection {
     public:
@@ -49,15 +95,43 @@ namespace wastlernet {
          * Construct a Modbus connection helper.
          * @param host        Target host (IPv4/IPv6/DNS name).
          * @param port        TCP port.
-         * @param init_addr   Optional starting address for an initial read during Init() (-1 to skip).
-         * @param init_count  Number of registers to read for the initial check.
-         * @param timeout_ms  Timeout for modbus connection in milliseconds
+         * @param init_addr    Optional starting address for the keepalive probe read (-1 to skip).
+         * @param init_count   Number of registers to read for the probe.
+         * @param timeout_ms   Timeout for modbus connection in milliseconds; an upper bound for the
+         *                     per-request response timeout derived from the Execute() deadline.
+         * @param keepalive_ms Idle time after which the connection is probed (if init_addr >= 0).
+         */
+        ModbusConnection(const std::string& host, int16_t port, int32_t init_addr = -1, int16_t init_count = 2,
+                         int32_t timeout_ms = 10000, int32_t keepalive_ms = 60000)
+        : host_(host), port_(port), init_addr_(init_addr), init_count_(init_count), timeout_ms_(timeout_ms),
+          keepalive_(std::chrono::milliseconds(keepalive_ms)), address_(absl::StrCat(host, ":", port)),
+          breaker_(address_) { }
+
+        /**
+         * Construct a Modbus RTU connection on a serial line. Several units may share the line
+         * (multi-drop); address them with modbus_set_slave() in Execute(), or through a ModbusBus.
+         * @param rtu        Serial line settings.
+         * @param timeout_ms Response timeout in milliseconds (see above).
          */
-        ModbusConnection(const std::string& host, int16_t port, int32_t init_addr = -1, int16_t init_count = 2, int32_t timeout_ms = 10000)
-        : host_(host), port_(port), init_addr_(init_addr), init_count_(init_count), timeout_ms_(timeout_ms) { }
+        explicit ModbusConnection(const ModbusRtuOptions& rtu, int32_t timeout_ms = 1000)
+        : host_(rtu.device), port_(0), init_addr_(-1), init_count_(0), timeout_ms_(timeout_ms),
+          keepalive_(std::chrono::milliseconds(0)), rtu_(rtu), inter_frame_delay_(InterFrameDelay(rtu)),
+          address_(rtu.device), breaker_(address_) { }
 
         virtual ~ModbusConnection();
 
+        /** What a request told about the device, for circuit breakers. */
+        enum class Outcome {
+            /** The device answered (possibly with an exception or a reply the callback rejected). */
+            kAnswered,
+            /** The addressed unit did not answer within the response timeout. */
+            kNoAnswer,
+            /** Connecting failed or the connection broke. */
+            kTransportError,
+            /** Nothing is known, e.g. because the caller's deadline expired. */
+            kUnknown,
+        };
+
         /**
          * Initialize (or re-initialize) the libmodbus context and establish a TCP connection.
          * Safe to call multiple times; subsequent calls are no-ops if already initialized.
@@ -66,13 +140,79 @@ namespace wastlernet {
         absl::Status Init();
 
         /**
-         * Execute user code with the active modbus_t context. Handles reconnects transparently
-         * if the connection is lost and Reinit() succeeds.
+         * Execute user code with the active modbus_t context. If the callback fails with a
+         * connection-level errno (reset, broken pipe, timeout, ...), the connection is re-established
+         * and the callback is retried once. Callbacks should therefore be idempotent.
+         *
+         * The libmodbus response timeout is shrunk to the time remaining until `deadline` (capped
+         * at the configured timeout) while the callback runs.
+         *
+         * While the circuit breaker is open, Execute() fails fast with Unavailable without touching
+         * the network. Only transport failures (connect errors, broken connections, response
+         * timeouts) count towards opening it; Modbus exception replies, errors returned by the
+         * callback and expired deadlines do not.
+         *
+         * @param method   A function that receives the active modbus_t* and returns status.
+         * @param deadline Time by which the callback must have completed.
+         * @param outcome  Optional; receives what the request told about the device.
+         *
+         * @return absl::OkStatus if the callback returned OK; DeadlineExceeded if the deadline
+         *         expired before or during the call; otherwise a non-OK status.
+         */
+        absl::Status Execute(const std::function<absl::Status(modbus_t*)>& method,
+                             const Deadline& deadline = Deadline::Infinite(), Outcome* outcome = nullptr);
+
+        /** Consecutive holding registers written with a single request. */
+        struct WriteRun {
+            int address;
+            std::vector<uint16_t> values;
+        };
+
+        /**
+         * Write holding registers (address -> value) through Execute().
+         *
+         * Values equal to the last value successfully written to the same register on the current
+         * connection are skipped. The remaining registers are coalesced into runs of consecutive
+         * addresses, each written with one request: modbus_write_registers (function 0x10) for
+         * runs of several registers, modbus_write_register (0x06) for single ones. An unchanged
+         * register between two changed ones is rewritten to keep the run contiguous.
+         *
+         * The shadow of written values is dropped on reconnect, since the device may have been
+         * restarted in the meantime.
+         *
+         * @param unit_id Modbus unit identifier to address behind a gateway (-1 to keep the current one).
+         *                Each unit has its own shadow.
+         * @param outcome Optional; see Execute().
+         */
+        absl::Status Write(const std::map<int, uint16_t>& values, const Deadline& deadline = Deadline::Infinite(),
+                           int unit_id = -1, Outcome* outcome = nullptr);
+
+        /** Plan the requests for Write(), given the last written values in `shadow`. */
+        static std::vector<WriteRun> PlanWrites(const std::map<int, uint16_t>& values,
+                                                const absl::flat_hash_map<int, uint16_t>& shadow);
+
+        /**
+         * Cache the registers [address, address + count) of unit `unit_id` for `ttl` after they
+         * have been read by ReadBlocks(). Meant for registers that rarely change (configuration,
+         * versions, ranges), declared by the module once at Init(). A zero `ttl` removes the
+         * declaration, e.g. when caching was disabled by a configuration change.
+         */
+        void SetRegisterTtl(int unit_id, int address, int count, std::chrono::steady_clock::duration ttl);
+
+        /**
+         * Read `blocks` (see RegisterMap::blocks()) into `buffer` from within an Execute() callback.
          *
-         * @param method A function that receives the active modbus_t* and returns status.
-         * @return absl::OkStatus if the callback returned OK; otherwise a non-OK status.
+         * Registers with a TTL that are still cached are served from the cache; only the remaining
+         * registers are read from the device, re-planned into as few requests as possible with
+         * PlanRegisterBlocks(). Cache hits and misses are exported as
+         * wastlernet_modbus_register_cache_total. The cache is dropped on reconnect.
          */
-        absl::Status Execute(const std::function<absl::Status(modbus_t*)>& method);
+        absl::Status ReadBlocks(modbus_t* ctx, const std::vector<RegisterBlock>& blocks, uint16_t* buffer);
+
+        /** Silence kept between requests; zero for Modbus/TCP. */
+        std::chrono::microseconds inter_frame_delay() const {
+            return inter_frame_delay_;
+        }
 
     private:
         absl::Mutex mutex_;
@@ -83,17 +223,97 @@ namespace wastlernet {
         int16_t init_count_;
         int32_t timeout_ms_;
 
-        bool initialized_ = false;
+        std::chrono::steady_clock::duration keepalive_;
+
+        /** Serial line settings if this is a Modbus RTU connection. */
+        std::optional<ModbusRtuOptions> rtu_;
+        std::chrono::microseconds inter_frame_delay_{0};
+
+        /** "host:port" or the serial device, for logs, errors and metrics. */
+        std::string address_;
+
+        /** Set once Init() succeeded. */
+        bool initialized_ ABSL_GUARDED_BY(mutex_) = false;
+        /** Whether ctx_ currently holds an open connection. */
+        bool connected_ ABSL_GUARDED_BY(mutex_) = false;
+        /** Set by ShareBetweenUnits(). */
+        bool shared_ = false;
+        /** Unit addressed by the keepalive probe, -1 for the current one. */
+        int probe_unit_ = -1;
+
+        /** Time of the last successful exchange with the device. */
+        std::chrono::steady_clock::time_point last_activity_ ABSL_GUARDED_BY(mutex_);
+        /** End of the last request on the line, successful or not (RTU inter-frame timing). */
+        std::chrono::steady_clock::time_point last_frame_ ABSL_GUARDED_BY(mutex_);
+
+        modbus_t *ctx_ ABSL_GUARDED_BY(mutex_) = nullptr;
+
+        /** Last value written to each register on the current connection, per unit id. */
+        absl::flat_hash_map<int, absl::flat_hash_map<int, uint16_t>> shadow_ ABSL_GUARDED_BY(mutex_);
+
+        struct RegisterTtl {
+            int address;
+            int count;
+            std::chrono::steady_clock::duration ttl;
+        };
 
-        modbus_t *ctx_ = nullptr;
+        struct CachedRegister {
+            uint16_t value;
+            std::chrono::steady_clock::time_point expires;
+        };
 
-        /** Check if a reinit is necessary and re-establish the connection if needed. */
-        absl::Status Reinit();
+        // ReadBlocks() runs inside Execute() callbacks, i.e. while mutex_ is held by Attempt(),
+        // so the cache has its own lock.
+        absl::Mutex cache_mutex_ ABSL_ACQUIRED_AFTER(mutex_);
+        /** Declared TTLs per unit id. */
+        absl::flat_hash_map<int, std::vector<RegisterTtl>> register_ttls_ ABSL_GUARDED_BY(cache_mutex_);
+        /** Cached register values per unit id. */
+        absl::flat_hash_map<int, absl::flat_hash_map<int, CachedRegister>> cache_ ABSL_GUARDED_BY(cache_mutex_);
+
+        /** TTL of a register of `unit_id`, zero if it is not cached. */
+        std::chrono::steady_clock::duration TtlOf(int unit_id, int address) ABSL_SHARED_LOCKS_REQUIRED(cache_mutex_);
+
+        CircuitBreaker breaker_;
+
+        bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+        std::thread keepalive_thread_;
+
+        /** Allocate the context if needed and make a single connection attempt. */
+        absl::Status Connect() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        /** Close the connection; the next request reconnects. */
+        void Disconnect() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        /** Run `method`, reconnecting and retrying once on connection-level errors. */
+        absl::Status Attempt(const std::function<absl::Status(modbus_t*)>& method, const Deadline& deadline,
+                             Outcome* outcome);
+
+        /** Classify the result of RunOnce() given the errno it left in `error`. */
+        Outcome Classify(const absl::Status& st, int error, const Deadline& deadline) const;
+
+        /** Run `method` once with the response timeout shrunk to the remaining budget. */
+        absl::Status RunOnce(const std::function<absl::Status(modbus_t*)>& method, const Deadline& deadline,
+                             int* error) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        /** Keepalive thread body: probe the connection whenever it has been idle for `keepalive_`. */
+        void KeepAlive();
 
     protected:
         /** Name of the connection (for logging/diagnostics). Must be provided by derived classes. */
         virtual std::string Name() = 0;
 
+        /**
+         * Declare that several units share this connection, e.g. behind a gateway or on an RS485
+         * line (see ModbusBus); call from the derived constructor. A response timeout then only
+         * concerns the addressed unit: it neither reconnects nor counts towards the circuit breaker,
+         * and is reported as Outcome::kNoAnswer for the caller to track per unit. The keepalive
+         * probe addresses `probe_unit`.
+         */
+        void ShareBetweenUnits(int probe_unit) {
+            shared_ = true;
+            probe_unit_ = probe_unit;
+        }
+
     public:
         /** Convert a single 16-bit register to a signed int16_t. */
         static int16_t toInt16(const uint16_t* u);
@@ -1,152 +1,39 @@
 //
 // Created by wastl on 04.07.25.
 //
+#include <future>
 #include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
 #include <modbus/modbus.h>
 
+#include "modbus_async.h"
+#include "modbus_bus.h"
 #include "modbus_connection.h"
+#include "modbus_sim.h"
 
+#include <absl/synchronization/mutex.h>
+#include <absl/synchronization/notification.h>
 #include <glog/logging.h>
 
 class ModbusTest : public testing::Test {
 protected:
-    ModbusTest() {
-    }
-
     void SetUp() override {
-        // Code here will be called immediately after the constructor (right
-        // before each test).
-
-        server_thread_.reset(new std::thread([=]() {
-            ASSERT_EQ(this->runModbusTCPServer(15002, 50), 0);
-        }));
-
-        // Give the server a moment to start up and bind to the port
-        while (!running_) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        sim_ = std::make_unique<wastlernet::ModbusSimulator>(15002, 0, 50);
+        for (int i = 0; i < 50; ++i) {
+            sim_->SetRegister(i, i + 100);
         }
+        ASSERT_TRUE(sim_->Start().ok());
     }
 
     void TearDown() override {
-        // Code here will be called immediately after each test (right
-        // before the destructor).
-        running_ = false;
-
-        if (server_thread_ != nullptr) {
-            server_thread_->join();
-        }
+        sim_.reset();
     }
 
-private:
-    bool running_ = false;
-    std::unique_ptr<std::thread> server_thread_;
-
-    int runModbusTCPServer(int port, int num_registers) {
-        modbus_t *ctx = nullptr;
-        modbus_mapping_t *mb_mapping = nullptr;
-        int server_socket = -1;
-
-        // 1. Create a Modbus TCP context
-        // The IP address is NULL, which means it will listen on all available network interfaces.
-        ctx = modbus_new_tcp(NULL, port);
-        if (ctx == NULL) {
-            std::cerr << "Failed to create Modbus TCP context: " << modbus_strerror(errno) << std::endl;
-            return -1;
-        }
-
-        // Set Modbus debug mode (optional, useful for debugging)
-        // modbus_set_debug(ctx, TRUE);
-
-        // 2. Allocate Modbus mapping structure
-        // This structure holds the actual register data.
-        // We'll set the number of coils, discrete inputs, holding registers, and input registers.
-        // For this example, we'll focus on holding registers.
-        mb_mapping = modbus_mapping_new(
-            10, // num_coils (0x01, 0x02)
-            10, // num_discrete_inputs (0x02)
-            num_registers, // num_holding_registers (0x03, 0x06, 0x10)
-            10 // num_input_registers (0x04)
-        );
-
-        if (mb_mapping == NULL) {
-            std::cerr << "Failed to allocate Modbus mapping: " << modbus_strerror(errno) << std::endl;
-            modbus_free(ctx);
-            return -1;
-        }
-
-        // Initialize holding registers with some sample data
-        for (int i = 0; i < num_registers; ++i) {
-            mb_mapping->tab_registers[i] = i + 100; // Example data
-        }
-        std::cout << "Initialized " << num_registers << " holding registers." << std::endl;
-
-        // 3. Bind the server to the specified port
-        // This makes the server listen for incoming connections.
-        server_socket = modbus_tcp_listen(ctx, 1); // 1 is the maximum number of pending connections
-        if (server_socket == -1) {
-            std::cerr << "Failed to listen on TCP port " << port << ": " << modbus_strerror(errno) << std::endl;
-            modbus_mapping_free(mb_mapping);
-            modbus_free(ctx);
-            return -1;
-        }
-        std::cout << "Modbus TCP server listening on port " << port << std::endl;
-
-        running_ = true;
-        // 4. Main server loop to handle client connections
-        while (running_) {
-            // Accept a new client connection
-            int client_socket = modbus_tcp_accept(ctx, &server_socket);
-            if (client_socket == -1) {
-                std::cerr << "Failed to accept client connection: " << modbus_strerror(errno) << std::endl;
-                // Depending on the error, you might want to break or continue
-                continue;
-            }
-            std::cout << "Client connected (socket: " << client_socket << ")" << std::endl;
-
-            // Set the socket for the Modbus context to the newly accepted client socket
-            modbus_set_socket(ctx, client_socket);
-
-            // Buffer for Modbus requests
-            uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
-            int rc; // Return code
-
-            // Loop to serve requests from the current client
-            while (running_) {
-                // Read the request from the client
-                rc = modbus_receive(ctx, query);
-                if (rc == -1) {
-                    // Connection closed by client or an error occurred
-                    std::cerr << "Client connection closed or error: " << modbus_strerror(errno) << std::endl;
-                    break; // Exit inner loop to accept new client
-                } else if (rc == 0) {
-                    // No request received (e.g., timeout, though modbus_receive blocks)
-                    std::cout << "No request received from client, perhaps timeout." << std::endl;
-                    continue;
-                }
-
-                // Process the Modbus request and send the response
-                // modbus_reply handles the request using the data in mb_mapping
-                modbus_reply(ctx, query, rc, mb_mapping);
-                std::cout << "Served request from client." << std::endl;
-            }
-
-            // Close the client socket when done with it
-            close(client_socket);
-            std::cout << "Client disconnected (socket: " << client_socket << ")" << std::endl;
-        }
-
-        // 5. Cleanup (This part is typically unreachable in an infinite server loop,
-        // but essential if the loop can terminate.)
-        std::cout << "Server shutting down..." << std::endl;
-        modbus_mapping_free(mb_mapping);
-        modbus_free(ctx);
-        if (server_socket != -1) {
-            close(server_socket);
-        }
-
-        return 0;
-    }
+    std::unique_ptr<wastlernet::ModbusSimulator> sim_;
 };
 
 class TestModbusConnection : public wastlernet::ModbusConnection {
@@ -245,3 +132,444 @@ TEST_F(ModbusTest, TypeConversions) {
     uint16_t value7[2] = {0x47F1, 0x2000};
     EXPECT_DOUBLE_EQ(wastlernet::ModbusConnection::toFloat(value7), 123456.0);
 }
+
+// A request failing with a connection-level error is retried once on a fresh connection.
+TEST_F(ModbusTest, ReconnectsAndRetriesOnConnectionError) {
+    TestModbusConnection test;
+    ASSERT_TRUE(test.Init().ok());
+
+    int calls = 0;
+    auto st = test.Execute([&calls](modbus_t* ctx) {
+        if (++calls == 1) {
+            errno = ECONNRESET;
+            return absl::InternalError("connection reset");
+        }
+
+        uint16_t value;
+        if (modbus_read_registers(ctx, 0, 1, &value) == -1) {
+            return absl::InternalError(std::string("Error reading register: ") + modbus_strerror(errno));
+        }
+        EXPECT_EQ(value, 100);
+        return absl::OkStatus();
+    });
+
+    EXPECT_TRUE(st.ok()) << st;
+    EXPECT_EQ(calls, 2);
+}
+
+// Application-level errors are not retried.
+TEST_F(ModbusTest, DoesNotRetryOtherErrors) {
+    TestModbusConnection test;
+    ASSERT_TRUE(test.Init().ok());
+
+    int calls = 0;
+    auto st = test.Execute([&calls](modbus_t* ctx) {
+        calls++;
+        errno = EMBMDATA;
+        return absl::InternalError("too many data");
+    });
+
+    EXPECT_FALSE(st.ok());
+    EXPECT_EQ(calls, 1);
+}
+
+// Exception replies and callback errors mean the device answered: they never open the circuit.
+TEST_F(ModbusTest, ApplicationErrorsDoNotOpenCircuit) {
+    TestModbusConnection test;
+    ASSERT_TRUE(test.Init().ok());
+
+    for (int i = 0; i < 5; i++) {
+        auto st = test.Execute([](modbus_t* ctx) {
+            uint16_t value;
+            // Outside the simulated register range: the device answers with an exception.
+            if (modbus_read_registers(ctx, 1000, 1, &value) == -1) {
+                return absl::InternalError(std::string("Error reading register: ") + modbus_strerror(errno));
+            }
+            return absl::OkStatus();
+        });
+        EXPECT_FALSE(st.ok());
+        EXPECT_FALSE(absl::IsUnavailable(st)) << st;
+    }
+
+    EXPECT_TRUE(test.Execute([](modbus_t* ctx) {
+        uint16_t value;
+        return modbus_read_registers(ctx, 0, 1, &value) == -1 ? absl::InternalError("read failed")
+                                                              : absl::OkStatus();
+    }).ok());
+}
+
+TEST(ModbusPlanWritesTest, CoalescesConsecutiveRegisters) {
+    auto runs = wastlernet::ModbusConnection::PlanWrites({{10, 1}, {11, 2}, {12, 3}, {20, 4}}, {});
+    ASSERT_EQ(runs.size(), 2);
+    EXPECT_EQ(runs[0].address, 10);
+    EXPECT_EQ(runs[0].values, std::vector<uint16_t>({1, 2, 3}));
+    EXPECT_EQ(runs[1].address, 20);
+    EXPECT_EQ(runs[1].values, std::vector<uint16_t>({4}));
+}
+
+// Unchanged values at the edges of a run are dropped; unchanged values inside a run are rewritten.
+TEST(ModbusPlanWritesTest, SkipsUnchangedValues) {
+    absl::flat_hash_map<int, uint16_t> shadow = {{10, 1}, {12, 3}, {13, 4}, {20, 5}};
+
+    auto runs = wastlernet::ModbusConnection::PlanWrites({{10, 1}, {11, 9}, {12, 3}, {13, 9}, {14, 4}, {20, 5}},
+                                                         shadow);
+    ASSERT_EQ(runs.size(), 1);
+    EXPECT_EQ(runs[0].address, 11);
+    EXPECT_EQ(runs[0].values, std::vector<uint16_t>({9, 3, 9, 4}));
+
+    EXPECT_TRUE(wastlernet::ModbusConnection::PlanWrites({{10, 1}, {20, 5}}, shadow).empty());
+}
+
+TEST_F(ModbusTest, WriteSkipsValuesAlreadyWritten) {
+    TestModbusConnection test;
+    ASSERT_TRUE(test.Init().ok());
+
+    ASSERT_TRUE(test.Write({{20, 1}, {21, 2}, {22, 3}}).ok());
+
+    // Change a register behind the connection's back; writing the same values again must not touch it.
+    ASSERT_TRUE(test.Execute([](modbus_t* ctx) {
+        return modbus_write_register(ctx, 21, 42) == -1 ? absl::InternalError("write failed") : absl::OkStatus();
+    }).ok());
+    ASSERT_TRUE(test.Write({{20, 1}, {21, 2}, {22, 3}}).ok());
+
+    ASSERT_TRUE(test.Execute([](modbus_t* ctx) {
+        uint16_t values[3];
+        if (modbus_read_registers(ctx, 20, 3, values) == -1) {
+            return absl::InternalError("read failed");
+        }
+        EXPECT_EQ(values[0], 1);
+        EXPECT_EQ(values[1], 42);
+        EXPECT_EQ(values[2], 3);
+        return absl::OkStatus();
+    }).ok());
+}
+
+TEST_F(ModbusTest, ReadBlocksServesCachedRegisters) {
+    TestModbusConnection test;
+    ASSERT_TRUE(test.Init().ok());
+    test.SetRegisterTtl(MODBUS_TCP_SLAVE, 10, 30, std::chrono::hours(1));
+
+    uint16_t values[50];
+    auto read = [&test, &values](modbus_t* ctx) { return test.ReadBlocks(ctx, {{0, 50, 0}}, values); };
+    ASSERT_TRUE(test.Execute(read).ok());
+    EXPECT_EQ(values[20], 120);
+
+    // Registers 10-39 come from the cache; 0-9 and 40-49 are too far apart for one request.
+    sim_->SetRegister(5, 5);
+    sim_->SetRegister(20, 20);
+    int64_t requests = sim_->requests();
+    ASSERT_TRUE(test.Execute(read).ok());
+    EXPECT_EQ(sim_->requests() - requests, 2);
+    EXPECT_EQ(values[5], 5);
+    EXPECT_EQ(values[20], 120);
+    EXPECT_EQ(values[45], 145);
+
+    // Expired registers are read again.
+    test.SetRegisterTtl(MODBUS_TCP_SLAVE, 10, 30, std::chrono::milliseconds(1));
+    ASSERT_TRUE(test.Execute(read).ok());
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    ASSERT_TRUE(test.Execute(read).ok());
+    EXPECT_EQ(values[20], 20);
+
+    // A zero TTL stops caching: every register is read from the device again.
+    test.SetRegisterTtl(MODBUS_TCP_SLAVE, 10, 30, std::chrono::hours(1));
+    ASSERT_TRUE(test.Execute(read).ok());
+    test.SetRegisterTtl(MODBUS_TCP_SLAVE, 10, 30, std::chrono::seconds(0));
+    sim_->SetRegister(20, 21);
+    requests = sim_->requests();
+    ASSERT_TRUE(test.Execute(read).ok());
+    EXPECT_EQ(sim_->requests() - requests, 1);
+    EXPECT_EQ(values[20], 21);
+}
+
+// Requests of different units are interleaved round-robin, and control requests overtake queued reads.
+TEST_F(ModbusTest, BusSchedulesFairlyAndPrioritizesControl) {
+    wastlernet::ModbusBus bus("127.0.0.1", 15002);
+    ASSERT_TRUE(bus.Init().ok());
+
+    absl::Mutex mu;
+    bool released = false;
+    std::vector<std::string> order;
+    auto record = [&](const std::string& label) {
+        return [&, label](modbus_t* ctx) {
+            uint16_t value;
+            if (modbus_read_registers(ctx, 0, 1, &value) == -1) {
+                return absl::InternalError("read failed");
+            }
+            absl::MutexLock lock(&mu);
+            order.push_back(label);
+            return absl::OkStatus();
+        };
+    };
+
+    // Occupy the bus until all other requests are queued.
+    std::thread blocker([&]() {
+        ASSERT_TRUE(bus.Execute(1, wastlernet::ModbusBus::Priority::kRead, [&](modbus_t*) {
+            absl::MutexLock lock(&mu);
+            mu.Await(absl::Condition(&released));
+            return absl::OkStatus();
+        }).ok());
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::vector<std::thread> clients;
+    auto submit = [&](int unit, wastlernet::ModbusBus::Priority priority, const std::string& label) {
+        clients.emplace_back([&, unit, priority, label]() {
+            EXPECT_TRUE(bus.Execute(unit, priority, record(label)).ok());
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    };
+    submit(1, wastlernet::ModbusBus::Priority::kRead, "1a");
+    submit(1, wastlernet::ModbusBus::Priority::kRead, "1b");
+    submit(2, wastlernet::ModbusBus::Priority::kRead, "2a");
+    submit(3, wastlernet::ModbusBus::Priority::kControl, "3w");
+
+    {
+        absl::MutexLock lock(&mu);
+        released = true;
+    }
+    blocker.join();
+    for (auto& t : clients) {
+        t.join();
+    }
+
+    EXPECT_EQ(order, std::vector<std::string>({"3w", "2a", "1a", "1b"}));
+}
+
+TEST_F(ModbusTest, BusDropsRequestsQueuedPastDeadline) {
+    wastlernet::ModbusBus bus("127.0.0.1", 15002);
+    ASSERT_TRUE(bus.Init().ok());
+
+    absl::Notification release;
+    std::thread blocker([&]() {
+        ASSERT_TRUE(bus.Execute(1, wastlernet::ModbusBus::Priority::kRead, [&](modbus_t*) {
+            release.WaitForNotification();
+            return absl::OkStatus();
+        }).ok());
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    bool called = false;
+    auto st = bus.Execute(2, wastlernet::ModbusBus::Priority::kRead, [&](modbus_t*) {
+        called = true;
+        return absl::OkStatus();
+    }, wastlernet::Deadline::After(std::chrono::milliseconds(50)));
+    release.Notify();
+    blocker.join();
+
+    EXPECT_EQ(st.code(), absl::StatusCode::kDeadlineExceeded);
+    EXPECT_FALSE(called);
+}
+
+// A silent unit opens only its own circuit: it is neither retried on a new connection nor holds up other units.
+TEST_F(ModbusTest, BusIsolatesSilentUnit) {
+    wastlernet::ModbusBus bus("127.0.0.1", 15002);
+    ASSERT_TRUE(bus.Init().ok());
+
+    int calls = 0;
+    auto silent = [&calls](modbus_t*) {
+        calls++;
+        errno = ETIMEDOUT;
+        return absl::InternalError("Connection timed out");
+    };
+    auto read = [](modbus_t* ctx) {
+        uint16_t value;
+        return modbus_read_registers(ctx, 0, 1, &value) == -1 ? absl::InternalError("read failed")
+                                                              : absl::OkStatus();
+    };
+
+    for (int i = 0; i < 3; i++) {
+        auto st = bus.Execute(2, wastlernet::ModbusBus::Priority::kRead, silent);
+        EXPECT_FALSE(absl::IsUnavailable(st)) << st;
+        EXPECT_TRUE(bus.Execute(1, wastlernet::ModbusBus::Priority::kRead, read).ok());
+    }
+    EXPECT_EQ(calls, 3);
+
+    EXPECT_TRUE(absl::IsUnavailable(bus.Execute(2, wastlernet::ModbusBus::Priority::kRead, silent)));
+    EXPECT_EQ(calls, 3);
+    EXPECT_TRUE(bus.Execute(1, wastlernet::ModbusBus::Priority::kRead, read).ok());
+}
+
+TEST_F(ModbusTest, AsyncConnectionPipelinesRequests) {
+    wastlernet::ModbusEventLoop loop;
+    ASSERT_TRUE(loop.Init().ok());
+    wastlernet::AsyncModbusConnection conn(&loop, "127.0.0.1", 15002, 4);
+    ASSERT_TRUE(conn.Init().ok());
+
+    // More requests than in-flight slots; all are answered over the same connection.
+    std::vector<std::future<absl::StatusOr<wastlernet::ModbusRegisters>>> results;
+    for (int i = 0; i < 10; i++) {
+        results.push_back(conn.ReadRegisters(1, i, 2, wastlernet::Deadline::After(std::chrono::seconds(5))));
+    }
+    for (int i = 0; i < 10; i++) {
+        auto registers = results[i].get();
+        ASSERT_TRUE(registers.ok()) << registers.status();
+        EXPECT_EQ(*registers, wastlernet::ModbusRegisters({static_cast<uint16_t>(100 + i),
+                                                           static_cast<uint16_t>(101 + i)}));
+    }
+
+    ASSERT_TRUE(conn.WriteRegisters(1, 30, {7, 8}).get().ok());
+    auto registers = conn.ReadRegisters(1, 30, 2).get();
+    ASSERT_TRUE(registers.ok()) << registers.status();
+    EXPECT_EQ(*registers, wastlernet::ModbusRegisters({7, 8}));
+
+    // Out of range of the server's register map.
+    EXPECT_FALSE(conn.ReadRegisters(1, 48, 5).get().ok());
+}
+
+// Callbacks run without the event loop's lock: a callback may attach a new connection to the loop
+// and destroy its own connection.
+TEST_F(ModbusTest, AsyncCallbackReplacesItsConnection) {
+    wastlernet::ModbusEventLoop loop;
+    ASSERT_TRUE(loop.Init().ok());
+    auto conn = std::make_unique<wastlernet::AsyncModbusConnection>(&loop, "127.0.0.1", 15002);
+    ASSERT_TRUE(conn->Init().ok());
+
+    std::unique_ptr<wastlernet::AsyncModbusConnection> replacement;
+    std::promise<absl::Status> replaced;
+    conn->ReadRegisters(1, 0, 1, wastlernet::Deadline::After(std::chrono::seconds(5)),
+                        [&](absl::StatusOr<wastlernet::ModbusRegisters> registers) {
+        EXPECT_TRUE(registers.ok()) << registers.status();
+        replacement = std::make_unique<wastlernet::AsyncModbusConnection>(&loop, "127.0.0.1", 15002);
+        auto st = replacement->Init();
+        conn.reset();
+        replaced.set_value(st);
+    });
+
+    auto result = replaced.get_future();
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    ASSERT_TRUE(result.get().ok());
+
+    auto registers = replacement->ReadRegisters(1, 1, 1, wastlernet::Deadline::After(std::chrono::seconds(5))).get();
+    ASSERT_TRUE(registers.ok()) << registers.status();
+    EXPECT_EQ(*registers, wastlernet::ModbusRegisters({101}));
+}
+
+TEST_F(ModbusTest, AsyncConnectionFailsWithoutServer) {
+    wastlernet::ModbusEventLoop loop;
+    ASSERT_TRUE(loop.Init().ok());
+    wastlernet::AsyncModbusConnection conn(&loop, "127.0.0.1", 15003);
+    ASSERT_TRUE(conn.Init().ok());
+
+    auto registers = conn.ReadRegisters(1, 0, 2, wastlernet::Deadline::After(std::chrono::seconds(5))).get();
+    EXPECT_EQ(registers.status().code(), absl::StatusCode::kUnavailable);
+}
+
+// A gateway answering with another unit id than requested must not complete the request.
+TEST(AsyncModbusTest, DropsResponsesOfOtherUnits) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(15004);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    ASSERT_EQ(listen(listener, 1), 0);
+
+    // Answers every read of one register with 42, requests to unit 7 as unit 8.
+    std::thread server([listener]() {
+        int client = accept(listener, nullptr, nullptr);
+        uint8_t request[12];
+        while (recv(client, request, sizeof(request), MSG_WAITALL) == sizeof(request)) {
+            uint8_t unit = request[6] == 7 ? 8 : request[6];
+            std::vector<uint8_t> response = {request[0], request[1], 0, 0, 0, 5, unit, 3, 2, 0, 42};
+            send(client, response.data(), response.size(), MSG_NOSIGNAL);
+        }
+        close(client);
+    });
+
+    {
+        wastlernet::ModbusEventLoop loop;
+        ASSERT_TRUE(loop.Init().ok());
+        wastlernet::AsyncModbusConnection conn(&loop, "127.0.0.1", 15004);
+        ASSERT_TRUE(conn.Init().ok());
+
+        auto other = conn.ReadRegisters(7, 0, 1, wastlernet::Deadline::After(std::chrono::milliseconds(300))).get();
+        EXPECT_EQ(other.status().code(), absl::StatusCode::kDeadlineExceeded) << other.status();
+        auto registers = conn.ReadRegisters(1, 0, 1, wastlernet::Deadline::After(std::chrono::seconds(5))).get();
+        ASSERT_TRUE(registers.ok()) << registers.status();
+        EXPECT_EQ(*registers, wastlernet::ModbusRegisters({42}));
+    }
+    server.join();
+    close(listener);
+}
+
+TEST_F(ModbusTest, SimulatorInjectsFaults) {
+    TestModbusConnection test;
+    ASSERT_TRUE(test.Init().ok());
+
+    auto read = [](modbus_t* ctx) {
+        uint16_t value;
+        if (modbus_read_registers(ctx, 0, 1, &value) == -1) {
+            return absl::InternalError(std::string("Error reading register: ") + modbus_strerror(errno));
+        }
+        return absl::OkStatus();
+    };
+
+    sim_->SetFaults(std::chrono::microseconds(0), std::chrono::microseconds(0), 1.0, 0, 0);
+    EXPECT_FALSE(test.Execute(read).ok());
+
+    sim_->SetFaults(std::chrono::milliseconds(20), std::chrono::microseconds(0), 0, 0, 0);
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(test.Execute(read).ok());
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+}
+
+TEST(ModbusRtuTest, InterFrameDelayFollowsBaudRate) {
+    wastlernet::ModbusRtuOptions rtu;
+    rtu.baud = 9600;
+    EXPECT_EQ(wastlernet::InterFrameDelay(rtu), std::chrono::microseconds(4011));
+    rtu.baud = 19200;
+    EXPECT_EQ(wastlernet::InterFrameDelay(rtu), std::chrono::microseconds(2006));
+    rtu.baud = 115200;
+    EXPECT_EQ(wastlernet::InterFrameDelay(rtu), std::chrono::microseconds(1750));
+    rtu.inter_frame_delay = std::chrono::milliseconds(10);
+    EXPECT_EQ(wastlernet::InterFrameDelay(rtu), std::chrono::milliseconds(10));
+}
+
+// A simulated unit on a pseudo terminal stands in for an RS485 line with several units.
+TEST(ModbusRtuTest, SharesSerialLineBetweenUnits) {
+    wastlernet::ModbusSimOptions options;
+    options.rtu = true;
+    options.unit_id = 3;
+    wastlernet::ModbusSimulator sim(0, 0, 20, options);
+    for (int i = 0; i < 20; ++i) {
+        sim.SetRegister(i, i + 100);
+    }
+    ASSERT_TRUE(sim.Start().ok());
+
+    wastlernet::ModbusRtuOptions rtu;
+    rtu.device = sim.device();
+    rtu.baud = 19200;
+    wastlernet::ModbusBus bus(rtu);
+    wastlernet::ModbusUnit unit(&bus, 3);
+    wastlernet::ModbusUnit absent(&bus, 4);
+    ASSERT_TRUE(unit.Init().ok());
+
+    ASSERT_TRUE(unit.Write({{5, 42}, {6, 43}, {9, 44}}).ok());
+    EXPECT_EQ(sim.GetRegister(6), 43);
+    EXPECT_EQ(sim.GetRegister(9), 44);
+
+    uint16_t values[18];
+    auto read = [&values](wastlernet::ModbusUnit* u) {
+        return [u, &values](modbus_t* ctx) { return u->ReadBlocks(ctx, {{0, 10, 0}, {12, 8, 10}}, values); };
+    };
+    ASSERT_TRUE(unit.Execute(read(&unit)).ok());
+    EXPECT_EQ(values[0], 100);
+    EXPECT_EQ(values[5], 42);
+    EXPECT_EQ(values[10], 112);
+
+    // Requests for a unit not on the line time out without breaking the line for the others.
+    EXPECT_FALSE(absent.Execute(read(&absent), wastlernet::Deadline::After(std::chrono::milliseconds(200))).ok());
+    ASSERT_TRUE(unit.Execute(read(&unit)).ok());
+    EXPECT_EQ(values[17], 119);
+
+    // Repeated timeouts open the circuit of the absent unit only.
+    for (int i = 0; i < 3; i++) {
+        auto st = absent.Execute(read(&absent));
+        EXPECT_FALSE(absl::IsUnavailable(st)) << st;
+    }
+    EXPECT_TRUE(absl::IsUnavailable(absent.Execute(read(&absent))));
+    EXPECT_TRUE(unit.Execute(read(&unit)).ok());
+}
@@ -0,0 +1,283 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "modbus_sim.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+#include <absl/strings/str_cat.h>
+#include <glog/logging.h>
+#include <modbus/modbus-rtu.h>
+#include <modbus/modbus-tcp.h>
+
+namespace wastlernet {
+    ModbusSimulator::ModbusSimulator(int port, int start, int count, ModbusSimOptions options)
+        : port_(port), start_(start), count_(count), options_(std::move(options)), random_(options_.seed) {
+        mapping_ = modbus_mapping_new_start_address(0, 0, 0, 0, start, count, 0, 0);
+    }
+
+    ModbusSimulator::~ModbusSimulator() {
+        Stop();
+        absl::MutexLock lock(&mutex_);
+        if (mapping_ != nullptr) {
+            modbus_mapping_free(mapping_);
+        }
+    }
+
+    absl::Status ModbusSimulator::Start() {
+        if (mapping_ == nullptr) {
+            return absl::InternalError(absl::StrCat("Could not allocate Modbus mapping: ", modbus_strerror(errno)));
+        }
+        if (pipe2(wake_fds_, O_NONBLOCK | O_CLOEXEC) != 0) {
+            return absl::InternalError(absl::StrCat("Could not create pipe: ", strerror(errno)));
+        }
+
+        std::string host;
+        bool rtu;
+        int unit_id;
+        {
+            absl::MutexLock lock(&mutex_);
+            host = options_.host;
+            rtu = options_.rtu;
+            unit_id = options_.unit_id;
+        }
+        if (rtu) {
+            if (auto st = StartRtu(unit_id); !st.ok()) {
+                return st;
+            }
+            thread_ = std::thread(&ModbusSimulator::Run, this);
+            return absl::OkStatus();
+        }
+
+        ctx_ = modbus_new_tcp(host.empty() ? nullptr : host.c_str(), port_);
+        if (ctx_ == nullptr) {
+            return absl::InternalError(absl::StrCat("Could not create Modbus context: ", modbus_strerror(errno)));
+        }
+        server_socket_ = modbus_tcp_listen(ctx_, 5);
+        if (server_socket_ == -1) {
+            return absl::UnavailableError(absl::StrCat("Could not listen on port ", port_, ": ",
+                                                       modbus_strerror(errno)));
+        }
+
+        thread_ = std::thread(&ModbusSimulator::Run, this);
+        return absl::OkStatus();
+    }
+
+    absl::Status ModbusSimulator::StartRtu(int unit_id) {
+        pty_ = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (pty_ < 0 || grantpt(pty_) != 0 || unlockpt(pty_) != 0) {
+            return absl::InternalError(absl::StrCat("Could not open pseudo terminal: ", strerror(errno)));
+        }
+        char name[128];
+        if (ptsname_r(pty_, name, sizeof(name)) != 0) {
+            return absl::InternalError(absl::StrCat("Could not get pseudo terminal name: ", strerror(errno)));
+        }
+        device_ = name;
+
+        pty_peer_ = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (pty_peer_ < 0) {
+            return absl::InternalError(absl::StrCat("Could not open ", device_, ": ", strerror(errno)));
+        }
+        termios tios;
+        tcgetattr(pty_peer_, &tios);
+        cfmakeraw(&tios);
+        tcsetattr(pty_peer_, TCSANOW, &tios);
+
+        // The context is never connected: it only frames requests and replies on the controlling side.
+        ctx_ = modbus_new_rtu(name, 9600, 'E', 8, 1);
+        if (ctx_ == nullptr) {
+            return absl::InternalError(absl::StrCat("Could not create Modbus context: ", modbus_strerror(errno)));
+        }
+        modbus_set_slave(ctx_, unit_id);
+        modbus_set_socket(ctx_, pty_);
+        return absl::OkStatus();
+    }
+
+    void ModbusSimulator::Stop() {
+        if (thread_.joinable()) {
+            (void)!write(wake_fds_[1], "s", 1);
+            thread_.join();
+        }
+        for (int* fd : {&server_socket_, &pty_, &pty_peer_, &wake_fds_[0], &wake_fds_[1]}) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        if (ctx_ != nullptr) {
+            modbus_free(ctx_);
+            ctx_ = nullptr;
+        }
+    }
+
+    void ModbusSimulator::SetRegister(int address, uint16_t value) {
+        SetRegisters(address, {value});
+    }
+
+    void ModbusSimulator::SetRegisters(int address, const std::vector<uint16_t>& values) {
+        absl::MutexLock lock(&mutex_);
+        for (size_t i = 0; i < values.size(); i++) {
+            int offset = address - start_ + static_cast<int>(i);
+            if (offset >= 0 && offset < count_) {
+                mapping_->tab_registers[offset] = values[i];
+            }
+        }
+    }
+
+    uint16_t ModbusSimulator::GetRegister(int address) {
+        absl::MutexLock lock(&mutex_);
+        int offset = address - start_;
+        return offset >= 0 && offset < count_ ? mapping_->tab_registers[offset] : 0;
+    }
+
+    void ModbusSimulator::SetFaults(std::chrono::microseconds latency, std::chrono::microseconds jitter,
+                                    double error_rate, double drop_rate, double disconnect_rate) {
+        absl::MutexLock lock(&mutex_);
+        options_.latency = latency;
+        options_.jitter = jitter;
+        options_.error_rate = error_rate;
+        options_.drop_rate = drop_rate;
+        options_.disconnect_rate = disconnect_rate;
+    }
+
+    int64_t ModbusSimulator::requests() {
+        absl::MutexLock lock(&mutex_);
+        return requests_;
+    }
+
+    ModbusSimulator::Fault ModbusSimulator::NextFault(std::chrono::microseconds* delay) {
+        absl::MutexLock lock(&mutex_);
+        requests_++;
+
+        *delay = options_.latency;
+        if (options_.jitter.count() > 0) {
+            std::uniform_int_distribution<int64_t> jitter(0, options_.jitter.count());
+            *delay += std::chrono::microseconds(jitter(random_));
+        }
+
+        double p = std::uniform_real_distribution<double>(0, 1)(random_);
+        if ((p -= options_.error_rate) < 0) {
+            return Fault::kError;
+        }
+        if ((p -= options_.drop_rate) < 0) {
+            return Fault::kDrop;
+        }
+        if ((p -= options_.disconnect_rate) < 0) {
+            return Fault::kDisconnect;
+        }
+        return Fault::kNone;
+    }
+
+    bool ModbusSimulator::Reply(const uint8_t* query, int length) {
+        std::chrono::microseconds delay;
+        Fault fault = NextFault(&delay);
+        if (delay.count() > 0) {
+            std::this_thread::sleep_for(delay);
+        }
+
+        switch (fault) {
+            case Fault::kError:
+                modbus_reply_exception(ctx_, query, MODBUS_EXCEPTION_SLAVE_OR_SERVER_FAILURE);
+                break;
+            case Fault::kDrop:
+                break;
+            case Fault::kDisconnect:
+                return false;
+            case Fault::kNone: {
+                absl::MutexLock lock(&mutex_);
+                modbus_reply(ctx_, query, length, mapping_);
+                if (options_.on_request) {
+                    options_.on_request(mapping_);
+                }
+                break;
+            }
+        }
+        return true;
+    }
+
+    void ModbusSimulator::Run() {
+        uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
+        std::vector<int> clients;
+
+        while (true) {
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(wake_fds_[0], &fds);
+            int max_fd = wake_fds_[0];
+            // In RTU mode the pseudo terminal is the only "client".
+            int listen_fd = pty_ >= 0 ? pty_ : server_socket_;
+            FD_SET(listen_fd, &fds);
+            max_fd = std::max(max_fd, listen_fd);
+            for (int fd : clients) {
+                FD_SET(fd, &fds);
+                max_fd = std::max(max_fd, fd);
+            }
+
+            if (select(max_fd + 1, &fds, nullptr, nullptr, nullptr) == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                LOG(ERROR) << "Modbus simulator select() failed: " << strerror(errno);
+                break;
+            }
+            if (FD_ISSET(wake_fds_[0], &fds)) {
+                break;
+            }
+
+            if (pty_ >= 0) {
+                if (FD_ISSET(pty_, &fds)) {
+                    // Frames for other units are ignored (rc == 0), broken frames are discarded.
+                    if (int rc = modbus_receive(ctx_, query); rc > 0) {
+                        Reply(query, rc);
+                    } else if (rc == -1) {
+                        modbus_flush(ctx_);
+                    }
+                }
+                continue;
+            }
+
+            if (FD_ISSET(server_socket_, &fds)) {
+                int fd = accept(server_socket_, nullptr, nullptr);
+                if (fd >= 0) {
+                    clients.push_back(fd);
+                }
+            }
+
+            std::vector<int> closed;
+            for (int fd : clients) {
+                if (!FD_ISSET(fd, &fds)) {
+                    continue;
+                }
+                modbus_set_socket(ctx_, fd);
+                int rc = modbus_receive(ctx_, query);
+                if (rc == -1) {
+                    closed.push_back(fd);
+                    continue;
+                }
+                if (rc == 0) {
+                    // Request ignored by libmodbus (e.g. addressed to another unit).
+                    continue;
+                }
+                if (!Reply(query, rc)) {
+                    closed.push_back(fd);
+                }
+            }
+
+            for (int fd : closed) {
+                close(fd);
+                clients.erase(std::find(clients.begin(), clients.end(), fd));
+            }
+        }
+
+        for (int fd : clients) {
+            close(fd);
+        }
+    }
+}
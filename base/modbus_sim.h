@@ -0,0 +1,145 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Simulated Modbus device.
+//
+// A wastlernet::ModbusSimulator serves a block of holding registers over Modbus/TCP (or Modbus RTU
+// on a pseudo terminal) using the libmodbus server API, so that Modbus code can be tested and
+// benchmarked without a real controller:
+//
+//   ModbusSimOptions options;
+//   options.latency = std::chrono::milliseconds(5);   // typical RS485 gateway round trip
+//   options.error_rate = 0.01;                        // 1% of requests answered with an exception
+//
+//   ModbusSimulator sim(15020, 33024, 512, options);
+//   sim.SetRegisters(33024, {612, 587, 443});
+//   RETURN_IF_ERROR(sim.Start());
+//
+// The simulator accepts several clients and answers their requests one at a time in arrival
+// order, like a gateway in front of a serial bus; injected latency therefore adds up across
+// clients. Faults are drawn independently per request:
+// - `error_rate`: answer with exception 4 (server device failure),
+// - `drop_rate`: do not answer at all (the client runs into its response timeout),
+// - `disconnect_rate`: close the client connection instead of answering.
+//
+// With `rtu` set, the simulator opens a pseudo terminal pair instead of listening on a port and
+// stands in for one unit on an RS485 line: clients open device() as their serial device, and
+// requests addressed to other units are ignored like on a real multi-drop line. Disconnect faults
+// are treated as dropped requests in this mode.
+//
+// Thread-safety
+// All public methods are internally synchronized; registers may be changed while clients are
+// connected.
+//
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <absl/status/status.h>
+#include <absl/synchronization/mutex.h>
+#include <modbus/modbus.h>
+
+#ifndef WASTLERNET_MODBUS_SIM_H
+#define WASTLERNET_MODBUS_SIM_H
+namespace wastlernet {
+    struct ModbusSimOptions {
+        /** Address to listen on; empty listens on all interfaces. */
+        std::string host;
+        /** Delay before each response. */
+        std::chrono::microseconds latency{0};
+        /** Additional uniformly distributed delay in [0, jitter]. */
+        std::chrono::microseconds jitter{0};
+        /** Fraction of requests answered with a Modbus exception. */
+        double error_rate = 0;
+        /** Fraction of requests left unanswered. */
+        double drop_rate = 0;
+        /** Fraction of requests answered by closing the connection. */
+        double disconnect_rate = 0;
+        /** Seed for fault injection and jitter, for reproducible runs. */
+        uint32_t seed = 1;
+        /** Called on the server thread after each answered request. */
+        std::function<void(const modbus_mapping_t*)> on_request;
+        /** Serve Modbus RTU on a pseudo terminal instead of Modbus/TCP (see above). */
+        bool rtu = false;
+        /** Unit id answered in RTU mode. */
+        int unit_id = 1;
+    };
+
+    class ModbusSimulator {
+    public:
+        /**
+         * @param port      TCP port to listen on (ignored in RTU mode).
+         * @param start     First holding register address served.
+         * @param count     Number of holding registers served (initialized to 0).
+         * @param options   Latency and fault injection.
+         */
+        ModbusSimulator(int port, int start, int count, ModbusSimOptions options = ModbusSimOptions());
+
+        /** Stops the server if still running. */
+        ~ModbusSimulator();
+
+        ModbusSimulator(const ModbusSimulator&) = delete;
+        ModbusSimulator& operator=(const ModbusSimulator&) = delete;
+
+        /** Listen on the port (or open the pseudo terminal) and start serving on a background thread. */
+        absl::Status Start();
+
+        /** Serial device clients open in RTU mode; valid after Start(). */
+        const std::string& device() const {
+            return device_;
+        }
+
+        /** Close all connections and stop the server thread. */
+        void Stop();
+
+        void SetRegister(int address, uint16_t value);
+        void SetRegisters(int address, const std::vector<uint16_t>& values);
+        uint16_t GetRegister(int address);
+
+        /** Replace the latency and fault injection settings (on_request is kept). */
+        void SetFaults(std::chrono::microseconds latency, std::chrono::microseconds jitter, double error_rate,
+                       double drop_rate, double disconnect_rate);
+
+        /** Number of requests received so far. */
+        int64_t requests();
+
+    private:
+        int port_;
+        int start_;
+        int count_;
+
+        absl::Mutex mutex_;
+        ModbusSimOptions options_ ABSL_GUARDED_BY(mutex_);
+        std::mt19937 random_ ABSL_GUARDED_BY(mutex_);
+        modbus_mapping_t* mapping_ ABSL_GUARDED_BY(mutex_) = nullptr;
+        int64_t requests_ ABSL_GUARDED_BY(mutex_) = 0;
+
+        modbus_t* ctx_ = nullptr;
+        int server_socket_ = -1;
+        // RTU mode: controlling side of the pseudo terminal and the path of its serial side.
+        int pty_ = -1;
+        // Serial side, kept open so that the controlling side does not report a hangup between clients.
+        int pty_peer_ = -1;
+        std::string device_;
+        // Self-pipe to interrupt select() on Stop().
+        int wake_fds_[2] = {-1, -1};
+        std::thread thread_;
+
+        enum class Fault { kNone, kError, kDrop, kDisconnect };
+
+        /** Draw the fault (if any) and the delay for the next response. */
+        Fault NextFault(std::chrono::microseconds* delay);
+
+        absl::Status StartRtu(int unit_id);
+
+        void Run();
+
+        /** Answer a request received on `ctx_`; false if the client connection is to be closed. */
+        bool Reply(const uint8_t* query, int length);
+    };
+}
+#endif //WASTLERNET_MODBUS_SIM_H
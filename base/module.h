@@ -17,8 +17,9 @@
 ///
 /// State cache
 /// Each module may publish its latest serialized protobuf payload into a shared
-/// `StateCache`, keyed by the module `Name()`. This is intended for lightweight
-/// in-memory introspection and should not be treated as a durable store.
+/// `StateCache` (see `state_cache.h`), keyed by the module `Name()`. This is
+/// intended for lightweight in-memory introspection and for notifying updaters
+/// of new samples; it should not be treated as a durable store.
 ///
 /// Created by wastl on 07.04.23. Updated on 2025-11-06 12:51.
 #pragma once
@@ -27,18 +28,17 @@
 #include <type_traits>
 #include <functional>   // for std::function used in PollingModule::Query
 #include <absl/status/status.h>
-#include <absl/container/flat_hash_map.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
 
+#include "base/deadline.h"
+#include "base/state_cache.h"
 #include "config/config.pb.h"
 #include "timescaledb/timescaledb-client.h"
 
 #ifndef WASTLERNET_MODULE_H
 #define WASTLERNET_MODULE_H
 namespace wastlernet {
-    /// Alias for a shared in-memory state cache used by modules to expose their
-    /// latest serialized protobuf payload (value) keyed by module name (key).
-    typedef absl::flat_hash_map<std::string, std::string> StateCache;
-
     /// Minimal lifecycle interface implemented by all modules.
     class IModule {
     public:
@@ -46,7 +46,8 @@ namespace wastlernet {
 
         /// Perform any setup required before `Start()`. May establish network
         /// connections, validate configuration, or create database schema.
-        /// Implementations should be idempotent.
+        /// Implementations should be idempotent: `ModuleRunner` calls `Init()`
+        /// repeatedly until it succeeds, and only then calls `Start()`.
         ///
         /// Returns: OK on success; a descriptive error otherwise.
         virtual absl::Status Init() = 0;
@@ -86,11 +87,12 @@ namespace wastlernet {
         StateCache* current_state_;
 
         /// Write a single `data` sample to the state cache and TimescaleDB.
+        /// Publishing to the state cache notifies subscribed updaters.
         ///
         /// Thread-safety: Not thread-safe for concurrent callers; `PollingModule`
         /// ensures single-writer semantics.
         virtual absl::Status Update(const Data& data) {
-            (*current_state_)[Name()] = data.SerializeAsString();
+            current_state_->Put(Name(), data.SerializeAsString());
             return conn_.Update(data);
         }
 
@@ -124,7 +126,11 @@ namespace wastlernet {
     /// - For each polled sample, `Query()` should invoke the provided handler
     ///   with a `Data` instance to store; the default handler writes to the DB
     ///   and updates the shared `StateCache` via `Module::Update()`.
-    /// - `Abort()` requests the loop to stop and then joins the thread.
+    /// - Each poll receives a `Deadline` expiring when the next poll is due;
+    ///   `Query()` should pass it on to the connections it uses so that a hung
+    ///   device cannot delay polls beyond `poll_interval`.
+    /// - `Abort()` wakes the loop from its wait for the next poll, stops it and
+    ///   then joins the thread; a poll in progress is completed first.
     /// - `Wait()` simply joins the worker thread.
     ///
     /// Time semantics: The wake-up schedule uses `std::chrono::system_clock`
@@ -135,8 +141,9 @@ namespace wastlernet {
     private:
         /// Polling period in seconds.
         int poll_interval;
-        /// Set to true by `Abort()` to stop the worker loop.
-        bool aborted_;
+        absl::Mutex mutex_;
+        /// Set to true by `Abort()` to stop the worker loop, also while it waits for the next poll.
+        bool aborted_ ABSL_GUARDED_BY(mutex_) = false;
         /// Worker thread running the polling loop.
         std::thread t_;
 
@@ -146,8 +153,11 @@ namespace wastlernet {
         /// to obtain one `Data` object and call `handler(data)`; the handler will
         /// then write to the DB and update the state cache.
         ///
+        /// The poll must be completed by `deadline`; implementations forward it
+        /// to `ModbusConnection::Execute()` / `HttpConnection::Execute()`.
+        ///
         /// Return OK on success; any error is logged by the caller.
-        virtual absl::Status Query(std::function<absl::Status(const Data& data)> handler) = 0;
+        virtual absl::Status Query(const Deadline& deadline, std::function<absl::Status(const Data& data)> handler) = 0;
 
     public:
         /// Construct a polling module.
@@ -156,16 +166,24 @@ namespace wastlernet {
         /// - `current_state`: shared cache for the latest sample (not owned)
         /// - `poll_interval`: period in seconds between polls
         PollingModule(const TimescaleDB& config, timescaledb::TimescaleWriter<Data>* writer, StateCache* current_state, int poll_interval)
-        : Module<Data>(config, writer, current_state), poll_interval(poll_interval), aborted_(false) { }
+        : Module<Data>(config, writer, current_state), poll_interval(poll_interval) { }
 
         /// Start the background polling thread.
         void Start() override {
             t_ = std::thread([this]() {
                 auto next = std::chrono::system_clock::now();
-                while (!aborted_) {
+                while (true) {
                     next += std::chrono::seconds(poll_interval);
-                    std::this_thread::sleep_until(next);
-                    auto st = Query([this](const Data& data){
+                    {
+                        // Sleep until the next poll, unless aborted meanwhile.
+                        absl::MutexLock lock(&mutex_);
+                        mutex_.AwaitWithDeadline(absl::Condition(&aborted_), absl::FromChrono(next));
+                        if (aborted_) {
+                            break;
+                        }
+                    }
+                    auto deadline = Deadline::After(std::chrono::seconds(poll_interval));
+                    auto st = Query(deadline, [this](const Data& data){
                         auto st = Module<Data>::Update(data);
                         if (!st.ok()) {
                             LOG(ERROR) << "Error writing to database: " << st;
@@ -179,15 +197,20 @@ namespace wastlernet {
             });
         }
 
-        /// Ask the polling loop to stop and wait until it exits.
+        /// Ask the polling loop to stop and wait until it exits; a poll in progress is completed.
         void Abort() override {
-            aborted_ = true;
-            t_.join();
+            {
+                absl::MutexLock lock(&mutex_);
+                aborted_ = true;
+            }
+            Wait();
         }
 
         /// Wait until the polling thread has finished.
         void Wait() override {
-            t_.join();
+            if (t_.joinable()) {
+                t_.join();
+            }
         }
     };
 }
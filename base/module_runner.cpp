@@ -0,0 +1,164 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "module_runner.h"
+
+#include <algorithm>
+#include <glog/logging.h>
+
+namespace wastlernet {
+    ModuleRunner::~ModuleRunner() {
+        Abort();
+        Wait();
+    }
+
+    void ModuleRunner::Launch(std::unique_ptr<IModule> module) {
+        absl::MutexLock lock(&mu_);
+
+        auto entry = std::make_shared<Entry>();
+        entry->name = module->Name();
+        entry->module = std::move(module);
+        entry->aborted = aborted_;
+        entry->launcher = std::thread(&ModuleRunner::Bringup, this, entry.get());
+        entries_.emplace_back(std::move(entry));
+    }
+
+    void ModuleRunner::Bringup(Entry* entry) {
+        absl::Duration delay = kInitialRetryDelay;
+        for (int attempt = 1;; attempt++) {
+            auto st = entry->module->Init();
+            if (st.ok()) {
+                break;
+            }
+
+            LOG(WARNING) << "Could not initialize module " << entry->name << " (attempt " << attempt << "): "
+                         << st << "; running degraded, retrying in " << delay;
+
+            absl::MutexLock lock(&mu_);
+            if (mu_.AwaitWithTimeout(absl::Condition(&entry->aborted), delay)) {
+                return;
+            }
+            delay = std::min(delay * 2, kMaxRetryDelay);
+        }
+
+        {
+            absl::MutexLock lock(&mu_);
+            if (entry->aborted) {
+                return;
+            }
+            entry->starting = true;
+        }
+        // Start() may block (e.g. opening a listener or connecting to a broker); other modules,
+        // Stop() and AwaitStartup() must not wait for it.
+        entry->module->Start();
+
+        bool aborted;
+        {
+            absl::MutexLock lock(&mu_);
+            entry->starting = false;
+            entry->started = true;
+            aborted = entry->aborted;
+            entry->stopped = aborted;
+        }
+        if (aborted) {
+            // Stopped while starting: Stop() and Abort() could not abort the module yet.
+            entry->module->Abort();
+            LOG(INFO) << "Module " << entry->name << " stopped while starting";
+            return;
+        }
+
+        LOG(INFO) << "Started module " << entry->name;
+    }
+
+    bool ModuleRunner::AllStarted() const {
+        return std::all_of(entries_.begin(), entries_.end(), [](const auto& e) { return e->started; });
+    }
+
+    bool ModuleRunner::AwaitStartup(absl::Time deadline) {
+        absl::MutexLock lock(&mu_);
+        if (mu_.AwaitWithDeadline(absl::Condition(this, &ModuleRunner::AllStarted), deadline)) {
+            return true;
+        }
+
+        for (const auto& e : entries_) {
+            if (!e->started) {
+                LOG(WARNING) << "Module " << e->name << " not ready at startup deadline; continuing degraded";
+            }
+        }
+        return false;
+    }
+
+    bool ModuleRunner::Stop(const std::string& name) {
+        std::shared_ptr<Entry> entry;
+        {
+            absl::MutexLock lock(&mu_);
+            auto it = std::find_if(entries_.begin(), entries_.end(), [&](const auto& e) { return e->name == name; });
+            if (it == entries_.end()) {
+                return false;
+            }
+            entry = *it;
+            entries_.erase(it);
+            entry->aborted = true;
+        }
+
+        // Once the launcher has exited, `started` no longer changes.
+        if (entry->launcher.joinable()) {
+            entry->launcher.join();
+        }
+        if (entry->started) {
+            if (!entry->stopped) {
+                entry->module->Abort();
+            }
+            entry->module->Wait();
+        }
+
+        LOG(INFO) << "Stopped module " << name;
+        return true;
+    }
+
+    void ModuleRunner::Abort() {
+        std::vector<IModule*> running;
+        {
+            absl::MutexLock lock(&mu_);
+            if (aborted_) {
+                return;
+            }
+            aborted_ = true;
+            for (const auto& e : entries_) {
+                e->aborted = true;
+                // Modules still in Start() are aborted by their launcher once it returns.
+                if (e->started && !e->stopped) {
+                    running.push_back(e->module.get());
+                }
+            }
+        }
+
+        for (auto* module : running) {
+            module->Abort();
+        }
+    }
+
+    void ModuleRunner::Wait() {
+        std::vector<std::shared_ptr<Entry>> entries;
+        {
+            absl::MutexLock lock(&mu_);
+            entries = entries_;
+        }
+
+        for (const auto& e : entries) {
+            if (e->launcher.joinable()) {
+                e->launcher.join();
+            }
+        }
+        for (const auto& e : entries) {
+            bool started;
+            {
+                absl::MutexLock lock(&mu_);
+                started = e->started;
+            }
+            if (started) {
+                e->module->Wait();
+            }
+        }
+    }
+}
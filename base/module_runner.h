@@ -0,0 +1,98 @@
+/// \file module_runner.h
+/// \brief Concurrent, fault-tolerant startup supervision for WastlerNet modules.
+///
+/// `ModuleRunner` owns a set of `IModule` instances and brings each of them up
+/// on its own launcher thread: `Init()` is called, and on success the module is
+/// `Start()`ed. All modules initialize concurrently, so cold start is bounded by
+/// the slowest device rather than the sum of all of them.
+///
+/// A module whose `Init()` fails does not abort the process. It stays in a
+/// degraded state and its launcher keeps retrying `Init()` with exponential
+/// backoff until it succeeds (or the runner is aborted), then starts it.
+///
+/// Modules can also be stopped individually with `Stop()` and relaunched, which
+/// is used to apply configuration changes without restarting the process.
+///
+/// Thread-safety: all public methods may be called from any thread, except that
+/// `Stop()` must not run concurrently with `Wait()` (both wait for the module).
+#pragma once
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
+
+#include "base/module.h"
+
+#ifndef WASTLERNET_MODULE_RUNNER_H
+#define WASTLERNET_MODULE_RUNNER_H
+namespace wastlernet {
+    class ModuleRunner {
+    public:
+        ModuleRunner() = default;
+
+        /// Aborts all modules and waits for them to stop.
+        ~ModuleRunner();
+
+        ModuleRunner(const ModuleRunner&) = delete;
+        ModuleRunner& operator=(const ModuleRunner&) = delete;
+
+        /// Take ownership of `module` and bring it up in the background. Returns
+        /// immediately; use `AwaitStartup()` to wait for modules to come up.
+        void Launch(std::unique_ptr<IModule> module);
+
+        /// Block until all launched modules are running or `deadline` has passed.
+        /// Modules still initializing at the deadline are logged as degraded and
+        /// keep retrying in the background.
+        ///
+        /// Returns: true if all modules were started before the deadline.
+        bool AwaitStartup(absl::Time deadline);
+
+        /// Stop the module called `name` (aborting a pending initialization if it
+        /// has not started yet), wait for it and release it. The name can then be
+        /// reused by a subsequent `Launch()`.
+        ///
+        /// Returns: false if no module with that name was launched.
+        bool Stop(const std::string& name);
+
+        /// Stop all modules, including those still retrying their initialization.
+        /// It is allowed to call `Abort()` multiple times.
+        void Abort();
+
+        /// Block until all launcher threads have finished and all started
+        /// modules have stopped.
+        void Wait();
+
+    private:
+        /// Delay before the first `Init()` retry of a degraded module.
+        static constexpr absl::Duration kInitialRetryDelay = absl::Seconds(1);
+        /// Upper bound for the exponential `Init()` retry backoff.
+        static constexpr absl::Duration kMaxRetryDelay = absl::Minutes(5);
+
+        struct Entry {
+            std::unique_ptr<IModule> module;
+            std::string name;
+            std::thread launcher;
+            /// `Start()` is running on the launcher thread, without holding `mu_`.
+            bool starting = false;
+            bool started = false;
+            /// Set by `Stop()` or `Abort()`; guarded by `mu_`.
+            bool aborted = false;
+            /// Set when the launcher aborted the module itself because it was stopped while
+            /// starting; `Stop()` and `Abort()` then leave it alone.
+            bool stopped = false;
+        };
+
+        absl::Mutex mu_;
+        /// Shared so that `Wait()` can keep entries alive that `Stop()` removes.
+        std::vector<std::shared_ptr<Entry>> entries_ ABSL_GUARDED_BY(mu_);
+        bool aborted_ ABSL_GUARDED_BY(mu_) = false;
+
+        /// Launcher thread body: initialize `entry` with retries, then start it.
+        void Bringup(Entry* entry);
+
+        bool AllStarted() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+    };
+}
+#endif //WASTLERNET_MODULE_RUNNER_H
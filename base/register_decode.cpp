@@ -0,0 +1,271 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "register_decode.h"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WASTLERNET_DECODE_X86 1
+#include <immintrin.h>
+#endif
+
+namespace wastlernet {
+    namespace {
+        // For each RegisterOrder: which of the bytes (r0 & 0xFF, r0 >> 8, r1 & 0xFF, r1 >> 8) of a
+        // register pair holds bit 0-7, 8-15, 16-23 and 24-31 of the value. On little-endian hosts
+        // this is also the pshufb mask for a register pair in memory.
+        constexpr uint8_t kByteOrder[4][4] = {
+                {2, 3, 0, 1},  // kABCD
+                {0, 1, 2, 3},  // kCDAB
+                {3, 2, 1, 0},  // kBADC
+                {1, 0, 3, 2},  // kDCBA
+        };
+
+        DecodeIsa DetectIsa() {
+#ifdef WASTLERNET_DECODE_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return DecodeIsa::kAvx2;
+            }
+            if (__builtin_cpu_supports("sse4.1")) {
+                return DecodeIsa::kSse4;
+            }
+#endif
+            return DecodeIsa::kScalar;
+        }
+
+        const DecodeIsa kSupportedIsa = DetectIsa();
+        std::atomic<DecodeIsa> active_isa{kSupportedIsa};
+
+        // Scalar implementations; also used for the tails of the vectorized loops.
+
+        template<bool Signed, class Out>
+        void WidenScalar(const uint16_t* in, size_t n, Out scale, Out* out) {
+            for (size_t i = 0; i < n; i++) {
+                Out v = Signed ? static_cast<Out>(static_cast<int16_t>(in[i])) : static_cast<Out>(in[i]);
+                out[i] = v * scale;
+            }
+        }
+
+        void Combine32Scalar(const uint16_t* in, size_t n, RegisterOrder order, uint32_t* out) {
+            const uint8_t* pos = kByteOrder[static_cast<int>(order)];
+            for (size_t i = 0; i < n; i++) {
+                uint8_t bytes[4] = {
+                        static_cast<uint8_t>(in[2 * i] & 0xFF), static_cast<uint8_t>(in[2 * i] >> 8),
+                        static_cast<uint8_t>(in[2 * i + 1] & 0xFF), static_cast<uint8_t>(in[2 * i + 1] >> 8),
+                };
+                out[i] = bytes[pos[0]] | (bytes[pos[1]] << 8) | (bytes[pos[2]] << 16) |
+                         (static_cast<uint32_t>(bytes[pos[3]]) << 24);
+            }
+        }
+
+        void BitsScalar(const uint16_t* in, size_t n, uint8_t* out) {
+            for (size_t i = 0; i < n; i++) {
+                for (int b = 0; b < 16; b++) {
+                    out[16 * i + b] = (in[i] >> b) & 1;
+                }
+            }
+        }
+
+#ifdef WASTLERNET_DECODE_X86
+        // SSE4.1: 4 registers per iteration.
+
+        template<bool Signed>
+        __attribute__((target("sse4.1"))) __m128i Widen4Sse4(const uint16_t* in) {
+            __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in));
+            if constexpr (Signed) {
+                return _mm_cvtepi16_epi32(v);
+            } else {
+                return _mm_cvtepu16_epi32(v);
+            }
+        }
+
+        template<bool Signed>
+        __attribute__((target("sse4.1"))) void WidenSse4(const uint16_t* in, size_t n, float scale, float* out) {
+            __m128 s = _mm_set1_ps(scale);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(Widen4Sse4<Signed>(in + i)), s));
+            }
+            WidenScalar<Signed>(in + i, n - i, scale, out + i);
+        }
+
+        template<bool Signed>
+        __attribute__((target("sse4.1"))) void WidenSse4(const uint16_t* in, size_t n, double scale, double* out) {
+            __m128d s = _mm_set1_pd(scale);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128i v = Widen4Sse4<Signed>(in + i);
+                _mm_storeu_pd(out + i, _mm_mul_pd(_mm_cvtepi32_pd(v), s));
+                _mm_storeu_pd(out + i + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(v, v)), s));
+            }
+            WidenScalar<Signed>(in + i, n - i, scale, out + i);
+        }
+
+        __attribute__((target("sse4.1"))) __m128i ShuffleMaskSse4(RegisterOrder order) {
+            const uint8_t* pos = kByteOrder[static_cast<int>(order)];
+            alignas(16) uint8_t mask[16];
+            for (int i = 0; i < 16; i++) {
+                mask[i] = (i & ~3) + pos[i & 3];
+            }
+            return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+        }
+
+        __attribute__((target("sse4.1"))) void Combine32Sse4(const uint16_t* in, size_t n, RegisterOrder order,
+                                                            uint32_t* out) {
+            __m128i mask = ShuffleMaskSse4(order);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_shuffle_epi8(v, mask));
+            }
+            Combine32Scalar(in + 2 * i, n - i, order, out + i);
+        }
+
+        __attribute__((target("sse4.1"))) void BitsSse4(const uint16_t* in, size_t n, uint8_t* out) {
+            const __m128i bits_lo = _mm_setr_epi16(1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7);
+            const __m128i bits_hi = _mm_setr_epi16(1 << 8, 1 << 9, 1 << 10, 1 << 11, 1 << 12, 1 << 13, 1 << 14,
+                                                   static_cast<int16_t>(1 << 15));
+            const __m128i one = _mm_set1_epi8(1);
+            for (size_t i = 0; i < n; i++) {
+                __m128i v = _mm_set1_epi16(static_cast<int16_t>(in[i]));
+                __m128i lo = _mm_cmpeq_epi16(_mm_and_si128(v, bits_lo), bits_lo);
+                __m128i hi = _mm_cmpeq_epi16(_mm_and_si128(v, bits_hi), bits_hi);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * i),
+                                 _mm_and_si128(_mm_packs_epi16(lo, hi), one));
+            }
+        }
+
+        // AVX2: 8 registers per iteration.
+
+        template<bool Signed>
+        __attribute__((target("avx2"))) __m256i Widen8Avx2(const uint16_t* in) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+            if constexpr (Signed) {
+                return _mm256_cvtepi16_epi32(v);
+            } else {
+                return _mm256_cvtepu16_epi32(v);
+            }
+        }
+
+        template<bool Signed>
+        __attribute__((target("avx2"))) void WidenAvx2(const uint16_t* in, size_t n, float scale, float* out) {
+            __m256 s = _mm256_set1_ps(scale);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(Widen8Avx2<Signed>(in + i)), s));
+            }
+            WidenScalar<Signed>(in + i, n - i, scale, out + i);
+        }
+
+        template<bool Signed>
+        __attribute__((target("avx2"))) void WidenAvx2(const uint16_t* in, size_t n, double scale, double* out) {
+            __m256d s = _mm256_set1_pd(scale);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                __m256i v = Widen8Avx2<Signed>(in + i);
+                _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), s));
+                _mm256_storeu_pd(out + i + 4, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), s));
+            }
+            WidenScalar<Signed>(in + i, n - i, scale, out + i);
+        }
+
+        __attribute__((target("avx2"))) void Combine32Avx2(const uint16_t* in, size_t n, RegisterOrder order,
+                                                          uint32_t* out) {
+            // pshufb works within 128-bit lanes; the mask repeats every 4 bytes, so both lanes use the same.
+            __m128i lane = ShuffleMaskSse4(order);
+            __m256i mask = _mm256_broadcastsi128_si256(lane);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_shuffle_epi8(v, mask));
+            }
+            Combine32Sse4(in + 2 * i, n - i, order, out + i);
+        }
+#endif
+
+        template<bool Signed, class Out>
+        void Widen(const uint16_t* in, size_t n, Out scale, Out* out) {
+            switch (active_isa.load(std::memory_order_relaxed)) {
+#ifdef WASTLERNET_DECODE_X86
+                case DecodeIsa::kAvx2:
+                    return WidenAvx2<Signed>(in, n, scale, out);
+                case DecodeIsa::kSse4:
+                    return WidenSse4<Signed>(in, n, scale, out);
+#endif
+                default:
+                    return WidenScalar<Signed>(in, n, scale, out);
+            }
+        }
+
+        void Combine32(const uint16_t* in, size_t n, RegisterOrder order, uint32_t* out) {
+            switch (active_isa.load(std::memory_order_relaxed)) {
+#ifdef WASTLERNET_DECODE_X86
+                case DecodeIsa::kAvx2:
+                    return Combine32Avx2(in, n, order, out);
+                case DecodeIsa::kSse4:
+                    return Combine32Sse4(in, n, order, out);
+#endif
+                default:
+                    return Combine32Scalar(in, n, order, out);
+            }
+        }
+    }
+
+    DecodeIsa ActiveDecodeIsa() {
+        return active_isa.load();
+    }
+
+    void SetDecodeIsa(DecodeIsa isa) {
+        active_isa = static_cast<int>(isa) <= static_cast<int>(kSupportedIsa) ? isa : kSupportedIsa;
+    }
+
+    void DecodeUInt16(const uint16_t* in, size_t n, float scale, float* out) {
+        Widen<false>(in, n, scale, out);
+    }
+
+    void DecodeUInt16(const uint16_t* in, size_t n, double scale, double* out) {
+        Widen<false>(in, n, scale, out);
+    }
+
+    void DecodeInt16(const uint16_t* in, size_t n, float scale, float* out) {
+        Widen<true>(in, n, scale, out);
+    }
+
+    void DecodeInt16(const uint16_t* in, size_t n, double scale, double* out) {
+        Widen<true>(in, n, scale, out);
+    }
+
+    void DecodeUInt32(const uint16_t* in, size_t n, RegisterOrder order, uint32_t* out) {
+        Combine32(in, n, order, out);
+    }
+
+    void DecodeInt32(const uint16_t* in, size_t n, RegisterOrder order, int32_t* out) {
+        // int32_t and uint32_t may alias each other.
+        Combine32(in, n, order, reinterpret_cast<uint32_t*>(out));
+    }
+
+    void DecodeFloat32(const uint16_t* in, size_t n, RegisterOrder order, float* out) {
+        static_assert(sizeof(float) == sizeof(uint32_t), "float32 must be IEEE 754 single precision");
+        // Decode in chunks through a buffer; memcpy of the bits is the portable way to reinterpret them.
+        constexpr size_t kChunk = 64;
+        uint32_t bits[kChunk];
+        for (size_t i = 0; i < n; i += kChunk) {
+            size_t count = n - i < kChunk ? n - i : kChunk;
+            Combine32(in + 2 * i, count, order, bits);
+            std::memcpy(out + i, bits, count * sizeof(float));
+        }
+    }
+
+    void DecodeBits(const uint16_t* in, size_t n, uint8_t* out) {
+#ifdef WASTLERNET_DECODE_X86
+        // The SSE4 version covers AVX2 as well: one register expands to exactly 16 bytes.
+        if (active_isa.load(std::memory_order_relaxed) != DecodeIsa::kScalar) {
+            return BitsSse4(in, n, out);
+        }
+#endif
+        BitsScalar(in, n, out);
+    }
+}
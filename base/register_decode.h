@@ -0,0 +1,69 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Bulk decoding of Modbus register blocks.
+//
+// The ModbusConnection::toXXX helpers convert one value at a time. Devices such as energy meters
+// expose hundreds of registers of the same type; the decoders in this header convert a whole
+// block in one pass and write the values into a column array:
+//
+//   uint16_t regs[240];                                   // 120 float32 values
+//   RETURN_IF_ERROR(...modbus_read_registers(ctx, 40000, 120, regs) ... );
+//   float values[120];
+//   DecodeFloat32(regs, 120, RegisterOrder::kABCD, values);
+//
+// Multi-register values are decoded according to a RegisterOrder, named after the byte order of
+// the value 0xAABBCCDD as it appears in the registers: kABCD is the Modbus default (high word
+// first, as in ModbusConnection::toInt32()), kCDAB is word-swapped (low word first, common on
+// meters), kBADC and kDCBA additionally swap the bytes inside each register.
+//
+// On x86-64 the decoders use AVX2 or SSE4.1, selected at runtime from the CPU features; other
+// platforms use the scalar implementation. All implementations produce identical results.
+//
+// Thread-safety
+// The decoders are stateless and may be called concurrently.
+//
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#ifndef WASTLERNET_REGISTER_DECODE_H
+#define WASTLERNET_REGISTER_DECODE_H
+namespace wastlernet {
+    /** Register layout of 32-bit values (see above). */
+    enum class RegisterOrder { kABCD, kCDAB, kBADC, kDCBA };
+
+    /** Instruction set used by the decoders. */
+    enum class DecodeIsa { kScalar, kSse4, kAvx2 };
+
+    /** The instruction set currently used. */
+    DecodeIsa ActiveDecodeIsa();
+
+    /**
+     * Use `isa` for subsequent calls, or the best supported one if the CPU lacks it. Intended for
+     * tests and benchmarks comparing implementations.
+     */
+    void SetDecodeIsa(DecodeIsa isa);
+
+    /** out[i] = in[i] * scale for `n` unsigned 16-bit registers. */
+    void DecodeUInt16(const uint16_t* in, size_t n, float scale, float* out);
+    void DecodeUInt16(const uint16_t* in, size_t n, double scale, double* out);
+
+    /** out[i] = int16(in[i]) * scale for `n` signed 16-bit registers. */
+    void DecodeInt16(const uint16_t* in, size_t n, float scale, float* out);
+    void DecodeInt16(const uint16_t* in, size_t n, double scale, double* out);
+
+    /** Decode `n` 32-bit integers from 2 * n registers. */
+    void DecodeInt32(const uint16_t* in, size_t n, RegisterOrder order, int32_t* out);
+    void DecodeUInt32(const uint16_t* in, size_t n, RegisterOrder order, uint32_t* out);
+
+    /** Decode `n` IEEE 754 single-precision values from 2 * n registers. */
+    void DecodeFloat32(const uint16_t* in, size_t n, RegisterOrder order, float* out);
+
+    /**
+     * Expand `n` registers into 16 * n flags (0 or 1), bit 0 (LSB) of each register first, as in
+     * ModbusConnection::toBitset16().
+     */
+    void DecodeBits(const uint16_t* in, size_t n, uint8_t* out);
+}
+#endif //WASTLERNET_REGISTER_DECODE_H
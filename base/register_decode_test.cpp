@@ -0,0 +1,115 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include <bitset>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "register_decode.h"
+#include "modbus_connection.h"
+
+using wastlernet::DecodeIsa;
+using wastlernet::RegisterOrder;
+
+// Runs each test once per instruction set (unsupported ones fall back to the best available).
+class RegisterDecodeTest : public testing::TestWithParam<DecodeIsa> {
+protected:
+    void SetUp() override {
+        wastlernet::SetDecodeIsa(GetParam());
+
+        // Odd sizes exercise the scalar tails of the vectorized loops.
+        std::mt19937 random(42);
+        registers_.resize(2 * 37);
+        for (auto& r : registers_) {
+            r = random();
+        }
+    }
+
+    void TearDown() override {
+        wastlernet::SetDecodeIsa(DecodeIsa::kAvx2);
+    }
+
+    std::vector<uint16_t> registers_;
+};
+
+TEST_P(RegisterDecodeTest, Widens16BitRegisters) {
+    size_t n = registers_.size();
+    std::vector<float> f(n);
+    std::vector<double> d(n);
+
+    wastlernet::DecodeUInt16(registers_.data(), n, 0.1f, f.data());
+    wastlernet::DecodeUInt16(registers_.data(), n, 0.1, d.data());
+    for (size_t i = 0; i < n; i++) {
+        EXPECT_EQ(f[i], static_cast<float>(registers_[i]) * 0.1f);
+        EXPECT_EQ(d[i], registers_[i] * 0.1);
+    }
+
+    wastlernet::DecodeInt16(registers_.data(), n, 0.5f, f.data());
+    wastlernet::DecodeInt16(registers_.data(), n, 0.5, d.data());
+    for (size_t i = 0; i < n; i++) {
+        EXPECT_EQ(f[i], wastlernet::ModbusConnection::toInt16(&registers_[i]) * 0.5f);
+        EXPECT_EQ(d[i], wastlernet::ModbusConnection::toInt16(&registers_[i]) * 0.5);
+    }
+}
+
+TEST_P(RegisterDecodeTest, Decodes32BitValuesLikeSingleValueHelpers) {
+    size_t n = registers_.size() / 2;
+    std::vector<int32_t> ints(n);
+    std::vector<float> floats(n);
+
+    wastlernet::DecodeInt32(registers_.data(), n, RegisterOrder::kABCD, ints.data());
+    wastlernet::DecodeFloat32(registers_.data(), n, RegisterOrder::kABCD, floats.data());
+    for (size_t i = 0; i < n; i++) {
+        EXPECT_EQ(ints[i], wastlernet::ModbusConnection::toInt32(&registers_[2 * i]));
+        float expected = wastlernet::ModbusConnection::toFloat(&registers_[2 * i]);
+        if (std::isnan(expected)) {
+            EXPECT_TRUE(std::isnan(floats[i]));
+        } else {
+            EXPECT_EQ(floats[i], expected);
+        }
+    }
+}
+
+TEST_P(RegisterDecodeTest, HandlesRegisterOrders) {
+    // 0x11223344 in each layout, repeated to cover the vectorized loops.
+    const std::vector<std::pair<RegisterOrder, std::vector<uint16_t>>> layouts = {
+            {RegisterOrder::kABCD, {0x1122, 0x3344}},
+            {RegisterOrder::kCDAB, {0x3344, 0x1122}},
+            {RegisterOrder::kBADC, {0x2211, 0x4433}},
+            {RegisterOrder::kDCBA, {0x4433, 0x2211}},
+    };
+    for (const auto& [order, layout] : layouts) {
+        std::vector<uint16_t> in;
+        for (int i = 0; i < 11; i++) {
+            in.insert(in.end(), layout.begin(), layout.end());
+        }
+        std::vector<uint32_t> out(11);
+        wastlernet::DecodeUInt32(in.data(), out.size(), order, out.data());
+        for (uint32_t v : out) {
+            EXPECT_EQ(v, 0x11223344u) << "order " << static_cast<int>(order);
+        }
+    }
+
+    // 123456.0f is 0x47F12000.
+    uint16_t cdab[2] = {0x2000, 0x47F1};
+    float f;
+    wastlernet::DecodeFloat32(cdab, 1, RegisterOrder::kCDAB, &f);
+    EXPECT_EQ(f, 123456.0f);
+}
+
+TEST_P(RegisterDecodeTest, ExpandsBits) {
+    size_t n = registers_.size();
+    std::vector<uint8_t> bits(16 * n);
+    wastlernet::DecodeBits(registers_.data(), n, bits.data());
+    for (size_t i = 0; i < n; i++) {
+        auto expected = wastlernet::ModbusConnection::toBitset16(&registers_[i]);
+        for (int b = 0; b < 16; b++) {
+            EXPECT_EQ(bits[16 * i + b], expected[b] ? 1 : 0);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(AllIsas, RegisterDecodeTest,
+                         testing::Values(DecodeIsa::kScalar, DecodeIsa::kSse4, DecodeIsa::kAvx2));
@@ -0,0 +1,91 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "register_map.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+#include <absl/strings/str_cat.h>
+
+#include "base/modbus_connection.h"
+
+namespace wastlernet {
+    int RegisterWidth(RegisterType type) {
+        switch (type) {
+            case RegisterType::kUInt16:
+            case RegisterType::kInt16:
+                return 1;
+            case RegisterType::kUInt32:
+            case RegisterType::kInt32:
+            case RegisterType::kFloat32:
+                return 2;
+        }
+        return 1;
+    }
+
+    double DecodeRegister(const uint16_t* u, RegisterType type) {
+        switch (type) {
+            case RegisterType::kUInt16:
+                return *u;
+            case RegisterType::kInt16:
+                return ModbusConnection::toInt16(u);
+            case RegisterType::kUInt32:
+                return static_cast<uint32_t>(ModbusConnection::toInt32(u));
+            case RegisterType::kInt32:
+                return ModbusConnection::toInt32(u);
+            case RegisterType::kFloat32:
+                return ModbusConnection::toFloat(u);
+        }
+        return 0;
+    }
+
+    std::vector<RegisterBlock> PlanRegisterBlocks(std::vector<RegisterRange> ranges,
+                                                  const RegisterPlanOptions& options) {
+        std::sort(ranges.begin(), ranges.end(), [](const RegisterRange& a, const RegisterRange& b) {
+            return a.address < b.address || (a.address == b.address && a.count > b.count);
+        });
+
+        // Greedily extend the current block as long as the next range fits into it; for sorted
+        // ranges this yields the minimum number of blocks.
+        std::vector<RegisterBlock> blocks;
+        for (const auto& r : ranges) {
+            if (!blocks.empty()) {
+                auto& current = blocks.back();
+                int end = current.address + current.count;
+                int merged_end = std::max(end, r.address + r.count);
+                if (r.address - end <= options.max_gap && merged_end - current.address <= options.max_block_size) {
+                    current.count = merged_end - current.address;
+                    continue;
+                }
+            }
+            blocks.push_back({r.address, r.count, 0});
+        }
+
+        int offset = 0;
+        for (auto& b : blocks) {
+            b.offset = offset;
+            offset += b.count;
+        }
+        return blocks;
+    }
+
+    absl::Status ReadRegisterBlocks(modbus_t* ctx, const std::vector<RegisterBlock>& blocks, uint16_t* buffer,
+                                    std::chrono::microseconds inter_frame_delay) {
+        for (const auto& b : blocks) {
+            if (&b != &blocks.front() && inter_frame_delay.count() > 0) {
+                std::this_thread::sleep_for(inter_frame_delay);
+            }
+            int rc = modbus_read_registers(ctx, b.address, b.count, buffer + b.offset);
+            if (rc == -1) {
+                return absl::InternalError(absl::StrCat("Error reading registers ", b.address, "-",
+                                                        b.address + b.count - 1, ": ", modbus_strerror(errno)));
+            }
+            if (rc < b.count) {
+                return absl::InternalError(absl::StrCat("Could not retrieve all registers ", b.address, "-",
+                                                        b.address + b.count - 1, " (got ", rc, ")"));
+            }
+        }
+        return absl::OkStatus();
+    }
+}
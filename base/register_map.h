@@ -0,0 +1,177 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Declarative Modbus register maps.
+//
+// A module declares the registers it is interested in as fields (address, type, scale) together
+// with a setter that stores the decoded value in its Data message:
+//
+//   static const auto registers = wastlernet::RegisterMap<SolvisData>::Builder()
+//       .Field(33024, 0.1, [](SolvisData* d, double v) { d->set_speicher_oben(v); })
+//       .Field(33031, RegisterType::kInt16, 0.1, [](SolvisData* d, double v) { d->set_solar_kollektor(v); })
+//       .Build();
+//
+//   SolvisData data;
+//   RETURN_IF_ERROR(registers.Read(ctx, &data));
+//
+// Build() coalesces all fields into the minimum number of block reads. Adjacent fields are merged
+// as long as the block stays within the Modbus limit of 125 registers per request and the
+// unused gap between them does not exceed `max_gap` registers (reading a few unused registers is
+// cheaper than an additional round trip). Every field is assigned its offset in the read buffer at
+// build time, so decoding is a plain walk over the field table.
+//
+// For fixed device layouts, a compile-time schema (register_schema.h) avoids the runtime table walk.
+//
+// Thread-safety
+// A built RegisterMap is immutable and may be shared between threads.
+//
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <absl/status/status.h>
+#include <modbus/modbus.h>
+
+#ifndef WASTLERNET_REGISTER_MAP_H
+#define WASTLERNET_REGISTER_MAP_H
+namespace wastlernet {
+    /** Encoding of a value in one or more 16-bit registers (multi-register values are big-endian). */
+    enum class RegisterType { kUInt16, kInt16, kUInt32, kInt32, kFloat32 };
+
+    /** Number of 16-bit registers occupied by a value of `type`. */
+    int RegisterWidth(RegisterType type);
+
+    /** Decode the value of `type` starting at `u`. */
+    double DecodeRegister(const uint16_t* u, RegisterType type);
+
+    /** A contiguous range of registers fetched with a single read request. */
+    struct RegisterBlock {
+        /** First register address. */
+        int address;
+        /** Number of registers to read. */
+        int count;
+        /** Position of the first register in the read buffer. */
+        int offset;
+    };
+
+    struct RegisterPlanOptions {
+        /** Maximum number of registers per read request. */
+        int max_block_size = MODBUS_MAX_READ_REGISTERS;
+        /** Maximum number of unused registers read to merge two blocks. */
+        int max_gap = 16;
+    };
+
+    /** A register range [address, address + count). */
+    struct RegisterRange {
+        int address;
+        int count;
+    };
+
+    /**
+     * Coalesce `ranges` into the minimum number of blocks satisfying `options`. Ranges may overlap
+     * and need not be sorted. Blocks are returned in ascending address order with consecutive
+     * buffer offsets.
+     */
+    std::vector<RegisterBlock> PlanRegisterBlocks(std::vector<RegisterRange> ranges,
+                                                  const RegisterPlanOptions& options = RegisterPlanOptions());
+
+    /**
+     * Read `blocks` into `buffer` (at their offsets), one request per block, keeping the line silent
+     * for `inter_frame_delay` between requests (Modbus RTU).
+     */
+    absl::Status ReadRegisterBlocks(modbus_t* ctx, const std::vector<RegisterBlock>& blocks, uint16_t* buffer,
+                                    std::chrono::microseconds inter_frame_delay = std::chrono::microseconds(0));
+
+    template<class Data>
+    class RegisterMap {
+    public:
+        /** Stores a decoded (and scaled) value in `data`. */
+        using Setter = void (*)(Data* data, double value);
+
+    private:
+        struct FieldSpec {
+            int address;
+            RegisterType type;
+            double scale;
+            Setter setter;
+            /** Position in the read buffer, resolved by Build(). */
+            int offset;
+        };
+
+    public:
+        class Builder {
+        public:
+            /** Declare a register of `type` whose decoded value is multiplied by `scale`. */
+            Builder& Field(int address, RegisterType type, double scale, Setter setter) {
+                fields_.push_back({address, type, scale, setter, 0});
+                return *this;
+            }
+
+            /** Declare an unsigned 16-bit register. */
+            Builder& Field(int address, double scale, Setter setter) {
+                return Field(address, RegisterType::kUInt16, scale, setter);
+            }
+
+            /** Plan the block reads and resolve all field offsets. */
+            RegisterMap Build(const RegisterPlanOptions& options = RegisterPlanOptions()) const {
+                std::vector<RegisterRange> ranges;
+                ranges.reserve(fields_.size());
+                for (const auto& f : fields_) {
+                    ranges.push_back({f.address, RegisterWidth(f.type)});
+                }
+
+                RegisterMap map;
+                map.blocks_ = PlanRegisterBlocks(std::move(ranges), options);
+                map.fields_ = fields_;
+                for (auto& f : map.fields_) {
+                    for (const auto& b : map.blocks_) {
+                        if (f.address >= b.address && f.address < b.address + b.count) {
+                            f.offset = b.offset + (f.address - b.address);
+                            break;
+                        }
+                    }
+                }
+                if (!map.blocks_.empty()) {
+                    map.buffer_size_ = map.blocks_.back().offset + map.blocks_.back().count;
+                }
+                return map;
+            }
+
+        private:
+            std::vector<FieldSpec> fields_;
+        };
+
+        /** The planned read requests. */
+        const std::vector<RegisterBlock>& blocks() const {
+            return blocks_;
+        }
+
+        /** Number of registers fetched by Read(). */
+        int buffer_size() const {
+            return buffer_size_;
+        }
+
+        /** Read all blocks from the device and decode them into `data`. */
+        absl::Status Read(modbus_t* ctx, Data* data) const {
+            std::vector<uint16_t> buffer(buffer_size_);
+            if (auto st = ReadRegisterBlocks(ctx, blocks_, buffer.data()); !st.ok()) {
+                return st;
+            }
+            Decode(buffer.data(), data);
+            return absl::OkStatus();
+        }
+
+        /** Decode a buffer laid out according to blocks() into `data`. */
+        void Decode(const uint16_t* buffer, Data* data) const {
+            for (const auto& f : fields_) {
+                f.setter(data, DecodeRegister(buffer + f.offset, f.type) * f.scale);
+            }
+        }
+
+    private:
+        std::vector<RegisterBlock> blocks_;
+        std::vector<FieldSpec> fields_;
+        int buffer_size_ = 0;
+    };
+}
+#endif //WASTLERNET_REGISTER_MAP_H
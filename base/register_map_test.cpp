@@ -0,0 +1,81 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "register_map.h"
+
+using wastlernet::PlanRegisterBlocks;
+using wastlernet::RegisterMap;
+using wastlernet::RegisterPlanOptions;
+using wastlernet::RegisterType;
+
+namespace {
+    struct TestData {
+        double a = 0;
+        double b = 0;
+        double c = 0;
+        std::vector<double> repeated;
+    };
+}
+
+// Ranges separated by at most max_gap registers are read in one block.
+TEST(RegisterMapTest, CoalescesNearbyRanges) {
+    RegisterPlanOptions options;
+    options.max_gap = 5;
+
+    auto blocks = PlanRegisterBlocks({{110, 2}, {100, 1}, {104, 1}, {200, 1}}, options);
+    ASSERT_EQ(blocks.size(), 2);
+    EXPECT_EQ(blocks[0].address, 100);
+    EXPECT_EQ(blocks[0].count, 12);
+    EXPECT_EQ(blocks[0].offset, 0);
+    EXPECT_EQ(blocks[1].address, 200);
+    EXPECT_EQ(blocks[1].count, 1);
+    EXPECT_EQ(blocks[1].offset, 12);
+}
+
+TEST(RegisterMapTest, RespectsMaximumBlockSize) {
+    RegisterPlanOptions options;
+    options.max_gap = 10;
+
+    std::vector<wastlernet::RegisterRange> ranges;
+    for (int i = 0; i < 130; i++) {
+        ranges.push_back({1000 + i, 1});
+    }
+    auto blocks = PlanRegisterBlocks(ranges, options);
+    ASSERT_EQ(blocks.size(), 2);
+    EXPECT_EQ(blocks[0].count, MODBUS_MAX_READ_REGISTERS);
+    EXPECT_EQ(blocks[1].address, 1000 + MODBUS_MAX_READ_REGISTERS);
+    EXPECT_EQ(blocks[1].count, 130 - MODBUS_MAX_READ_REGISTERS);
+}
+
+TEST(RegisterMapTest, OverlappingRangesShareRegisters) {
+    auto blocks = PlanRegisterBlocks({{10, 2}, {11, 1}, {10, 1}});
+    ASSERT_EQ(blocks.size(), 1);
+    EXPECT_EQ(blocks[0].address, 10);
+    EXPECT_EQ(blocks[0].count, 2);
+}
+
+TEST(RegisterMapTest, DecodesFieldsAtResolvedOffsets) {
+    auto map = RegisterMap<TestData>::Builder()
+            .Field(100, 0.1, [](TestData* d, double v) { d->a = v; })
+            .Field(101, RegisterType::kInt16, 0.5, [](TestData* d, double v) { d->b = v; })
+            .Field(500, RegisterType::kInt32, 1, [](TestData* d, double v) { d->c = v; })
+            .Field(100, 1, [](TestData* d, double v) { d->repeated.push_back(v); })
+            .Field(101, 1, [](TestData* d, double v) { d->repeated.push_back(v); })
+            .Build();
+
+    ASSERT_EQ(map.blocks().size(), 2);
+    ASSERT_EQ(map.buffer_size(), 4);
+
+    // Block 100-101 followed by block 500-501
+    uint16_t buffer[] = {215, 0xFFFC, 0xFFFF, 0xFFFE};
+    TestData data;
+    map.Decode(buffer, &data);
+
+    EXPECT_DOUBLE_EQ(data.a, 21.5);
+    EXPECT_DOUBLE_EQ(data.b, -2);
+    EXPECT_DOUBLE_EQ(data.c, -2);
+    EXPECT_EQ(data.repeated, std::vector<double>({215, 0xFFFC}));
+}
@@ -0,0 +1,193 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Compile-time Modbus register schemas.
+//
+// Where RegisterMap (register_map.h) plans reads and decodes at runtime, a register schema
+// describes a fixed device layout as a type. The compiler checks the layout and generates a fully
+// unrolled decoder: every field's buffer offset and scale factor is a constant, and the
+// register encoding is selected with `if constexpr`, so decoding has no loop, no branches and no
+// bounds checks.
+//
+//   using Plan = schema::ReadPlan<schema::Block<33024, 18>, schema::Block<33280, 20>>;
+//   using Registers = schema::Schema<SolvisData, Plan,
+//       schema::Field<33024, &SolvisData::set_speicher_oben, std::deci>,
+//       schema::Field<33031, &SolvisData::set_solar_kollektor, std::deci, RegisterType::kInt16>,
+//       schema::Flag<33282, &SolvisData::set_pumpe_heizkreis1>,
+//       schema::Repeated<33280, 14, &SolvisData::add_ausgang, std::ratio<1, 2>>>;
+//
+//   SolvisData data;
+//   RETURN_IF_ERROR(Registers::Read(ctx, &data));
+//
+// Layout errors are compile errors: a block larger than the Modbus limit of 125 registers, or a
+// field not fully covered by one block of the read plan, fails a static_assert.
+//
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <ratio>
+#include <utility>
+#include <vector>
+#include <absl/status/status.h>
+#include <absl/strings/str_cat.h>
+#include <modbus/modbus.h>
+
+#include "base/register_map.h"
+
+#ifndef WASTLERNET_REGISTER_SCHEMA_H
+#define WASTLERNET_REGISTER_SCHEMA_H
+namespace wastlernet::schema {
+    constexpr int Width(RegisterType type) {
+        return type == RegisterType::kUInt16 || type == RegisterType::kInt16 ? 1 : 2;
+    }
+
+    /**
+     * Decode a value of `Type` (big-endian for multi-register values). Same semantics as the
+     * ModbusConnection::toXXX helpers, but inline so that it folds into the generated decoder.
+     */
+    template<RegisterType Type>
+    inline double Value(const uint16_t* u) {
+        if constexpr (Type == RegisterType::kUInt16) {
+            return u[0];
+        } else if constexpr (Type == RegisterType::kInt16) {
+            return static_cast<int16_t>(u[0]);
+        } else if constexpr (Type == RegisterType::kUInt32) {
+            return (static_cast<uint32_t>(u[0]) << 16) | u[1];
+        } else if constexpr (Type == RegisterType::kInt32) {
+            return static_cast<int32_t>((static_cast<uint32_t>(u[0]) << 16) | u[1]);
+        } else {
+            uint32_t bits = (static_cast<uint32_t>(u[0]) << 16) | u[1];
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            return f;
+        }
+    }
+
+    /** A single read request of `Count` registers starting at `Address`. */
+    template<int Address, int Count>
+    struct Block {
+        static_assert(Count > 0, "empty register block");
+        static_assert(Count <= MODBUS_MAX_READ_REGISTERS, "register block exceeds the Modbus read limit");
+
+        static constexpr int address = Address;
+        static constexpr int count = Count;
+    };
+
+    /** The block reads of a schema; registers are stored in the order of the blocks. */
+    template<class... Blocks>
+    struct ReadPlan {
+        static_assert(sizeof...(Blocks) > 0, "read plan without blocks");
+
+        /** Total number of registers read. */
+        static constexpr int size = (Blocks::count + ...);
+
+        /**
+         * Buffer offset of the value occupying [address, address + width), or -1 if it is not
+         * contained in a single block.
+         */
+        static constexpr int OffsetOf(int address, int width) {
+            constexpr int addresses[] = {Blocks::address...};
+            constexpr int counts[] = {Blocks::count...};
+            int offset = 0;
+            for (size_t i = 0; i < sizeof...(Blocks); i++) {
+                if (address >= addresses[i] && address + width <= addresses[i] + counts[i]) {
+                    return offset + address - addresses[i];
+                }
+                offset += counts[i];
+            }
+            return -1;
+        }
+
+        /** The blocks with their buffer offsets, e.g. for ModbusConnection::ReadBlocks(). */
+        static const std::vector<RegisterBlock>& blocks() {
+            static const std::vector<RegisterBlock> layout = [] {
+                std::vector<RegisterBlock> result;
+                int offset = 0;
+                for (auto [address, count] : {std::pair<int, int>{Blocks::address, Blocks::count}...}) {
+                    result.push_back({address, count, offset});
+                    offset += count;
+                }
+                return result;
+            }();
+            return layout;
+        }
+
+        /** Read all blocks into `buffer`, which must hold `size` registers. */
+        static absl::Status Read(modbus_t* ctx, uint16_t* buffer) {
+            constexpr int addresses[] = {Blocks::address...};
+            constexpr int counts[] = {Blocks::count...};
+            for (size_t i = 0; i < sizeof...(Blocks); i++) {
+                int rc = modbus_read_registers(ctx, addresses[i], counts[i], buffer);
+                if (rc == -1) {
+                    return absl::InternalError(absl::StrCat("Error reading registers ", addresses[i], "-",
+                                                            addresses[i] + counts[i] - 1, ": ", modbus_strerror(errno)));
+                }
+                if (rc < counts[i]) {
+                    return absl::InternalError(absl::StrCat("Could not retrieve all registers ", addresses[i], "-",
+                                                            addresses[i] + counts[i] - 1, " (got ", rc, ")"));
+                }
+                buffer += counts[i];
+            }
+            return absl::OkStatus();
+        }
+    };
+
+    /** A value at `Address` of `Type`, multiplied by `Scale` and passed to `Setter`. */
+    template<int Address, auto Setter, class Scale = std::ratio<1>, RegisterType Type = RegisterType::kUInt16>
+    struct Field {
+        template<class Plan, class Data>
+        static void Decode(const uint16_t* buffer, Data* data) {
+            constexpr int offset = Plan::OffsetOf(Address, Width(Type));
+            static_assert(offset >= 0, "register field not covered by a block of the read plan");
+            constexpr double scale = static_cast<double>(Scale::num) / Scale::den;
+            (data->*Setter)(Value<Type>(buffer + offset) * scale);
+        }
+    };
+
+    /** A register interpreted as a boolean (non-zero = true). */
+    template<int Address, auto Setter>
+    struct Flag {
+        template<class Plan, class Data>
+        static void Decode(const uint16_t* buffer, Data* data) {
+            constexpr int offset = Plan::OffsetOf(Address, 1);
+            static_assert(offset >= 0, "register flag not covered by a block of the read plan");
+            (data->*Setter)(buffer[offset] != 0);
+        }
+    };
+
+    /** `Count` consecutive values starting at `Address`, appended in order via `Adder`. */
+    template<int Address, int Count, auto Adder, class Scale = std::ratio<1>, RegisterType Type = RegisterType::kUInt16>
+    struct Repeated {
+        template<class Plan, class Data>
+        static void Decode(const uint16_t* buffer, Data* data) {
+            DecodeAll<Plan>(buffer, data, std::make_integer_sequence<int, Count>());
+        }
+
+    private:
+        template<class Plan, class Data, int... I>
+        static void DecodeAll(const uint16_t* buffer, Data* data, std::integer_sequence<int, I...>) {
+            (Field<Address + I * Width(Type), Adder, Scale, Type>::template Decode<Plan>(buffer, data), ...);
+        }
+    };
+
+    /** A complete device layout: how to read it (`Plan`) and how to decode it into `Data`. */
+    template<class Data, class Plan, class... Fields>
+    struct Schema {
+        /** Decode a buffer filled according to `Plan`. */
+        static void Decode(const uint16_t* buffer, Data* data) {
+            (Fields::template Decode<Plan>(buffer, data), ...);
+        }
+
+        /** Read all blocks of `Plan` from the device and decode them into `data`. */
+        static absl::Status Read(modbus_t* ctx, Data* data) {
+            std::array<uint16_t, Plan::size> buffer;
+            if (auto st = Plan::Read(ctx, buffer.data()); !st.ok()) {
+                return st;
+            }
+            Decode(buffer.data(), data);
+            return absl::OkStatus();
+        }
+    };
+}
+#endif //WASTLERNET_REGISTER_SCHEMA_H
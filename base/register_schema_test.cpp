@@ -0,0 +1,65 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "register_schema.h"
+
+using namespace wastlernet::schema;
+using wastlernet::RegisterType;
+
+namespace {
+    struct TestData {
+        double a = 0;
+        double b = 0;
+        double c = 0;
+        bool flag = false;
+        std::vector<double> repeated;
+
+        void set_a(double v) { a = v; }
+        void set_b(double v) { b = v; }
+        void set_c(double v) { c = v; }
+        void set_flag(bool v) { flag = v; }
+        void add_repeated(double v) { repeated.push_back(v); }
+    };
+
+    using Plan = ReadPlan<Block<100, 4>, Block<500, 2>>;
+
+    static_assert(Plan::size == 6);
+    static_assert(Plan::OffsetOf(100, 1) == 0);
+    static_assert(Plan::OffsetOf(103, 1) == 3);
+    static_assert(Plan::OffsetOf(500, 2) == 4);
+    // Not covered, or crossing the end of a block.
+    static_assert(Plan::OffsetOf(104, 1) == -1);
+    static_assert(Plan::OffsetOf(103, 2) == -1);
+}
+
+TEST(RegisterSchemaTest, DecodesScaledFields) {
+    using Schema = Schema<TestData, Plan,
+            Field<100, &TestData::set_a, std::deci>,
+            Field<101, &TestData::set_b, std::ratio<1, 2>, RegisterType::kInt16>,
+            Field<500, &TestData::set_c, std::ratio<1>, RegisterType::kInt32>,
+            Flag<102, &TestData::set_flag>,
+            Repeated<100, 4, &TestData::add_repeated>>;
+
+    uint16_t buffer[] = {215, 0xFFFC, 1, 7, 0xFFFF, 0xFFFE};
+    TestData data;
+    Schema::Decode(buffer, &data);
+
+    EXPECT_DOUBLE_EQ(data.a, 21.5);
+    EXPECT_DOUBLE_EQ(data.b, -2);
+    EXPECT_DOUBLE_EQ(data.c, -2);
+    EXPECT_TRUE(data.flag);
+    EXPECT_EQ(data.repeated, std::vector<double>({215, 0xFFFC, 1, 7}));
+}
+
+TEST(RegisterSchemaTest, DecodesFloat) {
+    using Schema = Schema<TestData, ReadPlan<Block<0, 2>>,
+            Field<0, &TestData::set_a, std::ratio<1>, RegisterType::kFloat32>>;
+
+    uint16_t buffer[] = {0x47F1, 0x2000};
+    TestData data;
+    Schema::Decode(buffer, &data);
+    EXPECT_DOUBLE_EQ(data.a, 123456.0);
+}
@@ -0,0 +1,41 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "state_cache.h"
+
+namespace wastlernet {
+    void StateCache::Put(const std::string& key, std::string value) {
+        {
+            absl::MutexLock lock(&values_mutex_);
+            values_[key] = value;
+        }
+
+        absl::ReaderMutexLock lock(&subscriptions_mutex_);
+        for (const auto& [id, subscription] : subscriptions_) {
+            if (subscription.key == key) {
+                subscription.callback(key, value);
+            }
+        }
+    }
+
+    std::optional<std::string> StateCache::Get(const std::string& key) const {
+        absl::MutexLock lock(&values_mutex_);
+        auto it = values_.find(key);
+        if (it == values_.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    StateCache::SubscriptionId StateCache::Subscribe(const std::string& key, Callback callback) {
+        absl::MutexLock lock(&subscriptions_mutex_);
+        SubscriptionId id = next_id_++;
+        subscriptions_.emplace(id, Subscription{key, std::move(callback)});
+        return id;
+    }
+
+    void StateCache::Unsubscribe(SubscriptionId id) {
+        absl::MutexLock lock(&subscriptions_mutex_);
+        subscriptions_.erase(id);
+    }
+}
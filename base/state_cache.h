@@ -0,0 +1,58 @@
+/// \file state_cache.h
+/// \brief Shared in-memory cache of the latest module payloads.
+///
+/// Modules publish their latest serialized protobuf payload into a shared
+/// `StateCache`, keyed by the module `Name()`. Consumers can either read the
+/// current value (`Get()`, e.g. the REST listener) or subscribe to a key to be
+/// notified as soon as a new value is published (`Subscribe()`, e.g. the
+/// event-driven updaters in `updater.h`).
+///
+/// Thread-safety: all methods are internally synchronized. Subscriber callbacks
+/// are invoked synchronously on the publishing thread; they must be short and
+/// must not call `Subscribe()`/`Unsubscribe()` themselves.
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <absl/container/flat_hash_map.h>
+#include <absl/synchronization/mutex.h>
+
+#ifndef WASTLERNET_STATE_CACHE_H
+#define WASTLERNET_STATE_CACHE_H
+namespace wastlernet {
+    class StateCache {
+    public:
+        /// Called with the key and the newly published value.
+        using Callback = std::function<void(const std::string& key, const std::string& value)>;
+        using SubscriptionId = int64_t;
+
+        /// Publish `value` under `key` and notify all subscribers of `key`.
+        void Put(const std::string& key, std::string value);
+
+        /// Return the latest value published under `key`, if any.
+        std::optional<std::string> Get(const std::string& key) const;
+
+        /// Register `callback` to be invoked on every `Put()` to `key`.
+        SubscriptionId Subscribe(const std::string& key, Callback callback);
+
+        /// Remove a subscription. When this returns, the callback is guaranteed
+        /// not to be running and will not be invoked again.
+        void Unsubscribe(SubscriptionId id);
+
+    private:
+        struct Subscription {
+            std::string key;
+            Callback callback;
+        };
+
+        mutable absl::Mutex values_mutex_;
+        absl::flat_hash_map<std::string, std::string> values_ ABSL_GUARDED_BY(values_mutex_);
+
+        // Held shared while dispatching notifications, exclusively while (un)subscribing.
+        absl::Mutex subscriptions_mutex_;
+        absl::flat_hash_map<SubscriptionId, Subscription> subscriptions_ ABSL_GUARDED_BY(subscriptions_mutex_);
+        SubscriptionId next_id_ ABSL_GUARDED_BY(subscriptions_mutex_) = 0;
+    };
+}
+#endif //WASTLERNET_STATE_CACHE_H
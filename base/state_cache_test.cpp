@@ -0,0 +1,43 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "state_cache.h"
+
+using wastlernet::StateCache;
+
+TEST(StateCacheTest, GetReturnsLatestValue) {
+    StateCache cache;
+    EXPECT_FALSE(cache.Get("weather").has_value());
+
+    cache.Put("weather", "a");
+    cache.Put("weather", "b");
+    ASSERT_TRUE(cache.Get("weather").has_value());
+    EXPECT_EQ(*cache.Get("weather"), "b");
+}
+
+// Subscribers are only notified for the key they subscribed to.
+TEST(StateCacheTest, NotifiesSubscribersOfKey) {
+    StateCache cache;
+    std::vector<std::string> received;
+    cache.Subscribe("weather", [&](const std::string& key, const std::string& value) {
+        received.push_back(key + "=" + value);
+    });
+
+    cache.Put("solvis", "x");
+    cache.Put("weather", "y");
+    EXPECT_EQ(received, std::vector<std::string>({"weather=y"}));
+}
+
+TEST(StateCacheTest, UnsubscribeStopsNotifications) {
+    StateCache cache;
+    int calls = 0;
+    auto id = cache.Subscribe("weather", [&](const std::string&, const std::string&) { calls++; });
+
+    cache.Put("weather", "a");
+    cache.Unsubscribe(id);
+    cache.Put("weather", "b");
+    EXPECT_EQ(calls, 1);
+}
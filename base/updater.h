@@ -1,21 +1,34 @@
 //
 // Created by wastl on 27.10.23.
 //
+// Updaters push derived values back into devices (e.g. the indoor temperature measured by the
+// weather station into the Solvis heating controller).
+//
+// - PollingUpdater: calls Update() every `poll_interval` seconds.
+// - EventUpdater:   subscribes to keys of the shared StateCache and calls Update() whenever one of
+//                   them receives a new value. Bursts of events within `debounce` are collapsed into
+//                   a single Update(), so a device is written at most once per burst.
+//
+// Updaters implement IModule and can be launched by a ModuleRunner like any other module.
+//
 #pragma once
 #include <chrono>
+#include <string>
 #include <thread>
+#include <vector>
 #include <absl/status/status.h>
-#include <absl/container/flat_hash_map.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
 #include <glog/logging.h>
 
+#include "base/module.h"
+#include "base/state_cache.h"
 #include "config/config.pb.h"
 #ifndef WASTLERNET_UPDATER_H
 #define WASTLERNET_UPDATER_H
 namespace wastlernet {
-    typedef absl::flat_hash_map<std::string, std::string> StateCache;
-
     template<class Data>
-    class Updater {
+    class Updater : public IModule {
     protected:
         // not owned
         StateCache* current_state_;
@@ -28,34 +41,112 @@ namespace wastlernet {
         }
 
         // Perform initialization needed before starting.
-        virtual absl::Status Init() {
+        absl::Status Init() override {
             return absl::OkStatus();
         }
-
-        virtual void Start() = 0;
-
-        virtual void Abort() = 0;
-
-        virtual void Wait() = 0;
     };
 
     template<class Data>
     class PollingUpdater : public Updater<Data> {
     private:
         int poll_interval;
-        bool aborted_;
+        absl::Mutex mutex_;
+        bool aborted_ ABSL_GUARDED_BY(mutex_) = false;
         std::thread t_;
 
     public:
         PollingUpdater(StateCache* current_state, int poll_interval)
-                : Updater<Data>(current_state), poll_interval(poll_interval), aborted_(false) { }
+                : Updater<Data>(current_state), poll_interval(poll_interval) { }
 
         void Start() override {
             t_ = std::thread([this]() {
                 auto next = std::chrono::system_clock::now();
-                while (!aborted_) {
+                while (true) {
                     next += std::chrono::seconds(poll_interval);
-                    std::this_thread::sleep_until(next);
+                    {
+                        absl::MutexLock lock(&mutex_);
+                        mutex_.AwaitWithDeadline(absl::Condition(&aborted_), absl::FromChrono(next));
+                        if (aborted_) {
+                            break;
+                        }
+                    }
+                    auto st = this->Update();
+                    if (!st.ok()) {
+                        LOG(ERROR) << "Updater Error: " << st;
+                    }
+                }
+            });
+        }
+
+        void Abort() override {
+            {
+                absl::MutexLock lock(&mutex_);
+                aborted_ = true;
+            }
+            Wait();
+        }
+
+        void Wait() override {
+            if (t_.joinable()) {
+                t_.join();
+            }
+        }
+    };
+
+    template<class Data>
+    class EventUpdater : public Updater<Data> {
+    private:
+        std::vector<std::string> keys_;
+        absl::Duration debounce_;
+
+        absl::Mutex mutex_;
+        bool pending_ ABSL_GUARDED_BY(mutex_) = false;
+        bool aborted_ ABSL_GUARDED_BY(mutex_) = false;
+
+        std::vector<StateCache::SubscriptionId> subscriptions_;
+        std::thread t_;
+
+        bool Woken() const ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+            return pending_ || aborted_;
+        }
+
+        // Block until an event arrived and no further event followed within `debounce_`.
+        // Returns false if the updater was aborted.
+        bool AwaitQuiescentEvent() {
+            absl::MutexLock lock(&mutex_);
+            mutex_.Await(absl::Condition(this, &EventUpdater::Woken));
+            while (!aborted_) {
+                pending_ = false;
+                if (!mutex_.AwaitWithTimeout(absl::Condition(this, &EventUpdater::Woken), debounce_)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    public:
+        EventUpdater(StateCache* current_state, std::vector<std::string> keys,
+                     absl::Duration debounce = absl::Milliseconds(500))
+                : Updater<Data>(current_state), keys_(std::move(keys)), debounce_(debounce) { }
+
+        void Start() override {
+            {
+                absl::MutexLock lock(&mutex_);
+                for (const auto& key : keys_) {
+                    // Apply values published before we subscribed.
+                    pending_ |= this->current_state_->Get(key).has_value();
+                }
+            }
+            for (const auto& key : keys_) {
+                subscriptions_.push_back(this->current_state_->Subscribe(
+                        key, [this](const std::string&, const std::string&) {
+                            absl::MutexLock lock(&mutex_);
+                            pending_ = true;
+                        }));
+            }
+
+            t_ = std::thread([this]() {
+                while (AwaitQuiescentEvent()) {
                     auto st = this->Update();
                     if (!st.ok()) {
                         LOG(ERROR) << "Updater Error: " << st;
@@ -65,12 +156,21 @@ namespace wastlernet {
         }
 
         void Abort() override {
-            aborted_ = true;
-            t_.join();
+            for (auto id : subscriptions_) {
+                this->current_state_->Unsubscribe(id);
+            }
+            subscriptions_.clear();
+            {
+                absl::MutexLock lock(&mutex_);
+                aborted_ = true;
+            }
+            Wait();
         }
 
         void Wait() override {
-            t_.join();
+            if (t_.joinable()) {
+                t_.join();
+            }
         }
     };
 }
@@ -4,13 +4,13 @@
 #include <cpprest/uri.h>
 #include <cpprest/http_msg.h>
 #include <cpprest/http_client.h>
-#include <cpprest/json.h>
 #include <glog/logging.h>
 #include <absl/strings/str_cat.h>
 #include <chrono>
 #include <cmath>
 #include <algorithm>
 
+#include "base/json_extract.h"
 #include "base/metrics.h"
 #include "fronius_client.h"
 
@@ -21,77 +21,67 @@ namespace fronius {
     using namespace web; // Common features like URIs.
     using namespace web::http; // Common HTTP functionality
     using namespace web::http::client; // HTTP client features
-    using namespace web::json; // JSON library
 
-    // Small helpers to traverse cpprestsdk JSON more succinctly.
+    // JSON paths of the fields read from each endpoint. The Data objects are keyed "0", "1", ...
+    // (one per device), which the extractor matches like array indexes.
     namespace {
-        inline utility::string_t s2t(const char* s) {
-            return utility::conversions::to_string_t(s);
-        }
-
-        // Walk a nested object path like {"Body","Data","Site"}. Returns nullptr if missing.
-        inline const value* json_getp(const value& root, std::initializer_list<const char*> path) {
-            const value* cur = &root;
-            for (const char* k : path) {
-                if (!cur->is_object()) return nullptr;
-                const auto key = s2t(k);
-                const auto& obj = cur->as_object();
-                auto it = obj.find(key);
-                if (it == obj.end()) return nullptr;
-                cur = &it->second;
-            }
-            return cur;
-        }
-
-        // Get a double field from an object; returns def if not present or not a number.
-        inline double json_get_double(const value& obj, const char* key, double def = 0.0) {
-            try {
-                if (!obj.is_object()) return def;
-                auto sk = s2t(key);
-                const auto& o = obj.as_object();
-                auto it = o.find(sk);
-                if (it == o.end()) return def;
-                const auto& v = it->second;
-                if (v.is_number()) return v.as_double();
-                // Some Fronius firmwares have numeric-ish strings; try conversion.
-                if (v.is_string()) {
-                    try {
-                        return std::stod(utility::conversions::to_utf8string(v.as_string()));
-                    } catch (...) {
-                        return def;
-                    }
-                }
-            } catch (...) {
-            }
-            return def;
-        }
+        struct PowerFlowFields {
+            wastlernet::JsonExtractor json;
+            int site = json.Add({"Body", "Data", "Site"});
+            int p_load = json.Add({"Body", "Data", "Site", "P_Load"});
+            int p_pv = json.Add({"Body", "Data", "Site", "P_PV"});
+            int p_grid = json.Add({"Body", "Data", "Site", "P_Grid"});
+            int p_akku = json.Add({"Body", "Data", "Site", "P_Akku"});
+        };
+
+        struct BatteryFields {
+            wastlernet::JsonExtractor json;
+            int controller = json.Add({"Body", "Data", "0", "Controller"});
+            int soc = json.Add({"Body", "Data", "0", "Controller", "StateOfCharge_Relative"});
+            int current_dc = json.Add({"Body", "Data", "0", "Controller", "Current_DC"});
+            int temperature = json.Add({"Body", "Data", "0", "Controller", "Temperature_Cell"});
+            int voltage_dc = json.Add({"Body", "Data", "0", "Controller", "Voltage_DC"});
+        };
+
+        struct MeterFields {
+            wastlernet::JsonExtractor json;
+            int meter = json.Add({"Body", "Data", "0"});
+            int phase_1 = json.Add({"Body", "Data", "0", "PowerApparent_S_Phase_1"});
+            int phase_2 = json.Add({"Body", "Data", "0", "PowerApparent_S_Phase_2"});
+            int phase_3 = json.Add({"Body", "Data", "0", "PowerApparent_S_Phase_3"});
+            int sum = json.Add({"Body", "Data", "0", "PowerApparent_S_Sum"});
+        };
     } // namespace
 
-    absl::Status FroniusPowerFlowClient::Query(const std::function<void(const Leistung&, const Quellen&)>& handler) {
+    absl::Status FroniusPowerFlowClient::Query(const std::function<void(const Leistung&, const Quellen&)>& handler,
+                                               const wastlernet::Deadline& deadline) {
+        return QueryAsync(handler, deadline).get();
+    }
+
+    pplx::task<absl::Status> FroniusPowerFlowClient::QueryAsync(
+            std::function<void(const Leistung&, const Quellen&)> handler, const wastlernet::Deadline& deadline) {
         auto start_time = std::chrono::high_resolution_clock::now();
 
-        auto st = Execute([&](const http_response& response) {
-            if (response.status_code() != status_codes::OK) {
-                LOGF(ERROR) << "Fronius query failed: " << response.reason_phrase();
-                return absl::InternalError(absl::StrCat("Fronius query failed: ", response.reason_phrase()));
+        return ExecuteIfChangedAsync([handler](const std::string& body) {
+            static const PowerFlowFields fields;
+            wastlernet::JsonSlots slots;
+            if (auto st = fields.json.Extract(body, &slots); !st.ok()) {
+                LOGF(ERROR) << "Invalid Fronius JSON: " << st.message();
+                return st;
             }
 
-            value result = response.extract_json(true).get();
-
-            // Drill down to Body/Data/Site in a compact way.
-            const value* Site = json_getp(result, {"Body","Data","Site"});
-            if (!Site) {
-                LOGF(ERROR) << "Unexpected JSON: missing Body.Data.Site: " << result.serialize();
+            if (!slots[fields.site].present()) {
+                LOGF(ERROR) << "Unexpected JSON: missing Body.Data.Site: " << body;
                 return absl::InternalError("Unexpected Fronius JSON (no Body.Data.Site)");
             }
 
             Leistung data;
 
             // Extract doubles with sensible defaults (0.0 if missing)
-            double p_load = json_get_double(*Site, "P_Load"); // W, positive consumption
-            double p_pv = json_get_double(*Site, "P_PV"); // W, PV production
-            double p_grid = json_get_double(*Site, "P_Grid"); // W, positive import, negative export
-            double p_akku = json_get_double(*Site, "P_Akku"); // W, positive discharge, negative charge
+            double p_load = slots[fields.p_load].AsDouble(); // W, positive consumption
+            double p_pv = slots[fields.p_pv].AsDouble(); // W, PV production
+            double p_grid = slots[fields.p_grid].AsDouble(); // W, positive import, negative export
+            double p_akku = slots[fields.p_akku].AsDouble(); // W, positive discharge, negative charge
 
             data.set_hausverbrauch(-p_load);
             data.set_pv_leistung(p_pv);
@@ -117,42 +107,43 @@ namespace fronius {
 
             handler(data, quellen);
             return absl::OkStatus();
-        });
-
-        {
+        }, deadline).then([start_time](absl::Status st) {
             auto end_time = std::chrono::high_resolution_clock::now();
             const double seconds = std::chrono::duration<double>(end_time - start_time).count();
             wastlernet::metrics::WastlernetMetrics::GetInstance().ObserveQueryLatency("fronius", seconds);
-            wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryResult("fronius", st.ok());
-        }
+            wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryStatus("fronius", st);
+            return st;
+        });
+    }
 
-        return st;
+    absl::Status FroniusBatteryClient::Query(const std::function<void(const Batterie&)>& handler,
+                                             const wastlernet::Deadline& deadline) {
+        return QueryAsync(handler, deadline).get();
     }
 
-    absl::Status FroniusBatteryClient::Query(const std::function<void(const Batterie&)>& handler) {
+    pplx::task<absl::Status> FroniusBatteryClient::QueryAsync(std::function<void(const Batterie&)> handler,
+                                                              const wastlernet::Deadline& deadline) {
         auto start_time = std::chrono::high_resolution_clock::now();
 
-        auto st = Execute([&](const http_response& response) {
-            if (response.status_code() != status_codes::OK) {
-                LOGF(ERROR) << "Fronius query failed: " << response.reason_phrase();
-                return absl::InternalError(absl::StrCat("Fronius query failed: ", response.reason_phrase()));
+        return ExecuteIfChangedAsync([handler](const std::string& body) {
+            static const BatteryFields fields;
+            wastlernet::JsonSlots slots;
+            if (auto st = fields.json.Extract(body, &slots); !st.ok()) {
+                LOGF(ERROR) << "Invalid Fronius JSON: " << st.message();
+                return st;
             }
 
-            value result = response.extract_json(true).get();
-
-            // Body/Data/0/Controller
-            const value* Controller = json_getp(result, {"Body","Data","0","Controller"});
-            if (!Controller) {
-                LOGF(ERROR) << "Unexpected JSON: missing Body.Data.0.Controller: " << result.serialize();
+            if (!slots[fields.controller].present()) {
+                LOGF(ERROR) << "Unexpected JSON: missing Body.Data.0.Controller: " << body;
                 return absl::InternalError("Unexpected Fronius JSON (no Body.Data.0.Controller)");
             }
 
             Batterie data;
 
-            double p_soc = json_get_double(*Controller, "StateOfCharge_Relative"); // %
-            double p_current_dc = json_get_double(*Controller, "Current_DC"); // A
-            double p_temp = json_get_double(*Controller, "Temperature_Cell"); // °C
-            double p_voltage_dc = json_get_double(*Controller, "Voltage_DC"); // V
+            double p_soc = slots[fields.soc].AsDouble(); // %
+            double p_current_dc = slots[fields.current_dc].AsDouble(); // A
+            double p_temp = slots[fields.temperature].AsDouble(); // °C
+            double p_voltage_dc = slots[fields.voltage_dc].AsDouble(); // V
 
             data.set_soc(p_soc);
             data.set_spannung(p_voltage_dc);
@@ -161,41 +152,42 @@ namespace fronius {
 
             handler(data);
             return absl::OkStatus();
-        });
-
-        {
+        }, deadline).then([start_time](absl::Status st) {
             auto end_time = std::chrono::high_resolution_clock::now();
             const double seconds = std::chrono::duration<double>(end_time - start_time).count();
             wastlernet::metrics::WastlernetMetrics::GetInstance().ObserveQueryLatency("fronius", seconds);
-            wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryResult("fronius", st.ok());
-        }
-
-        return st;
+            wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryStatus("fronius", st);
+            return st;
+        });
     }
 
 
-    absl::Status FroniusEnergyMeterClient::Query(const std::function<void(double consumption_watts)> &handler) {
+    absl::Status FroniusEnergyMeterClient::Query(const std::function<void(double consumption_watts)> &handler,
+                                                 const wastlernet::Deadline &deadline) {
+        return QueryAsync(handler, deadline).get();
+    }
+
+    pplx::task<absl::Status> FroniusEnergyMeterClient::QueryAsync(std::function<void(double consumption_watts)> handler,
+                                                                  const wastlernet::Deadline &deadline) {
         auto start_time = std::chrono::high_resolution_clock::now();
 
-        auto st = Execute([&](const http_response& response) {
-            if (response.status_code() != status_codes::OK) {
-                LOGF(ERROR) << "Fronius query failed: " << response.reason_phrase();
-                return absl::InternalError(absl::StrCat("Fronius query failed: ", response.reason_phrase()));
+        return ExecuteIfChangedAsync([handler](const std::string& body) {
+            static const MeterFields fields;
+            wastlernet::JsonSlots slots;
+            if (auto st = fields.json.Extract(body, &slots); !st.ok()) {
+                LOGF(ERROR) << "Invalid Fronius JSON: " << st.message();
+                return st;
             }
 
-            value result = response.extract_json(true).get();
-
-            // Body/Data/0
-            const value* Meter0 = json_getp(result, {"Body","Data","0"});
-            if (!Meter0) {
-                LOGF(ERROR) << "Unexpected JSON: missing Body.Data.0: " << result.serialize();
+            if (!slots[fields.meter].present()) {
+                LOGF(ERROR) << "Unexpected JSON: missing Body.Data.0: " << body;
                 return absl::InternalError("Unexpected Fronius JSON (no Body.Data.0)");
             }
 
             // Prefer per-phase powers if available
-            double p1 = json_get_double(*Meter0, "PowerApparent_S_Phase_1", NAN);
-            double p2 = json_get_double(*Meter0, "PowerApparent_S_Phase_2", NAN);
-            double p3 = json_get_double(*Meter0, "PowerApparent_S_Phase_3", NAN);
+            double p1 = slots[fields.phase_1].AsDouble(NAN);
+            double p2 = slots[fields.phase_2].AsDouble(NAN);
+            double p3 = slots[fields.phase_3].AsDouble(NAN);
 
             double consumption = 0.0;
             if (!std::isnan(p1) && !std::isnan(p2) && !std::isnan(p3)) {
@@ -203,22 +195,19 @@ namespace fronius {
                 auto pos = [](double v){ return v > 0 ? v : 0.0; };
                 consumption = pos(p1) + pos(p2) + pos(p3);
             } else {
-                double psum = json_get_double(*Meter0, "PowerApparent_S_Sum", 0.0);
+                double psum = slots[fields.sum].AsDouble(0.0);
                 consumption = std::max(0.0, psum);
             }
 
             handler(consumption);
             return absl::OkStatus();
-        });
-
-        {
+        }, deadline).then([start_time](absl::Status st) {
             auto end_time = std::chrono::high_resolution_clock::now();
             const double seconds = std::chrono::duration<double>(end_time - start_time).count();
             wastlernet::metrics::WastlernetMetrics::GetInstance().ObserveQueryLatency("fronius", seconds);
-            wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryResult("fronius", st.ok());
-        }
-
-        return st;
+            wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryStatus("fronius", st);
+            return st;
+        });
     }
 
     http_client_config FroniusBaseClient::ClientConfig() {
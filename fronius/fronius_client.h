@@ -83,12 +83,18 @@ namespace fronius {
          * Performs a GET request to the configured endpoint and, on success,
          * calls `handler` with the parsed `Leistung` and `Quellen` messages.
          *
-         * @param handler Callback invoked on successful parsing.
-         *                It receives references to `Leistung` and `Quellen`.
+         * @param handler Callback invoked on successful parsing, only if the response changed since
+         *                the last query. It receives references to `Leistung` and `Quellen`.
+         * @param deadline Time by which the response must have been received.
          * @return `absl::OkStatus()` on success; appropriate error otherwise
          *         (e.g., network/HTTP errors, parse errors, missing fields).
          */
-        absl::Status Query(const std::function<void(const Leistung&, const Quellen&)> &handler);
+        absl::Status Query(const std::function<void(const Leistung&, const Quellen&)> &handler,
+                           const wastlernet::Deadline &deadline = wastlernet::Deadline::Infinite());
+
+        /** @brief Asynchronous variant of Query(); `handler` runs on a cpprest thread. */
+        pplx::task<absl::Status> QueryAsync(std::function<void(const Leistung&, const Quellen&)> handler,
+                                            const wastlernet::Deadline &deadline = wastlernet::Deadline::Infinite());
 
     protected:
         /** @brief Human-readable client name for logging/debugging. */
@@ -120,10 +126,17 @@ namespace fronius {
          * Performs a GET request to the storage endpoint and, on success,
          * calls `handler` with the parsed `Batterie` message.
          *
-         * @param handler Callback invoked on successful parsing.
+         * @param handler Callback invoked on successful parsing, only if the response changed since
+         *                the last query.
+         * @param deadline Time by which the response must have been received.
          * @return `absl::OkStatus()` on success; an error status otherwise.
          */
-        absl::Status Query(const std::function<void(const Batterie&)> &handler);
+        absl::Status Query(const std::function<void(const Batterie&)> &handler,
+                           const wastlernet::Deadline &deadline = wastlernet::Deadline::Infinite());
+
+        /** @brief Asynchronous variant of Query(); `handler` runs on a cpprest thread. */
+        pplx::task<absl::Status> QueryAsync(std::function<void(const Batterie&)> handler,
+                                            const wastlernet::Deadline &deadline = wastlernet::Deadline::Infinite());
 
     protected:
         /** @brief Human-readable client name for logging/debugging. */
@@ -147,9 +160,16 @@ namespace fronius {
 
         /**
          * @brief Query the device and deliver computed consumption via callback.
-         * @param handler Callback receiving total house consumption in Watts.
+         * @param handler Callback receiving total house consumption in Watts, only if the response
+         *                changed since the last query.
+         * @param deadline Time by which the response must have been received.
          */
-        absl::Status Query(const std::function<void(double consumption_watts)> &handler);
+        absl::Status Query(const std::function<void(double consumption_watts)> &handler,
+                           const wastlernet::Deadline &deadline = wastlernet::Deadline::Infinite());
+
+        /** @brief Asynchronous variant of Query(); `handler` runs on a cpprest thread. */
+        pplx::task<absl::Status> QueryAsync(std::function<void(double consumption_watts)> handler,
+                                            const wastlernet::Deadline &deadline = wastlernet::Deadline::Infinite());
 
     protected:
         std::string Name() override { return "FroniusEnergyMeterClient"; }
@@ -6,28 +6,60 @@
 #include "base/utility.h"
 
 #include <glog/logging.h>
+#include <atomic>
 #include <chrono>
+#include <vector>
 
 #define LOGF(level) LOG(level) << "[fronius] "
 
 namespace fronius {
 
-absl::Status FroniusModule::Query(std::function<absl::Status(const fronius::FroniusData &)> handler) {
+absl::Status FroniusModule::Query(const wastlernet::Deadline &deadline,
+                                  std::function<absl::Status(const fronius::FroniusData &)> handler) {
+    // A sample combines all four endpoints, so a client's response only counts as stored once the
+    // other endpoints answered and the write succeeded. If not, the next poll must rebuild the
+    // sample from all responses, including those that did not change in between.
+    auto forget = [this]() {
+        pf_client_.ForgetLastResponse();
+        slave_client_.ForgetLastResponse();
+        energy_client_.ForgetLastResponse();
+        battery_client_.ForgetLastResponse();
+    };
     try {
-        FroniusData data;
+        // Query all endpoints concurrently; each handler updates its own result, combined below.
+        // Handlers only run for changed responses.
+        std::atomic<bool> changed{false};
+        std::vector<pplx::task<absl::Status>> requests = {
+            pf_client_.QueryAsync([this, &changed](const Leistung &l, const Quellen &q) {
+                master_ = l;
+                changed = true;
+            }, deadline),
+            slave_client_.QueryAsync([this, &changed](const Leistung &l, const Quellen &q) {
+                slave_ = l;
+                changed = true;
+            }, deadline),
+            // The consumption is recomputed from the power flow below.
+            energy_client_.QueryAsync([](double consumption) { }, deadline),
+            battery_client_.QueryAsync([this, &changed](const Batterie &b) {
+                batterie_ = b;
+                changed = true;
+            }, deadline),
+        };
+        for (const auto& st : pplx::when_all(requests.begin(), requests.end()).get()) {
+            if (!st.ok()) {
+                forget();
+                return st;
+            }
+        }
+        if (!changed) {
+            // Same state as the last sample; nothing to store.
+            return absl::OkStatus();
+        }
 
-        RETURN_IF_ERROR(pf_client_.Query([&](const Leistung &l, const Quellen &q) {
-            *data.mutable_leistung() = l;
-        }));
-        RETURN_IF_ERROR(slave_client_.Query([&](const Leistung &l, const Quellen &q) {
-            data.mutable_leistung()->set_pv_leistung(data.leistung().pv_leistung() + l.pv_leistung());
-        }));
-        RETURN_IF_ERROR(energy_client_.Query([&](double consumption) {
-            data.mutable_leistung()->set_hausverbrauch(consumption);
-        }));
-        RETURN_IF_ERROR(battery_client_.Query([&](const Batterie &b) {
-            *data.mutable_batterie() = b;
-        }));
+        FroniusData data;
+        *data.mutable_leistung() = master_;
+        data.mutable_leistung()->set_pv_leistung(master_.pv_leistung() + slave_.pv_leistung());
+        *data.mutable_batterie() = batterie_;
 
         // Fix up consumption
         double consumption = data.leistung().pv_leistung()+data.leistung().batterie_leistung()+data.leistung().netz_leistung();
@@ -53,8 +85,13 @@ absl::Status FroniusModule::Query(std::function<absl::Status(const fronius::Fron
         *data.mutable_quellen() = quellen;
 
 
-        return handler(data);
+        auto st = handler(data);
+        if (!st.ok()) {
+            forget();
+        }
+        return st;
     } catch (std::exception const &e) {
+        forget();
         LOGF(ERROR) << "Error querying Fronius Solar API: " << e.what();
         return absl::InternalError(e.what());
     }
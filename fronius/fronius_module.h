@@ -23,8 +23,14 @@ namespace fronius {
         FroniusEnergyMeterClient energy_client_;
         FroniusBatteryClient battery_client_;
 
+        // Last data received from each endpoint. The clients only deliver changed responses, so
+        // endpoints that did not change are combined from here.
+        Leistung master_, slave_;
+        Batterie batterie_;
+
     protected:
-        absl::Status Query(std::function<absl::Status(const FroniusData &)> handler) override;
+        absl::Status Query(const wastlernet::Deadline &deadline,
+                           std::function<absl::Status(const FroniusData &)> handler) override;
 
     public:
         FroniusModule(const wastlernet::TimescaleDB &db_cfg, const wastlernet::Fronius &client_cfg,
@@ -0,0 +1,105 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include <memory>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <absl/strings/str_cat.h>
+
+#include "fronius_module.h"
+
+#include "base/http_replay.h"
+
+constexpr char kMasterHost[] = "127.0.0.1:15005";
+constexpr char kSlaveHost[] = "127.0.0.1:15006";
+constexpr char kPowerFlowPath[] = "/solar_api/v1/GetPowerFlowRealtimeData.fcgi";
+
+namespace {
+    std::string PowerFlow(double pv) {
+        return absl::StrCat(R"({"Body":{"Data":{"Site":{"P_Load":-800,"P_PV":)", pv,
+                            R"(,"P_Grid":0,"P_Akku":-200}}}})");
+    }
+
+    // Exposes the poll of a single sample.
+    class TestFroniusModule : public fronius::FroniusModule {
+    public:
+        using FroniusModule::FroniusModule;
+        using FroniusModule::Query;
+    };
+}
+
+class FroniusModuleTest : public testing::Test {
+protected:
+    void SetUp() override {
+        master_ = std::make_unique<wastlernet::HttpReplayServer>(absl::StrCat("http://", kMasterHost));
+        master_->AddResponse(kPowerFlowPath, PowerFlow(1000));
+        master_->AddResponse("/solar_api/v1/GetStorageRealtimeData.cgi",
+                             R"({"Body":{"Data":{"0":{"Controller":{"StateOfCharge_Relative":50,)"
+                             R"("Current_DC":-4,"Temperature_Cell":21,"Voltage_DC":50}}}}})");
+        master_->AddResponse("/solar_api/v1/GetMeterRealtimeData.cgi",
+                             R"({"Body":{"Data":{"0":{"PowerApparent_S_Sum":800}}}})");
+        ASSERT_TRUE(master_->Start().ok());
+
+        slave_ = std::make_unique<wastlernet::HttpReplayServer>(absl::StrCat("http://", kSlaveHost));
+        slave_->AddResponse(kPowerFlowPath, PowerFlow(500));
+        ASSERT_TRUE(slave_->Start().ok());
+
+        config_.mutable_master()->set_host(kMasterHost);
+        config_.mutable_slave()->set_host(kSlaveHost);
+        config_.mutable_meter()->set_host(kMasterHost);
+        config_.set_poll_interval(1);
+    }
+
+    // Poll once; the stored samples are appended to `stored_`, unless `fail_store` is set.
+    absl::Status Poll(TestFroniusModule& module, bool fail_store = false) {
+        return module.Query(wastlernet::Deadline::After(std::chrono::seconds(5)),
+                            [this, fail_store](const fronius::FroniusData& data) {
+            if (fail_store) {
+                return absl::UnavailableError("database down");
+            }
+            stored_.push_back(data);
+            return absl::OkStatus();
+        });
+    }
+
+    wastlernet::TimescaleDB db_;
+    wastlernet::Fronius config_;
+    wastlernet::StateCache cache_;
+    std::vector<fronius::FroniusData> stored_;
+
+    std::unique_ptr<wastlernet::HttpReplayServer> master_, slave_;
+};
+
+TEST_F(FroniusModuleTest, SkipsUnchangedSample) {
+    TestFroniusModule module(db_, config_, &cache_);
+    ASSERT_TRUE(Poll(module).ok());
+    ASSERT_TRUE(Poll(module).ok());
+    ASSERT_EQ(stored_.size(), 1);
+    EXPECT_DOUBLE_EQ(stored_[0].leistung().pv_leistung(), 1500);
+}
+
+// The master changed while the slave failed: the next poll sees only unchanged bodies, but the new
+// master data was never stored and must be stored now.
+TEST_F(FroniusModuleTest, StoresSampleAfterFailedEndpoint) {
+    TestFroniusModule module(db_, config_, &cache_);
+    ASSERT_TRUE(Poll(module).ok());
+
+    master_->AddResponse(kPowerFlowPath, PowerFlow(2000));
+    slave_->SetFaults(std::chrono::microseconds(0), std::chrono::microseconds(0), 1.0);
+    EXPECT_FALSE(Poll(module).ok());
+    EXPECT_EQ(stored_.size(), 1);
+
+    slave_->SetFaults(std::chrono::microseconds(0), std::chrono::microseconds(0), 0);
+    ASSERT_TRUE(Poll(module).ok());
+    ASSERT_EQ(stored_.size(), 2);
+    EXPECT_DOUBLE_EQ(stored_[1].leistung().pv_leistung(), 2500);
+}
+
+TEST_F(FroniusModuleTest, StoresSampleAfterFailedWrite) {
+    TestFroniusModule module(db_, config_, &cache_);
+    EXPECT_FALSE(Poll(module, true).ok());
+    ASSERT_TRUE(Poll(module).ok());
+    ASSERT_EQ(stored_.size(), 1);
+    EXPECT_DOUBLE_EQ(stored_[0].leistung().pv_leistung(), 1500);
+}
@@ -2,18 +2,16 @@
 // Created by wastl on 09.12.22.
 //
 
-#include <absl/strings/str_join.h>
-#include <cctype>
+#include <absl/strings/str_cat.h>
 #include <iostream>
 #include <cpprest/uri.h>                        // URI library
 #include <cpprest/http_msg.h>
 #include <cpprest/http_client.h>
 #include <cpprest/json.h>
 #include <glog/logging.h>
-#include <gumbo-query/Document.h>
-#include <gumbo-query/Node.h>
 
 #include "hafnertec_client.h"
+#include "schematic_parser.h"
 
 #include "base/metrics.h"
 
@@ -26,73 +24,29 @@ using namespace concurrency::streams; // Asynchronous streams
 #define LOGH(level) LOG(level) << "[hafnertec] "
 
 namespace hafnertec {
-    namespace {
-        double parse_numeric(absl::string_view s) {
-            int start, end;
-
-            // find start of number
-            for (start = 0; start < s.size(); start++) {
-                if (std::isdigit(s[start]) && s[start] != '-' && s[start] != '.' && s[start] != '+') {
-                    break;
-                }
-            }
-
-            // find end of number
-            for (end = s.size() - 1; end > start; end--) {
-                if (std::isdigit(s[end]) && s[end] != '-' && s[end] != '.' && s[end] != '+') {
-                    break;
-                }
-            }
-
-            if (start == end) {
-                LOGH(ERROR) << "Could not find number in '" << s << "'";
-                return 0;
-            }
-
-            std::string n = std::string(s.substr(start, end));
-
-            return std::atof(n.c_str());
-        }
-    }
-
-    absl::Status HafnertecClient::Query(const std::function<void(const HafnertecData &)> &handler) {
+    absl::Status HafnertecClient::Query(const std::function<absl::Status(const HafnertecData &)> &handler,
+                                        const wastlernet::Deadline &deadline) {
         auto start_time = std::chrono::high_resolution_clock::now();
 
-        auto st = Execute([=](const http_response &response) {
-            if (response.status_code() == status_codes::OK) {
-                std::string html = absl::StrCat("<html>", response.extract_string().get(), "</html>");
-                CDocument doc;
-                doc.parse(html);
-
-                CSelection c = doc.find("html div");
-
-                hafnertec::HafnertecData data;
-                data.set_temp_brennkammer(parse_numeric(c.nodeAt(1).text()));
-                data.set_anteil_heizung(parse_numeric(c.nodeAt(2).text()));
-                data.set_temp_vorlauf(parse_numeric(c.nodeAt(3).text()));
-                data.set_temp_ruecklauf(parse_numeric(c.nodeAt(4).text()));
-                data.set_durchlauf(parse_numeric(c.nodeAt(5).text()));
-                data.set_ventilator(parse_numeric(c.nodeAt(9).text()));
-
-                LOGH(INFO) << "Received data from Hafnertec controller (chamber temperature " << parse_numeric(
-                    c.nodeAt(1).text()) << ")";
-                LOGH(INFO) << "running handler";
+        auto st = ExecuteIfChanged([=](const std::string &html) {
+            hafnertec::HafnertecData data;
+            if (auto st = ParseSchematic(html, DefaultSchematic(), &data); !st.ok()) {
+                LOGH(ERROR) << "Unexpected Hafnertec page: " << st.message();
+                return st;
+            }
 
-                handler(data);
+            LOGH(INFO) << "Received data from Hafnertec controller (chamber temperature "
+                       << data.temp_brennkammer() << ")";
+            LOGH(INFO) << "running handler";
 
-                return absl::OkStatus();
-            } else {
-                LOGH(ERROR) << "Hafnertec controller query failed: " << response.reason_phrase();
-                return absl::InternalError(
-                    absl::StrCat("Hafnertec controller query failed: ", response.reason_phrase()));
-            }
-        });
+            return handler(data);
+        }, deadline);
 
         {
             auto end_time = std::chrono::high_resolution_clock::now();
             const double seconds = std::chrono::duration<double>(end_time - start_time).count();
             wastlernet::metrics::WastlernetMetrics::GetInstance().ObserveQueryLatency("hafnertec", seconds);
-            wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryResult("hafnertec", st.ok());
+            wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryStatus("hafnertec", st);
         }
         return st;
     }
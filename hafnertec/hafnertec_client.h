@@ -21,7 +21,12 @@ namespace hafnertec {
               user_(user), password_(password) {
         }
 
-        absl::Status Query(const std::function<void(const HafnertecData &)> &handler);
+        /**
+         * Poll the schematic page and pass changed data to `handler`. A non-OK status of the handler
+         * (e.g. a failed database write) is returned, and the page is handed on again next time.
+         */
+        absl::Status Query(const std::function<absl::Status(const HafnertecData &)> &handler,
+                           const wastlernet::Deadline &deadline = wastlernet::Deadline::Infinite());
 
     protected:
         std::string Name() override { return "HafnertecClient"; }
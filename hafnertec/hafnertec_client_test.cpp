@@ -6,12 +6,7 @@
 
 #include "hafnertec_client.h"
 
-#include <absl/strings/strip.h>
-#include <cpprest/http_listener.h>
-#include <glog/logging.h>
-
-using web::http::http_request;
-using web::http::experimental::listener::http_listener;
+#include "base/http_replay.h"
 
 constexpr char kAddress[] = "http://127.0.0.1:15003";
 constexpr char kContent[] = R"(<div id="pos0" >
@@ -52,57 +47,14 @@ T. Max VL AWE</div>
 
 class HafnertecClientTest : public testing::Test {
 protected:
-    HafnertecClientTest() {
-    }
-
     void SetUp() override {
-        server_thread_ = startListener(kAddress);
-    }
-
-    void TearDown() override {
-        if (server_thread_ != nullptr) {
-            server_thread_->close();
-        }
+        server_ = std::make_unique<wastlernet::HttpReplayServer>(kAddress);
+        server_->AddResponse("/schematic_files/9.cgi", kContent, "text/html");
+        ASSERT_TRUE(server_->Start().ok());
     }
 
 private:
-    std::unique_ptr<http_listener> server_thread_;
-
-
-    // Start a listener for test purposes that echos back the request as JSON
-    std::unique_ptr<http_listener> startListener(const std::string &listen) {
-        auto listener = std::make_unique<http_listener>(listen);
-
-        LOG(INFO) << "starting REST listener on address " << listen;
-
-        listener->support([=](const http_request &request) {
-            auto uri = request.relative_uri();
-
-            LOG(INFO) << "Received REST request to " << uri.path();
-
-            std::string path = std::string(absl::StripPrefix(uri.path(), "/"));
-
-            try {
-                if (path == "") {
-                    // empty path is connection init
-                    request.reply(web::http::status_codes::OK).get();
-                } else if (path == "schematic_files/9.cgi") {
-                    request.reply(web::http::status_codes::OK, kContent, "text/html").get();
-                } else {
-                    // everything else should return NOT FOUND
-                    request.reply(web::http::status_codes::NotFound,
-                                  std::string("data for module \"") + path + "\" not found", "text/plain").get();
-                }
-            } catch (const std::exception &e) {
-                LOG(ERROR) << "Error while resolving REST request: " << e.what();
-                request.reply(web::http::status_codes::InternalError);
-            }
-        });
-
-        listener->open().get();
-
-        return std::move(listener);
-    }
+    std::unique_ptr<wastlernet::HttpReplayServer> server_;
 };
 
 TEST_F(HafnertecClientTest, Query) {
@@ -117,6 +69,7 @@ TEST_F(HafnertecClientTest, Query) {
         EXPECT_DOUBLE_EQ(data.temp_ruecklauf(), 24.8);
         EXPECT_DOUBLE_EQ(data.durchlauf(), 0.0);
         EXPECT_DOUBLE_EQ(data.anteil_heizung(), 90.0);
+        return absl::OkStatus();
     });
     ASSERT_TRUE(st.ok()) << "Querying Hafnertec data failed: " << st;
 }
\ No newline at end of file
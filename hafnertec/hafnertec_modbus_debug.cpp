@@ -1,146 +1,46 @@
 //
 // Created by wastl on 27.09.24.
 //
-#include <endian.h>
-#include <errno.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
+// Modbus server receiving the register values pushed by the Hafnertec controller; prints the
+// values after every request.
+//
+#include <csignal>
+#include <pthread.h>
+#include <iostream>
 
 #include <glog/logging.h>
-#include <absl/status/status.h>
 #include <modbus/modbus.h>
-#include <modbus/modbus-tcp.h>
-
-#include <arpa/inet.h>
-#include <netinet/in.h>
-#include <sys/select.h>
-#include <sys/socket.h>
-
-#define NB_CONNECTION 5
-
-static modbus_t *ctx = NULL;
-static modbus_mapping_t *mb_mapping;
 
-static int server_socket = -1;
-
-static void close_sigint(int dummy)
-{
-    if (server_socket != -1) {
-        close(server_socket);
-    }
-    modbus_free(ctx);
-    modbus_mapping_free(mb_mapping);
+#include "base/modbus_sim.h"
 
-    exit(dummy);
-}
 int main(int argc, char *argv[])
 {
-    uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
-    int master_socket;
-    int rc;
-    fd_set refset;
-    fd_set rdset;
-    /* Maximum file descriptor number */
-    int fdmax;
-
-    ctx = modbus_new_tcp("192.168.178.2", 502);
-
-    mb_mapping =
-            modbus_mapping_new(MODBUS_MAX_READ_BITS, 0, MODBUS_MAX_READ_REGISTERS, 0);
-    if (mb_mapping == NULL) {
-        fprintf(stderr, "Failed to allocate the mapping: %s\n", modbus_strerror(errno));
-        modbus_free(ctx);
-        return -1;
-    }
-
-    server_socket = modbus_tcp_listen(ctx, NB_CONNECTION);
-    if (server_socket == -1) {
-        fprintf(stderr, "Unable to listen TCP connection\n");
-        modbus_free(ctx);
+    wastlernet::ModbusSimOptions options;
+    options.host = "192.168.178.2";
+    options.on_request = [](const modbus_mapping_t* mb_mapping) {
+        std::cout << "start_registers=" << mb_mapping->start_registers << ", nb_registers=" << mb_mapping->nb_registers
+                  << std::endl;
+        std::cout << "Ladepumpe: " << mb_mapping->tab_registers[0] << std::endl;
+        std::cout << "Temp Feuerraum: " << mb_mapping->tab_registers[1] << std::endl;
+        std::cout << "Temp Vorlauf: " << mb_mapping->tab_registers[2] << std::endl;
+        std::cout << "Temp Rücklauf: " << mb_mapping->tab_registers[3] << std::endl;
+    };
+
+    // Block SIGINT in all threads; it is received synchronously below.
+    sigset_t sigint;
+    sigemptyset(&sigint);
+    sigaddset(&sigint, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigint, nullptr);
+
+    wastlernet::ModbusSimulator server(502, 0, MODBUS_MAX_READ_REGISTERS, options);
+    if (auto st = server.Start(); !st.ok()) {
+        std::cerr << "Unable to listen TCP connection: " << st << std::endl;
         return -1;
     }
 
-    signal(SIGINT, close_sigint);
-
-    /* Clear the reference set of socket */
-    FD_ZERO(&refset);
-    /* Add the server socket */
-    FD_SET(server_socket, &refset);
-
-    /* Keep track of the max file descriptor */
-    fdmax = server_socket;
-
-    for (;;) {
-        rdset = refset;
-        if (select(fdmax + 1, &rdset, NULL, NULL, NULL) == -1) {
-            perror("Server select() failure.");
-            close_sigint(1);
-        }
-
-        /* Run through the existing connections looking for data to be
-         * read */
-        for (master_socket = 0; master_socket <= fdmax; master_socket++) {
-
-            if (!FD_ISSET(master_socket, &rdset)) {
-                continue;
-            }
-
-            if (master_socket == server_socket) {
-                /* A client is asking a new connection */
-                socklen_t addrlen;
-                struct sockaddr_in clientaddr;
-                int newfd;
-
-                /* Handle new connections */
-                addrlen = sizeof(clientaddr);
-                memset(&clientaddr, 0, sizeof(clientaddr));
-                newfd = accept(server_socket, (struct sockaddr *) &clientaddr, &addrlen);
-                if (newfd == -1) {
-                    perror("Server accept() error");
-                } else {
-                    FD_SET(newfd, &refset);
-
-                    if (newfd > fdmax) {
-                        /* Keep track of the maximum */
-                        fdmax = newfd;
-                    }
-                    printf("New connection from %s:%d on socket %d\n",
-                           inet_ntoa(clientaddr.sin_addr),
-                           clientaddr.sin_port,
-                           newfd);
-                }
-            } else {
-                modbus_set_socket(ctx, master_socket);
-                rc = modbus_receive(ctx, query);
-                if (rc > 0) {
-                    modbus_reply(ctx, query, rc, mb_mapping);
-                    std::cout << "start_registers=" << mb_mapping->start_registers << ", nb_registers=" << mb_mapping->nb_registers
-                            << ", start_input_registers=" << mb_mapping->start_input_registers << ", nb_input_registers=" << mb_mapping->nb_input_registers
-                        << std::endl;
-                    std::cout << "Ladepumpe: " << mb_mapping->tab_registers[0] << std::endl;
-                    std::cout << "Temp Feuerraum: " << mb_mapping->tab_registers[1] << std::endl;
-                    std::cout << "Temp Vorlauf: " << mb_mapping->tab_registers[2] << std::endl;
-                    std::cout << "Temp Rücklauf: " << mb_mapping->tab_registers[3] << std::endl;
-                    //std::cout << "Temp Rücklauf: " << (int16_t)__bswap_16(mb_mapping->tab_registers[3]) << std::endl;
-                } else if (rc == -1) {
-                    /* This example server in ended on connection closing or
-                     * any errors. */
-                    printf("Connection closed on socket %d\n", master_socket);
-                    close(master_socket);
-
-                    /* Remove from reference set */
-                    FD_CLR(master_socket, &refset);
-
-                    if (master_socket == fdmax) {
-                        fdmax--;
-                    }
-                }
-            }
-        }
-    }
+    int sig;
+    sigwait(&sigint, &sig);
+    server.Stop();
 
     return 0;
-
-}
\ No newline at end of file
+}
@@ -6,9 +6,10 @@
 
 #include "hafnertec/hafnertec_client.h"
 
-absl::Status hafnertec::HafnertecModule::Query(std::function<absl::Status(const hafnertec::HafnertecData &)> handler) {
+absl::Status hafnertec::HafnertecModule::Query(const wastlernet::Deadline& deadline,
+                                               std::function<absl::Status(const hafnertec::HafnertecData &)> handler) {
     try {
-        return client_.Query(handler);
+        return client_.Query(handler, deadline);
     } catch (std::exception const &e) {
         LOG(ERROR) << "Error querying Hafnertec controller: " << e.what();
         return absl::InternalError(e.what());
@@ -15,7 +15,8 @@ namespace hafnertec {
         HafnertecClient client_;
 
     protected:
-        absl::Status Query(std::function<absl::Status(const HafnertecData &)> handler) override;
+        absl::Status Query(const wastlernet::Deadline& deadline,
+                           std::function<absl::Status(const HafnertecData &)> handler) override;
 
     public:
         HafnertecModule(const wastlernet::TimescaleDB& db_cfg, const wastlernet::Hafnertec& client_cfg, wastlernet::StateCache* c)
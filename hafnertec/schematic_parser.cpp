@@ -0,0 +1,132 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "schematic_parser.h"
+
+#include <absl/strings/str_cat.h>
+
+namespace hafnertec {
+    namespace {
+        constexpr double kPow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15};
+
+        bool IsDigit(char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        char Lower(char c) {
+            return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+        }
+
+        // Position after the '>' closing the tag starting at `pos` (skipping quoted attribute values).
+        size_t SkipTag(std::string_view html, size_t pos) {
+            char quote = 0;
+            for (; pos < html.size(); pos++) {
+                char c = html[pos];
+                if (quote != 0) {
+                    quote = c == quote ? 0 : quote;
+                } else if (c == '"' || c == '\'') {
+                    quote = c;
+                } else if (c == '>') {
+                    return pos + 1;
+                }
+            }
+            return html.size();
+        }
+
+        // Whether the tag starting at `pos` ('<') is a <div> start tag.
+        bool IsDivStart(std::string_view html, size_t pos) {
+            if (pos + 4 >= html.size() || Lower(html[pos + 1]) != 'd' || Lower(html[pos + 2]) != 'i' ||
+                Lower(html[pos + 3]) != 'v') {
+                return false;
+            }
+            char next = html[pos + 4];
+            return next == '>' || next == '/' || next == ' ' || next == '\t' || next == '\n' || next == '\r';
+        }
+    }
+
+    const std::vector<SchematicField>& DefaultSchematic() {
+        static const std::vector<SchematicField> schema = {
+                {1, [](HafnertecData* d, double v) { d->set_temp_brennkammer(v); }},
+                {2, [](HafnertecData* d, double v) { d->set_anteil_heizung(static_cast<int32_t>(v)); }},
+                {3, [](HafnertecData* d, double v) { d->set_temp_vorlauf(v); }},
+                {4, [](HafnertecData* d, double v) { d->set_temp_ruecklauf(v); }},
+                {5, [](HafnertecData* d, double v) { d->set_durchlauf(static_cast<int32_t>(v)); }},
+                {9, [](HafnertecData* d, double v) { d->set_ventilator(static_cast<int32_t>(v)); }},
+        };
+        return schema;
+    }
+
+    bool ParseNumber(std::string_view text, double* out) {
+        size_t pos = 0;
+        for (; pos < text.size(); pos++) {
+            if (IsDigit(text[pos]) ||
+                ((text[pos] == '-' || text[pos] == '+' || text[pos] == '.') && pos + 1 < text.size() &&
+                 IsDigit(text[pos + 1]))) {
+                break;
+            }
+        }
+        if (pos == text.size()) {
+            return false;
+        }
+
+        bool negative = text[pos] == '-';
+        if (text[pos] == '-' || text[pos] == '+') {
+            pos++;
+        }
+
+        // Mantissa as an integer and a power of ten: exact (and thus correctly rounded) for the
+        // short values of the controller.
+        double mantissa = 0;
+        int fraction_digits = 0;
+        bool fraction = false;
+        for (; pos < text.size(); pos++) {
+            char c = text[pos];
+            if (IsDigit(c)) {
+                mantissa = mantissa * 10 + (c - '0');
+                fraction_digits += fraction ? 1 : 0;
+            } else if (c == '.' && !fraction) {
+                fraction = true;
+            } else {
+                break;
+            }
+        }
+        double value = fraction_digits < 16 ? mantissa / kPow10[fraction_digits] : 0;
+        *out = negative ? -value : value;
+        return true;
+    }
+
+    absl::Status ParseSchematic(std::string_view html, const std::vector<SchematicField>& schema,
+                                HafnertecData* data) {
+        auto field = schema.begin();
+        int div = -1;
+        size_t pos = html.find('<');
+        while (field != schema.end() && pos != std::string_view::npos) {
+            if (html.compare(pos, 4, "<!--") == 0) {
+                size_t end = html.find("-->", pos + 4);
+                pos = end == std::string_view::npos ? end : html.find('<', end + 3);
+                continue;
+            }
+
+            bool is_div = IsDivStart(html, pos);
+            pos = SkipTag(html, pos);
+            if (is_div && ++div == field->div) {
+                // Text of the div up to the next tag.
+                size_t end = html.find('<', pos);
+                double value;
+                if (!ParseNumber(html.substr(pos, end == std::string_view::npos ? end : end - pos), &value)) {
+                    value = 0;
+                }
+                field->set(data, value);
+                ++field;
+            }
+            pos = html.find('<', pos);
+        }
+
+        if (field != schema.end()) {
+            return absl::InvalidArgumentError(
+                absl::StrCat("Hafnertec page has ", div + 1, " divs, expected at least ", field->div + 1));
+        }
+        return absl::OkStatus();
+    }
+}
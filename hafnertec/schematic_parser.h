@@ -0,0 +1,56 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Streaming parser for the Hafnertec schematic page (/schematic_files/9.cgi).
+//
+// The controller renders its measurements as a flat list of <div> elements, one per value on the
+// schematic, with the value and its unit as text ("18.8°", "90.0 %"). Which value is in which div
+// only depends on the schematic, so it is described once by a schema mapping div indexes (in
+// document order, counting from 0) to HafnertecData fields:
+//
+//   static const std::vector<SchematicField> schema = {
+//       {1, [](HafnertecData* d, double v) { d->set_temp_brennkammer(v); }}, ...};
+//   RETURN_IF_ERROR(ParseSchematic(body, schema, &data));
+//
+// ParseSchematic() makes a single pass over the body: it counts div start tags, parses the
+// numbers of the divs named in the schema in place and stops after the last one. It does not
+// build a DOM and does not allocate.
+//
+// Thread-safety
+// The functions are stateless and may be called concurrently.
+//
+#pragma once
+#include <string_view>
+#include <vector>
+#include <absl/status/status.h>
+
+#include "hafnertec/hafnertec.pb.h"
+
+#ifndef HAFNERTEC_SCHEMATIC_PARSER_H
+#define HAFNERTEC_SCHEMATIC_PARSER_H
+
+namespace hafnertec {
+    /** A value of the schematic page: index of its div and how to store it (converting to the field type). */
+    struct SchematicField {
+        int div;
+        void (*set)(HafnertecData* data, double value);
+    };
+
+    /** Schema of the default schematic (9.cgi). Sorted by div index, as ParseSchematic() requires. */
+    const std::vector<SchematicField>& DefaultSchematic();
+
+    /**
+     * Fill the fields of `schema` (sorted by div index) from `html`. Divs without a number set their
+     * field to 0. Returns InvalidArgument if the page has fewer divs than the schema needs.
+     */
+    absl::Status ParseSchematic(std::string_view html, const std::vector<SchematicField>& schema,
+                                HafnertecData* data);
+
+    /**
+     * The first decimal number in `text` (e.g. -10.0 in "-10.0°"), ignoring surrounding units and
+     * whitespace. Returns false if there is none.
+     */
+    bool ParseNumber(std::string_view text, double* out);
+}
+
+#endif //HAFNERTEC_SCHEMATIC_PARSER_H
@@ -0,0 +1,95 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Microbenchmark of the Hafnertec schematic page parsing.
+//
+// Parses recorded controller responses with the previous gumbo-query implementation (wrap in
+// <html>, build the DOM, select "html div") and with hafnertec::ParseSchematic, and reports the
+// time per page:
+//
+//   schematic_parser_bench --iterations=100000 --responses=hafnertec/testdata/schematic_9.html
+//
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+#include <gflags/gflags.h>
+#include <gumbo-query/Document.h>
+#include <gumbo-query/Node.h>
+
+#include "hafnertec/schematic_parser.h"
+
+DEFINE_int32(iterations, 20000, "Number of parses per response and implementation");
+DEFINE_string(responses, HAFNERTEC_TESTDATA_DIR "/schematic_9.html",
+              "Comma-separated list of recorded controller responses");
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // The parsing of hafnertec_client.cpp before schematic_parser.h, as a baseline.
+    double LegacyNumber(const std::string& s) {
+        size_t start = s.find_first_of("0123456789");
+        return start == std::string::npos ? 0 : std::atof(s.c_str() + start);
+    }
+
+    hafnertec::HafnertecData LegacyParse(const std::string& body) {
+        std::string html = absl::StrCat("<html>", body, "</html>");
+        CDocument doc;
+        doc.parse(html);
+        CSelection c = doc.find("html div");
+
+        hafnertec::HafnertecData data;
+        data.set_temp_brennkammer(LegacyNumber(c.nodeAt(1).text()));
+        data.set_anteil_heizung(LegacyNumber(c.nodeAt(2).text()));
+        data.set_temp_vorlauf(LegacyNumber(c.nodeAt(3).text()));
+        data.set_temp_ruecklauf(LegacyNumber(c.nodeAt(4).text()));
+        data.set_durchlauf(LegacyNumber(c.nodeAt(5).text()));
+        data.set_ventilator(LegacyNumber(c.nodeAt(9).text()));
+        return data;
+    }
+
+    template<typename F>
+    void Run(const char* name, const std::string& response, F&& parse) {
+        double sum = 0;
+        auto start = Clock::now();
+        for (int i = 0; i < FLAGS_iterations; i++) {
+            sum += parse(response).temp_brennkammer();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        // The checksum keeps the compiler from dropping the loop.
+        printf("%-8s %8d pages %10.2f us/page   checksum %.1f\n", name, FLAGS_iterations,
+               seconds * 1e6 / FLAGS_iterations, sum);
+    }
+}
+
+int main(int argc, char** argv) {
+    gflags::SetUsageMessage("Usage: schematic_parser_bench [--iterations=N] [--responses=file,...]");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    for (const auto& path : absl::StrSplit(FLAGS_responses, ',', absl::SkipEmpty())) {
+        std::ifstream in{std::string(path)};
+        if (!in) {
+            fprintf(stderr, "cannot read %s\n", std::string(path).c_str());
+            return 1;
+        }
+        std::stringstream content;
+        content << in.rdbuf();
+        std::string response = content.str();
+
+        printf("%s (%zu bytes)\n", std::string(path).c_str(), response.size());
+        Run("gumbo", response, LegacyParse);
+        Run("stream", response, [](const std::string& body) {
+            hafnertec::HafnertecData data;
+            if (!hafnertec::ParseSchematic(body, hafnertec::DefaultSchematic(), &data).ok()) {
+                abort();
+            }
+            return data;
+        });
+    }
+    return 0;
+}
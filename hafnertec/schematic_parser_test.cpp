@@ -0,0 +1,83 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include <gtest/gtest.h>
+
+#include "schematic_parser.h"
+
+constexpr char kPage[] = R"(<div id="pos0" >
+60.0 °C</div>
+<div id="pos1" >
+18.8°
+</div>
+<div id="pos2" class="changex2" adresse="10F44140A91">
+90.0 %</div>
+<!-- <div id="hidden">99</div> -->
+<div id="pos3" >
+24.9°
+</div>
+<DIV id="pos4" title="a > b">
+24.8°
+</DIV>
+<div id="pos5" class="changex2" adresse="00840D10A91">
+3.0%
+</div>
+<div id="pos6" class="changex2" adresse="03C48120A91">
+-10.0°
+</div>
+<div id="pos7" class="changex2" adresse="10E44140A91">
+80.0 °C</div>
+<div id="pos8" >
+T. Max VL AWE</div>
+<div id="pos9" class="changex2" adresse="00940D10A91">
+45.0%
+</div>
+<div id="pos10" class="durchsichtig" onClick="location.href='schema.html#1'">
+</div>)";
+
+TEST(SchematicParserTest, ParsesDefaultSchematic) {
+    hafnertec::HafnertecData data;
+    auto st = hafnertec::ParseSchematic(kPage, hafnertec::DefaultSchematic(), &data);
+    ASSERT_TRUE(st.ok()) << st;
+
+    EXPECT_DOUBLE_EQ(data.temp_brennkammer(), 18.8);
+    EXPECT_EQ(data.anteil_heizung(), 90);
+    EXPECT_DOUBLE_EQ(data.temp_vorlauf(), 24.9);
+    EXPECT_DOUBLE_EQ(data.temp_ruecklauf(), 24.8);
+    EXPECT_EQ(data.durchlauf(), 3);
+    EXPECT_EQ(data.ventilator(), 45);
+}
+
+TEST(SchematicParserTest, MapsCustomSchema) {
+    std::vector<hafnertec::SchematicField> schema = {
+            {6, [](hafnertec::HafnertecData* d, double v) { d->set_temp_vorlauf(v); }},
+            {8, [](hafnertec::HafnertecData* d, double v) { d->set_temp_ruecklauf(v); }},
+    };
+    hafnertec::HafnertecData data;
+    data.set_temp_ruecklauf(1);
+    ASSERT_TRUE(hafnertec::ParseSchematic(kPage, schema, &data).ok());
+
+    EXPECT_DOUBLE_EQ(data.temp_vorlauf(), -10.0);
+    EXPECT_EQ(data.temp_ruecklauf(), 0);  // text without a number
+    EXPECT_FALSE(data.has_temp_brennkammer());
+}
+
+TEST(SchematicParserTest, RejectsTruncatedPages) {
+    hafnertec::HafnertecData data;
+    auto st = hafnertec::ParseSchematic(R"(<div>1</div><div>2</div>)", hafnertec::DefaultSchematic(), &data);
+    EXPECT_EQ(st.code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST(SchematicParserTest, ParsesNumbers) {
+    double v = 0;
+    EXPECT_TRUE(hafnertec::ParseNumber("\n18.8°\n", &v));
+    EXPECT_DOUBLE_EQ(v, 18.8);
+    EXPECT_TRUE(hafnertec::ParseNumber("-10.0°", &v));
+    EXPECT_DOUBLE_EQ(v, -10.0);
+    EXPECT_TRUE(hafnertec::ParseNumber("approx .5 bar", &v));
+    EXPECT_DOUBLE_EQ(v, 0.5);
+    EXPECT_TRUE(hafnertec::ParseNumber("1234", &v));
+    EXPECT_DOUBLE_EQ(v, 1234);
+    EXPECT_FALSE(hafnertec::ParseNumber("T. Max VL - AWE", &v));
+    EXPECT_FALSE(hafnertec::ParseNumber("", &v));
+}
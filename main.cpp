@@ -1,20 +1,24 @@
 #include <iostream>
 #include <thread>
 #include <glog/logging.h>
-#include <google/protobuf/text_format.h>
-#include <google/protobuf/io/zero_copy_stream.h>
-#include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/util/json_util.h>
-#include <fcntl.h>
+#include <optional>
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
 #include <absl/strings/str_split.h>
 #include <absl/strings/strip.h>
 #include <absl/strings/str_cat.h>
 #include <absl/status/status.h>
 #include <absl/status/statusor.h>
+#include <absl/time/time.h>
 #include <cpprest/http_listener.h>
 #include <prometheus/exposer.h>
 
+#include "base/config_watcher.h"
+#include "base/http_client_pool.h"
 #include "base/metrics.h"
+#include "base/modbus_bus.h"
+#include "base/module_runner.h"
 #include "base/utility.h"
 #include "config/config.pb.h"
 #include "fronius/fronius_client.h"
@@ -29,8 +33,6 @@
 #include "weather/weather_module.h"
 
 using namespace std::chrono;
-using google::protobuf::io::ZeroCopyInputStream;
-using google::protobuf::io::FileInputStream;
 using namespace google::protobuf::util;
 using namespace std::chrono_literals;
 
@@ -64,9 +66,8 @@ namespace wastlernet::rest {
             std::string path = std::string(absl::StripPrefix(uri.path(), "/"));
 
             try {
-                auto it = stateCache->find(path);
-                if (it != stateCache->cend()) {
-                    std::string binary_message = it->second;
+                if (auto value = stateCache->Get(path); value.has_value()) {
+                    const std::string& binary_message = *value;
                     std::string output;
 
                     if (path == "weather") {
@@ -99,155 +100,252 @@ namespace wastlernet::rest {
 }
 
 
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: wastlernet <path-to-config.yml>" << std::endl;
-        return 1;
-    }
-
-    google::InitGoogleLogging(argv[0]);
-    google::EnableLogCleaner(24h * 3);
+namespace wastlernet {
+    // Owns the running modules and applies configuration changes to them. The state cache, the REST
+    // listener and device connections whose endpoint did not change survive a reload.
+    class Controller {
+    public:
+        // Bring the running modules in line with `config`. The first call launches all configured
+        // modules; subsequent calls only stop, relaunch or start modules whose section changed.
+        void Apply(const Config& config) {
+            bool initial = !running_.has_value();
+            const Config& old = initial ? Config::default_instance() : *running_;
+
+            // Removing the setting on reload restores the default.
+            HttpClientPool::GetInstance().SetIdleTimeout(
+                    config.has_http_idle_timeout() ? std::chrono::seconds(config.http_idle_timeout())
+                                                   : HttpClientPool::kDefaultIdleTimeout);
+
+            // All modules write to TimescaleDB, so a database change affects every module.
+            bool db_changed = initial || SectionChanged(old.has_timescaledb(), old.timescaledb(),
+                                                        config.has_timescaledb(), config.timescaledb());
+
+            if (db_changed || SectionChanged(old.has_solvis(), old.solvis(), config.has_solvis(), config.solvis())) {
+                runner_.Stop("solvis_updater");
+                runner_.Stop("solvis");
+
+                solvis_unit_.reset();
+                if (config.has_solvis()) {
+                    // Devices behind the same gateway share its bus; an existing connection stays open.
+                    auto* bus = ModbusBusFor(config.solvis(), solvis::UnitId(config.solvis()),
+                                             solvis::kProbeRegister);
+                    solvis_unit_ = std::make_unique<ModbusUnit>(bus, solvis::UnitId(config.solvis()));
+
+                    runner_.Launch(std::make_unique<solvis::SolvisModule>(config.timescaledb(), config.solvis(),
+                                                                          solvis_unit_.get(), &current_state_));
+
+                    // Pushes the indoor temperature into the heating controller whenever a new weather sample arrives.
+                    runner_.Launch(std::make_unique<solvis::SolvisUpdater>(config.solvis(), solvis_unit_.get(),
+                                                                           &current_state_));
+                }
+                ReleaseUnusedModbusBuses(config);
+            }
 
+            if (db_changed || SectionChanged(old.has_hafnertec(), old.hafnertec(),
+                                             config.has_hafnertec(), config.hafnertec())) {
+                runner_.Stop("hafnertec");
+                if (config.has_hafnertec()) {
+                    runner_.Launch(std::make_unique<hafnertec::HafnertecModule>(
+                        config.timescaledb(), config.hafnertec(), &current_state_));
+                }
+            }
 
-    wastlernet::Config config;
+            if (db_changed || SectionChanged(old.has_senec(), old.senec(), config.has_senec(), config.senec())) {
+                runner_.Stop("senec");
+                if (config.has_senec()) {
+                    runner_.Launch(std::make_unique<senec::SenecModule>(config.timescaledb(), config.senec(),
+                                                                        &current_state_));
+                }
+            }
 
-    int fd = open(argv[1], O_RDONLY);
-    if (fd == -1) {
-        LOG(ERROR) << "Could not open configuration file";
-        return 1;
-    }
+            if (db_changed || SectionChanged(old.has_fronius(), old.fronius(), config.has_fronius(), config.fronius())) {
+                runner_.Stop("fronius");
+                if (config.has_fronius()) {
+                    runner_.Launch(std::make_unique<fronius::FroniusModule>(config.timescaledb(), config.fronius(),
+                                                                            &current_state_));
+                }
+            }
 
-    {
-        std::unique_ptr<ZeroCopyInputStream> cfg_file = std::make_unique<FileInputStream>(fd);
-        if (!google::protobuf::TextFormat::Parse(cfg_file.get(), &config)) {
-            LOG(ERROR) << "Unable to parse configuration file" << std::endl;
-            return 1;
-        }
-    }
-    LOG(INFO) << "Loaded configuration from " << argv[1] << std::endl;
-    close(fd);
+            if (db_changed || SectionChanged(old.has_weather(), old.weather(), config.has_weather(), config.weather())) {
+                runner_.Stop("weather");
+                if (config.has_weather()) {
+                    runner_.Launch(std::make_unique<weather::WeatherModule>(config.timescaledb(), config.weather(),
+                                                                            &current_state_));
+                }
+            }
 
-    std::string prometheus_address;
-    if (config.has_prometheus() && config.prometheus().has_listen()) {
-        prometheus_address = config.prometheus().listen();
-    } else {
-        prometheus_address = "127.0.0.1:32154";
-    }
-    prometheus::Exposer exposer{prometheus_address};
-    exposer.RegisterCollectable(wastlernet::metrics::WastlernetMetrics::GetInstance().registry());
+            if (db_changed || SectionChanged(old.has_shelly(), old.shelly(), config.has_shelly(), config.shelly())) {
+                runner_.Stop("shelly");
+                if (config.has_shelly()) {
+                    runner_.Launch(std::make_unique<wastlernet::shelly::ShellyModule>(
+                        config.timescaledb(), &current_state_, config.shelly().mqtt_address()));
+                }
+            }
 
-    LOG(INFO) << "Started Prometheus exporter on " << prometheus_address;
+            if (initial || SectionChanged(old.has_rest(), old.rest(), config.has_rest(), config.rest())) {
+                if (rest_listener_) {
+                    rest_listener_->close().wait();
+                }
+                rest_listener_ = wastlernet::rest::start_listener(config.rest().listen(), &current_state_);
+            }
 
-    wastlernet::StateCache current_state;
-    std::vector<std::unique_ptr<wastlernet::IModule>> modules;
+            if (!initial && SectionChanged(old.has_prometheus(), old.prometheus(),
+                                           config.has_prometheus(), config.prometheus())) {
+                LOG(WARNING) << "Prometheus configuration changed; this only takes effect after a restart.";
+            }
 
-    std::unique_ptr<solvis::SolvisModbusConnection> solvis_connection;
-    if (config.has_solvis()) {
-        solvis_connection = std::make_unique<solvis::SolvisModbusConnection>(config.solvis());
-        auto solvis_st = solvis_connection->Init();
-        if (!solvis_st.ok()) {
-            LOG(WARNING) << "Could not initialize Solvis Modbus connection: " << solvis_st << "; retrying later.";
+            running_ = config;
         }
 
-        auto solvis_client = std::make_unique<solvis::SolvisModule>(config.timescaledb(), config.solvis(),
-                                                                    solvis_connection.get(), &current_state);
-        solvis_st = solvis_client->Init();
-        if (!solvis_st.ok()) {
-            LOG(ERROR) << "Could not initialize Solvis module: " << solvis_st;
-            return 1;
+        bool AwaitStartup(absl::Time deadline) {
+            return runner_.AwaitStartup(deadline);
         }
-        solvis_client->Start();
-        modules.emplace_back(std::move(solvis_client));
 
-        LOG(INFO) << "Started Solvis module." << std::endl;
+        // Block until all modules have stopped.
+        void Wait() {
+            runner_.Wait();
+        }
 
-        /*
-        solvis::SolvisUpdater solvis_updater(config.solvis(), solvis_connection.get(), &current_state);
-        auto su_st = solvis_updater.Init();
-        if(!su_st.ok()) {
-            LOG(ERROR) << "Could not initialize Solvis updater: " << su_st;
-            return 1;
+    private:
+        // Key of the bus a device is attached to: its serial device (RTU) or gateway "host:port" (TCP).
+        template<class DeviceConfig>
+        static std::string ModbusBusKey(const DeviceConfig& cfg) {
+            return cfg.has_rtu() ? cfg.rtu().device() : absl::StrCat(cfg.host(), ":", cfg.port());
         }
-        solvis_updater.Start();
 
-        LOG(INFO) << "Started Solvis updater." << std::endl;
-        */
-    }
+        // Settings a bus is built from. A device whose settings differ from those of the existing bus
+        // replaces it, so that e.g. a changed baud rate or probe register takes effect on reload.
+        template<class DeviceConfig>
+        static std::string ModbusBusSettings(const DeviceConfig& cfg, int probe_unit, int32_t probe_addr) {
+            if (cfg.has_rtu()) {
+                auto rtu = ModbusRtuOptionsFrom(cfg.rtu());
+                return absl::StrCat(rtu.baud, " ", rtu.data_bits, std::string(1, rtu.parity), rtu.stop_bits, " ",
+                                    rtu.inter_frame_delay.count(), "us");
+            }
+            return absl::StrCat("probe ", probe_unit, ":", probe_addr);
+        }
 
-    if (config.has_hafnertec()) {
-        auto hafnertec_client = std::make_unique<hafnertec::HafnertecModule>(
-            config.timescaledb(), config.hafnertec(), &current_state);
-        auto hafnertec_st = hafnertec_client->Init();
-        if (!hafnertec_st.ok()) {
-            LOG(ERROR) << "Could not initialize Hafnertec module: " << hafnertec_st;
-            return 1;
+        // Devices attached to a bus that is replaced must have been stopped before.
+        template<class DeviceConfig>
+        ModbusBus* ModbusBusFor(const DeviceConfig& cfg, int probe_unit, int32_t probe_addr) {
+            auto& entry = modbus_buses_[ModbusBusKey(cfg)];
+            auto settings = ModbusBusSettings(cfg, probe_unit, probe_addr);
+            if (entry.bus != nullptr && entry.settings != settings) {
+                LOG(INFO) << "Settings of Modbus bus " << entry.bus->name() << " changed, reconnecting";
+                entry.bus.reset();
+            }
+            if (entry.bus == nullptr) {
+                if (cfg.has_rtu()) {
+                    entry.bus = std::make_unique<ModbusBus>(ModbusRtuOptionsFrom(cfg.rtu()));
+                } else {
+                    entry.bus = std::make_unique<ModbusBus>(cfg.host(), cfg.port(), probe_unit, probe_addr);
+                }
+                entry.settings = settings;
+            }
+            return entry.bus.get();
         }
-        hafnertec_client->Start();
-        modules.emplace_back(std::move(hafnertec_client));
 
-        LOG(INFO) << "Started Hafnertec module." << std::endl;
-    }
+        static ModbusRtuOptions ModbusRtuOptionsFrom(const ModbusRtu& cfg) {
+            ModbusRtuOptions options;
+            options.device = cfg.device();
+            if (cfg.has_baud()) {
+                options.baud = cfg.baud();
+            }
+            if (cfg.has_parity() && !cfg.parity().empty()) {
+                options.parity = cfg.parity()[0];
+            }
+            if (cfg.has_data_bits()) {
+                options.data_bits = cfg.data_bits();
+            }
+            if (cfg.has_stop_bits()) {
+                options.stop_bits = cfg.stop_bits();
+            }
+            options.inter_frame_delay = std::chrono::microseconds(cfg.inter_frame_delay_us());
+            return options;
+        }
 
-    if (config.has_senec()) {
-        auto senec_client = std::make_unique<senec::SenecModule>(config.timescaledb(), config.senec(), &current_state);
-        auto senec_st = senec_client->Init();
-        if (!senec_st.ok()) {
-            LOG(ERROR) << "Could not initialize Senec module: " << senec_st;
-            return 1;
+        // Close gateway connections and serial lines no longer used by any configured device.
+        void ReleaseUnusedModbusBuses(const Config& config) {
+            absl::flat_hash_set<std::string> used;
+            if (config.has_solvis()) {
+                used.insert(ModbusBusKey(config.solvis()));
+            }
+            absl::erase_if(modbus_buses_, [&used](const auto& entry) { return !used.contains(entry.first); });
         }
-        senec_client->Start();
-        modules.emplace_back(std::move(senec_client));
 
-        LOG(INFO) << "Started Fronius module." << std::endl;
-    }
+    private:
+        // Declared before the runner so that they outlive all modules.
+        StateCache current_state_;
+        // Shared Modbus buses keyed by gateway "host:port" or serial device, and the devices attached to them.
+        struct ModbusBusEntry {
+            std::unique_ptr<ModbusBus> bus;
+            // See ModbusBusSettings().
+            std::string settings;
+        };
+        absl::flat_hash_map<std::string, ModbusBusEntry> modbus_buses_;
+        std::unique_ptr<ModbusUnit> solvis_unit_;
+
+        // All modules are initialized concurrently by the runner; modules failing to initialize keep retrying
+        // in the background instead of aborting the process.
+        ModuleRunner runner_;
+        std::unique_ptr<http_listener> rest_listener_;
+
+        std::optional<Config> running_;
+    };
+}
 
-    if (config.has_fronius()) {
-        auto fronius_client = std::make_unique<fronius::FroniusModule>(config.timescaledb(), config.fronius(),
-                                                                       &current_state);
-        auto fronius_st = fronius_client->Init();
-        if (!fronius_st.ok()) {
-            LOG(ERROR) << "Could not initialize Fronius module: " << fronius_st;
-            return 1;
-        }
-        fronius_client->Start();
-        modules.emplace_back(std::move(fronius_client));
 
-        LOG(INFO) << "Started Fronius module." << std::endl;
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: wastlernet <path-to-config.yml>" << std::endl;
+        return 1;
     }
 
-    if (config.has_weather()) {
-        auto weather_client = std::make_unique<weather::WeatherModule>(config.timescaledb(), config.weather(),
-                                                                       &current_state);
-        auto weather_st = weather_client->Init();
-        if (!weather_st.ok()) {
-            LOG(ERROR) << "Could not initialize Weather module: " << weather_st;
-            return 1;
-        }
-        weather_client->Start();
-        modules.emplace_back(std::move(weather_client));
+    google::InitGoogleLogging(argv[0]);
+    google::EnableLogCleaner(24h * 3);
 
-        LOG(INFO) << "Started Weather module." << std::endl;
+    auto config = wastlernet::LoadConfig(argv[1]);
+    if (!config.ok()) {
+        LOG(ERROR) << config.status();
+        return 1;
+    }
+    LOG(INFO) << "Loaded configuration from " << argv[1] << std::endl;
+
+    std::string prometheus_address;
+    if (config->has_prometheus() && config->prometheus().has_listen()) {
+        prometheus_address = config->prometheus().listen();
+    } else {
+        prometheus_address = "127.0.0.1:32154";
     }
+    prometheus::Exposer exposer{prometheus_address};
+    exposer.RegisterCollectable(wastlernet::metrics::WastlernetMetrics::GetInstance().registry());
 
-    if (config.has_shelly()) {
-        auto shelly_client = std::make_unique<wastlernet::shelly::ShellyModule>(config.timescaledb(), &current_state, config.shelly().mqtt_address());
+    LOG(INFO) << "Started Prometheus exporter on " << prometheus_address;
 
-        auto shelly_st = shelly_client->Init();
-        if (!shelly_st.ok()) {
-            LOG(ERROR) << "Could not initialize Shelly module: " << shelly_st;
-            return 1;
-        }
-        shelly_client->Start();
-        modules.emplace_back(std::move(shelly_client));
+    wastlernet::Controller controller;
+    controller.Apply(*config);
 
-        LOG(INFO) << "Started Shelly module." << std::endl;
+    absl::Duration startup_timeout = absl::Seconds(config->has_startup_timeout() ? config->startup_timeout() : 30);
+    if (!controller.AwaitStartup(absl::Now() + startup_timeout)) {
+        LOG(WARNING) << "Not all modules started within " << startup_timeout << "; continuing in degraded mode.";
     }
 
-    auto rest_listener = wastlernet::rest::start_listener(config.rest().listen(), &current_state);
-
     LOG(INFO) << "Smart Home Controller startup sequence completed.";
 
-    for (auto& module : modules) {
-        module->Wait();
+    // Reload the configuration on SIGHUP or when the file changes; only affected modules are restarted.
+    wastlernet::ConfigWatcher watcher(argv[1]);
+    if (auto st = watcher.Init(); !st.ok()) {
+        LOG(ERROR) << "Configuration reload disabled: " << st;
+        controller.Wait();
+        return 0;
     }
-}
\ No newline at end of file
+    watcher.Run([&]() {
+        auto reloaded = wastlernet::LoadConfig(argv[1]);
+        if (!reloaded.ok()) {
+            LOG(ERROR) << "Keeping running configuration: " << reloaded.status();
+            return;
+        }
+        controller.Apply(*reloaded);
+        LOG(INFO) << "Applied configuration from " << argv[1];
+    });
+}
@@ -10,8 +10,10 @@
 #include <glog/logging.h>
 #include <absl/strings/str_cat.h>
 
+#include "base/json_extract.h"
 #include "base/metrics.h"
 #include "senec_client.h"
+#include "senec_decode.h"
 
 using namespace utility; // Common utilities like string conversions
 using namespace web; // Common features like URIs.
@@ -23,152 +25,197 @@ using namespace web::json; // JSON library
 #define LOGS(level) LOG(level) << "[senec] "
 
 namespace {
-    float hex2float(const std::string &s) {
-        uint32_t num;
-        sscanf(s.c_str(), "%x", &num); // assuming you checked input
-        return *((float *) &num);
-    }
-
     template<typename T>
-    T senec_parse(const json::value &v) {
-        if (!v.is_string()) {
-            LOGS(ERROR) << "Warning: value is not a string: " << v.serialize();
+    T senec_parse(const wastlernet::JsonSlot &v) {
+        if (v.type != wastlernet::JsonSlot::Type::kString) {
+            LOGS(ERROR) << "Warning: value is not a string: " << v.raw;
             return 0;
         }
 
-        std::string s = v.as_string();
-
-        if (s.rfind("u1", 0) == 0 || s.rfind("u3", 0) == 0 || s.rfind("u8", 0) == 0) {
-            return std::stoul(s.substr(3), nullptr, 16);
-        }
-        if (s.rfind("i1", 0) == 0) {
-            return std::stol(s.substr(3), nullptr, 16);
+        double value;
+        if (senec::DecodeSenecValue(v.raw, &value)) {
+            return static_cast<T>(value);
         }
-        if (s.rfind("fl", 0) == 0) {
-            return hex2float(s.substr(3));
-        }
-        if (s.rfind("st", 0) == 0) {
-            LOGS(ERROR) << "Warning: value is not a number: " << v.serialize();
-            return 0;
+        if (v.raw.substr(0, 2) == "st") {
+            LOGS(ERROR) << "Warning: value is not a number: " << v.raw;
         }
         return 0;
     }
+
+    // Decode the per-phase or per-tracker array elements at `slots` into `out`.
+    void senec_parse_array(const wastlernet::JsonSlots &r, const int (&slots)[3], double (&out)[3]) {
+        std::string_view values[3];
+        for (int i = 0; i < 3; i++) {
+            values[i] = r[slots[i]].raw;
+        }
+        senec::DecodeSenecValues(values, 3, out);
+    }
+
+    // JSON paths of all values requested in the request body.
+    struct SenecFields {
+        wastlernet::JsonExtractor json;
+        int power_ratio = json.Add({"PV1", "POWER_RATIO"});
+        int p_total = json.Add({"PM1OBJ1", "P_TOTAL"});
+        int freq = json.Add({"PM1OBJ1", "FREQ"});
+        int fuel_charge = json.Add({"ENERGY", "GUI_BAT_DATA_FUEL_CHARGE"});
+        int bat_power = json.Add({"ENERGY", "GUI_BAT_DATA_POWER"});
+        int bat_voltage = json.Add({"ENERGY", "GUI_BAT_DATA_VOLTAGE"});
+        int house_pow = json.Add({"ENERGY", "GUI_HOUSE_POW"});
+        int grid_pow = json.Add({"ENERGY", "GUI_GRID_POW"});
+        int inverter_power = json.Add({"ENERGY", "GUI_INVERTER_POWER"});
+        int stat_state = json.Add({"ENERGY", "STAT_STATE"});
+        int hours_of_operation = json.Add({"ENERGY", "STAT_HOURS_OF_OPERATION"});
+        int nr_installed = json.Add({"BMS", "NR_INSTALLED"});
+        int total_current = json.Add({"BMS", "TOTAL_CURRENT"});
+        int grid_import = json.Add({"STATISTIC", "LIVE_GRID_IMPORT"});
+        int grid_export = json.Add({"STATISTIC", "LIVE_GRID_EXPORT"});
+        int house_cons = json.Add({"STATISTIC", "LIVE_HOUSE_CONS"});
+        int pv_gen = json.Add({"STATISTIC", "LIVE_PV_GEN"});
+        int battery_temp = json.Add({"TEMPMEASURE", "BATTERY_TEMP"});
+        int case_temp = json.Add({"TEMPMEASURE", "CASE_TEMP"});
+        int mcu_temp = json.Add({"TEMPMEASURE", "MCU_TEMP"});
+        int fan_speed = json.Add({"FAN_SPEED", "INV_LV"});
+
+        // Per phase / per MPP tracker.
+        int u_ac[3], i_ac[3], p_ac[3];
+        int mpp_cur[3], mpp_vol[3], mpp_power[3];
+
+        SenecFields() {
+            const char* index[] = {"0", "1", "2"};
+            for (int i = 0; i < 3; i++) {
+                u_ac[i] = json.Add({"PM1OBJ1", "U_AC", index[i]});
+                i_ac[i] = json.Add({"PM1OBJ1", "I_AC", index[i]});
+                p_ac[i] = json.Add({"PM1OBJ1", "P_AC", index[i]});
+                mpp_cur[i] = json.Add({"PV1", "MPP_CUR", index[i]});
+                mpp_vol[i] = json.Add({"PV1", "MPP_VOL", index[i]});
+                mpp_power[i] = json.Add({"PV1", "MPP_POWER", index[i]});
+            }
+        }
+    };
 }
 
 senec::SenecClient::SenecClient(const std::string &base_url)
     : HttpConnection(base_url, "/lala.cgi", POST) {
-    request_body_["PV1"]["POWER_RATIO"] = json::value::string("");
-    request_body_["PM1OBJ1"]["P_TOTAL"] = json::value::string("");
-    request_body_["PM1OBJ1"]["FREQ"] = json::value::string("");
-    request_body_["PM1OBJ1"]["U_AC"] = json::value::string("");
-    request_body_["PM1OBJ1"]["I_AC"] = json::value::string("");
-    request_body_["PM1OBJ1"]["P_AC"] = json::value::string("");
-    request_body_["ENERGY"]["GUI_BAT_DATA_FUEL_CHARGE"] = json::value::string("");
-    request_body_["ENERGY"]["GUI_BAT_DATA_POWER"] = json::value::string("");
-    request_body_["ENERGY"]["GUI_BAT_DATA_VOLTAGE"] = json::value::string("");
-    request_body_["ENERGY"]["GUI_HOUSE_POW"] = json::value::string("");
-    request_body_["ENERGY"]["GUI_GRID_POW"] = json::value::string("");
-    request_body_["ENERGY"]["GUI_INVERTER_POWER"] = json::value::string("");
-    request_body_["ENERGY"]["STAT_STATE"] = json::value::string("");
-    request_body_["ENERGY"]["STAT_HOURS_OF_OPERATION"] = json::value::string("");
-    request_body_["BMS"]["NR_INSTALLED"] = json::value::string("");
-    request_body_["BMS"]["TOTAL_CURRENT"] = json::value::string("");
-    request_body_["STATISTIC"]["LIVE_GRID_IMPORT"] = json::value::string("");
-    request_body_["STATISTIC"]["LIVE_GRID_EXPORT"] = json::value::string("");
-    request_body_["STATISTIC"]["LIVE_HOUSE_CONS"] = json::value::string("");
-    request_body_["STATISTIC"]["LIVE_PV_GEN"] = json::value::string("");
-    request_body_["STATISTIC"]["CURRENT_STATE"] = json::value::string("");
-    request_body_["TEMPMEASURE"]["BATTERY_TEMP"] = json::value::string("");
-    request_body_["TEMPMEASURE"]["CASE_TEMP"] = json::value::string("");
-    request_body_["TEMPMEASURE"]["MCU_TEMP"] = json::value::string("");
-    request_body_["FAN_SPEED"]["INV_LV"] = json::value::string("");
-    request_body_["PV1"]["MPP_CUR"] = json::value::string("");
-    request_body_["PV1"]["MPP_VOL"] = json::value::string("");
-    request_body_["PV1"]["MPP_POWER"] = json::value::string("");
+    // The requested variables never change, so the body is serialized only once.
+    json::value request_body;
+    request_body["PV1"]["POWER_RATIO"] = json::value::string("");
+    request_body["PM1OBJ1"]["P_TOTAL"] = json::value::string("");
+    request_body["PM1OBJ1"]["FREQ"] = json::value::string("");
+    request_body["PM1OBJ1"]["U_AC"] = json::value::string("");
+    request_body["PM1OBJ1"]["I_AC"] = json::value::string("");
+    request_body["PM1OBJ1"]["P_AC"] = json::value::string("");
+    request_body["ENERGY"]["GUI_BAT_DATA_FUEL_CHARGE"] = json::value::string("");
+    request_body["ENERGY"]["GUI_BAT_DATA_POWER"] = json::value::string("");
+    request_body["ENERGY"]["GUI_BAT_DATA_VOLTAGE"] = json::value::string("");
+    request_body["ENERGY"]["GUI_HOUSE_POW"] = json::value::string("");
+    request_body["ENERGY"]["GUI_GRID_POW"] = json::value::string("");
+    request_body["ENERGY"]["GUI_INVERTER_POWER"] = json::value::string("");
+    request_body["ENERGY"]["STAT_STATE"] = json::value::string("");
+    request_body["ENERGY"]["STAT_HOURS_OF_OPERATION"] = json::value::string("");
+    request_body["BMS"]["NR_INSTALLED"] = json::value::string("");
+    request_body["BMS"]["TOTAL_CURRENT"] = json::value::string("");
+    request_body["STATISTIC"]["LIVE_GRID_IMPORT"] = json::value::string("");
+    request_body["STATISTIC"]["LIVE_GRID_EXPORT"] = json::value::string("");
+    request_body["STATISTIC"]["LIVE_HOUSE_CONS"] = json::value::string("");
+    request_body["STATISTIC"]["LIVE_PV_GEN"] = json::value::string("");
+    request_body["STATISTIC"]["CURRENT_STATE"] = json::value::string("");
+    request_body["TEMPMEASURE"]["BATTERY_TEMP"] = json::value::string("");
+    request_body["TEMPMEASURE"]["CASE_TEMP"] = json::value::string("");
+    request_body["TEMPMEASURE"]["MCU_TEMP"] = json::value::string("");
+    request_body["FAN_SPEED"]["INV_LV"] = json::value::string("");
+    request_body["PV1"]["MPP_CUR"] = json::value::string("");
+    request_body["PV1"]["MPP_VOL"] = json::value::string("");
+    request_body["PV1"]["MPP_POWER"] = json::value::string("");
+
+    SetStaticBody(utility::conversions::to_utf8string(request_body.serialize()));
 }
 
-absl::Status senec::SenecClient::Query(const std::function<void(const SenecData &)> &handler) {
+absl::Status senec::SenecClient::Query(const std::function<absl::Status(const SenecData &)> &handler,
+                                       const wastlernet::Deadline &deadline) {
     auto start_time = std::chrono::high_resolution_clock::now();
 
-    auto st = Execute([=](const http_response &response) {
-        if (response.status_code() == status_codes::OK) {
-            json::value result = response.extract_json(true).get();
-
-            LOGS(INFO) << "Received data from Senec controller";
-
-            senec::SenecData data;
-            data.mutable_system()->set_pv_begrenzung(senec_parse<int>(result["PV1"]["POWER_RATIO"]));
-            data.mutable_system()->set_ac_leistung(senec_parse<double>(result["PM1OBJ1"]["P_TOTAL"]));
-            data.mutable_system()->set_frequenz(senec_parse<double>(result["PM1OBJ1"]["FREQ"]));
-            data.mutable_batterie()->set_soc(senec_parse<double>(result["ENERGY"]["GUI_BAT_DATA_FUEL_CHARGE"]));
-            data.mutable_batterie()->set_leistung(senec_parse<double>(result["ENERGY"]["GUI_BAT_DATA_POWER"]));
-            data.mutable_batterie()->set_spannung(senec_parse<double>(result["ENERGY"]["GUI_BAT_DATA_VOLTAGE"]));
-            data.mutable_batterie()->set_temperatur(senec_parse<double>(result["TEMPMEASURE"]["BATTERY_TEMP"]));
-            data.mutable_leistung()->set_hausverbrauch(senec_parse<double>(result["ENERGY"]["GUI_HOUSE_POW"]));
-            data.mutable_leistung()->set_netz_leistung(senec_parse<double>(result["ENERGY"]["GUI_GRID_POW"]));
-            data.mutable_leistung()->set_pv_leistung(senec_parse<double>(result["ENERGY"]["GUI_INVERTER_POWER"]));
-            data.mutable_leistung()->set_batterie_leistung(senec_parse<double>(result["ENERGY"]["GUI_BAT_DATA_POWER"]));
-            data.mutable_system()->set_status(senec_parse<int>(result["ENERGY"]["STAT_STATE"]));
-            data.mutable_system()->set_betriebsstunden(senec_parse<int>(result["ENERGY"]["STAT_HOURS_OF_OPERATION"]));
-            data.mutable_system()->set_anzahl_batterien(senec_parse<int>(result["BMS"]["NR_INSTALLED"]));
-            data.mutable_gesamt()->set_bezug(senec_parse<double>(result["STATISTIC"]["LIVE_GRID_IMPORT"]) * 1000);
-            data.mutable_gesamt()->set_strom(senec_parse<double>(result["BMS"]["TOTAL_CURRENT"]));
-            data.mutable_gesamt()->set_einspeisung(senec_parse<double>(result["STATISTIC"]["LIVE_GRID_EXPORT"]) * 1000);
-            data.mutable_gesamt()->set_verbrauch(senec_parse<double>(result["STATISTIC"]["LIVE_HOUSE_CONS"]) * 1000);
-            data.mutable_gesamt()->set_produktion(senec_parse<double>(result["STATISTIC"]["LIVE_PV_GEN"]) * 1000);
-            data.mutable_system()->set_gehaeuse_temperatur(senec_parse<double>(result["TEMPMEASURE"]["CASE_TEMP"]));
-            data.mutable_system()->set_mcu_temperatur(senec_parse<double>(result["TEMPMEASURE"]["MCU_TEMP"]));
-            data.mutable_system()->set_fan_speed(senec_parse<int>(result["FAN_SPEED"]["INV_LV"]));
-
-            for (int i = 0; i < 3; i++) {
-                auto ac_data = data.add_ac_data();
-                ac_data->set_spannung(senec_parse<double>(result["PM1OBJ1"]["U_AC"][i]));
-                ac_data->set_strom(senec_parse<double>(result["PM1OBJ1"]["I_AC"][i]));
-                ac_data->set_leistung(senec_parse<double>(result["PM1OBJ1"]["P_AC"][i]));
-            }
-
-            for (int i = 0; i < 3; i++) {
-                auto mppt = data.add_mppt();
-                mppt->set_strom(senec_parse<double>(result["PV1"]["MPP_CUR"][i]));
-                mppt->set_spannung(senec_parse<double>(result["PV1"]["MPP_VOL"][i]));
-                mppt->set_leistung(senec_parse<double>(result["PV1"]["MPP_POWER"][i]));
-            }
-
-            if (data.batterie().leistung() < 0) {
-                data.mutable_quellen()->set_laden(0);
-                data.mutable_quellen()->set_entladen(-data.batterie().leistung());
-            } else {
-                data.mutable_quellen()->set_laden(data.batterie().leistung());
-                data.mutable_quellen()->set_entladen(0);
-            }
-
-            if (data.leistung().netz_leistung() < 0) {
-                data.mutable_quellen()->set_einspeisung(-data.leistung().netz_leistung());
-                data.mutable_quellen()->set_bezug(0);
-            } else {
-                data.mutable_quellen()->set_einspeisung(0);
-                data.mutable_quellen()->set_bezug(data.leistung().netz_leistung());
-            }
+    auto st = ExecuteIfChanged([=](const std::string &body) {
+        static const SenecFields fields;
+        wastlernet::JsonSlots r;
+        if (auto st = fields.json.Extract(body, &r); !st.ok()) {
+            LOGS(ERROR) << "Invalid SENEC JSON: " << st.message();
+            return st;
+        }
 
-            LOGS(INFO) << "running handler";
+        LOGS(INFO) << "Received data from Senec controller";
+
+        senec::SenecData data;
+        data.mutable_system()->set_pv_begrenzung(senec_parse<int>(r[fields.power_ratio]));
+        data.mutable_system()->set_ac_leistung(senec_parse<double>(r[fields.p_total]));
+        data.mutable_system()->set_frequenz(senec_parse<double>(r[fields.freq]));
+        data.mutable_batterie()->set_soc(senec_parse<double>(r[fields.fuel_charge]));
+        data.mutable_batterie()->set_leistung(senec_parse<double>(r[fields.bat_power]));
+        data.mutable_batterie()->set_spannung(senec_parse<double>(r[fields.bat_voltage]));
+        data.mutable_batterie()->set_temperatur(senec_parse<double>(r[fields.battery_temp]));
+        data.mutable_leistung()->set_hausverbrauch(senec_parse<double>(r[fields.house_pow]));
+        data.mutable_leistung()->set_netz_leistung(senec_parse<double>(r[fields.grid_pow]));
+        data.mutable_leistung()->set_pv_leistung(senec_parse<double>(r[fields.inverter_power]));
+        data.mutable_leistung()->set_batterie_leistung(senec_parse<double>(r[fields.bat_power]));
+        data.mutable_system()->set_status(senec_parse<int>(r[fields.stat_state]));
+        data.mutable_system()->set_betriebsstunden(senec_parse<int>(r[fields.hours_of_operation]));
+        data.mutable_system()->set_anzahl_batterien(senec_parse<int>(r[fields.nr_installed]));
+        data.mutable_gesamt()->set_bezug(senec_parse<double>(r[fields.grid_import]) * 1000);
+        data.mutable_gesamt()->set_strom(senec_parse<double>(r[fields.total_current]));
+        data.mutable_gesamt()->set_einspeisung(senec_parse<double>(r[fields.grid_export]) * 1000);
+        data.mutable_gesamt()->set_verbrauch(senec_parse<double>(r[fields.house_cons]) * 1000);
+        data.mutable_gesamt()->set_produktion(senec_parse<double>(r[fields.pv_gen]) * 1000);
+        data.mutable_system()->set_gehaeuse_temperatur(senec_parse<double>(r[fields.case_temp]));
+        data.mutable_system()->set_mcu_temperatur(senec_parse<double>(r[fields.mcu_temp]));
+        data.mutable_system()->set_fan_speed(senec_parse<int>(r[fields.fan_speed]));
+
+        double u_ac[3], i_ac[3], p_ac[3];
+        senec_parse_array(r, fields.u_ac, u_ac);
+        senec_parse_array(r, fields.i_ac, i_ac);
+        senec_parse_array(r, fields.p_ac, p_ac);
+        for (int i = 0; i < 3; i++) {
+            auto ac_data = data.add_ac_data();
+            ac_data->set_spannung(u_ac[i]);
+            ac_data->set_strom(i_ac[i]);
+            ac_data->set_leistung(p_ac[i]);
+        }
 
-            handler(data);
+        double mpp_cur[3], mpp_vol[3], mpp_power[3];
+        senec_parse_array(r, fields.mpp_cur, mpp_cur);
+        senec_parse_array(r, fields.mpp_vol, mpp_vol);
+        senec_parse_array(r, fields.mpp_power, mpp_power);
+        for (int i = 0; i < 3; i++) {
+            auto mppt = data.add_mppt();
+            mppt->set_strom(mpp_cur[i]);
+            mppt->set_spannung(mpp_vol[i]);
+            mppt->set_leistung(mpp_power[i]);
+        }
 
+        if (data.batterie().leistung() < 0) {
+            data.mutable_quellen()->set_laden(0);
+            data.mutable_quellen()->set_entladen(-data.batterie().leistung());
+        } else {
+            data.mutable_quellen()->set_laden(data.batterie().leistung());
+            data.mutable_quellen()->set_entladen(0);
+        }
 
-            return absl::OkStatus();
+        if (data.leistung().netz_leistung() < 0) {
+            data.mutable_quellen()->set_einspeisung(-data.leistung().netz_leistung());
+            data.mutable_quellen()->set_bezug(0);
         } else {
-            LOGS(ERROR) << "SENEC query failed: " << response.reason_phrase();
+            data.mutable_quellen()->set_einspeisung(0);
+            data.mutable_quellen()->set_bezug(data.leistung().netz_leistung());
+        }
 
+        LOGS(INFO) << "running handler";
 
-            return absl::InternalError(absl::StrCat("SENEC query failed: ", response.reason_phrase()));
-        }
-    });
+        return handler(data);
+    }, deadline);
 
     {
         auto end_time = std::chrono::high_resolution_clock::now();
         const double seconds = std::chrono::duration<double>(end_time - start_time).count();
         wastlernet::metrics::WastlernetMetrics::GetInstance().ObserveQueryLatency("senec", seconds);
-        wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryResult("senec", st.ok());
+        wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryStatus("senec", st);
     }
 
     return st;
@@ -179,7 +226,3 @@ web::http::client::http_client_config senec::SenecClient::ClientConfig() {
     config.set_validate_certificates(false);
     return config;
 }
-
-std::optional<web::json::value> senec::SenecClient::RequestBody() {
-    return request_body_;
-}
@@ -15,17 +15,17 @@ namespace senec {
      public:
           explicit SenecClient(const std::string &base_url);
 
-          absl::Status Query(const std::function<void(const SenecData&)>& handler);
+          /**
+           * Poll the device and pass changed data to `handler`. A non-OK status of the handler (e.g.
+           * a failed database write) is returned, and the response is handed on again next time.
+           */
+          absl::Status Query(const std::function<absl::Status(const SenecData&)>& handler,
+                             const wastlernet::Deadline& deadline = wastlernet::Deadline::Infinite());
 
      protected:
           std::string Name() override { return "SenecClient"; }
 
           web::http::client::http_client_config ClientConfig() override;
-
-          std::optional<web::json::value> RequestBody() override;
-
-     private:
-          web::json::value request_body_;
      };
 }
 
@@ -6,12 +6,9 @@
 
 #include "senec_client.h"
 
-#include <absl/strings/strip.h>
-#include <cpprest/http_listener.h>
-#include <glog/logging.h>
+#include "base/http_replay.h"
 
 using web::http::http_request;
-using web::http::experimental::listener::http_listener;
 
 constexpr char kAddress[] = "http://127.0.0.1:15003";
 constexpr char kContent[] = R"({
@@ -84,63 +81,22 @@ constexpr char kContent[] = R"({
 
 class SenecClientTest : public testing::Test {
 protected:
-    SenecClientTest() {
-    }
-
     void SetUp() override {
-        server_thread_ = startListener(kAddress);
-    }
-
-    void TearDown() override {
-        if (server_thread_ != nullptr) {
-            server_thread_->close();
-        }
+        wastlernet::HttpReplayOptions options;
+        options.on_request = [](const http_request &request) {
+            auto body = request.extract_json().get();
+
+            // Test if request body is present
+            EXPECT_TRUE(body.has_object_field("PV1"));
+            EXPECT_TRUE(body.has_object_field("ENERGY"));
+        };
+        server_ = std::make_unique<wastlernet::HttpReplayServer>(kAddress, options);
+        server_->AddResponse("/lala.cgi", kContent, "text/json");
+        ASSERT_TRUE(server_->Start().ok());
     }
 
 private:
-    std::unique_ptr<http_listener> server_thread_;
-
-
-    // Start a listener for test purposes that echos back the request as JSON
-    std::unique_ptr<http_listener> startListener(const std::string &listen) {
-        auto listener = std::make_unique<http_listener>(listen);
-
-        LOG(INFO) << "starting REST listener on address " << listen;
-
-        listener->support([=](const http_request &request) {
-            auto uri = request.relative_uri();
-
-            LOG(INFO) << "Received REST request to " << uri.path();
-
-            std::string path = std::string(absl::StripPrefix(uri.path(), "/"));
-
-            try {
-                if (path == "") {
-                    // empty path is connection init
-                    request.reply(web::http::status_codes::OK).get();
-                } else if (path == "lala.cgi") {
-                    auto body = request.extract_json().get();
-
-                    // Test if request body is present
-                    ASSERT_TRUE(body.has_object_field("PV1"));
-                    ASSERT_TRUE(body.has_object_field("ENERGY"));
-
-                    request.reply(web::http::status_codes::OK, kContent, "text/json").get();
-                } else {
-                    // everything else should return NOT FOUND
-                    request.reply(web::http::status_codes::NotFound,
-                                  std::string("data for module \"") + path + "\" not found", "text/plain").get();
-                }
-            } catch (const std::exception &e) {
-                LOG(ERROR) << "Error while resolving REST request: " << e.what();
-                request.reply(web::http::status_codes::InternalError);
-            }
-        });
-
-        listener->open().get();
-
-        return std::move(listener);
-    }
+    std::unique_ptr<wastlernet::HttpReplayServer> server_;
 };
 
 TEST_F(SenecClientTest, Query) {
@@ -150,13 +106,14 @@ TEST_F(SenecClientTest, Query) {
     ASSERT_TRUE(st.ok()) << "Could not initialize SENEC client: " << st;
 
     st = client.Query([](const senec::SenecData &data) {
-        ASSERT_TRUE(data.has_leistung());
+        EXPECT_TRUE(data.has_leistung());
         EXPECT_GT(data.leistung().pv_leistung(), 900.0);
         EXPECT_GT(data.leistung().hausverbrauch(), 1000.0);
         EXPECT_NEAR(
             data.leistung().pv_leistung() + data.leistung().netz_leistung() - data.leistung().batterie_leistung(),
             data.leistung().hausverbrauch(), 0.001);
         data.PrintDebugString();
+        return absl::OkStatus();
     });
     ASSERT_TRUE(st.ok()) << "Querying SENEC data failed: " << st;
 }
@@ -0,0 +1,100 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "senec_decode.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace senec {
+    namespace {
+        // Value of each hex digit; all other characters map to 0xFF, which has the high nibble set.
+        constexpr std::array<uint8_t, 256> kHexDigits = [] {
+            std::array<uint8_t, 256> table{};
+            for (int c = 0; c < 256; c++) {
+                table[c] = 0xFF;
+            }
+            for (int c = 0; c < 10; c++) {
+                table['0' + c] = c;
+            }
+            for (int c = 0; c < 6; c++) {
+                table['A' + c] = 10 + c;
+                table['a' + c] = 10 + c;
+            }
+            return table;
+        }();
+
+        constexpr uint16_t Tag(char a, char b) {
+            return static_cast<uint16_t>(static_cast<uint8_t>(a) << 8 | static_cast<uint8_t>(b));
+        }
+
+        // Parse at most 16 hex digits without branching on the characters.
+        bool ParseHex(std::string_view hex, uint64_t* out) {
+            uint64_t value = 0;
+            uint8_t invalid = 0;
+            for (char c : hex) {
+                uint8_t digit = kHexDigits[static_cast<uint8_t>(c)];
+                invalid |= digit;
+                value = value << 4 | (digit & 0x0F);
+            }
+            *out = value;
+            return (invalid & 0xF0) == 0;
+        }
+
+        int64_t SignExtend(uint64_t value, size_t digits) {
+            const int shift = 64 - 4 * static_cast<int>(digits);
+            return static_cast<int64_t>(value << shift) >> shift;
+        }
+    }
+
+    bool DecodeSenecValue(std::string_view value, double* out) {
+        if (value.size() < 4 || value[2] != '_') {
+            return false;
+        }
+
+        // Maximum number of hex digits and signedness of the type.
+        size_t digits;
+        bool is_signed = false;
+        bool is_float = false;
+        switch (Tag(value[0], value[1])) {
+            case Tag('f', 'l'): digits = 8; is_float = true; break;
+            case Tag('u', '8'): digits = 2; break;
+            case Tag('u', '1'): digits = 4; break;
+            case Tag('u', '3'): digits = 8; break;
+            case Tag('u', '6'): digits = 16; break;
+            case Tag('i', '8'): digits = 2; is_signed = true; break;
+            case Tag('i', '1'): digits = 4; is_signed = true; break;
+            case Tag('i', '3'): digits = 8; is_signed = true; break;
+            default: return false;
+        }
+
+        std::string_view hex = value.substr(3);
+        uint64_t bits;
+        if (hex.size() > digits || !ParseHex(hex, &bits)) {
+            return false;
+        }
+
+        if (is_float) {
+            // std::bit_cast is C++20; memcpy compiles to the same register move.
+            uint32_t bits32 = static_cast<uint32_t>(bits);
+            float f;
+            memcpy(&f, &bits32, sizeof(f));
+            *out = f;
+        } else if (is_signed) {
+            *out = static_cast<double>(SignExtend(bits, digits));
+        } else {
+            *out = static_cast<double>(bits);
+        }
+        return true;
+    }
+
+    size_t DecodeSenecValues(const std::string_view* values, size_t n, double* out) {
+        size_t decoded = 0;
+        for (size_t i = 0; i < n; i++) {
+            out[i] = 0;
+            decoded += DecodeSenecValue(values[i], &out[i]) ? 1 : 0;
+        }
+        return decoded;
+    }
+}
@@ -0,0 +1,36 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Decoding of SENEC lala.cgi values.
+//
+// The SENEC controller returns every value as a string of a two-character type tag, an underscore
+// and the raw value in hex, e.g. "fl_4274147B" (float 61.02), "u8_0F" (uint8 15) or "i1_FFFE"
+// (int16 -2). The decoders in this header convert such strings in place, without allocating:
+//
+//   fl  float32 (8 digits, IEEE 754 bit pattern)
+//   u8  uint8     u1  uint16     u3  uint32     u6  uint64
+//   i8  int8      i1  int16      i3  int32
+//
+// Strings ("st_..."), markers such as "VARIABLE_NOT_FOUND", unknown tags, non-hex characters and
+// values with more digits than their type has are rejected.
+//
+// Thread-safety
+// The decoders are stateless and may be called concurrently.
+//
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+#ifndef WASTLERNET_SENEC_DECODE_H
+#define WASTLERNET_SENEC_DECODE_H
+namespace senec {
+    /** Decode one SENEC value into `out`. Returns false (and leaves `out` unchanged) if it is not numeric. */
+    bool DecodeSenecValue(std::string_view value, double* out);
+
+    /**
+     * Decode `n` SENEC values, e.g. the per-phase U_AC/I_AC/P_AC arrays. Values that are not numeric
+     * are stored as 0. Returns the number of successfully decoded values.
+     */
+    size_t DecodeSenecValues(const std::string_view* values, size_t n, double* out);
+}
+#endif //WASTLERNET_SENEC_DECODE_H
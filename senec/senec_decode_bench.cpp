@@ -0,0 +1,99 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Microbenchmark of the SENEC value decoding.
+//
+// Decodes the values of a typical lala.cgi response (floats, unsigned and signed integers and
+// VARIABLE_NOT_FOUND markers) with the previous implementation (prefix checks, substr, stoul /
+// sscanf) and with senec::DecodeSenecValue, and reports the time per value:
+//
+//   senec_decode_bench --iterations=1000000
+//
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <gflags/gflags.h>
+
+#include "senec/senec_decode.h"
+
+DEFINE_int32(iterations, 200000, "Number of passes over the sample values");
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const std::vector<std::string> kValues = {
+            "fl_3F716873", "fl_43C9AF9E", "fl_43BE170B", "fl_4274147B", "fl_424847AE", "fl_436C0000",
+            "fl_436CE667", "fl_436D199A", "fl_40428F5C", "fl_402851EB", "fl_3F933333", "fl_4403070A",
+            "fl_C41A5E14", "fl_431A63D7", "fl_00000000", "fl_C0BF0220", "fl_4237AD0E", "fl_447AB7E0",
+            "fl_4469F894", "u8_0F", "u3_00009B5D", "u8_04", "u1_0064", "i1_FFFE", "fl_42040000",
+            "fl_420B2845", "fl_424368B3", "u8_00", "VARIABLE_NOT_FOUND", "VARIABLE_NOT_FOUND",
+    };
+
+    // The decoding of senec_client.cpp before senec_decode.h, as a baseline.
+    double LegacyParse(const std::string& s) {
+        if (s.rfind("u1", 0) == 0 || s.rfind("u3", 0) == 0 || s.rfind("u8", 0) == 0) {
+            return std::stoul(s.substr(3), nullptr, 16);
+        }
+        if (s.rfind("i1", 0) == 0) {
+            return std::stol(s.substr(3), nullptr, 16);
+        }
+        if (s.rfind("fl", 0) == 0) {
+            uint32_t num;
+            sscanf(s.substr(3).c_str(), "%x", &num);
+            float f;
+            memcpy(&f, &num, sizeof(f));
+            return f;
+        }
+        return 0;
+    }
+
+    template<typename F>
+    void Run(const char* name, F&& decode) {
+        double sum = 0;
+        auto start = Clock::now();
+        for (int i = 0; i < FLAGS_iterations; i++) {
+            sum += decode();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        double values = static_cast<double>(FLAGS_iterations) * kValues.size();
+        // The checksum keeps the compiler from dropping the loop.
+        printf("%-8s %10.0f values %8.1f ns/value   checksum %.3f\n", name, values, seconds * 1e9 / values, sum);
+    }
+}
+
+int main(int argc, char** argv) {
+    gflags::SetUsageMessage("Usage: senec_decode_bench [--iterations=N]");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    std::vector<std::string_view> views(kValues.begin(), kValues.end());
+    std::vector<double> out(views.size());
+
+    Run("legacy", [] {
+        double sum = 0;
+        for (const auto& v : kValues) {
+            sum += LegacyParse(v);
+        }
+        return sum;
+    });
+    Run("decode", [&] {
+        double sum = 0;
+        for (auto v : views) {
+            double value = 0;
+            senec::DecodeSenecValue(v, &value);
+            sum += value;
+        }
+        return sum;
+    });
+    Run("batch", [&] {
+        senec::DecodeSenecValues(views.data(), views.size(), out.data());
+        double sum = 0;
+        for (double v : out) {
+            sum += v;
+        }
+        return sum;
+    });
+    return 0;
+}
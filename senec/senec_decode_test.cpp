@@ -0,0 +1,52 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include <gtest/gtest.h>
+
+#include "senec_decode.h"
+
+TEST(SenecDecodeTest, DecodesTypedValues) {
+    double v = -1;
+    EXPECT_TRUE(senec::DecodeSenecValue("fl_4274147B", &v));
+    EXPECT_FLOAT_EQ(v, 61.02f);
+    EXPECT_TRUE(senec::DecodeSenecValue("fl_C41A5E14", &v));
+    EXPECT_FLOAT_EQ(v, -617.47f);
+    EXPECT_TRUE(senec::DecodeSenecValue("fl_00000000", &v));
+    EXPECT_EQ(v, 0);
+
+    EXPECT_TRUE(senec::DecodeSenecValue("u8_0F", &v));
+    EXPECT_EQ(v, 15);
+    EXPECT_TRUE(senec::DecodeSenecValue("u1_ffff", &v));
+    EXPECT_EQ(v, 65535);
+    EXPECT_TRUE(senec::DecodeSenecValue("u3_00009B5D", &v));
+    EXPECT_EQ(v, 39773);
+    EXPECT_TRUE(senec::DecodeSenecValue("u6_0000000100000000", &v));
+    EXPECT_EQ(v, 4294967296.0);
+
+    EXPECT_TRUE(senec::DecodeSenecValue("i1_FFFE", &v));
+    EXPECT_EQ(v, -2);
+    EXPECT_TRUE(senec::DecodeSenecValue("i1_7FFF", &v));
+    EXPECT_EQ(v, 32767);
+    EXPECT_TRUE(senec::DecodeSenecValue("i8_80", &v));
+    EXPECT_EQ(v, -128);
+    EXPECT_TRUE(senec::DecodeSenecValue("i3_FFFFFF9C", &v));
+    EXPECT_EQ(v, -100);
+}
+
+TEST(SenecDecodeTest, RejectsNonNumericValues) {
+    double v = 42;
+    for (const char* value : {"", "fl_", "st_Hello", "VARIABLE_NOT_FOUND", "xx_0000", "fl_4274147B0",
+                              "u8_100", "fl_4274G47B", "u1-0064", "fl_42 4147B"}) {
+        EXPECT_FALSE(senec::DecodeSenecValue(value, &v)) << value;
+    }
+    EXPECT_EQ(v, 42);
+}
+
+TEST(SenecDecodeTest, DecodesArrays) {
+    std::string_view values[] = {"fl_436C0000", "VARIABLE_NOT_FOUND", "fl_436D199A"};
+    double out[3] = {-1, -1, -1};
+    EXPECT_EQ(senec::DecodeSenecValues(values, 3, out), 2);
+    EXPECT_FLOAT_EQ(out[0], 236.0f);
+    EXPECT_EQ(out[1], 0);
+    EXPECT_FLOAT_EQ(out[2], 237.1f);
+}
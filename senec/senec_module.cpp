@@ -5,9 +5,10 @@
 #include "senec_module.h"
 #include "senec_client.h"
 
-absl::Status senec::SenecModule::Query(std::function<absl::Status(const SenecData &)> handler) {
+absl::Status senec::SenecModule::Query(const wastlernet::Deadline& deadline,
+                                       std::function<absl::Status(const SenecData &)> handler) {
     try {
-        return client_.Query(handler);
+        return client_.Query(handler, deadline);
     } catch (std::exception const &e) {
         LOG(ERROR) << "Error querying SENEC controller: " << e.what();
         return absl::InternalError(e.what());
@@ -14,7 +14,8 @@ namespace senec {
         SenecClient client_;
 
     protected:
-        absl::Status Query(std::function<absl::Status(const SenecData &)> handler) override;
+        absl::Status Query(const wastlernet::Deadline& deadline,
+                           std::function<absl::Status(const SenecData &)> handler) override;
 
     public:
         SenecModule(const wastlernet::TimescaleDB& db_cfg, const wastlernet::Senec& client_cfg, wastlernet::StateCache* c)
@@ -9,18 +9,31 @@
 #include <absl/strings/str_cat.h>
 #include <vector>
 
+#include "base/json_extract.h"
 #include "base/metrics.h"
 
-using web::json::value;
-using utility::conversions::to_string_t;
-
 namespace wastlernet::shelly {
     namespace {
-        bool check_fields(const value& json, std::initializer_list<const char*> fields) {
-            return std::all_of(fields.begin(), fields.end(), [&json](const char* f) { return json.has_field(f); });
-        }
-
-        bool check_method(const value& json, const char* method) { return json.at("method").as_string() == method; }
+        // JSON paths of all fields used from the messages of the supported devices.
+        struct MessageFields {
+            JsonExtractor json;
+            // RPC notifications of Gen2 devices (e.g. H&T sensors)
+            int method = json.Add({"method"});
+            int params = json.Add({"params"});
+            int temperature = json.Add({"params", "temperature:0", "tC"});
+            int humidity = json.Add({"params", "humidity:0", "rh"});
+            int lux = json.Add({"params", "illuminance:0", "lux"});
+            int illumination = json.Add({"params", "illuminance:0", "illumination"});
+            // Switch status (relais)
+            int apower = json.Add({"apower"});
+            int current = json.Add({"current"});
+            int voltage = json.Add({"voltage"});
+            int freq = json.Add({"freq"});
+            // BLU sensors forwarded by a relais
+            int service_data = json.Add({"service_data"});
+            int service_illuminance = json.Add({"service_data", "illuminance"});
+            int service_motion = json.Add({"service_data", "motion"});
+        };
     }
 
     void ShellyModule::ParseMqttAddress(const std::string& mqtt_address, std::string* host, int* port) {
@@ -64,13 +77,12 @@ namespace wastlernet::shelly {
         try {
             auto start_time = std::chrono::high_resolution_clock::now();
             std::string topic = msg && msg->topic ? msg->topic : "";
-            std::string payload;
+            // Parsed in place, the payload buffer stays valid until the callback returns.
+            std::string_view payload;
             if (msg && msg->payload && msg->payloadlen > 0) {
-                payload.assign(static_cast<const char*>(msg->payload), static_cast<size_t>(msg->payloadlen));
+                payload = std::string_view(static_cast<const char*>(msg->payload), static_cast<size_t>(msg->payloadlen));
             }
-            // Parse JSON using cpprestsdk
-            value json = value::parse(to_string_t(payload));
-            auto st = self->HandleMqttMessage(topic, json);
+            auto st = self->HandleMqttMessage(topic, payload);
             if (!st.ok()) {
                 LOG(ERROR) << "Shelly MQTT message handling failed: " << st.message();
             }
@@ -156,16 +168,22 @@ namespace wastlernet::shelly {
         // No explicit worker thread to join here, mosquitto_loop_start manages its own thread
     }
 
-    absl::Status ShellyModule::HandleMqttMessage(const std::string& topic, const web::json::value& payload_json) {
+    absl::Status ShellyModule::HandleMqttMessage(const std::string& topic, std::string_view payload) {
         try {
             // Default: just log the message. Modules may override to transform into ShellyData and store.
-            LOG(INFO) << absl::StrCat("Shelly MQTT message on ", topic, ": ",
-                                      utility::conversions::to_utf8string(payload_json.serialize()));
+            LOG(INFO) << "Shelly MQTT message on " << topic << ": " << payload;
+
+            static const MessageFields fields;
+            JsonSlots slots;
+            if (auto st = fields.json.Extract(payload, &slots); !st.ok()) {
+                wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryResult("shelly", false);
+                return st;
+            }
 
             bool has_data = false;
 
             ShellyData data;
-            std::vector<std::string> dsts = absl::StrSplit(utility::conversions::to_utf8string(topic), '/');
+            std::vector<std::string> dsts = absl::StrSplit(topic, '/');
 
             if (dsts.size() > 2) {
                 data.set_device_name(absl::StrCat(dsts[1], "-", dsts[2]));
@@ -174,24 +192,22 @@ namespace wastlernet::shelly {
                 data.set_device_name(topic);
             }
 
-            if (check_fields(payload_json, {"method", "params"}) &&
-                (check_method(payload_json, "NotifyFullStatus") || check_method(payload_json, "NotifyStatus"))) {
-
-                auto params = payload_json.at("params");
+            const JsonSlot& method = slots[fields.method];
+            if (method.present() && slots[fields.params].present() &&
+                (method.raw == "NotifyFullStatus" || method.raw == "NotifyStatus")) {
 
                 // Thermometer
-                if (params.has_field("temperature:0")) {
-                    data.mutable_temperature_data()->set_temperature(params.at("temperature:0").at("tC").as_double());
+                if (slots[fields.temperature].present()) {
+                    data.mutable_temperature_data()->set_temperature(slots[fields.temperature].AsDouble());
                     has_data = true;
                 }
-                if (params.has_field("humidity:0")) {
-                    data.mutable_temperature_data()->set_humidity(params.at("humidity:0").at("rh").as_double());
+                if (slots[fields.humidity].present()) {
+                    data.mutable_temperature_data()->set_humidity(slots[fields.humidity].AsDouble());
                     has_data = true;
                 }
-                if (params.has_field("illuminance:0")) {
-                    data.mutable_light_data()->set_lux(params.at("illuminance:0").at("lux").as_integer());
-                    data.mutable_light_data()->set_illumination(
-                        params.at("illuminance:0").at("illumination").as_string());
+                if (slots[fields.lux].present()) {
+                    data.mutable_light_data()->set_lux(slots[fields.lux].AsInt());
+                    data.mutable_light_data()->set_illumination(slots[fields.illumination].AsString());
                     has_data = true;
                 }
 
@@ -199,26 +215,25 @@ namespace wastlernet::shelly {
             }
 
             // Relais / Switches
-            if (check_fields(payload_json, {"apower", "current", "voltage", "freq"})) {
+            if (slots[fields.apower].present() && slots[fields.current].present() &&
+                slots[fields.voltage].present() && slots[fields.freq].present()) {
                 EnergyData* energy = data.mutable_energy_data();
-                energy->set_power(payload_json.at("apower").as_double());
-                energy->set_current(payload_json.at("current").as_double());
-                energy->set_voltage(payload_json.at("voltage").as_double());
-                energy->set_frequency(payload_json.at("freq").as_double());
+                energy->set_power(slots[fields.apower].AsDouble());
+                energy->set_current(slots[fields.current].AsDouble());
+                energy->set_voltage(slots[fields.voltage].AsDouble());
+                energy->set_frequency(slots[fields.freq].AsDouble());
                 has_data = true;
             }
 
             // Bluetooth connected BLU sensors, data forwarded e.g. by a relais
-            if (check_fields(payload_json, {"service_data"})) {
-                auto service_data = payload_json.at("service_data");
-
-                if (check_fields(service_data, {"illuminance"})) {
-                    data.mutable_light_data()->set_lux(service_data.at("illuminance").as_integer());
+            if (slots[fields.service_data].present()) {
+                if (slots[fields.service_illuminance].present()) {
+                    data.mutable_light_data()->set_lux(slots[fields.service_illuminance].AsInt());
                     has_data = true;
                 }
 
-                if (check_fields(service_data, {"motion"})) {
-                    data.mutable_motion_data()->set_motion(service_data.at("motion").as_integer() == 1);
+                if (slots[fields.service_motion].present()) {
+                    data.mutable_motion_data()->set_motion(slots[fields.service_motion].AsInt() == 1);
                     has_data = true;
                 }
             }
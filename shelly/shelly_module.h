@@ -10,7 +10,7 @@
 #include <string>
 #include <atomic>
 #include <mosquitto.h>
-#include <cpprest/json.h>
+#include <string_view>
 
 namespace wastlernet::shelly {
     class ShellyModule : public Module<ShellyData> {
@@ -42,9 +42,9 @@ namespace wastlernet::shelly {
 
         void Wait() override;
 
-        // Called for every incoming MQTT message on topics matching "shelly/#".
+        // Called for every incoming MQTT message on topics matching "shelly/#" with its raw JSON payload.
         // Default implementation just logs the message. Override in subclasses if needed.
-        virtual absl::Status HandleMqttMessage(const std::string& topic, const web::json::value& payload_json);
+        virtual absl::Status HandleMqttMessage(const std::string& topic, std::string_view payload);
 
     private:
         // MQTT helpers and state
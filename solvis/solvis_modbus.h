@@ -2,24 +2,29 @@
 // Created by wastl on 30.10.23.
 //
 #pragma once
-#include <string>
+#include <cstdint>
 
-#include "base/modbus_connection.h"
+#include "base/modbus_bus.h"
 #include "config/config.pb.h"
 
 #ifndef WASTLERNET_SOLVIS_MODBUS_H
 #define WASTLERNET_SOLVIS_MODBUS_H
 namespace solvis {
-    class SolvisModbusConnection : public wastlernet::ModbusConnection {
-    public:
-        explicit SolvisModbusConnection(const wastlernet::Solvis& client_cfg)
-        : ModbusConnection(client_cfg.host(), client_cfg.port(), 32770) { }
+    // Register read to check an idle connection (SOLVIS version).
+    constexpr int32_t kProbeRegister = 32770;
 
-    protected:
-        std::string Name() override {
-            return "SolvisModbusConnection";
-        }
-    };
+    // Unit id used if none is configured: the Modbus/TCP default (0xFF), which the SOLVIS
+    // controller answers when it is connected directly.
+    constexpr int kDefaultUnitId = 0xFF;
+
+    // Unit id used on an RS485 line if none is configured (0xFF is not a valid RTU address).
+    constexpr int kDefaultRtuUnitId = 1;
 
+    inline int UnitId(const wastlernet::Solvis& client_cfg) {
+        if (client_cfg.has_unit_id()) {
+            return client_cfg.unit_id();
+        }
+        return client_cfg.has_rtu() ? kDefaultRtuUnitId : kDefaultUnitId;
+    }
 }
 #endif //WASTLERNET_SOLVIS_MODBUS_H
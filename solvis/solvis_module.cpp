@@ -4,98 +4,109 @@
 
 #include "solvis_module.h"
 
-#include <fstream>
-#include <limits.h>
+#include <algorithm>
+#include <array>
 #include <absl/strings/str_cat.h>
 #include <glog/logging.h>
 
 #include "base/metrics.h"
+#include "base/register_schema.h"
+#include "base/utility.h"
 
 #define LOGS(level) LOG(level) << "[solvis] "
 
-int16_t uint2int(uint16_t u) {
-    if (u <= (uint16_t) INT16_MAX)
-        return (int16_t) u;
-    else
-        return -(int16_t) ~u - 1;
+namespace {
+    using solvis::SolvisData;
+    using wastlernet::RegisterType;
+    using namespace wastlernet::schema;
+
+    using SolvisPlan = ReadPlan<Block<33024, 18>,   // Sensors S1-S18
+                                Block<33280, 20>>;  // Outputs A1-A14, analog outputs O1-O6
+
+    // Registers that only change when the controller is reconfigured or updated; read if
+    // Solvis.config_cache_seconds is set, and cached for that long.
+    constexpr int kVersion = 32770, kVersionCount = 2;
+    constexpr int kAnalogOutStatus = 3840, kAnalogOutStatusCount = 26;
+
+    using SolvisConfigPlan = ReadPlan<Block<kVersion, kVersionCount>,                   // SC2, NBG
+                                      Block<kAnalogOutStatus, kAnalogOutStatusCount>>;  // O1-O6, every 5th
+
+    using SolvisConfigRegisters = Schema<SolvisData, SolvisConfigPlan,
+        Field<32770, &SolvisData::set_version_sc2>,
+        Field<32771, &SolvisData::set_version_nbg>,
+        Field<3840, &SolvisData::add_analog_out_status>,
+        Field<3845, &SolvisData::add_analog_out_status>,
+        Field<3850, &SolvisData::add_analog_out_status>,
+        Field<3855, &SolvisData::add_analog_out_status>,
+        Field<3860, &SolvisData::add_analog_out_status>,
+        Field<3865, &SolvisData::add_analog_out_status>>;
+
+    // Register layout of the SOLVIS controller. Temperatures are stored in units of 0.1 °C.
+    using SolvisRegisters = Schema<SolvisData, SolvisPlan,
+        Field<33024, &SolvisData::set_speicher_oben, std::deci>,
+        Field<33025, &SolvisData::set_warmwasser, std::deci>,
+        Field<33026, &SolvisData::set_speicher_unten, std::deci>,
+        Field<33027, &SolvisData::set_heizungspuffer_oben, std::deci>,
+        Field<33028, &SolvisData::set_solar_vorlauf, std::deci>,
+        Field<33029, &SolvisData::set_solar_ruecklauf, std::deci>,
+        Field<33030, &SolvisData::set_solar_waermetauscher, std::deci>,
+        Field<33031, &SolvisData::set_solar_kollektor, std::deci, RegisterType::kInt16>,
+        Field<33032, &SolvisData::set_heizungspuffer_unten, std::deci>,
+        Field<33034, &SolvisData::set_zirkulation, std::deci>,
+        Field<33035, &SolvisData::set_vorlauf_heizkreis1, std::deci>,
+        Field<33036, &SolvisData::set_vorlauf_heizkreis2, std::deci>,
+        Field<33037, &SolvisData::set_kessel, std::deci>,
+        Field<33038, &SolvisData::set_kaltwasser, std::deci>,
+        Field<33039, &SolvisData::set_vorlauf_heizkreis3, std::deci>,
+        Field<33040, &SolvisData::set_solar_volumenstrom>,
+        Field<33041, &SolvisData::set_durchfluss>,
+        Flag<33282, &SolvisData::set_pumpe_heizkreis1>,
+        Flag<33283, &SolvisData::set_pumpe_heizkreis2>,
+        Flag<33284, &SolvisData::set_pumpe_heizkreis3>,
+        Flag<33291, &SolvisData::set_kessel_brenner>,
+        Flag<33292, &SolvisData::set_kessel_ladepumpe>,
+        // 26 kW maximale Leistung * aktuelle Leistung Ladepumpe in % / 100 (O4)
+        Field<33297, &SolvisData::set_kessel_leistung, std::ratio<26, 1000>>,
+        Repeated<33280, 14, &SolvisData::add_ausgang, std::ratio<1, 2>>,
+        Repeated<33294, 6, &SolvisData::add_analog_out, std::deci>>;
 }
 
-absl::Status solvis::SolvisModule::Query(std::function<absl::Status(const solvis::SolvisData &)> handler) {
+absl::Status solvis::SolvisModule::Query(const wastlernet::Deadline &deadline,
+                                         std::function<absl::Status(const solvis::SolvisData &)> handler) {
     auto start_time = std::chrono::high_resolution_clock::now();
     try {
-        auto st = conn_->Execute([handler](modbus_t *ctx) {
+        auto st = conn_->Execute([this, handler](modbus_t *ctx) {
             LOGS(INFO) << "Reading Modbus registers";
 
-            uint16_t tab_reg[64];
-            int rc1 = modbus_read_registers(ctx, 33024, 18, tab_reg);
-            int rc2 = modbus_read_registers(ctx, 33536, 5, &tab_reg[20]);
-            int rc3 = modbus_read_registers(ctx, 33280, 20, &tab_reg[32]);
-
-            if (rc1 == -1 || rc2 == -1 || rc3 == -1) {
-                LOGS(ERROR) << "Error reading register: " << modbus_strerror(errno);
-                return absl::InternalError(absl::StrCat("Error reading register: ", modbus_strerror(errno)));
-            }
-
-            if (rc1 < 17) {
-                LOGS(ERROR) << "Could not retrieve all registers" << std::endl;
-                return absl::InternalError("Could not retrieve all registers");
-            }
-            if (rc2 < 5) {
-                LOGS(ERROR) << "Could not retrieve all registers" << std::endl;
-                return absl::InternalError("Could not retrieve all registers");
+            std::array<uint16_t, SolvisPlan::size> buffer;
+            if (auto st = conn_->ReadBlocks(ctx, SolvisPlan::blocks(), buffer.data()); !st.ok()) {
+                LOGS(ERROR) << st;
+                return st;
             }
-
             SolvisData data;
-            data.set_speicher_oben(tab_reg[0] / 10.0);
-            data.set_heizungspuffer_oben(tab_reg[3] / 10.0);
-            data.set_heizungspuffer_unten(tab_reg[8] / 10.0);
-            data.set_speicher_unten(tab_reg[2] / 10.0);
-
-            data.set_warmwasser(tab_reg[1] / 10.0);
-            data.set_kaltwasser(tab_reg[14] / 10.0);
-            data.set_zirkulation(tab_reg[10] / 10.0);
-            data.set_durchfluss(tab_reg[17]);
-
-            data.set_solar_kollektor(uint2int(tab_reg[7]) / 10.0);
-            data.set_solar_vorlauf(tab_reg[4] / 10.0);
-            data.set_solar_ruecklauf(tab_reg[5] / 10.0);
-            data.set_solar_waermetauscher(tab_reg[6] / 10.0);
-            data.set_solar_volumenstrom(tab_reg[16]);
-            data.set_solar_leistung((tab_reg[4] - tab_reg[5]) * tab_reg[16] / 8600.0);
-
-            data.set_kessel(tab_reg[13] / 10.0);
-
-            data.set_vorlauf_heizkreis1(tab_reg[11] / 10.0);
-            data.set_vorlauf_heizkreis2(tab_reg[12] / 10.0);
-            data.set_vorlauf_heizkreis3(tab_reg[15] / 10.0);
-            data.set_pumpe_heizkreis1(tab_reg[32 + 2] > 0);
-            data.set_pumpe_heizkreis2(tab_reg[32 + 3] > 0);
-            data.set_pumpe_heizkreis3(tab_reg[32 + 4] > 0);
-
-            //data.set_kessel_leistung(tab_reg[23] / 1000.0);
-            data.set_kessel_ladepumpe(tab_reg[32 + 12] > 0);
-            data.set_kessel_brenner(tab_reg[32 + 11] > 0);
-
-            // 26 kW maximale Leistung * aktuelle Leistung Ladepumpe in % / 100
-            data.set_kessel_leistung(0.26 * tab_reg[46 + 3] * 0.1);
-
-            for (int i = 0; i < 14; i++) {
-                data.add_ausgang(tab_reg[32 + i] * 0.5);
+            SolvisRegisters::Decode(buffer.data(), &data);
+
+            if (config_cache_seconds_ > 0) {
+                std::array<uint16_t, SolvisConfigPlan::size> config;
+                if (auto st = conn_->ReadBlocks(ctx, SolvisConfigPlan::blocks(), config.data()); !st.ok()) {
+                    LOGS(ERROR) << st;
+                    return st;
+                }
+                SolvisConfigRegisters::Decode(config.data(), &data);
             }
 
-            for (int i = 0; i < 6; i++) {
-                data.add_analog_out(tab_reg[46 + i] * 0.1);
-            }
+            // Temperature delta (S5 - S6) * volume flow (S17) / 860
+            data.set_solar_leistung((data.solar_vorlauf() - data.solar_ruecklauf()) * data.solar_volumenstrom() / 860.0);
 
             LOGS(INFO) << "running handler";
 
             return handler(data);
-        });
+        }, deadline);
 
         auto end_time = std::chrono::high_resolution_clock::now();
         const double seconds = std::chrono::duration<double>(end_time - start_time).count();
         wastlernet::metrics::WastlernetMetrics::GetInstance().ObserveQueryLatency("solvis", seconds);
-        wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryResult("solvis", st.ok());
+        wastlernet::metrics::WastlernetMetrics::GetInstance().RecordQueryStatus("solvis", st);
 
         return st;
     } catch (std::exception const &e) {
@@ -104,3 +115,12 @@ absl::Status solvis::SolvisModule::Query(std::function<absl::Status(const solvis
         return absl::InternalError(e.what());
     }
 }
+
+absl::Status solvis::SolvisModule::Init() {
+    RETURN_IF_ERROR(PollingModule::Init());
+    // Also on 0, to drop a TTL declared before a configuration reload.
+    auto ttl = std::chrono::seconds(std::max(config_cache_seconds_, 0));
+    conn_->SetRegisterTtl(kVersion, kVersionCount, ttl);
+    conn_->SetRegisterTtl(kAnalogOutStatus, kAnalogOutStatusCount, ttl);
+    return conn_->Init();
+}
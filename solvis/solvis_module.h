@@ -12,19 +12,24 @@
 namespace solvis {
     class SolvisModule : public wastlernet::PollingModule<SolvisData> {
     private:
-        SolvisModbusConnection* conn_;
+        wastlernet::ModbusUnit* conn_;
+        int config_cache_seconds_;
 
     protected:
-        absl::Status Query(std::function<absl::Status(const SolvisData &)> handler) override;
+        absl::Status Query(const wastlernet::Deadline &deadline,
+                           std::function<absl::Status(const SolvisData &)> handler) override;
 
     public:
         SolvisModule(const wastlernet::TimescaleDB &db_cfg, const wastlernet::Solvis &client_cfg,
-                     SolvisModbusConnection *conn, wastlernet::StateCache *c)
-                : PollingModule(db_cfg, new SolvisWriter, c, client_cfg.poll_interval()), conn_(conn) {}
+                     wastlernet::ModbusUnit *conn, wastlernet::StateCache *c)
+                : PollingModule(db_cfg, new SolvisWriter, c, client_cfg.poll_interval()), conn_(conn),
+                  config_cache_seconds_(client_cfg.config_cache_seconds()) {}
 
         std::string Name() override {
             return "solvis";
         }
+
+        absl::Status Init() override;
     };
 }
 #endif //WASTLERNET_SOLVIS_MODULE_H
@@ -8,18 +8,23 @@
 #ifndef WASTLERNET_SOLVIS_UPDATER_H
 #define WASTLERNET_SOLVIS_UPDATER_H
 namespace solvis {
-    class SolvisUpdater : public wastlernet::PollingUpdater<SolvisData> {
+    // Writes the indoor temperature measured by the weather station into the SOLVIS room
+    // temperature registers whenever a new weather sample is published.
+    class SolvisUpdater : public wastlernet::EventUpdater<SolvisData> {
     private:
-        SolvisModbusConnection* conn_;
+        wastlernet::ModbusUnit* conn_;
 
     protected:
         absl::Status Update() override;
 
     public:
-        SolvisUpdater(const wastlernet::Solvis& client_cfg, SolvisModbusConnection* conn, wastlernet::StateCache* c)
-                : wastlernet::PollingUpdater<SolvisData>(c, client_cfg.poll_interval()),
+        SolvisUpdater(const wastlernet::Solvis& client_cfg, wastlernet::ModbusUnit* conn, wastlernet::StateCache* c)
+                : wastlernet::EventUpdater<SolvisData>(c, {"weather"}),
                   conn_(conn) { }
 
+        std::string Name() override {
+            return "solvis_updater";
+        }
     };
 }
 
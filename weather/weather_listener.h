@@ -9,6 +9,11 @@
 using web::http::experimental::listener::http_listener;
 
 namespace weather {
+    /**
+     * Listen on `uri` for samples uploaded by the weather station. Each request is answered right
+     * away, and `handler` is then called with the parsed sample on a cpprest thread; it should hand
+     * the sample off rather than block. Requests without any known field are answered with 400.
+     */
     std::unique_ptr<http_listener> start_listener(const std::string &uri, const std::function<void(const WeatherData &)> &handler);
 }
 #endif //WEATHER_EXPORTER_WEATHER_LISTENER_H
@@ -5,25 +5,63 @@
 #include "weather_module.h"
 #include "weather_listener.h"
 
+#define LOGW(level) LOG(level) << "[weather] "
+
 namespace weather {
     void WeatherModule::Start() {
+        worker_ = std::thread(&WeatherModule::Run, this);
         listener = start_listener(uri, [this](const WeatherData& data) {
+            Enqueue(data);
+        });
+    }
+
+    void WeatherModule::Enqueue(const WeatherData& data) {
+        absl::MutexLock lock(&mutex_);
+        if (queued_.size() >= kMaxQueued) {
+            LOGW(WARNING) << "Too many samples waiting for the database, dropping the oldest";
+            queued_.pop_front();
+        }
+        queued_.push_back(data);
+    }
+
+    void WeatherModule::Run() {
+        while (true) {
+            WeatherData data;
+            {
+                absl::MutexLock lock(&mutex_);
+                mutex_.Await(absl::Condition(this, &WeatherModule::Woken));
+                if (queued_.empty()) {
+                    return;  // aborted
+                }
+                data = std::move(queued_.front());
+                queued_.pop_front();
+            }
             auto st = Update(data);
             if (!st.ok()) {
                 LOG(ERROR) << "Error: " << st;
             }
-        });
+        }
     }
 
     void WeatherModule::Abort() {
-        listener->close();
+        absl::MutexLock abort_lock(&abort_mutex_);
+        if (stopped_.HasBeenNotified()) {
+            return;
+        }
+        if (listener) {
+            listener->close().wait();
+        }
+        {
+            absl::MutexLock lock(&mutex_);
+            aborted_ = true;
+        }
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+        stopped_.Notify();
     }
 
     void WeatherModule::Wait() {
-        using namespace std::chrono_literals;
-        while(true) {
-            std::this_thread::sleep_for(1s);
-        }
-
+        stopped_.WaitForNotification();
     }
-}
\ No newline at end of file
+}
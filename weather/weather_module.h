@@ -1,7 +1,11 @@
 //
 // Created by wastl on 08.04.23.
 //
+#include <deque>
+#include <thread>
 #include <cpprest/http_listener.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/synchronization/notification.h>
 
 #include "base/module.h"
 #include "weather/weather.pb.h"
@@ -10,6 +14,8 @@
 #ifndef WASTLERNET_WEATHER_MODULE_H
 #define WASTLERNET_WEATHER_MODULE_H
 namespace weather {
+    // Samples are received by the HTTP listener and stored by a worker thread, so that the station is
+    // answered without waiting for the database.
     class WeatherModule : public wastlernet::Module<WeatherData> {
     public:
         WeatherModule(const wastlernet::TimescaleDB &db_cfg, const wastlernet::Weather& client_cfg, wastlernet::StateCache* c)
@@ -29,6 +35,31 @@ namespace weather {
         std::string uri;
 
         std::unique_ptr<web::http::experimental::listener::http_listener> listener;
+
+        // Notified by Abort() once the listener is closed and the queued samples are stored.
+        absl::Notification stopped_;
+
+        // Serializes Abort(): concurrent callers wait for the first teardown to finish.
+        absl::Mutex abort_mutex_;
+
+        // Samples waiting to be stored. Bounded, so that a database outage does not grow it without
+        // limit; the oldest samples are dropped first.
+        static constexpr size_t kMaxQueued = 100;
+
+        absl::Mutex mutex_;
+        std::deque<WeatherData> queued_ ABSL_GUARDED_BY(mutex_);
+        bool aborted_ ABSL_GUARDED_BY(mutex_) = false;
+        std::thread worker_;
+
+        bool Woken() const ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+            return !queued_.empty() || aborted_;
+        }
+
+        // Queue `data` for the worker.
+        void Enqueue(const WeatherData& data);
+
+        // Store queued samples until aborted and drained.
+        void Run();
     };
 }
 #endif //WASTLERNET_WEATHER_MODULE_H
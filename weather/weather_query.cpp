@@ -0,0 +1,84 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include "weather_query.h"
+
+#include <cstdint>
+#include <absl/strings/numbers.h>
+#include <absl/strings/string_view.h>
+
+namespace weather {
+    namespace {
+        double fahrenheit2celsius(double fahrenheit) {
+            return 5 * (fahrenheit - 32) / 9;
+        }
+
+        double mph2ms(double mph) {
+            double kmh = mph / 0.6213712;
+            return kmh * 1000 / 3600;
+        }
+
+        double inch2mm(double inch) {
+            return inch / 0.03937007874;
+        }
+
+        // A query argument of the station and how to store it (converting units).
+        struct QueryField {
+            std::string_view key;
+            void (*set)(WeatherData* data, double value);
+        };
+
+        constexpr QueryField kFields[] = {
+            {"UV", [](WeatherData* d, double v) { d->set_uv(v); }},
+            {"baromin", [](WeatherData* d, double v) { d->set_barometer(inch2mm(v) * 1.33322); }},
+            {"dailyrainin", [](WeatherData* d, double v) { d->set_dailyrain(inch2mm(v)); }},
+            {"dewptf", [](WeatherData* d, double v) { d->set_dewpoint(fahrenheit2celsius(v)); }},
+            {"humidity", [](WeatherData* d, double v) { d->mutable_outdoor()->set_humidity(v); }},
+            {"tempf", [](WeatherData* d, double v) {
+                d->mutable_outdoor()->set_temperature(fahrenheit2celsius(v));
+            }},
+            {"indoorhumidity", [](WeatherData* d, double v) { d->mutable_indoor()->set_humidity(v); }},
+            {"indoortempf", [](WeatherData* d, double v) {
+                d->mutable_indoor()->set_temperature(fahrenheit2celsius(v));
+            }},
+            {"rainin", [](WeatherData* d, double v) { d->set_rain(inch2mm(v)); }},
+            {"solarradiation", [](WeatherData* d, double v) { d->set_solarradiation(v); }},
+            {"winddir", [](WeatherData* d, double v) {
+                d->mutable_wind()->set_direction(static_cast<int32_t>(v));
+            }},
+            {"windgustmph", [](WeatherData* d, double v) { d->mutable_wind()->set_gusts(mph2ms(v)); }},
+            {"windspeedmph", [](WeatherData* d, double v) { d->mutable_wind()->set_speed(mph2ms(v)); }},
+        };
+
+        const QueryField* FindField(std::string_view key) {
+            for (const auto& field : kFields) {
+                if (field.key == key) {
+                    return &field;
+                }
+            }
+            return nullptr;
+        }
+    }
+
+    size_t ParseWeatherQuery(std::string_view query, WeatherData* data) {
+        size_t fields = 0;
+        while (!query.empty()) {
+            size_t end = query.find('&');
+            std::string_view argument = query.substr(0, end);
+            query = end == std::string_view::npos ? std::string_view() : query.substr(end + 1);
+
+            size_t eq = argument.find('=');
+            if (eq == std::string_view::npos) {
+                continue;
+            }
+            const QueryField* field = FindField(argument.substr(0, eq));
+            std::string_view value = argument.substr(eq + 1);
+            double v;
+            if (field != nullptr && absl::SimpleAtod(absl::string_view(value.data(), value.size()), &v)) {
+                field->set(data, v);
+                fields++;
+            }
+        }
+        return fields;
+    }
+}
@@ -0,0 +1,35 @@
+//
+// Created by wastl on 19.10.26.
+//
+// Parser for the Weather Underground upload protocol used by the weather station.
+//
+// The station sends each sample as query arguments of a GET request in imperial units, e.g.
+//
+//   /weatherstation/updateweatherstation.php?ID=x&PASSWORD=y&tempf=53.2&humidity=71&...&winddir=225
+//
+// ParseWeatherQuery() makes a single pass over the (still URL-encoded) query string, looks each key
+// up in a fixed table of the known fields and stores the converted value in WeatherData. Unknown
+// keys (ID, PASSWORD, dateutc, ...) and values that are not numbers are skipped; fields the station
+// did not send remain unset. It does not allocate.
+//
+// Thread-safety
+// The function is stateless and may be called concurrently.
+//
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+#include "weather/weather.pb.h"
+
+#ifndef WEATHER_WEATHER_QUERY_H
+#define WEATHER_WEATHER_QUERY_H
+
+namespace weather {
+    /**
+     * Fill `data` from the query string `query` (without the leading '?'). Returns the number of
+     * fields set; 0 if the query did not contain any known field with a numeric value.
+     */
+    size_t ParseWeatherQuery(std::string_view query, WeatherData* data);
+}
+
+#endif //WEATHER_WEATHER_QUERY_H
@@ -0,0 +1,51 @@
+//
+// Created by wastl on 19.10.26.
+//
+#include <gtest/gtest.h>
+
+#include "weather_query.h"
+
+// Upload of a Bresser 7-in-1 ClearView station.
+constexpr char kQuery[] =
+        "ID=station&PASSWORD=secret&action=updateraww&realtime=1&rtfreq=5&dateutc=now"
+        "&baromin=29.92&tempf=50.0&dewptf=41.0&humidity=71&windspeedmph=2.2&windgustmph=4.5"
+        "&winddir=225&rainin=0.04&dailyrainin=0.12&solarradiation=112.30&UV=1.0"
+        "&indoortempf=68.0&indoorhumidity=45";
+
+TEST(WeatherQueryTest, ParsesAllFields) {
+    weather::WeatherData data;
+    EXPECT_EQ(weather::ParseWeatherQuery(kQuery, &data), 13);
+
+    EXPECT_DOUBLE_EQ(data.uv(), 1.0);
+    EXPECT_NEAR(data.barometer(), 1013.2, 0.1);
+    EXPECT_NEAR(data.dailyrain(), 3.048, 1e-9);
+    EXPECT_DOUBLE_EQ(data.dewpoint(), 5.0);
+    EXPECT_DOUBLE_EQ(data.outdoor().temperature(), 10.0);
+    EXPECT_DOUBLE_EQ(data.outdoor().humidity(), 71);
+    EXPECT_DOUBLE_EQ(data.indoor().temperature(), 20.0);
+    EXPECT_DOUBLE_EQ(data.indoor().humidity(), 45);
+    EXPECT_NEAR(data.rain(), 1.016, 1e-9);
+    EXPECT_DOUBLE_EQ(data.solarradiation(), 112.3);
+    EXPECT_EQ(data.wind().direction(), 225);
+    EXPECT_NEAR(data.wind().speed(), 0.983, 1e-3);
+    EXPECT_NEAR(data.wind().gusts(), 2.012, 1e-3);
+}
+
+TEST(WeatherQueryTest, ToleratesMissingAndInvalidFields) {
+    weather::WeatherData data;
+    EXPECT_EQ(weather::ParseWeatherQuery("tempf=32&humidity=&UV=n/a&winddir&&indoortempf=212", &data), 2);
+
+    EXPECT_DOUBLE_EQ(data.outdoor().temperature(), 0.0);
+    EXPECT_DOUBLE_EQ(data.indoor().temperature(), 100.0);
+    EXPECT_FALSE(data.outdoor().has_humidity());
+    EXPECT_FALSE(data.has_uv());
+    EXPECT_FALSE(data.has_wind());
+    EXPECT_FALSE(data.has_barometer());
+}
+
+TEST(WeatherQueryTest, RejectsQueriesWithoutData) {
+    weather::WeatherData data;
+    EXPECT_EQ(weather::ParseWeatherQuery("", &data), 0);
+    EXPECT_EQ(weather::ParseWeatherQuery("ID=station&PASSWORD=secret", &data), 0);
+    EXPECT_FALSE(data.has_outdoor());
+}
@@ -4,24 +4,34 @@
 
 #include "weather_timescaledb.h"
 
+#include <optional>
+
 namespace weather {
+    namespace {
+        // Fields the station did not send are stored as NULL.
+        template<class T>
+        std::optional<T> value_or_null(bool has, T value) {
+            return has ? std::optional<T>(value) : std::nullopt;
+        }
+    }
+
     absl::Status WeatherWriter::write(pqxx::work &tx, const WeatherData &data) {
         tx.exec(
             pqxx::prepped{"weather_insert"},
             pqxx::params{
-                data.uv(),
-                data.barometer(),
-                data.dailyrain(),
-                data.dewpoint(),
-                data.outdoor().temperature(),
-                data.outdoor().humidity(),
-                data.indoor().temperature(),
-                data.indoor().humidity(),
-                data.wind().direction(),
-                data.wind().speed(),
-                data.wind().gusts(),
-                data.rain(),
-                data.solarradiation()
+                value_or_null(data.has_uv(), data.uv()),
+                value_or_null(data.has_barometer(), data.barometer()),
+                value_or_null(data.has_dailyrain(), data.dailyrain()),
+                value_or_null(data.has_dewpoint(), data.dewpoint()),
+                value_or_null(data.outdoor().has_temperature(), data.outdoor().temperature()),
+                value_or_null(data.outdoor().has_humidity(), data.outdoor().humidity()),
+                value_or_null(data.indoor().has_temperature(), data.indoor().temperature()),
+                value_or_null(data.indoor().has_humidity(), data.indoor().humidity()),
+                value_or_null(data.wind().has_direction(), data.wind().direction()),
+                value_or_null(data.wind().has_speed(), data.wind().speed()),
+                value_or_null(data.wind().has_gusts(), data.wind().gusts()),
+                value_or_null(data.has_rain(), data.rain()),
+                value_or_null(data.has_solarradiation(), data.solarradiation())
             }
         );
         return absl::OkStatus();